@@ -19,6 +19,13 @@ void clean_cpu_dcache(void *vaddr, u32 paddr, u32 length, bool inner_only,
 						bool *cleaned_everything);
 void flush_cpu_dcache(void *vaddr, u32 paddr, u32 length, bool inner_only,
 						bool *flushed_everything);
+void clean_cpu_dcache_all(bool inner_only);
+void flush_cpu_dcache_all(bool inner_only);
+/*
+ * Returns the total length of several range operations above which a single
+ * operation on the entire cache is faster.
+ */
+u32 get_dcache_all_breakpoint(bool flush, bool inner_only);
 bool speculative_data_prefetch(void);
 /* Returns 1 if no cache is present */
 u32 get_dcache_granularity(void);
@@ -15,6 +15,7 @@
  */
 
 #include <linux/device.h>
+#include <linux/dma-buf.h>
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/anon_inodes.h>
@@ -567,17 +568,206 @@ struct ion_handle *ion_import_fd(struct ion_client *client, int fd)
 		return ERR_PTR(-EINVAL);
 	}
 	if (file->f_op != &ion_share_fops) {
-		pr_err("%s: imported file is not a shared ion file.\n",
-		       __func__);
-		handle = ERR_PTR(-EINVAL);
-		goto end;
+		fput(file);
+		return ion_import_dma_buf(client, fd);
 	}
 	handle = ion_import(client, file->private_data);
-end:
 	fput(file);
 	return handle;
 }
 
+#ifdef CONFIG_DMA_SHARED_BUFFER
+static struct scatterlist *ion_buffer_map_dma(struct ion_buffer *buffer)
+{
+	struct scatterlist *sglist;
+
+	if (!buffer->heap->ops->map_dma)
+		return ERR_PTR(-ENODEV);
+
+	mutex_lock(&buffer->lock);
+	if (buffer->dmap_cnt == 0) {
+		sglist = buffer->heap->ops->map_dma(buffer->heap, buffer);
+		if (IS_ERR_OR_NULL(sglist)) {
+			mutex_unlock(&buffer->lock);
+			return sglist;
+		}
+		buffer->sglist = sglist;
+	}
+	buffer->dmap_cnt++;
+	sglist = buffer->sglist;
+	mutex_unlock(&buffer->lock);
+	return sglist;
+}
+
+static void ion_buffer_unmap_dma(struct ion_buffer *buffer)
+{
+	mutex_lock(&buffer->lock);
+	BUG_ON(buffer->dmap_cnt == 0);
+	if (--buffer->dmap_cnt == 0) {
+		buffer->heap->ops->unmap_dma(buffer->heap, buffer);
+		buffer->sglist = NULL;
+	}
+	mutex_unlock(&buffer->lock);
+}
+
+/*
+ * Every attachment gets its own copy of the scatterlist, mapped for its
+ * device. The cache maintenance is the one dma_map_sg() does for the
+ * direction the importer asks for.
+ */
+static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
+					enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+	struct scatterlist *sglist, *sg, *dst;
+	struct sg_table *table;
+	ion_phys_addr_t addr;
+	size_t len;
+	int nents = 0;
+	int ret;
+
+	table = kzalloc(sizeof(struct sg_table), GFP_KERNEL);
+	if (!table)
+		return ERR_PTR(-ENOMEM);
+
+	sglist = ion_buffer_map_dma(buffer);
+	if (IS_ERR_OR_NULL(sglist)) {
+		/*
+		 * Heaps without a scatterlist hand out memory outside the
+		 * kernel's page map, which they only map uncached, so the
+		 * physical address is all the importer needs.
+		 */
+		if (!buffer->heap->ops->phys ||
+		    buffer->heap->ops->phys(buffer->heap, buffer, &addr, &len)) {
+			ret = sglist ? PTR_ERR(sglist) : -ENOMEM;
+			goto err_free_table;
+		}
+		ret = sg_alloc_table(table, 1, GFP_KERNEL);
+		if (ret)
+			goto err_free_table;
+		sg_dma_address(table->sgl) = addr;
+		sg_dma_len(table->sgl) = len;
+		table->sgl->length = len;
+		return table;
+	}
+
+	for (sg = sglist; sg; sg = sg_next(sg))
+		nents++;
+	ret = sg_alloc_table(table, nents, GFP_KERNEL);
+	if (ret)
+		goto err_unmap_buffer;
+
+	dst = table->sgl;
+	for (sg = sglist; sg; sg = sg_next(sg)) {
+		sg_set_page(dst, sg_page(sg), sg->length, sg->offset);
+		dst = sg_next(dst);
+	}
+
+	if (!dma_map_sg(attachment->dev, table->sgl, table->nents,
+			direction)) {
+		ret = -ENOMEM;
+		goto err_free_sg;
+	}
+	return table;
+
+err_free_sg:
+	sg_free_table(table);
+err_unmap_buffer:
+	ion_buffer_unmap_dma(buffer);
+err_free_table:
+	kfree(table);
+	return ERR_PTR(ret);
+}
+
+static void ion_unmap_dma_buf(struct dma_buf_attachment *attachment,
+			      struct sg_table *table,
+			      enum dma_data_direction direction)
+{
+	struct ion_buffer *buffer = attachment->dmabuf->priv;
+
+	if (sg_page(table->sgl)) {
+		dma_unmap_sg(attachment->dev, table->sgl, table->nents,
+			     direction);
+		ion_buffer_unmap_dma(buffer);
+	}
+	sg_free_table(table);
+	kfree(table);
+}
+
+static void ion_dma_buf_release(struct dma_buf *dmabuf)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	ion_buffer_put(buffer);
+}
+
+static const struct dma_buf_ops ion_dma_buf_ops = {
+	.map_dma_buf = ion_map_dma_buf,
+	.unmap_dma_buf = ion_unmap_dma_buf,
+	.release = ion_dma_buf_release,
+};
+
+int ion_share_dma_buf(struct ion_client *client, struct ion_handle *handle)
+{
+	struct ion_buffer *buffer;
+	struct dma_buf *dmabuf;
+	bool valid_handle;
+	int fd;
+
+	mutex_lock(&client->lock);
+	valid_handle = ion_handle_validate(client, handle);
+	mutex_unlock(&client->lock);
+	if (!valid_handle) {
+		WARN(1, "%s: invalid handle passed to share.\n", __func__);
+		return -EINVAL;
+	}
+
+	buffer = handle->buffer;
+	/* the dma-buf keeps the buffer alive until its last fd is closed */
+	ion_buffer_get(buffer);
+	dmabuf = dma_buf_export(buffer, &ion_dma_buf_ops, buffer->size, O_RDWR);
+	if (IS_ERR(dmabuf)) {
+		ion_buffer_put(buffer);
+		return PTR_ERR(dmabuf);
+	}
+	fd = dma_buf_fd(dmabuf, O_CLOEXEC);
+	if (fd < 0)
+		dma_buf_put(dmabuf);
+
+	return fd;
+}
+
+struct ion_handle *ion_import_dma_buf(struct ion_client *client, int fd)
+{
+	struct dma_buf *dmabuf;
+	struct ion_handle *handle;
+
+	dmabuf = dma_buf_get(fd);
+	if (IS_ERR_OR_NULL(dmabuf))
+		return ERR_PTR(-EINVAL);
+	/* only buffers exported by ion can become ion handles */
+	if (dmabuf->ops != &ion_dma_buf_ops) {
+		pr_err("%s: can not import dmabuf from another exporter\n",
+		       __func__);
+		dma_buf_put(dmabuf);
+		return ERR_PTR(-EINVAL);
+	}
+	handle = ion_import(client, dmabuf->priv);
+	dma_buf_put(dmabuf);
+	return handle;
+}
+#else
+int ion_share_dma_buf(struct ion_client *client, struct ion_handle *handle)
+{
+	return -ENODEV;
+}
+
+struct ion_handle *ion_import_dma_buf(struct ion_client *client, int fd)
+{
+	return ERR_PTR(-ENODEV);
+}
+#endif /* CONFIG_DMA_SHARED_BUFFER */
+
 static int ion_debug_client_show(struct seq_file *s, void *unused)
 {
 	struct ion_client *client = s->private;
@@ -1031,6 +1221,19 @@ static long ion_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			return -EFAULT;
 		break;
 	}
+	case ION_IOC_SHARE_DMA_BUF:
+	{
+		struct ion_fd_data data;
+
+		if (copy_from_user(&data, (void __user *)arg, sizeof(data)))
+			return -EFAULT;
+		data.fd = ion_share_dma_buf(client, data.handle);
+		if (data.fd < 0)
+			return data.fd;
+		if (copy_to_user((void __user *)arg, &data, sizeof(data)))
+			return -EFAULT;
+		break;
+	}
 	case ION_IOC_IMPORT:
 	{
 		struct ion_fd_data data;
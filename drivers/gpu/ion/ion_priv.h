@@ -21,6 +21,8 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/list.h>
+#include <linux/mm.h>
 #include <linux/ion.h>
 
 struct ion_mapping;
@@ -181,4 +183,49 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  */
 #define ION_CARVEOUT_ALLOCATE_FAIL -1
 
+/**
+ * struct ion_page_pool - pagepool struct
+ * @high_count:		number of highmem items in the pool
+ * @low_count:		number of lowmem items in the pool
+ * @high_items:		list of highmem items
+ * @low_items:		list of lowmem items
+ * @mutex:		lock protecting this struct and especially the count
+ *			item list
+ * @gfp_mask:		gfp_mask to use from alloc
+ * @order:		order of pages in the pool
+ * @shrinker:		gives the pages back to the system under memory
+ *			pressure
+ *
+ * Allows you to keep a pool of pre allocated pages to use from your heap.
+ * Keeping a pool of pages that is ready for dma, ie any cached mapping have
+ * been invalidated from the cache, provides a significant peformance benefit
+ * on many systems.  The pool does not clear the pages, the heap has to
+ * clear them before it gives them back.
+ */
+struct ion_page_pool {
+	int high_count;
+	int low_count;
+	struct list_head high_items;
+	struct list_head low_items;
+	struct mutex mutex;
+	gfp_t gfp_mask;
+	unsigned int order;
+	struct shrinker shrinker;
+};
+
+struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
+void ion_page_pool_destroy(struct ion_page_pool *);
+struct page *ion_page_pool_alloc(struct ion_page_pool *);
+void ion_page_pool_free(struct ion_page_pool *, struct page *);
+
+/**
+ * ion_pages_sync_for_device - flush pages from the cpu caches
+ * @page:	first page
+ * @size:	size of the range starting at page, in bytes
+ *
+ * Makes the cpu writes to the pages, typically clearing, visible to
+ * devices accessing the pages without the cache.
+ */
+void ion_pages_sync_for_device(struct page *page, size_t size);
+
 #endif /* _ION_PRIV_H */
@@ -922,6 +922,9 @@ _mali_osk_errcode_t _mali_ukk_open(void **context)
 		MALI_ERROR(_MALI_OSK_ERR_NOMEM);
 	}
 
+	session_data->pid = _mali_osk_get_pid();
+	mali_pp_scheduler_session_begin(session_data);
+
 	*context = (void*)session_data;
 
 	/* Add session to the list of all sessions. */
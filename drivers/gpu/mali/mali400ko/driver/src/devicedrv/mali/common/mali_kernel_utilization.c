@@ -25,6 +25,7 @@ static _mali_osk_atomic_t num_running_cores;
 
 static u64 period_start_time = 0;
 static u64 work_start_time = 0;
+static u64 idle_start_time = 0;
 static u64 accumulated_work_time = 0;
 
 static _mali_osk_timer_t *utilization_timer = NULL;
@@ -216,7 +217,19 @@ void mali_utilization_core_end(u64 time_now)
 
 		accumulated_work_time += (time_now - work_start_time);
 		work_start_time = 0;
+		idle_start_time = time_now;
 
 		_mali_osk_lock_signal(time_data_lock, _MALI_OSK_LOCKMODE_RW);
 	}
 }
+
+u64 mali_utilization_idle_since(void)
+{
+	u64 time;
+
+	_mali_osk_lock_wait(time_data_lock, _MALI_OSK_LOCKMODE_RW);
+	time = (0 == work_start_time) ? idle_start_time : 0;
+	_mali_osk_lock_signal(time_data_lock, _MALI_OSK_LOCKMODE_RW);
+
+	return time;
+}
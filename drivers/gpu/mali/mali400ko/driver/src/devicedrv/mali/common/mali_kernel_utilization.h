@@ -40,5 +40,10 @@ void mali_utilization_suspend(void);
  */
 void mali_utilization_core_end(u64 time_now);
 
+/**
+ * Returns the time the GPU last became idle, or 0 if it is busy.
+ */
+u64 mali_utilization_idle_since(void);
+
 
 #endif /* __MALI_KERNEL_UTILIZATION_H__ */
@@ -11,6 +11,7 @@
 #include "mali_kernel_common.h"
 #include "mali_osk.h"
 #include "mali_ukk.h"
+#include "mali_platform.h"
 
 #if MALI_TIMELINE_PROFILING_ENABLED
 #include "mali_osk_profiling.h"
@@ -45,6 +46,11 @@ _mali_osk_errcode_t _mali_ukk_vsync_event_report(_mali_uk_vsync_event_report_s *
 	}
 #endif
 
+	if (event==_MALI_UK_VSYNC_EVENT_END_WAIT)
+	{
+		mali_gpu_vsync_handler(_mali_osk_time_get_ns());
+	}
+
 	MALI_DEBUG_PRINT(4, ("Received VSYNC event: %d\n", event));
 	MALI_SUCCESS;
 }
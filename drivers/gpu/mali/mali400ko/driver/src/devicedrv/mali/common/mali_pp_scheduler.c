@@ -17,6 +17,7 @@
 #include "mali_pp_job.h"
 #include "mali_group.h"
 #include "mali_cluster.h"
+#include <linux/math64.h>
 
 /* Maximum of 8 PP cores (a group can only have maximum of 1 PP core) */
 #define MALI_MAX_NUMBER_OF_PP_GROUPS 8
@@ -41,10 +42,12 @@ struct mali_pp_slot
 	 */
 	enum mali_pp_slot_state state;
 	struct mali_session_data *session;
+	u64 start_time;
 };
 
 static u32 pp_version = 0;
-static _MALI_OSK_LIST_HEAD(job_queue);                          /* List of jobs with some unscheduled work */
+/* Sessions with some unscheduled work, per class, in round robin order */
+static _mali_osk_list_t session_queues[MALI_PP_SESSION_PRIORITY_COUNT];
 static struct mali_pp_slot slots[MALI_MAX_NUMBER_OF_PP_GROUPS];
 static u32 num_slots = 0;
 static u32 num_slots_idle = 0;
@@ -61,7 +64,10 @@ _mali_osk_errcode_t mali_pp_scheduler_initialize(void)
 {
 	u32 i;
 
-	_MALI_OSK_INIT_LIST_HEAD(&job_queue);
+	for (i = 0; i < MALI_PP_SESSION_PRIORITY_COUNT; i++)
+	{
+		_MALI_OSK_INIT_LIST_HEAD(&session_queues[i]);
+	}
 
 	pp_scheduler_lock = _mali_osk_lock_init(_MALI_OSK_LOCKFLAG_ORDERED |_MALI_OSK_LOCKFLAG_NONINTERRUPTABLE, 0, _MALI_OSK_LOCK_ORDER_SCHEDULER);
 	if (NULL == pp_scheduler_lock)
@@ -167,17 +173,125 @@ static mali_bool mali_pp_scheduler_session_has_running_jobs(struct mali_session_
 	return MALI_FALSE;
 }
 
+static mali_bool mali_pp_scheduler_has_queued_jobs(void)
+{
+	u32 i;
+
+	MALI_ASSERT_PP_SCHEDULER_LOCKED();
+
+	for (i = 0; i < MALI_PP_SESSION_PRIORITY_COUNT; i++)
+	{
+		if (!_mali_osk_list_empty(&session_queues[i]))
+		{
+			return MALI_TRUE;
+		}
+	}
+
+	return MALI_FALSE;
+}
+
+static void mali_pp_scheduler_queue_job(struct mali_pp_job *job)
+{
+	struct mali_session_data *session = mali_pp_job_get_session(job);
+
+	MALI_ASSERT_PP_SCHEDULER_LOCKED();
+
+	_mali_osk_list_addtail(&job->list, &session->pp_job_queue);
+
+	if (_mali_osk_list_empty(&session->pp_link))
+	{
+		/* The session gets in line for a full turn */
+		session->pp_quantum = session->pp_weight;
+		_mali_osk_list_addtail(&session->pp_link, &session_queues[session->pp_priority]);
+	}
+}
+
+/*
+ * Finds the job to start next: the first job of the first session in line in
+ * the highest class with queued jobs. A session waiting for a barrier lets the
+ * sessions behind it go first.
+ */
+static struct mali_pp_job *mali_pp_scheduler_get_next_job(struct mali_session_data *only_session)
+{
+	struct mali_session_data *session, *tmp;
+	struct mali_pp_job *job;
+	int prio;
+
+	MALI_ASSERT_PP_SCHEDULER_LOCKED();
+
+	for (prio = MALI_PP_SESSION_PRIORITY_COUNT - 1; prio >= 0; prio--)
+	{
+		_MALI_OSK_LIST_FOREACHENTRY(session, tmp, &session_queues[prio], struct mali_session_data, pp_link)
+		{
+			if (NULL != only_session && session != only_session)
+			{
+				continue;
+			}
+
+			job = _MALI_OSK_LIST_ENTRY(session->pp_job_queue.next, struct mali_pp_job, list);
+			MALI_DEBUG_ASSERT(mali_pp_job_has_unstarted_sub_jobs(job)); /* All jobs on the session queues should have unstarted sub jobs */
+
+			if (MALI_TRUE == mali_pp_job_has_active_barrier(job))
+			{
+				if (MALI_TRUE == mali_pp_scheduler_session_has_running_jobs(session))
+				{
+					/* There is already a running job from this session, so we need to enforce the barrier */
+					continue;
+				}
+				/* Barrier is now enforced, update job object so we don't delay execution of sub-jobs */
+				mali_pp_job_barrier_enforced(job);
+			}
+
+			return job;
+		}
+	}
+
+	return NULL;
+}
+
+/* Takes the started sub job off the queues and passes the turn on when it is used up */
+static void mali_pp_scheduler_sub_job_started(struct mali_pp_job *job)
+{
+	struct mali_session_data *session = mali_pp_job_get_session(job);
+
+	MALI_ASSERT_PP_SCHEDULER_LOCKED();
+
+	if (0 < session->pp_quantum)
+	{
+		session->pp_quantum--;
+	}
+
+	if (!mali_pp_job_has_unstarted_sub_jobs(job))
+	{
+		/*
+		* All sub jobs have now started for this job, remove this job from the job queue.
+		* The job will now only be referred to by the slots which are running it.
+		* The last slot to complete will make sure it is returned to user space.
+		*/
+		_mali_osk_list_del(&job->list);
+	}
+
+	if (_mali_osk_list_empty(&session->pp_job_queue))
+	{
+		_mali_osk_list_delinit(&session->pp_link);
+	}
+	else if (0 == session->pp_quantum)
+	{
+		session->pp_quantum = session->pp_weight;
+		_mali_osk_list_delinit(&session->pp_link);
+		_mali_osk_list_addtail(&session->pp_link, &session_queues[session->pp_priority]);
+	}
+}
+
 static void mali_pp_scheduler_schedule(void)
 {
 	u32 i;
 	struct mali_pp_job *job;
-#if MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP_BETWEEN_APPS
-	struct mali_session_data * session;
-#endif
+	struct mali_session_data * session = NULL;
 
 	MALI_ASSERT_PP_SCHEDULER_LOCKED();
 
-	if (0 < pause_count || 0 == num_slots_idle || _mali_osk_list_empty(&job_queue))
+	if (0 < pause_count || 0 == num_slots_idle || !mali_pp_scheduler_has_queued_jobs())
 	{
 		MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Nothing to schedule (paused=%u, idle slots=%u)\n",
 		                     pause_count, num_slots_idle));
@@ -194,9 +308,7 @@ static void mali_pp_scheduler_schedule(void)
 #endif
 
 #if MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP_BETWEEN_APPS
-	/* Finding initial session for the PP cores */
-	job = _MALI_OSK_LIST_ENTRY(job_queue.next, struct mali_pp_job, list);
-	session = job->session;
+	/* Only the session already on the PP cores, if any, may start more work */
 	if ( num_slots != num_slots_idle )
 	{
 		for (i = 0; (i < num_slots) ; i++)
@@ -215,31 +327,15 @@ static void mali_pp_scheduler_schedule(void)
 	{
 		u32 sub_job;
 
-		if (_mali_osk_list_empty(&job_queue)) /* move this check down to where we know we have started all sub jobs for this job??? */
-		{
-			break; /* No more jobs to schedule, so early out */
-		}
-
 		if (MALI_PP_SLOT_STATE_IDLE != slots[i].state)
 		{
 			continue;
 		}
 
-		job = _MALI_OSK_LIST_ENTRY(job_queue.next, struct mali_pp_job, list);
-		MALI_DEBUG_ASSERT(mali_pp_job_has_unstarted_sub_jobs(job)); /* All jobs on the job_queue should have unstarted sub jobs */
-
-		if (MALI_TRUE == mali_pp_job_has_active_barrier(job))
+		job = mali_pp_scheduler_get_next_job(session);
+		if (NULL == job)
 		{
-			if (MALI_TRUE == mali_pp_scheduler_session_has_running_jobs(mali_pp_job_get_session(job)))
-			{
-				/* There is already a running job from this session, so we need to enforce the barrier */
-				return;
-			}
-			else
-			{
-				/* Barrier is now enforced, update job object so we don't delay execution of sub-jobs */
-				mali_pp_job_barrier_enforced(job);
-			}
+			break; /* No more jobs that can be started now, so early out */
 		}
 
 		if (mali_pp_scheduler_balance_jobs) {
@@ -250,14 +346,6 @@ static void mali_pp_scheduler_schedule(void)
 			}
 		}
 
-		#if MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP_BETWEEN_APPS
-		if ( job->session != session )
-		{
-			MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Job not started since existing job is from another application\n"));
-			return;
-		}
-		#endif
-
 		sub_job = mali_pp_job_get_first_unstarted_sub_job(job);
 
 		MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Starting job %u (0x%08X) part %u/%u\n", mali_pp_job_get_id(job), job, sub_job + 1, mali_pp_job_get_sub_job_count(job)));
@@ -271,21 +359,21 @@ static void mali_pp_scheduler_schedule(void)
 			/* Mark slot as busy */
 			slots[i].state = MALI_PP_SLOT_STATE_WORKING;
 			slots[i].session =  mali_pp_job_get_session(job);
+			slots[i].start_time = _mali_osk_time_get_ns();
 			num_slots_idle--;
 
+			mali_pp_scheduler_sub_job_started(job);
+#if MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP_BETWEEN_APPS
+			/* The cores are no longer idle, the rest of this pass is limited to the same session */
+			session = slots[i].session;
+#endif
+#if MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP
 			if (!mali_pp_job_has_unstarted_sub_jobs(job))
 			{
-				/*
-				* All sub jobs have now started for this job, remove this job from the job queue.
-				* The job will now only be referred to by the slots which are running it.
-				* The last slot to complete will make sure it is returned to user space.
-				*/
-				_mali_osk_list_del(&job->list);
-#if MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP
 				MALI_DEBUG_PRINT(6, ("Mali PP scheduler: Skip scheduling more jobs when MALI_PP_SCHEDULER_FORCE_NO_JOB_OVERLAP is set.\n"));
 				return;
-#endif
 			}
+#endif
 		}
 		else
 		{
@@ -359,6 +447,8 @@ void mali_pp_scheduler_job_done(struct mali_group *group, struct mali_pp_job *jo
 		if (slots[i].group == group)
 		{
 			MALI_DEBUG_ASSERT(MALI_PP_SLOT_STATE_WORKING == slots[i].state);
+			slots[i].session->pp_sub_jobs++;
+			slots[i].session->pp_gpu_time += div_u64(_mali_osk_time_get_ns() - slots[i].start_time, 1000);
 			slots[i].state = MALI_PP_SLOT_STATE_IDLE;
 			slots[i].session = NULL;
 			num_slots_idle++;
@@ -453,7 +543,7 @@ _mali_osk_errcode_t _mali_ukk_pp_start_job(_mali_uk_pp_start_job_s *args)
 
 	mali_pp_scheduler_lock();
 
-	_mali_osk_list_addtail(&job->list, &job_queue);
+	mali_pp_scheduler_queue_job(job);
 
 	MALI_DEBUG_PRINT(3, ("Mali PP scheduler: Job %u (0x%08X) with %u parts queued\n", mali_pp_job_get_id(job), job, mali_pp_job_get_sub_job_count(job)));
 
@@ -494,10 +584,9 @@ void _mali_ukk_pp_job_disable_wb(_mali_uk_pp_disable_wb_s *args)
 	mali_pp_scheduler_lock();
 
 	/* Check queue for jobs that match */
-	_MALI_OSK_LIST_FOREACHENTRY(job, tmp, &job_queue, struct mali_pp_job, list)
+	_MALI_OSK_LIST_FOREACHENTRY(job, tmp, &session->pp_job_queue, struct mali_pp_job, list)
 	{
-		if (mali_pp_job_get_session(job) == session &&
-		    mali_pp_job_get_frame_builder_id(job) == (u32)args->fb_id &&
+		if (mali_pp_job_get_frame_builder_id(job) == (u32)args->fb_id &&
 		    mali_pp_job_get_flush_id(job) == (u32)args->flush_id)
 		{
 			if (args->wbx & _MALI_UK_PP_JOB_WB0)
@@ -528,23 +617,21 @@ void mali_pp_scheduler_abort_session(struct mali_session_data *session)
 	MALI_DEBUG_PRINT(3, ("Mali PP scheduler: Aborting all jobs from session 0x%08x\n", session));
 
 	/* Check queue for jobs and remove */
-	_MALI_OSK_LIST_FOREACHENTRY(job, tmp, &job_queue, struct mali_pp_job, list)
+	_MALI_OSK_LIST_FOREACHENTRY(job, tmp, &session->pp_job_queue, struct mali_pp_job, list)
 	{
-		if (mali_pp_job_get_session(job) == session)
-		{
-			_mali_osk_list_del(&(job->list));
+		_mali_osk_list_del(&(job->list));
 
-			if ( mali_pp_job_is_currently_rendering_and_if_so_abort_new_starts(job) )
-			{
-				/* The job is in the render pipeline, we can not delete it yet. */
-				/* It will be deleted in the mali_group_abort_session() call below */
-				MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Keeping partially started PP job 0x%08x in queue\n", job));
-				continue;
-			}
-			MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Removing PP job 0x%08x from queue\n", job));
-			mali_pp_job_delete(job);
+		if ( mali_pp_job_is_currently_rendering_and_if_so_abort_new_starts(job) )
+		{
+			/* The job is in the render pipeline, we can not delete it yet. */
+			/* It will be deleted in the mali_group_abort_session() call below */
+			MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Keeping partially started PP job 0x%08x in queue\n", job));
+			continue;
 		}
+		MALI_DEBUG_PRINT(4, ("Mali PP scheduler: Removing PP job 0x%08x from queue\n", job));
+		mali_pp_job_delete(job);
 	}
+	_mali_osk_list_delinit(&session->pp_link);
 
 	mali_pp_scheduler_unlock();
 
@@ -575,6 +662,107 @@ static mali_bool mali_pp_scheduler_is_suspended(void)
 	return ret;
 }
 
+void mali_pp_scheduler_session_begin(struct mali_session_data *session)
+{
+	_MALI_OSK_INIT_LIST_HEAD(&session->pp_job_queue);
+	_MALI_OSK_INIT_LIST_HEAD(&session->pp_link);
+	session->pp_priority = MALI_PP_SESSION_PRIORITY_NORMAL;
+	session->pp_weight = MALI_PP_SESSION_WEIGHT_DEFAULT;
+	session->pp_quantum = 0;
+	session->pp_sub_jobs = 0;
+	session->pp_gpu_time = 0;
+}
+
+void mali_pp_scheduler_set_session_priority(struct mali_session_data *session, u32 priority)
+{
+	MALI_DEBUG_ASSERT(priority < MALI_PP_SESSION_PRIORITY_COUNT);
+
+	mali_pp_scheduler_lock();
+
+	if (session->pp_priority != priority)
+	{
+		session->pp_priority = priority;
+		if (!_mali_osk_list_empty(&session->pp_link))
+		{
+			_mali_osk_list_delinit(&session->pp_link);
+			_mali_osk_list_addtail(&session->pp_link, &session_queues[priority]);
+		}
+	}
+
+	mali_pp_scheduler_unlock();
+}
+
+_mali_osk_errcode_t mali_pp_scheduler_set_session_weight(u32 pid, u32 weight)
+{
+	struct mali_session_data *session, *tmp;
+	_mali_osk_errcode_t err = _MALI_OSK_ERR_ITEM_NOT_FOUND;
+
+	if (0 == weight || MALI_PP_SESSION_WEIGHT_MAX < weight)
+	{
+		return _MALI_OSK_ERR_INVALID_ARGS;
+	}
+
+	mali_session_lock();
+	mali_pp_scheduler_lock();
+
+	MALI_SESSION_FOREACH(session, tmp, link)
+	{
+		if (session->pid == pid)
+		{
+			session->pp_weight = weight;
+			if (session->pp_quantum > weight)
+			{
+				session->pp_quantum = weight;
+			}
+			err = _MALI_OSK_ERR_OK;
+		}
+	}
+
+	mali_pp_scheduler_unlock();
+	mali_session_unlock();
+
+	return err;
+}
+
+u32 mali_pp_scheduler_dump_sessions(char *buf, u32 size)
+{
+	struct mali_session_data *session, *tmp;
+	struct mali_pp_job *job, *tmp_job;
+	int n = 0;
+
+	n += _mali_osk_snprintf(buf + n, size - n, "%-8s %-16s %-6s %-6s %-6s %-10s %s\n",
+	                        "pid", "name", "class", "weight", "queued", "sub_jobs", "gpu_time_us");
+
+	mali_session_lock();
+	mali_pp_scheduler_lock();
+
+	MALI_SESSION_FOREACH(session, tmp, link)
+	{
+		u32 queued = 0;
+
+		_MALI_OSK_LIST_FOREACHENTRY(job, tmp_job, &session->pp_job_queue, struct mali_pp_job, list)
+		{
+			queued++;
+		}
+
+		n += _mali_osk_snprintf(buf + n, size - n, "%-8u %-16s %-6s %-6u %-6u %-10u %llu\n",
+		                        session->pid, session->comm,
+		                        MALI_PP_SESSION_PRIORITY_HIGH == session->pp_priority ? "high" : "normal",
+		                        session->pp_weight, queued, session->pp_sub_jobs,
+		                        (unsigned long long)session->pp_gpu_time);
+		if ((u32)n >= size)
+		{
+			n = size;
+			break;
+		}
+	}
+
+	mali_pp_scheduler_unlock();
+	mali_session_unlock();
+
+	return n;
+}
+
 #if MALI_STATE_TRACKING
 u32 mali_pp_scheduler_dump_state(char *buf, u32 size)
 {
@@ -582,7 +770,7 @@ u32 mali_pp_scheduler_dump_state(char *buf, u32 size)
 	int i;
 
 	n += _mali_osk_snprintf(buf + n, size - n, "PP:\n");
-	n += _mali_osk_snprintf(buf + n, size - n, "\tQueue is %s\n", _mali_osk_list_empty(&job_queue) ? "empty" : "not empty");
+	n += _mali_osk_snprintf(buf + n, size - n, "\tQueue is %s\n", mali_pp_scheduler_has_queued_jobs() ? "not empty" : "empty");
 	n += _mali_osk_snprintf(buf + n, size - n, "\n");
 
 	for (i = 0; i < num_slots; i++)
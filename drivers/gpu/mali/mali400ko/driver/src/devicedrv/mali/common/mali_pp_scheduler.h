@@ -15,6 +15,22 @@
 #include "mali_cluster.h"
 #include "mali_pp_job.h"
 
+/** @brief PP scheduling classes
+ *
+ * Sessions with queued jobs in a higher class are always served first. Within
+ * a class the sessions take turns, each starting as many sub jobs per turn as
+ * its weight.
+ */
+enum mali_pp_session_priority
+{
+	MALI_PP_SESSION_PRIORITY_NORMAL,
+	MALI_PP_SESSION_PRIORITY_HIGH, /**< The session composing the display */
+	MALI_PP_SESSION_PRIORITY_COUNT,
+};
+
+#define MALI_PP_SESSION_WEIGHT_DEFAULT 4
+#define MALI_PP_SESSION_WEIGHT_MAX     16
+
 _mali_osk_errcode_t mali_pp_scheduler_initialize(void);
 void mali_pp_scheduler_terminate(void);
 
@@ -33,6 +49,35 @@ void mali_pp_scheduler_resume(void);
  */
 void mali_pp_scheduler_abort_session(struct mali_session_data *session);
 
+/** @brief Set up the PP scheduling state of a new session
+ *
+ * @param session Pointer to the new session, not yet on the list of all sessions
+ */
+void mali_pp_scheduler_session_begin(struct mali_session_data *session);
+
+/** @brief Move a session to another PP scheduling class
+ *
+ * @param session Pointer to session
+ * @param priority One of mali_pp_session_priority
+ */
+void mali_pp_scheduler_set_session_priority(struct mali_session_data *session, u32 priority);
+
+/** @brief Set the round robin weight of all sessions of a process
+ *
+ * @param pid Process whose sessions should get the new weight
+ * @param weight Sub jobs started per turn, 1 to MALI_PP_SESSION_WEIGHT_MAX
+ * @return _MALI_OSK_ERR_OK on success, _MALI_OSK_ERR_ITEM_NOT_FOUND if the process has no session
+ */
+_mali_osk_errcode_t mali_pp_scheduler_set_session_weight(u32 pid, u32 weight);
+
+/** @brief Print the PP scheduling state and GPU time of all sessions
+ *
+ * @param buf Buffer to print into
+ * @param size Size of the buffer
+ * @return Number of characters printed
+ */
+u32 mali_pp_scheduler_dump_sessions(char *buf, u32 size);
+
 u32 mali_pp_scheduler_dump_state(char *buf, u32 size);
 
 #endif /* __MALI_PP_SCHEDULER_H__ */
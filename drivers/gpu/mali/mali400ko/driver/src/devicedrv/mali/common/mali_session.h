@@ -16,6 +16,8 @@
 #include "mali_osk.h"
 #include "mali_osk_list.h"
 
+#define MALI_SESSION_COMM_LEN 16
+
 struct mali_session_data
 {
 	_mali_osk_notification_queue_t * ioctl_queue;
@@ -27,6 +29,18 @@ struct mali_session_data
 	struct mali_page_directory *page_directory; /**< MMU page directory for this session */
 
 	_MALI_OSK_LIST_HEAD(link); /**< Link for list of all sessions */
+
+	u32 pid; /**< Process which opened the session */
+	char comm[MALI_SESSION_COMM_LEN]; /**< Name of that process */
+
+	/* Owned by the PP scheduler, protected by its lock */
+	_mali_osk_list_t pp_job_queue; /**< PP jobs of this session with some unscheduled work */
+	_mali_osk_list_t pp_link; /**< Link in the PP scheduler queue of sessions with jobs */
+	u32 pp_priority; /**< PP scheduling class, see mali_pp_session_priority */
+	u32 pp_weight; /**< PP sub jobs started for the session on each round robin turn */
+	u32 pp_quantum; /**< PP sub jobs left to start on the current turn */
+	u32 pp_sub_jobs; /**< PP sub jobs completed */
+	u64 pp_gpu_time; /**< Time PP cores have spent on the session, in us */
 };
 
 _mali_osk_errcode_t mali_session_initialize(void);
@@ -234,14 +234,14 @@ int mali_attach_dma_buf(struct mali_session_data *session, _mali_uk_attach_dma_b
 		if (NULL == mem)
 		{
 			MALI_PRINT_ERROR(("Failed to allocate dma-buf tracing struct\n"));
-			dma_buf_put(mem->buf);
+			dma_buf_put(buf);
 			return -ENOMEM;
 		}
 		_mali_osk_atomic_init(&mem->ref, 1);
 		mem->buf = buf;
 
 		mem->attachment = dma_buf_attach(mem->buf, mali_device);
-		if (NULL == mem->attachment)
+		if (IS_ERR_OR_NULL(mem->attachment))
 		{
 			MALI_DEBUG_PRINT(2, ("Failed to attach to dma-buf %d\n", fd));
 			dma_buf_put(mem->buf);
@@ -16,6 +16,7 @@
 #include <linux/fs.h>       /* file system operations */
 #include <linux/cdev.h>     /* character device definitions */
 #include <linux/mm.h>       /* memory manager definitions */
+#include <linux/sched.h>    /* current */
 #include <linux/platform_device.h>
 #include <linux/mali/mali_utgard_ioctl.h>
 #include "mali_kernel_common.h"
@@ -30,6 +31,7 @@
 #include "mali_platform.h"
 #include "mali_kernel_license.h"
 #include "mali_dma_buf.h"
+#include "mali_pp_scheduler.h"
 
 /* Streamline support for the Mali driver */
 #if defined(CONFIG_TRACEPOINTS) && MALI_TIMELINE_PROFILING_ENABLED
@@ -80,18 +82,15 @@ extern int mali_utilization_sampling_rate;
 module_param(mali_utilization_sampling_rate, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
 MODULE_PARM_DESC(mali_utilization_sampling_rate, "Mali GPU utilization sampling rate");
 
-extern int mali_utilization_high_to_low;
-module_param(mali_utilization_high_to_low, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
-MODULE_PARM_DESC(mali_utilization_high_to_low, "Mali GPU utilization high to low limit");
-
-extern int mali_utilization_low_to_high;
-module_param(mali_utilization_low_to_high, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
-MODULE_PARM_DESC(mali_utilization_low_to_high, "Mali GPU utilization low to high limit");
-
 extern bool mali_pp_scheduler_balance_jobs;
 module_param(mali_pp_scheduler_balance_jobs, bool, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
 MODULE_PARM_DESC(mali_pp_scheduler_balance_jobs, "Mali PP forces balance jobs at starts");
 
+/* Process composing the display, its PP jobs go before those of other processes */
+static char *mali_pp_composition_process = "surfaceflinger";
+module_param(mali_pp_composition_process, charp, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(mali_pp_composition_process, "Mali PP high priority process name");
+
 extern int mali_oskmem_allocorder;
 module_param(mali_oskmem_allocorder, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
 MODULE_PARM_DESC(mali_utilization_sampling_rate, "Mali OS kernel memory allocation order");
@@ -336,6 +335,13 @@ static int mali_open(struct inode *inode, struct file *filp)
 	/* link in our session data */
 	filp->private_data = (void*)session_data;
 
+	get_task_comm(session_data->comm, current->group_leader);
+	if (NULL != mali_pp_composition_process &&
+	    0 == strncmp(session_data->comm, mali_pp_composition_process, sizeof(session_data->comm) - 1))
+	{
+		mali_pp_scheduler_set_session_priority(session_data, MALI_PP_SESSION_PRIORITY_HIGH);
+	}
+
 	return 0;
 }
 
@@ -346,6 +352,13 @@ static int mali_release(struct inode *inode, struct file *filp)
     /* input validation */
 	if (0 != MINOR(inode->i_rdev)) return -ENODEV;
 
+	/*
+	 * Hand the pages kept for the session over to the other sessions.
+	 * All mappings are gone by now, and the pool must not outlive the
+	 * file even if closing the session fails.
+	 */
+	mali_osk_low_level_mem_session_end(filp);
+
     err = _mali_ukk_close((void **)&filp->private_data);
     if (_MALI_OSK_ERR_OK != err) return map_errcode(err);
 
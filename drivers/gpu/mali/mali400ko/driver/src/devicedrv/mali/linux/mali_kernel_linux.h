@@ -17,6 +17,7 @@ extern "C"
 #endif
 
 #include <linux/cdev.h>     /* character device definitions */
+#include <linux/fs.h>       /* struct file */
 #include "mali_kernel_license.h"
 #include "mali_osk.h"
 
@@ -35,6 +36,8 @@ extern struct workqueue_struct * mali_wq;
 
 void mali_osk_low_level_mem_init(void);
 void mali_osk_low_level_mem_term(void);
+void mali_osk_low_level_mem_session_end(struct file *owner);
+int mali_osk_low_level_mem_pool_stats(char *buf, int size);
 int init_mali(void);
 
 #ifdef __cplusplus
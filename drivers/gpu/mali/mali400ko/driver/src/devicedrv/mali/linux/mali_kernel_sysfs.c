@@ -39,6 +39,7 @@
 #include "mali_group.h"
 #include "mali_gp.h"
 #include "mali_pp.h"
+#include "mali_pp_scheduler.h"
 #include "mali_l2_cache.h"
 #include "mali_hw_core.h"
 #include "mali_kernel_core.h"
@@ -972,6 +973,89 @@ static const struct file_operations memory_usage_fops = {
 	.read = memory_used_read,
 };
 
+static ssize_t memory_pool_read(struct file *filp, char __user *ubuf, size_t cnt, loff_t *ppos)
+{
+	char buf[256];
+	size_t r;
+
+	r = mali_osk_low_level_mem_pool_stats(buf, sizeof(buf));
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
+}
+
+static const struct file_operations memory_pool_fops = {
+	.owner = THIS_MODULE,
+	.read = memory_pool_read,
+};
+
+static int pp_sessions_show(struct seq_file *seq_file, void *v)
+{
+	u32 size;
+	char *buf;
+
+	size = seq_get_buf(seq_file, &buf);
+
+	if(!size)
+	{
+			return -ENOMEM;
+	}
+
+	seq_commit(seq_file, mali_pp_scheduler_dump_sessions(buf, size));
+
+	return 0;
+}
+
+static int pp_sessions_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pp_sessions_show, NULL);
+}
+
+/* Writing "<pid> <weight>" sets the PP round robin weight of the sessions of a process */
+static ssize_t pp_sessions_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos)
+{
+	char buf[64];
+	u32 pid;
+	u32 weight;
+
+	if (cnt >= sizeof(buf))
+	{
+		return -EINVAL;
+	}
+
+	if (copy_from_user(&buf, ubuf, cnt))
+	{
+		return -EFAULT;
+	}
+
+	buf[cnt] = 0;
+
+	if (2 != sscanf(buf, "%u %u", &pid, &weight))
+	{
+		return -EINVAL;
+	}
+
+	switch (mali_pp_scheduler_set_session_weight(pid, weight))
+	{
+	case _MALI_OSK_ERR_OK:
+		break;
+	case _MALI_OSK_ERR_ITEM_NOT_FOUND:
+		return -ESRCH;
+	default:
+		return -EINVAL;
+	}
+
+	*ppos += cnt;
+	return cnt;
+}
+
+static const struct file_operations pp_sessions_fops = {
+	.owner = THIS_MODULE,
+	.open = pp_sessions_open,
+	.read = seq_read,
+	.write = pp_sessions_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 
 static ssize_t user_settings_write(struct file *filp, const char __user *ubuf, size_t cnt, loff_t *ppos)
 {
@@ -1208,6 +1292,8 @@ int mali_sysfs_register(struct mali_dev *device, dev_t dev, const char *mali_dev
 			}
 
 			debugfs_create_file("memory_usage", 0400, mali_debugfs_dir, NULL, &memory_usage_fops);
+			debugfs_create_file("memory_pool", 0400, mali_debugfs_dir, NULL, &memory_pool_fops);
+			debugfs_create_file("pp_sessions", 0600, mali_debugfs_dir, NULL, &pp_sessions_fops);
 
 #if MALI_INTERNAL_TIMELINE_PROFILING_ENABLED
 			mali_profiling_dir = debugfs_create_dir("profiling", mali_debugfs_dir);
@@ -22,6 +22,11 @@
 #include <linux/mm.h>
 #include <linux/dma-mapping.h>
 #include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/highmem.h>
+#include <linux/workqueue.h>
+#include <linux/sched.h>
+#include <linux/fs.h>
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,1,0)
 #include <linux/shrinker.h>
 #endif
@@ -69,6 +74,7 @@ typedef struct AllocationList AllocationList;
 struct MappingInfo
 {
 	struct vm_area_struct *vma;
+	struct file *owner;
 	struct AllocationList *list;
 	struct AllocationList *tail;
 };
@@ -76,24 +82,57 @@ struct MappingInfo
 typedef struct MappingInfo MappingInfo;
 
 
+/* Pages released by a session are handed back to the same session without
+ * being cleared, since they only hold data of that session.
+ */
+typedef struct mali_session_page_pool
+{
+	struct list_head list;
+	struct file *owner;
+	AllocationList *pages;
+	int size;
+} mali_session_page_pool;
+
+
 static u32 _kernel_page_allocate(void);
 static void _kernel_page_release(u32 physical_address);
-static AllocationList * _allocation_list_item_get(void);
-static void _allocation_list_item_release(AllocationList * item);
+static void _kernel_page_clear(u32 physical_address);
+static AllocationList * _allocation_list_item_get(struct file *owner);
+static void _allocation_list_item_release(AllocationList * item, struct file *owner);
+static void mali_mem_clear_work_func(struct work_struct *work);
 
 
 /* Variable declarations */
 static DEFINE_SPINLOCK(allocation_list_spinlock);
+/* Cleared pages, ready for any session */
 static AllocationList * pre_allocated_memory = (AllocationList*) NULL ;
+/* Pages left by closed sessions, waiting to be cleared */
+static AllocationList * dirty_memory = (AllocationList*) NULL ;
+/* Size of the global pool: cleared, dirty and currently clearing pages */
 static int pre_allocated_memory_size_current  = 0;
+static int dirty_memory_size_current = 0;
+/* Size of all session pools */
+static int session_memory_size_current = 0;
+static LIST_HEAD(session_page_pools);
+static DECLARE_WORK(mali_mem_clear_work, mali_mem_clear_work_func);
 #ifdef MALI_OS_MEMORY_KERNEL_BUFFER_SIZE_IN_MB
 	static int pre_allocated_memory_size_max      = MALI_OS_MEMORY_KERNEL_BUFFER_SIZE_IN_MB * 1024 * 1024;
 #else
 	static int pre_allocated_memory_size_max      = 16 * 1024 * 1024; /* 6 MiB */
 #endif
+static int session_memory_size_max = 4 * 1024 * 1024;
+
+/* Pool statistics */
+static u32 pool_session_hits = 0;
+static u32 pool_cleared_hits = 0;
+static u32 pool_dirty_hits = 0;
+static u32 pool_misses = 0;
+static u32 pool_pages_cleared = 0;
 
 module_param(pre_allocated_memory_size_max, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
 MODULE_PARM_DESC(pre_allocated_memory_size_max, "Mali pre-allocated kernel memory size");
+module_param(session_memory_size_max, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(session_memory_size_max, "Mali memory kept for reuse by each session");
 
 static struct vm_operations_struct mali_kernel_vm_ops =
 {
@@ -106,6 +145,55 @@ static struct vm_operations_struct mali_kernel_vm_ops =
 #endif
 };
 
+/* Moves up to *nr items from the head of list to the head of taken,
+ * returns the number of bytes moved */
+static int _allocation_list_take(AllocationList ** list, AllocationList ** taken, int *nr)
+{
+	AllocationList *item;
+	int size = 0;
+
+	while (NULL != *list && *nr > 0)
+	{
+		item = *list;
+		*list = item->next;
+		item->next = *taken;
+		*taken = item;
+
+		size += PAGE_SIZE;
+		--(*nr);
+	}
+
+	return size;
+}
+
+static void _allocation_list_free(AllocationList * list)
+{
+	AllocationList *item;
+
+	while (NULL != list)
+	{
+		item = list;
+		list = item->next;
+		_kernel_page_release(item->physaddr);
+		_mali_osk_free(item);
+	}
+}
+
+/* LOCKING: allocation_list_spinlock */
+static mali_session_page_pool * _session_page_pool_find(struct file *owner)
+{
+	mali_session_page_pool *pool;
+
+	if (NULL == owner) return NULL;
+
+	list_for_each_entry(pool, &session_page_pools, list)
+	{
+		if (pool->owner == owner) return pool;
+	}
+
+	return NULL;
+}
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,0,0)
 	#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,35)
 static int mali_mem_shrink(int nr_to_scan, gfp_t gfp_mask)
@@ -117,7 +205,9 @@ static int mali_mem_shrink(struct shrinker *shrinker, struct shrink_control *sc)
 #endif
 {
 	unsigned long flags;
-	AllocationList *item;
+	AllocationList *release = NULL;
+	mali_session_page_pool *pool;
+	int size;
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,0,0)
 	int nr = nr_to_scan;
 #else
@@ -126,10 +216,10 @@ static int mali_mem_shrink(struct shrinker *shrinker, struct shrink_control *sc)
 
 	if (0 == nr)
 	{
-		return pre_allocated_memory_size_current / PAGE_SIZE;
+		return (pre_allocated_memory_size_current + session_memory_size_current) / PAGE_SIZE;
 	}
 
-	if (0 == pre_allocated_memory_size_current)
+	if (0 == pre_allocated_memory_size_current + session_memory_size_current)
 	{
 		/* No pages availble */
 		return 0;
@@ -141,20 +231,24 @@ static int mali_mem_shrink(struct shrinker *shrinker, struct shrink_control *sc)
 		return -1;
 	}
 
-	while (pre_allocated_memory && nr > 0)
-	{
-		item = pre_allocated_memory;
-		pre_allocated_memory = item->next;
+	/* Give up the pages that are cheapest to get back first */
+	size = _allocation_list_take(&dirty_memory, &release, &nr);
+	dirty_memory_size_current -= size;
+	pre_allocated_memory_size_current -= size;
 
-		_kernel_page_release(item->physaddr);
-		_mali_osk_free(item);
+	pre_allocated_memory_size_current -= _allocation_list_take(&pre_allocated_memory, &release, &nr);
 
-		pre_allocated_memory_size_current -= PAGE_SIZE;
-		--nr;
+	list_for_each_entry(pool, &session_page_pools, list)
+	{
+		size = _allocation_list_take(&pool->pages, &release, &nr);
+		pool->size -= size;
+		session_memory_size_current -= size;
 	}
 	spin_unlock_irqrestore(&allocation_list_spinlock,flags);
 
-	return pre_allocated_memory_size_current / PAGE_SIZE;
+	_allocation_list_free(release);
+
+	return (pre_allocated_memory_size_current + session_memory_size_current) / PAGE_SIZE;
 }
 
 struct shrinker mali_mem_shrinker = {
@@ -162,26 +256,119 @@ struct shrinker mali_mem_shrinker = {
 	.seeks = DEFAULT_SEEKS,
 };
 
+/* Clears the pages left by closed sessions, so that allocations don't have to */
+static void mali_mem_clear_work_func(struct work_struct *work)
+{
+	AllocationList *item;
+	unsigned long flags;
+
+	for (;;)
+	{
+		spin_lock_irqsave(&allocation_list_spinlock, flags);
+		item = dirty_memory;
+		if (NULL == item)
+		{
+			spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+			break;
+		}
+		dirty_memory = item->next;
+		dirty_memory_size_current -= PAGE_SIZE;
+		spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+
+		_kernel_page_clear(item->physaddr);
+
+		spin_lock_irqsave(&allocation_list_spinlock, flags);
+		item->next = pre_allocated_memory;
+		pre_allocated_memory = item;
+		pool_pages_cleared++;
+		spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+
+		cond_resched();
+	}
+}
+
 void mali_osk_low_level_mem_init(void)
 {
 	pre_allocated_memory = (AllocationList*) NULL ;
+	dirty_memory = (AllocationList*) NULL ;
 
 	register_shrinker(&mali_mem_shrinker);
 }
 
 void mali_osk_low_level_mem_term(void)
 {
+	mali_session_page_pool *pool, *tmp;
+
 	unregister_shrinker(&mali_mem_shrinker);
+	cancel_work_sync(&mali_mem_clear_work);
 
-	while ( NULL != pre_allocated_memory )
+	_allocation_list_free(pre_allocated_memory);
+	_allocation_list_free(dirty_memory);
+	pre_allocated_memory = (AllocationList*) NULL ;
+	dirty_memory = (AllocationList*) NULL ;
+	pre_allocated_memory_size_current  = 0;
+	dirty_memory_size_current = 0;
+
+	list_for_each_entry_safe(pool, tmp, &session_page_pools, list)
 	{
-		AllocationList *item;
-		item = pre_allocated_memory;
-		pre_allocated_memory = item->next;
-		_kernel_page_release(item->physaddr);
-		_mali_osk_free( item );
+		list_del(&pool->list);
+		_allocation_list_free(pool->pages);
+		_mali_osk_free(pool);
 	}
-	pre_allocated_memory_size_current  = 0;
+	session_memory_size_current = 0;
+}
+
+void mali_osk_low_level_mem_session_end(struct file *owner)
+{
+	mali_session_page_pool *pool;
+	AllocationList *release = NULL;
+	unsigned long flags;
+	int nr;
+	int size;
+
+	spin_lock_irqsave(&allocation_list_spinlock, flags);
+	pool = _session_page_pool_find(owner);
+	if (NULL == pool)
+	{
+		spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+		return;
+	}
+	list_del(&pool->list);
+	session_memory_size_current -= pool->size;
+
+	/* Other sessions may only get the pages once they are cleared */
+	nr = (pre_allocated_memory_size_max - pre_allocated_memory_size_current) / PAGE_SIZE;
+	size = _allocation_list_take(&pool->pages, &dirty_memory, &nr);
+	dirty_memory_size_current += size;
+	pre_allocated_memory_size_current += size;
+	release = pool->pages;
+	spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+
+	if (0 != size) schedule_work(&mali_mem_clear_work);
+
+	_allocation_list_free(release);
+	_mali_osk_free(pool);
+}
+
+int mali_osk_low_level_mem_pool_stats(char *buf, int size)
+{
+	return snprintf(buf, size,
+	                "pool_size %d\n"
+	                "dirty_size %d\n"
+	                "session_size %d\n"
+	                "session_hits %u\n"
+	                "cleared_hits %u\n"
+	                "dirty_hits %u\n"
+	                "misses %u\n"
+	                "pages_cleared %u\n",
+	                pre_allocated_memory_size_current,
+	                dirty_memory_size_current,
+	                session_memory_size_current,
+	                pool_session_hits,
+	                pool_cleared_hits,
+	                pool_dirty_hits,
+	                pool_misses,
+	                pool_pages_cleared);
 }
 
 static u32 _kernel_page_allocate(void)
@@ -215,21 +402,62 @@ static void _kernel_page_release(u32 physical_address)
 	__free_page( unmap_page );
 }
 
-static AllocationList * _allocation_list_item_get(void)
+static void _kernel_page_clear(u32 physical_address)
+{
+	struct page *clear_page;
+
+	clear_page = pfn_to_page( physical_address >> PAGE_SHIFT );
+	MALI_DEBUG_ASSERT_POINTER( clear_page );
+
+	dma_unmap_page(NULL, physical_address, PAGE_SIZE, DMA_BIDIRECTIONAL);
+	clear_highpage( clear_page );
+	/* Flush the cleared page from CPU caches again. */
+	dma_map_page(NULL, clear_page, 0, PAGE_SIZE, DMA_BIDIRECTIONAL);
+}
+
+static AllocationList * _allocation_list_item_get(struct file *owner)
 {
 	AllocationList *item = NULL;
+	mali_session_page_pool *pool;
 	unsigned long flags;
 
 	spin_lock_irqsave(&allocation_list_spinlock,flags);
+	pool = _session_page_pool_find(owner);
+	if ( pool && pool->pages )
+	{
+		item = pool->pages;
+		pool->pages = item->next;
+		pool->size -= PAGE_SIZE;
+		session_memory_size_current -= PAGE_SIZE;
+		pool_session_hits++;
+
+		spin_unlock_irqrestore(&allocation_list_spinlock,flags);
+		return item;
+	}
 	if ( pre_allocated_memory )
 	{
 		item = pre_allocated_memory;
 		pre_allocated_memory = pre_allocated_memory->next;
 		pre_allocated_memory_size_current -= PAGE_SIZE;
+		pool_cleared_hits++;
+
+		spin_unlock_irqrestore(&allocation_list_spinlock,flags);
+		return item;
+	}
+	if ( dirty_memory )
+	{
+		/* The clearing work is behind, clearing is still cheaper than allocating */
+		item = dirty_memory;
+		dirty_memory = dirty_memory->next;
+		dirty_memory_size_current -= PAGE_SIZE;
+		pre_allocated_memory_size_current -= PAGE_SIZE;
+		pool_dirty_hits++;
 
 		spin_unlock_irqrestore(&allocation_list_spinlock,flags);
+		_kernel_page_clear(item->physaddr);
 		return item;
 	}
+	pool_misses++;
 	spin_unlock_irqrestore(&allocation_list_spinlock,flags);
 
 	item = _mali_osk_malloc( sizeof(AllocationList) );
@@ -248,16 +476,30 @@ static AllocationList * _allocation_list_item_get(void)
 	return item;
 }
 
-static void _allocation_list_item_release(AllocationList * item)
+static void _allocation_list_item_release(AllocationList * item, struct file *owner)
 {
+	mali_session_page_pool *pool;
 	unsigned long flags;
+
 	spin_lock_irqsave(&allocation_list_spinlock,flags);
+	pool = _session_page_pool_find(owner);
+	if ( pool && pool->size < session_memory_size_max )
+	{
+		item->next = pool->pages;
+		pool->pages = item;
+		pool->size += PAGE_SIZE;
+		session_memory_size_current += PAGE_SIZE;
+		spin_unlock_irqrestore(&allocation_list_spinlock,flags);
+		return;
+	}
 	if ( pre_allocated_memory_size_current < pre_allocated_memory_size_max)
 	{
-		item->next = pre_allocated_memory;
-		pre_allocated_memory = item;
+		item->next = dirty_memory;
+		dirty_memory = item;
+		dirty_memory_size_current += PAGE_SIZE;
 		pre_allocated_memory_size_current += PAGE_SIZE;
 		spin_unlock_irqrestore(&allocation_list_spinlock,flags);
+		schedule_work(&mali_mem_clear_work);
 		return;
 	}
 	spin_unlock_irqrestore(&allocation_list_spinlock,flags);
@@ -266,6 +508,34 @@ static void _allocation_list_item_release(AllocationList * item)
 	_mali_osk_free( item );
 }
 
+/* Sets up the page pool of the session a mapping belongs to */
+static void _session_page_pool_get(struct file *owner)
+{
+	mali_session_page_pool *pool;
+	unsigned long flags;
+
+	if (NULL == owner) return;
+
+	spin_lock_irqsave(&allocation_list_spinlock, flags);
+	pool = _session_page_pool_find(owner);
+	spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+	if (NULL != pool) return;
+
+	pool = _mali_osk_calloc(1, sizeof(mali_session_page_pool));
+	if (NULL == pool) return; /* The session just won't have a pool */
+	pool->owner = owner;
+
+	spin_lock_irqsave(&allocation_list_spinlock, flags);
+	if (NULL == _session_page_pool_find(owner))
+	{
+		list_add(&pool->list, &session_page_pools);
+		pool = NULL;
+	}
+	spin_unlock_irqrestore(&allocation_list_spinlock, flags);
+
+	if (NULL != pool) _mali_osk_free(pool);
+}
+
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
 static int mali_kernel_memory_cpu_page_fault_handler(struct vm_area_struct *vma, struct vm_fault *vmf)
@@ -457,7 +727,9 @@ _mali_osk_errcode_t _mali_osk_mem_mapregion_init( mali_memory_allocation * descr
 	}
 
 	mappingInfo->vma = vma;
+	mappingInfo->owner = vma->vm_file;
 	descriptor->process_addr_mapping_info = mappingInfo;
+	_session_page_pool_get(mappingInfo->owner);
 
 	/* Do the va range allocation - in this case, it was done earlier, so we copy in that information */
 	descriptor->mapping = (void __user*)vma->vm_start;
@@ -556,7 +828,7 @@ _mali_osk_errcode_t _mali_osk_mem_mapregion_map( mali_memory_allocation * descri
 		AllocationList *alloc_item;
 		u32 linux_phys_frame_num;
 
-		alloc_item = _allocation_list_item_get();
+		alloc_item = _allocation_list_item_get(mappingInfo->owner);
 		if (NULL == alloc_item)
 		{
 			MALI_DEBUG_PRINT(1, ("Failed to allocate list item\n"));
@@ -570,7 +842,7 @@ _mali_osk_errcode_t _mali_osk_mem_mapregion_map( mali_memory_allocation * descri
 		if ( ret != _MALI_OSK_ERR_OK)
 		{
 			MALI_PRINT_ERROR(("%s %d could not remap_pfn_range()\n", __FUNCTION__, __LINE__));
-			_allocation_list_item_release(alloc_item);
+			_allocation_list_item_release(alloc_item, mappingInfo->owner);
 			return ret;
 		}
 
@@ -651,7 +923,7 @@ void _mali_osk_mem_mapregion_unmap( mali_memory_allocation * descriptor, u32 off
 			}
 
 			*prev = alloc->next;
-			_allocation_list_item_release(alloc);
+			_allocation_list_item_release(alloc, mappingInfo->owner);
 
 			/* Move onto the next allocation */
 			size -= _MALI_OSK_CPU_PAGE_SIZE;
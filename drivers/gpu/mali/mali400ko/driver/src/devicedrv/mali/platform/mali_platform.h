@@ -66,6 +66,15 @@ _mali_osk_errcode_t mali_platform_power_mode_change(mali_power_mode power_mode);
  */
 void mali_gpu_utilization_handler(u32 utilization);
 
+/** @brief Platform specific handling of vsync events
+ *
+ * Called when a process has finished waiting for vsync, that is once per
+ * displayed frame of that process.
+ *
+ * @param time_now The time of the vsync, in ns
+ */
+void mali_gpu_vsync_handler(u64 time_now);
+
 /** @brief Setting the power domain of MALI
  *
  * This function sets the power domain of MALI if Linux run time power management is enabled
@@ -22,6 +22,12 @@
 #include <linux/io.h>
 #include <linux/workqueue.h>
 #include <linux/version.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
 
 #if CONFIG_HAS_WAKELOCK
 #include <linux/wakelock.h>
@@ -33,11 +39,61 @@
 #include <linux/mfd/dbx500-prcmu.h>
 #endif
 
-#define MALI_HIGH_TO_LOW_LEVEL_UTILIZATION_LIMIT 64
-#define MALI_LOW_TO_HIGH_LEVEL_UTILIZATION_LIMIT 192
+#ifdef CONFIG_MALI400_GPU_UTILIZATION
+#include "mali_kernel_utilization.h"
+#endif
+
+/*
+ * The GPU performance levels, from the slowest to the fastest. The Mali clock
+ * follows the APE OPP, and the DDR OPP limits how fast it can fetch. The
+ * capacity is the estimated throughput of a level in percent of the fastest
+ * one and is used to predict the utilization after a level change.
+ */
+struct mali_dvfs_level {
+	const char *name;
+	s32 ape_opp;
+	s32 ddr_opp;
+	u32 capacity;
+};
+
+static const struct mali_dvfs_level mali_dvfs_levels[] = {
+	{ "ape50_ddr25", 50, 25, 40 },
+	{ "ape50_ddr50", 50, 50, 50 },
+	{ "ape100_ddr50", 100, 50, 80 },
+	{ "ape100_ddr100", 100, 100, 100 },
+};
+
+#define MALI_DVFS_NUM_LEVELS ARRAY_SIZE(mali_dvfs_levels)
+
+/* Utilization, in parts of 256, above which a faster level is requested */
+static int mali_dvfs_up_threshold = 192;
+module_param(mali_dvfs_up_threshold, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(mali_dvfs_up_threshold, "Mali DVFS utilization to go to a faster level");
+
+/* Predicted utilization on the slower level below which it is requested */
+static int mali_dvfs_down_threshold = 144;
+module_param(mali_dvfs_down_threshold, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(mali_dvfs_down_threshold, "Mali DVFS predicted utilization to go to a slower level");
+
+/* Number of utilization samples in a row needed to change level */
+static int mali_dvfs_up_samples = 1;
+module_param(mali_dvfs_up_samples, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(mali_dvfs_up_samples, "Mali DVFS sampling periods before going to a faster level");
+
+static int mali_dvfs_down_samples = 3;
+module_param(mali_dvfs_down_samples, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(mali_dvfs_down_samples, "Mali DVFS sampling periods before going to a slower level");
+
+/*
+ * Part of the frame, in percent, that the GPU has been idle when vsync comes
+ * for the frames to be considered on time with margin
+ */
+static int mali_dvfs_slack_percent = 25;
+module_param(mali_dvfs_slack_percent, int, S_IRUSR | S_IWUSR | S_IWGRP | S_IRGRP | S_IROTH);
+MODULE_PARM_DESC(mali_dvfs_slack_percent, "Mali DVFS frame time left at vsync to allow a slower level");
 
-int mali_utilization_high_to_low = MALI_HIGH_TO_LOW_LEVEL_UTILIZATION_LIMIT;
-int mali_utilization_low_to_high = MALI_LOW_TO_HIGH_LEVEL_UTILIZATION_LIMIT;
+/* Longer frames are pauses in rendering and not part of the frame feedback */
+#define MALI_DVFS_MAX_FRAME_NS (100 * NSEC_PER_MSEC)
 
 static bool is_running;
 static bool is_initialized;
@@ -47,6 +103,31 @@ static u32 last_utilization;
 static struct work_struct mali_utilization_work;
 static struct workqueue_struct *mali_utilization_workqueue;
 
+/* Frame feedback, collected by the vsync handler */
+static DEFINE_SPINLOCK(mali_frame_lock);
+static u64 last_vsync_time;
+static u32 frame_count;
+static u64 frame_time_sum;
+static u64 frame_slack_sum;
+/* Frame feedback of the last utilization period */
+static u32 last_frame_count;
+static u64 last_frame_time_sum;
+static u64 last_frame_slack_sum;
+
+/* Governor state, only touched by the utilization work */
+static unsigned int mali_dvfs_level;
+static int mali_dvfs_up_votes;
+static int mali_dvfs_down_votes;
+
+/* Statistics, in the style of cpufreq_stats */
+static DEFINE_SPINLOCK(mali_dvfs_stats_lock);
+static u64 mali_dvfs_time_in_state[MALI_DVFS_NUM_LEVELS];
+static u64 mali_dvfs_last_time;
+static unsigned int mali_dvfs_stats_level;
+static u32 mali_dvfs_total_trans;
+static u32 mali_dvfs_trans_table[MALI_DVFS_NUM_LEVELS][MALI_DVFS_NUM_LEVELS];
+static struct kobject *mali_dvfs_kobject;
+
 #if CONFIG_HAS_WAKELOCK
 static struct wake_lock wakelock;
 #endif
@@ -101,63 +182,210 @@ error:
 	MALI_ERROR(_MALI_OSK_ERR_FAULT);
 }
 
-/* Rationale behind the values for:
-* MALI_HIGH_LEVEL_UTILIZATION_LIMIT and MALI_LOW_LEVEL_UTILIZATION_LIMIT
-* When operating at half clock frequency a faster clock is requested when
-* reaching 75% utilization. When operating at full clock frequency a slower
-* clock is requested when reaching 25% utilization. There is a margin of 25%
-* at the high range of the slow clock to avoid complete saturation of the
-* hardware and there is some overlap to avoid an oscillating situation where
-* the clock goes back and forth from high to low.
+/* Adds the time since the last update to the current level. Call with mali_dvfs_stats_lock held. */
+static void mali_dvfs_stats_account(void)
+{
+	u64 now = get_jiffies_64();
+
+	mali_dvfs_time_in_state[mali_dvfs_stats_level] += now - mali_dvfs_last_time;
+	mali_dvfs_last_time = now;
+}
+
+static void mali_dvfs_stats_update(unsigned int level)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&mali_dvfs_stats_lock, flags);
+	mali_dvfs_stats_account();
+	if (level != mali_dvfs_stats_level) {
+		mali_dvfs_trans_table[mali_dvfs_stats_level][level]++;
+		mali_dvfs_total_trans++;
+		mali_dvfs_stats_level = level;
+	}
+	spin_unlock_irqrestore(&mali_dvfs_stats_lock, flags);
+}
+
+/*
+ * The slowest level is the platform default, 50% APE OPP and 25% DDR OPP,
+ * and holds no requirements.
+ */
+static int mali_dvfs_set_level(unsigned int level)
+{
+	const struct mali_dvfs_level *cur = &mali_dvfs_levels[mali_dvfs_level];
+	const struct mali_dvfs_level *new = &mali_dvfs_levels[level];
+
+	if (level == mali_dvfs_level)
+		return 0;
+
+	if (0 == level) {
+		prcmu_qos_remove_requirement(PRCMU_QOS_APE_OPP, "mali");
+		prcmu_qos_remove_requirement(PRCMU_QOS_DDR_OPP, "mali");
+	} else if (0 == mali_dvfs_level) {
+		if (prcmu_qos_add_requirement(PRCMU_QOS_APE_OPP, "mali", new->ape_opp)) {
+			MALI_DEBUG_PRINT(2, ("MALI %d%% APE_OPP failed\n", new->ape_opp));
+			return -EINVAL;
+		}
+		if (prcmu_qos_add_requirement(PRCMU_QOS_DDR_OPP, "mali", new->ddr_opp)) {
+			prcmu_qos_remove_requirement(PRCMU_QOS_APE_OPP, "mali");
+			MALI_DEBUG_PRINT(2, ("MALI %d%% DDR_OPP failed\n", new->ddr_opp));
+			return -EINVAL;
+		}
+	} else {
+		if (new->ape_opp != cur->ape_opp)
+			prcmu_qos_update_requirement(PRCMU_QOS_APE_OPP, "mali", new->ape_opp);
+		if (new->ddr_opp != cur->ddr_opp)
+			prcmu_qos_update_requirement(PRCMU_QOS_DDR_OPP, "mali", new->ddr_opp);
+	}
+
+	MALI_DEBUG_PRINT(5, ("MALI GPU level %s -> %s\n", cur->name, new->name));
+	mali_dvfs_level = level;
+	mali_dvfs_stats_update(level);
+	return 0;
+}
+
+/* Utilization the current load would give on another level */
+static u32 mali_dvfs_predict(u32 utilization, unsigned int level)
+{
+	return utilization * mali_dvfs_levels[mali_dvfs_level].capacity /
+		mali_dvfs_levels[level].capacity;
+}
+
+/*
+* The governor steps up when the utilization on the current level is above
+* mali_dvfs_up_threshold, to the slowest level where the utilization is
+* predicted to fall below it again. It steps down one level when the
+* utilization predicted on that level is below mali_dvfs_down_threshold. The
+* gap between the two thresholds keeps the governor from going back and forth
+* between two levels, and a change has to be asked for by
+* mali_dvfs_up_samples or mali_dvfs_down_samples periods in a row.
 *
-* Utilization on full speed clock
-* 0               64             128             192              255
-* |---------------|---------------|---------------|---------------|
-*                 XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX
-*                 |       ^
-*                 V       |
-* XXXXXXXXXXXXXXXXXXXXXXXXX
-* 0       64     128     192      255
-* |-------|-------|-------|-------|
-* Utilization on half speed clock
+* The utilization alone does not tell if a busy GPU keeps up with the display.
+* The vsync handler records how long before each vsync the GPU became idle.
+* When the GPU has been done with mali_dvfs_slack_percent of the frame left,
+* the frames are on time: a faster level is not requested, and a slower one is
+* accepted as long as the predicted utilization stays below the up threshold.
 */
 void mali_utilization_function(struct work_struct *ptr)
 {
-	/*By default, platform start with 50% APE OPP and 25% DDR OPP*/
-	static u32 has_requested_low = 1;
+	u32 utilization = last_utilization;
+	unsigned int level = mali_dvfs_level;
+	unsigned long flags;
+	bool on_time = false;
+	u32 frames;
+	u64 frame_time;
+	u64 slack;
 
-	if (last_utilization > mali_utilization_low_to_high) {
-		if (has_requested_low) {
-			MALI_DEBUG_PRINT(5, ("MALI GPU utilization: %u SIGNAL_HIGH\n", last_utilization));
-			/*Request 100% APE_OPP.*/
-			if (prcmu_qos_add_requirement(PRCMU_QOS_APE_OPP, "mali", 100)) {
-				MALI_DEBUG_PRINT(2, ("MALI 100% APE_OPP failed\n"));
-				return;
-			}
-			/*
-			* Since the utilization values will be reported higher
-			* if DDR_OPP is lowered, we also request 100% DDR_OPP.
-			*/
-			if (prcmu_qos_add_requirement(PRCMU_QOS_DDR_OPP, "mali", 100)) {
-				MALI_DEBUG_PRINT(2, ("MALI 100% DDR_OPP failed\n"));
-				return;
-			}
-			has_requested_low = 0;
+	spin_lock_irqsave(&mali_frame_lock, flags);
+	frames = last_frame_count;
+	frame_time = last_frame_time_sum;
+	slack = last_frame_slack_sum;
+	spin_unlock_irqrestore(&mali_frame_lock, flags);
+
+	if (frames && slack * 100 >= frame_time * mali_dvfs_slack_percent)
+		on_time = true;
+
+	if (0 == utilization) {
+		/* The GPU went idle, there will be no more samples until it is used again */
+		mali_dvfs_up_votes = 0;
+		mali_dvfs_down_votes = 0;
+		mali_dvfs_set_level(0);
+		MALI_DEBUG_PRINT(5, ("MALI GPU utilization: idle\n"));
+		return;
+	}
+
+	if (utilization > mali_dvfs_up_threshold && !on_time &&
+			mali_dvfs_level < MALI_DVFS_NUM_LEVELS - 1) {
+		mali_dvfs_down_votes = 0;
+		if (++mali_dvfs_up_votes >= mali_dvfs_up_samples) {
+			for (level = mali_dvfs_level + 1; level < MALI_DVFS_NUM_LEVELS - 1; level++)
+				if (mali_dvfs_predict(utilization, level) <= mali_dvfs_up_threshold)
+					break;
 		}
+	} else if (mali_dvfs_level > 0 &&
+			(mali_dvfs_predict(utilization, mali_dvfs_level - 1) < mali_dvfs_down_threshold ||
+			(on_time && mali_dvfs_predict(utilization, mali_dvfs_level - 1) <= mali_dvfs_up_threshold))) {
+		mali_dvfs_up_votes = 0;
+		if (++mali_dvfs_down_votes >= mali_dvfs_down_samples)
+			level = mali_dvfs_level - 1;
 	} else {
-		if (last_utilization < mali_utilization_high_to_low) {
-			if (!has_requested_low) {
-				/*Remove APE_OPP and DDR_OPP requests*/
-				prcmu_qos_remove_requirement(PRCMU_QOS_APE_OPP, "mali");
-				prcmu_qos_remove_requirement(PRCMU_QOS_DDR_OPP, "mali");
-				MALI_DEBUG_PRINT(5, ("MALI GPU utilization: %u SIGNAL_LOW\n", last_utilization));
-				has_requested_low = 1;
-			}
-		}
+		mali_dvfs_up_votes = 0;
+		mali_dvfs_down_votes = 0;
+	}
+
+	if (level != mali_dvfs_level && 0 == mali_dvfs_set_level(level)) {
+		mali_dvfs_up_votes = 0;
+		mali_dvfs_down_votes = 0;
+	}
+
+	MALI_DEBUG_PRINT(5, ("MALI GPU utilization: %u frames: %u slack: %llu/%llu level: %s\n",
+			utilization, frames, slack, frame_time, mali_dvfs_levels[mali_dvfs_level].name));
+}
+
+static ssize_t time_in_state_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	u64 time_in_state[MALI_DVFS_NUM_LEVELS];
+	unsigned long flags;
+	ssize_t len = 0;
+	unsigned int i;
+
+	spin_lock_irqsave(&mali_dvfs_stats_lock, flags);
+	mali_dvfs_stats_account();
+	memcpy(time_in_state, mali_dvfs_time_in_state, sizeof(time_in_state));
+	spin_unlock_irqrestore(&mali_dvfs_stats_lock, flags);
+
+	for (i = 0; i < MALI_DVFS_NUM_LEVELS; i++)
+		len += sprintf(buf + len, "%s %llu\n", mali_dvfs_levels[i].name,
+				(unsigned long long)jiffies_64_to_clock_t(time_in_state[i]));
+	return len;
+}
+
+static ssize_t total_trans_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", mali_dvfs_total_trans);
+}
+
+static ssize_t trans_table_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	ssize_t len = 0;
+	unsigned int i, j;
+
+	len += snprintf(buf + len, PAGE_SIZE - len, "   From  :    To\n");
+	len += snprintf(buf + len, PAGE_SIZE - len, "         : ");
+	for (i = 0; i < MALI_DVFS_NUM_LEVELS; i++)
+		len += snprintf(buf + len, PAGE_SIZE - len, "%14s ", mali_dvfs_levels[i].name);
+	len += snprintf(buf + len, PAGE_SIZE - len, "\n");
+
+	for (i = 0; i < MALI_DVFS_NUM_LEVELS; i++) {
+		len += snprintf(buf + len, PAGE_SIZE - len, "%14s: ", mali_dvfs_levels[i].name);
+		for (j = 0; j < MALI_DVFS_NUM_LEVELS; j++)
+			len += snprintf(buf + len, PAGE_SIZE - len, "%14u ", mali_dvfs_trans_table[i][j]);
+		len += snprintf(buf + len, PAGE_SIZE - len, "\n");
 	}
-	MALI_DEBUG_PRINT(5, ("MALI GPU utilization: %u\n", last_utilization));
+	return len;
+}
+
+static ssize_t cur_level_show(struct kobject *kobj, struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n", mali_dvfs_levels[mali_dvfs_stats_level].name);
 }
 
+static struct kobj_attribute time_in_state_attr = __ATTR_RO(time_in_state);
+static struct kobj_attribute total_trans_attr = __ATTR_RO(total_trans);
+static struct kobj_attribute trans_table_attr = __ATTR_RO(trans_table);
+static struct kobj_attribute cur_level_attr = __ATTR_RO(cur_level);
+
+static struct attribute *mali_dvfs_attrs[] = {
+	&time_in_state_attr.attr,
+	&total_trans_attr.attr,
+	&trans_table_attr.attr,
+	&cur_level_attr.attr,
+	NULL,
+};
+
+static struct attribute_group mali_dvfs_attr_group = {
+	.attrs = mali_dvfs_attrs,
+};
+
 _mali_osk_errcode_t mali_platform_init()
 {
 	is_running = false;
@@ -188,6 +416,20 @@ _mali_osk_errcode_t mali_platform_init()
 #if CONFIG_HAS_WAKELOCK
 		wake_lock_init(&wakelock, WAKE_LOCK_SUSPEND, "mali_wakelock");
 #endif
+		mali_dvfs_level = 0;
+		mali_dvfs_stats_level = 0;
+		mali_dvfs_last_time = get_jiffies_64();
+
+		/* The governor works without the statistics */
+		mali_dvfs_kobject = kobject_create_and_add("mali_dvfs", kernel_kobj);
+		if (mali_dvfs_kobject &&
+				sysfs_create_group(mali_dvfs_kobject, &mali_dvfs_attr_group)) {
+			kobject_put(mali_dvfs_kobject);
+			mali_dvfs_kobject = NULL;
+		}
+		if (!mali_dvfs_kobject)
+			MALI_DEBUG_PRINT(2, ("%s: Failed to register sysfs %s\n", __func__, "mali_dvfs"));
+
 		is_initialized = true;
 	}
 
@@ -200,6 +442,12 @@ error:
 _mali_osk_errcode_t mali_platform_deinit()
 {
 	destroy_workqueue(mali_utilization_workqueue);
+	mali_dvfs_set_level(0);
+	if (mali_dvfs_kobject) {
+		sysfs_remove_group(mali_dvfs_kobject, &mali_dvfs_attr_group);
+		kobject_put(mali_dvfs_kobject);
+		mali_dvfs_kobject = NULL;
+	}
 	regulator_put(regulator);
 	clk_put(clk_sga);
 
@@ -224,6 +472,18 @@ _mali_osk_errcode_t mali_platform_power_mode_change(mali_power_mode power_mode)
 
 void mali_gpu_utilization_handler(u32 utilization)
 {
+	unsigned long flags;
+
+	/* Hand the frame feedback of this period to the governor */
+	spin_lock_irqsave(&mali_frame_lock, flags);
+	last_frame_count = frame_count;
+	last_frame_time_sum = frame_time_sum;
+	last_frame_slack_sum = frame_slack_sum;
+	frame_count = 0;
+	frame_time_sum = 0;
+	frame_slack_sum = 0;
+	spin_unlock_irqrestore(&mali_frame_lock, flags);
+
 	last_utilization = utilization;
 	/*
 	* We should not cancel the potentially not yet run old work
@@ -236,6 +496,32 @@ void mali_gpu_utilization_handler(u32 utilization)
 	queue_work(mali_utilization_workqueue, &mali_utilization_work);
 }
 
+void mali_gpu_vsync_handler(u64 time_now)
+{
+#ifdef CONFIG_MALI400_GPU_UTILIZATION
+	u64 idle_since = mali_utilization_idle_since();
+	unsigned long flags;
+	u64 frame;
+	u64 slack;
+
+	spin_lock_irqsave(&mali_frame_lock, flags);
+	frame = time_now - last_vsync_time;
+	if (last_vsync_time && time_now > last_vsync_time &&
+			frame < MALI_DVFS_MAX_FRAME_NS) {
+		/* How long before the vsync the GPU was done with the frame */
+		slack = 0;
+		if (idle_since && idle_since < time_now)
+			slack = min(time_now - idle_since, frame);
+
+		frame_count++;
+		frame_time_sum += frame;
+		frame_slack_sum += slack;
+	}
+	last_vsync_time = time_now;
+	spin_unlock_irqrestore(&mali_frame_lock, flags);
+#endif
+}
+
 void set_mali_parent_power_domain(void *dev)
 {
 	MALI_DEBUG_PRINT(2, ("This function should not be called since we are not using run time pm\n"));
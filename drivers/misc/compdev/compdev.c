@@ -26,12 +26,17 @@
 #include <linux/sched.h>
 #include <linux/compdev.h>
 #include <linux/compdev_util.h>
+#include <linux/compdev_planner.h>
 #include <linux/hwmem.h>
+#include <linux/dma-buf.h>
 #include <linux/mm.h>
 #include <linux/workqueue.h>
 #include <linux/completion.h>
 #include <linux/kref.h>
 #include <linux/kobject.h>
+#include <linux/poll.h>
+#include <linux/math64.h>
+#include <linux/ktime.h>
 #ifdef CONFIG_HAS_EARLYSUSPEND
 #include <linux/earlysuspend.h>
 #endif
@@ -66,6 +71,15 @@ struct compdev_display_work {
 	enum compdev_transform  mcde_transform;
 };
 
+struct compdev_flip_work {
+	struct mcde_dss_flip flip;
+	struct dss_context *dss_ctx;
+	struct compdev_img img;
+	struct hwmem_alloc *img_alloc;
+	struct mcde_rectangle damage;
+	enum compdev_transform mcde_transform;
+};
+
 struct dss_context {
 	struct device *dev;
 	struct mcde_display_device *ddev;
@@ -109,6 +123,8 @@ struct compdev {
 	struct compdev_img fb_image;
 	struct hwmem_alloc *fb_image_alloc;
 	bool blanked;
+	struct compdev_rect damage;
+	struct compdev_planner planner;
 };
 
 static struct compdev *compdevs[MAX_NBR_OF_COMPDEVS];
@@ -261,6 +277,7 @@ static int compdev_release(struct inode *inode, struct file *file)
 	if (&cd->list == &dev_list)
 		return -ENODEV;
 
+	mcde_dss_flush_flips(cd->dss_ctx.ddev);
 	for (i = 0; i < NUM_COMPDEV_BUFS; i++)
 		disable_overlay(cd->dss_ctx.ovly[i]);
 
@@ -509,7 +526,8 @@ static int release_prev_frame(struct dss_context *dss_ctx)
 static int compdev_blt(struct compdev *cd,
 		int blt_handle,
 		struct compdev_img *src_img,
-		struct compdev_img *dst_img)
+		struct compdev_img *dst_img,
+		s64 deadline)
 {
 
 	struct b2r2_blt_req req;
@@ -585,7 +603,7 @@ static int compdev_blt(struct compdev *cd,
 	dev_dbg(cd->dev, "%s: img_trans 0x%02x, mcde_trans %d\n",
 		__func__, src_img->transform, cd->mcde_transform);
 
-	req_id = b2r2_blt_request(blt_handle, &req);
+	req_id = b2r2_blt_request_deadline(blt_handle, &req, deadline);
 	if (req_id < 0) {
 		dev_err(cd->dev,
 			"%s: Failed b2r2_blt_request (%d), blt_handle %d\n",
@@ -597,7 +615,8 @@ static int compdev_blt(struct compdev *cd,
 
 static int compdev_post_buffers_dss(struct dss_context *dss_ctx,
 		struct compdev_img *img1, struct compdev_img *img2,
-		bool tripple_buffer, enum compdev_transform mcde_transform)
+		bool tripple_buffer, enum compdev_transform mcde_transform,
+		struct mcde_rectangle *damage)
 {
 	int ret = 0;
 	int i = 0;
@@ -613,6 +632,8 @@ static int compdev_post_buffers_dss(struct dss_context *dss_ctx,
 
 	/* Set channel rotation */
 	if ((curr_rot != img_rot)) {
+		/* The whole display changes with the rotation */
+		damage = NULL;
 		if (compdev_update_rotation(dss_ctx,
 				to_mcde_rotation(img_rot)) == 0)
 			dss_ctx->current_buffer_transform = mcde_transform;
@@ -678,8 +699,8 @@ static int compdev_post_buffers_dss(struct dss_context *dss_ctx,
 	/* Do the display update */
 	for (i = 0; i < 2; i++) {
 		if (update_ovly[i]) {
-			mcde_dss_update_overlay(dss_ctx->ovly[i],
-					tripple_buffer);
+			mcde_dss_update_overlay_area(dss_ctx->ovly[i],
+					tripple_buffer, damage);
 			break;
 		}
 	}
@@ -706,11 +727,11 @@ static void compdev_display_worker_function(struct work_struct *w)
 	if (dw->img_count == 1)
 		compdev_post_buffers_dss(dw->dss_ctx,
 				&dw->img1, NULL, false,
-				dw->mcde_transform);
+				dw->mcde_transform, NULL);
 	else if (dw->img_count == 2)
 		compdev_post_buffers_dss(dw->dss_ctx,
 				&dw->img1, &dw->img2, false,
-				dw->mcde_transform);
+				dw->mcde_transform, NULL);
 
 	if (dw->img1_alloc != NULL) {
 		hwmem_release(dw->img1_alloc);
@@ -768,6 +789,8 @@ int compdev_add_display_work(struct compdev *cd,
 
 	dw->dss_ctx = dss_ctx;
 	dw->mcde_transform = cd->mcde_transform;
+	/* Asynchronous frames always update the whole display */
+	memset(&cd->damage, 0, sizeof(cd->damage));
 	queue_work(cd->display_worker_thread, &dw->work);
 
 	return 0;
@@ -891,6 +914,56 @@ static int compdev_reuse_fb(struct compdev *cd, struct compdev_img **image1,
 	return 0;
 }
 
+/*
+ * The damage is given in display coordinates, which only match the
+ * channel without MCDE rotation. A zero sized area means the whole display.
+ */
+static void get_damage(struct compdev *cd, struct compdev_rect *rect,
+		struct mcde_rectangle *damage)
+{
+	damage->x = rect->x;
+	damage->y = rect->y;
+	damage->w = rect->width;
+	damage->h = rect->height;
+	if (cd->mcde_transform != COMPDEV_TRANSFORM_ROT_0 ||
+			rect->x < 0 || rect->y < 0 || !rect->height)
+		damage->w = 0;
+}
+
+/*
+ * Rate at which MCDE fetches the overlays without new posts,
+ * 0 if the display is only updated when something is posted
+ */
+static u32 compdev_refresh_rate(struct compdev *cd)
+{
+	struct mcde_display_device *ddev = cd->dss_ctx.ddev;
+	struct mcde_video_mode *vmode = &ddev->video_mode;
+	u64 frame_ps;
+
+	if (!ddev->port->update_auto_trig)
+		return 0;
+
+	frame_ps = (u64)vmode->pixclock *
+		(vmode->xres + vmode->hbp + vmode->hfp + vmode->hsw) *
+		(vmode->yres + vmode->vbp + vmode->vfp + vmode->vsw);
+	if (!frame_ps)
+		return 60;
+
+	return div64_u64(1000000000000ULL, frame_ps) ?: 1;
+}
+
+/*
+ * Composition blits feed the next display update, so B2R2 is asked to
+ * finish them within one frame. Displays that are only updated on posts
+ * get the frame time of 60 Hz.
+ */
+static s64 compdev_blt_deadline(struct compdev *cd)
+{
+	u32 rate = compdev_refresh_rate(cd) ?: 60;
+
+	return ktime_to_ns(ktime_get()) + div_u64(NSEC_PER_SEC, rate);
+}
+
 static int compdev_post_buffer_locked(struct compdev *cd,
 		struct compdev_img *src_img)
 {
@@ -902,6 +975,9 @@ static int compdev_post_buffer_locked(struct compdev *cd,
 
 	dev_dbg(cd->dev, "%s\n", __func__);
 
+	/* Queued flips use the same overlays */
+	mcde_dss_flush_flips(cd->dss_ctx.ddev);
+
 	/* Check for bypass images */
 	if (src_img->flags & COMPDEV_BYPASS_FLAG)
 		bypass_case = true;
@@ -916,11 +992,18 @@ static int compdev_post_buffer_locked(struct compdev *cd,
 	update_transform(cd, src_img);
 
 	if (!bypass_case) {
-		if (transform_needed(src_img, cd->mcde_transform)) {
+		enum compdev_plan_path path;
+		enum compdev_fmt fmt;
+
+		path = compdev_plan_layer(&cd->planner, cd->image_count,
+				src_img, cd->mcde_transform,
+				transform_needed(src_img, cd->mcde_transform),
+				compdev_refresh_rate(cd), &fmt);
+
+		if (path != COMPDEV_PLAN_OVERLAY) {
 			u16 width = 0;
 			u16 height = 0;
 			bool protected = false;
-			enum compdev_fmt fmt;
 
 			if (cd->dss_ctx.blt_handle < 0) {
 				dev_dbg(cd->dev, "%s: Opening B2R2\n",
@@ -942,10 +1025,6 @@ static int compdev_post_buffer_locked(struct compdev *cd,
 				height = src_img->dst_rect.height;
 			}
 
-			fmt = find_compatible_fmt(src_img->fmt,
-					src_img->transform &
-					COMPDEV_TRANSFORM_ROT_90_CW);
-
 			if (src_img->flags & COMPDEV_PROTECTED_FLAG)
 				protected = true;
 
@@ -974,7 +1053,8 @@ static int compdev_post_buffer_locked(struct compdev *cd,
 
 				b2r2_req_id = compdev_blt(cd,
 						cd->dss_ctx.blt_handle,
-						src_img, resulting_img);
+						src_img, resulting_img,
+						compdev_blt_deadline(cd));
 
 				if (cd->dss_ctx.blt_handle >= 0 &&
 						b2r2_req_id >= 0) {
@@ -1018,6 +1098,7 @@ static int compdev_post_buffer_locked(struct compdev *cd,
 			struct compdev_img *img[2] = {NULL, NULL};
 			int i;
 			struct compdev_img_internal *tmp_handle;
+			struct mcde_rectangle damage;
 
 			/* Unblank if blanked */
 			if (cd->blanked)
@@ -1032,10 +1113,14 @@ static int compdev_post_buffer_locked(struct compdev *cd,
 
 			compdev_reuse_fb(cd, &img[0], &img[1]);
 
+			get_damage(cd, &cd->damage, &damage);
+			memset(&cd->damage, 0, sizeof(cd->damage));
+
 			/* Do the refresh */
 			compdev_post_buffers_dss(&cd->dss_ctx,
 					img[0], img[1],
-					true, cd->mcde_transform);
+					true, cd->mcde_transform,
+					damage.w ? &damage : NULL);
 
 			/*
 			 * Free references to the temp buffers,
@@ -1084,6 +1169,8 @@ static int compdev_post_single_buffer_asynch_locked(struct compdev *cd,
 {
 	dev_dbg(cd->dev, "%s\n", __func__);
 
+	mcde_dss_flush_flips(cd->dss_ctx.ddev);
+
 	/* Add asynch work for b2r2 synch and dss */
 	if (cd->display_work != NULL) {
 		flush_work_sync(&cd->display_work->work);
@@ -1106,6 +1193,80 @@ static int compdev_post_single_buffer_asynch_locked(struct compdev *cd,
 	return 0;
 }
 
+static int compdev_flip_post(struct mcde_dss_flip *flip)
+{
+	struct compdev_flip_work *fw =
+		container_of(flip, struct compdev_flip_work, flip);
+
+	return compdev_post_buffers_dss(fw->dss_ctx, &fw->img, NULL, false,
+			fw->mcde_transform, fw->damage.w ? &fw->damage : NULL);
+}
+
+static void compdev_flip_release(struct mcde_dss_flip *flip)
+{
+	struct compdev_flip_work *fw =
+		container_of(flip, struct compdev_flip_work, flip);
+
+	if (fw->img_alloc != NULL)
+		hwmem_release(fw->img_alloc);
+	kfree(fw);
+}
+
+static int compdev_queue_flip_locked(struct compdev *cd,
+		struct compdev_flip *req)
+{
+	struct compdev_img *img = &req->img;
+	struct compdev_img mcde_img = *img;
+	struct compdev_flip_work *fw;
+	int ret;
+
+	dev_dbg(cd->dev, "%s\n", __func__);
+
+	/* Only images MCDE can show as they are, B2R2 work is synchronous */
+	if (img->flags & COMPDEV_BYPASS_FLAG)
+		return -EINVAL;
+	update_transform(cd, &mcde_img);
+	if (transform_needed(&mcde_img, cd->mcde_transform))
+		return -EINVAL;
+
+	if (cd->pb_cb != NULL)
+		cd->pb_cb(cd->cb_data, img);
+
+	fw = kzalloc(sizeof(*fw), GFP_KERNEL);
+	if (fw == NULL)
+		return -ENOMEM;
+
+	if (img->buf.type == COMPDEV_PTR_HWMEM_BUF_NAME_OFFSET) {
+		/* Hog the buffer until the flip is out */
+		fw->img_alloc = hwmem_resolve_by_name(img->buf.hwmem_buf_name);
+		if (IS_ERR_OR_NULL(fw->img_alloc)) {
+			dev_warn(cd->dev, "%s: HWMEM resolve failed\n",
+								__func__);
+			kfree(fw);
+			return -EINVAL;
+		}
+	}
+
+	fw->img = mcde_img;
+	fw->dss_ctx = &cd->dss_ctx;
+	fw->mcde_transform = cd->mcde_transform;
+	get_damage(cd, &req->damage, &fw->damage);
+	fw->flip.post = compdev_flip_post;
+	fw->flip.release = compdev_flip_release;
+
+	if (cd->display_work != NULL)
+		flush_work_sync(&cd->display_work->work);
+
+	if (cd->blanked)
+		cd->blanked = false;
+
+	ret = mcde_dss_queue_flip(cd->dss_ctx.ddev, &fw->flip, &req->seq);
+	if (ret)
+		compdev_flip_release(&fw->flip);
+
+	return ret;
+}
+
 static int compdev_post_scene_info_locked(struct compdev *cd,
 				struct compdev_scene_info *s_info)
 {
@@ -1218,6 +1379,97 @@ static int compdev_wait_for_vsync_unlocked(s64 *timestamp)
 	return ret;
 }
 
+/**
+ * struct compdev_dma_buf_ref - A dma-buf image resolved for one ioctl
+ *
+ * @alloc: The hwmem allocation behind the dma-buf, NULL if the image was
+ *         not a dma-buf
+ * @access: Access the caller had to @alloc before the ioctl
+ * @restore_access: True if @access has to be restored when done
+ */
+struct compdev_dma_buf_ref {
+	struct hwmem_alloc *alloc;
+	enum hwmem_access access;
+	bool restore_access;
+};
+
+static void compdev_put_dma_buf_img(struct compdev_dma_buf_ref *ref)
+{
+	if (ref->alloc == NULL)
+		return;
+
+	if (ref->restore_access)
+		(void)hwmem_set_access(ref->alloc, ref->access,
+				task_tgid_nr(current));
+	hwmem_release(ref->alloc);
+	ref->alloc = NULL;
+}
+
+/*
+ * Turns a dma-buf image into a hwmem image so that the rest of compdev only
+ * has to deal with hwmem names. MCDE has no MMU, so only hwmem exported
+ * dma-bufs, which are contiguous, can be put on an overlay. Must be called
+ * from the ioctl context as the fd belongs to the caller. The reference
+ * keeps the buffer alive until compdev_put_dma_buf_img().
+ *
+ * The overlay and blit paths resolve the name with the access of the
+ * caller, so the caller is given read access for the duration of the
+ * ioctl. compdev_put_dma_buf_img() takes it back so that passing the fd
+ * does not leave the process with lasting access to the name.
+ */
+static int compdev_get_dma_buf_img(struct compdev *cd,
+		struct compdev_img *img, struct compdev_dma_buf_ref *ref)
+{
+	const enum hwmem_access needed = HWMEM_ACCESS_READ |
+			HWMEM_ACCESS_IMPORT;
+	struct dma_buf *dmabuf;
+	s32 name;
+	int ret;
+
+	memset(ref, 0, sizeof(*ref));
+
+	if (img->buf.type != COMPDEV_PTR_DMA_BUF_FD_OFFSET)
+		return 0;
+
+	dmabuf = dma_buf_get(img->buf.fd);
+	if (IS_ERR(dmabuf)) {
+		dev_warn(cd->dev, "%s: dma_buf_get failed\n", __func__);
+		return PTR_ERR(dmabuf);
+	}
+
+	ref->alloc = hwmem_resolve_by_dma_buf(dmabuf);
+	dma_buf_put(dmabuf);
+	if (IS_ERR(ref->alloc)) {
+		dev_warn(cd->dev, "%s: Not a hwmem dma-buf\n", __func__);
+		ref->alloc = NULL;
+		return -EINVAL;
+	}
+
+	hwmem_get_info(ref->alloc, NULL, NULL, &ref->access);
+	if ((ref->access & needed) != needed) {
+		ret = hwmem_set_access(ref->alloc, ref->access | needed,
+				task_tgid_nr(current));
+		if (ret < 0)
+			goto error;
+		ref->restore_access = true;
+	}
+
+	name = hwmem_get_name(ref->alloc);
+	if (name < 0) {
+		ret = name;
+		goto error;
+	}
+
+	img->buf.type = COMPDEV_PTR_HWMEM_BUF_NAME_OFFSET;
+	img->buf.hwmem_buf_name = name;
+
+	return 0;
+
+error:
+	compdev_put_dma_buf_img(ref);
+	return ret;
+}
+
 static long compdev_ioctl(struct file *file,
 		unsigned int cmd,
 		unsigned long arg)
@@ -1261,6 +1513,9 @@ static long compdev_ioctl(struct file *file,
 		break;
 	}
 	case COMPDEV_POST_BUFFER_IOC:
+	{
+		struct compdev_dma_buf_ref dma_buf_ref;
+
 		mutex_lock(&cd->lock);
 		/* Get the user data */
 		if (copy_from_user(&img, (void *)arg, sizeof(img))) {
@@ -1270,9 +1525,13 @@ static long compdev_ioctl(struct file *file,
 			mutex_unlock(&cd->lock);
 			return -EFAULT;
 		}
-		ret = compdev_post_buffer_locked(cd, &img);
+		ret = compdev_get_dma_buf_img(cd, &img, &dma_buf_ref);
+		if (!ret)
+			ret = compdev_post_buffer_locked(cd, &img);
+		compdev_put_dma_buf_img(&dma_buf_ref);
 		mutex_unlock(&cd->lock);
 		break;
+	}
 	case COMPDEV_POST_SCENE_INFO_IOC:
 		mutex_lock(&cd->lock);
 		/* Get the user data */
@@ -1303,6 +1562,48 @@ static long compdev_ioctl(struct file *file,
 
 		mutex_unlock(&cd->lock);
 		break;
+	case COMPDEV_QUEUE_FLIP_IOC:
+	{
+		struct compdev_flip flip;
+		struct compdev_buf user_buf;
+		struct compdev_dma_buf_ref dma_buf_ref;
+
+		if (copy_from_user(&flip, (void *)arg, sizeof(flip))) {
+			dev_warn(cd->dev,
+				"%s: copy_from_user failed\n",
+				__func__);
+			return -EFAULT;
+		}
+		user_buf = flip.img.buf;
+		mutex_lock(&cd->lock);
+		ret = compdev_get_dma_buf_img(cd, &flip.img, &dma_buf_ref);
+		if (!ret)
+			ret = compdev_queue_flip_locked(cd, &flip);
+		compdev_put_dma_buf_img(&dma_buf_ref);
+		mutex_unlock(&cd->lock);
+		/* Only seq is for the caller */
+		flip.img.buf = user_buf;
+		if (!ret && copy_to_user((void __user *)arg, &flip,
+							sizeof(flip)))
+			ret = -EFAULT;
+		break;
+	}
+	case COMPDEV_POST_DAMAGE_IOC:
+	{
+		struct compdev_rect damage;
+
+		if (copy_from_user(&damage, (void *)arg, sizeof(damage))) {
+			dev_warn(cd->dev,
+				"%s: copy_from_user failed\n",
+				__func__);
+			return -EFAULT;
+		}
+		mutex_lock(&cd->lock);
+		cd->damage = damage;
+		mutex_unlock(&cd->lock);
+		ret = 0;
+		break;
+	}
 	case COMPDEV_WAIT_FOR_VSYNC_IOC:
 	{
 		s64 timestamp;
@@ -1327,12 +1628,74 @@ static long compdev_ioctl(struct file *file,
 	return ret;
 }
 
+/*
+ * Returns the present events of queued flips. Waits for the first event
+ * unless the file is non-blocking, then returns what is already queued.
+ */
+static ssize_t compdev_read(struct file *file, char __user *buf,
+		size_t count, loff_t *ppos)
+{
+	struct compdev *cd = (struct compdev *)file->private_data;
+	struct mcde_display_device *ddev = cd->dss_ctx.ddev;
+	struct mcde_dss_present_event ev;
+	struct compdev_present_event out;
+	size_t n = 0;
+	int ret;
+
+	if (count < sizeof(out))
+		return -EINVAL;
+
+	if (file->f_flags & O_NONBLOCK)
+		ret = mcde_dss_get_present_event(ddev, &ev);
+	else
+		ret = mcde_dss_wait_present_event(ddev, &ev);
+	if (ret)
+		return ret;
+
+	do {
+		out.seq = ev.seq;
+		out.reserved = 0;
+		out.timestamp = ev.timestamp;
+		if (copy_to_user(buf + n, &out, sizeof(out)))
+			return -EFAULT;
+		n += sizeof(out);
+	} while (count - n >= sizeof(out) &&
+			!mcde_dss_get_present_event(ddev, &ev));
+
+	return n;
+}
+
+static unsigned int compdev_poll(struct file *file, poll_table *wait)
+{
+	struct compdev *cd = (struct compdev *)file->private_data;
+
+	return mcde_dss_poll_present_event(cd->dss_ctx.ddev, file, wait);
+}
+
 static const struct file_operations compdev_fops = {
 	.open = compdev_open,
 	.release = compdev_release,
+	.read = compdev_read,
+	.poll = compdev_poll,
 	.unlocked_ioctl = compdev_ioctl,
 };
 
+static ssize_t plan_stats_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct miscdevice *mdev = dev_get_drvdata(dev);
+	struct compdev *cd = container_of(mdev, struct compdev, mdev);
+	ssize_t len;
+
+	mutex_lock(&cd->lock);
+	len = compdev_planner_show(&cd->planner, buf);
+	mutex_unlock(&cd->lock);
+
+	return len;
+}
+
+static DEVICE_ATTR(plan_stats, S_IRUGO, plan_stats_show, NULL);
+
 static void init_compdev(struct compdev *cd)
 {
 	mutex_init(&cd->lock);
@@ -1349,6 +1712,7 @@ static void init_compdev(struct compdev *cd)
 	cd->dev = cd->mdev.this_device;
 	cd->fb_image_alloc = NULL;
 	cd->blanked = false;
+	compdev_planner_init(&cd->planner);
 }
 
 static int init_dss_context(struct dss_context *dss_ctx,
@@ -1466,6 +1830,10 @@ int compdev_create(struct mcde_display_device *ddev,
 	cd->dss_ctx.dev = cd->dev;
 	cd->dss_ctx.cache_ctx.dev = cd->dev;
 
+	if (device_create_file(cd->dev, &dev_attr_plan_stats))
+		dev_warn(cd->dev, "%s: Failed to create plan_stats\n",
+				__func__);
+
 	compdevs[cd->dev_index] = cd;
 	list_add_tail(&cd->list, &dev_list);
 	mutex_unlock(&dev_list_lock);
@@ -1719,6 +2087,7 @@ void compdev_destroy(struct mcde_display_device *ddev)
 	list_for_each_entry_safe(cd, tmp, &dev_list, list) {
 		if (cd->dss_ctx.ddev == ddev) {
 			list_del(&cd->list);
+			device_remove_file(cd->dev, &dev_attr_plan_stats);
 			misc_deregister(&cd->mdev);
 			kref_put(&cd->ref_count,
 				compdev_device_release);
@@ -1737,6 +2106,7 @@ static void compdev_destroy_all(void)
 	mutex_lock(&dev_list_lock);
 	list_for_each_entry_safe(cd, tmp, &dev_list, list) {
 		list_del(&cd->list);
+		device_remove_file(cd->dev, &dev_attr_plan_stats);
 		misc_deregister(&cd->mdev);
 		kref_put(&cd->ref_count, compdev_device_release);
 	}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * Overlay composition planner for Compdev
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/math64.h>
+#include <linux/time.h>
+#include <linux/hrtimer.h>
+#include <linux/compdev_util.h>
+#include <linux/compdev_planner.h>
+
+/* Post interval assumed for a layer until it has been posted twice */
+#define DEFAULT_INTERVAL_US 16667
+/* Longer pauses between posts are not part of the average */
+#define MAX_INTERVAL_US 1000000
+/* Estimated B2R2 throughput, bytes read and written per us */
+#define B2R2_BYTES_PER_US 400
+/* A new plan has to save 1/8 of the traffic to replace the current one */
+#define HYSTERESIS_SHIFT 3
+
+struct plan_cost {
+	u64 b2r2_bytes;	/* per post */
+	u64 mcde_bytes;	/* per display refresh */
+	u64 bytes_per_sec;
+	u32 b2r2_us;
+};
+
+static const char * const path_names[COMPDEV_PLAN_NUM_PATHS] = {
+	[COMPDEV_PLAN_OVERLAY] = "overlay",
+	[COMPDEV_PLAN_B2R2] = "b2r2",
+	[COMPDEV_PLAN_B2R2_PACK] = "b2r2_pack",
+};
+
+static u64 rect_bytes(struct compdev_rect *rect, enum compdev_fmt fmt)
+{
+	return ((u64)rect->width * rect->height * compdev_get_bpp(fmt)) >> 3;
+}
+
+static void path_cost(enum compdev_plan_path path, struct compdev_img *img,
+		enum compdev_fmt b2r2_fmt, u32 post_us, u32 refresh_us,
+		struct plan_cost *cost)
+{
+	u64 src_bytes = rect_bytes(&img->src_rect, img->fmt);
+
+	if (path == COMPDEV_PLAN_OVERLAY) {
+		cost->b2r2_bytes = 0;
+		cost->mcde_bytes = src_bytes;
+	} else {
+		/* B2R2 reads the layer and writes what MCDE fetches */
+		cost->mcde_bytes = rect_bytes(&img->dst_rect, b2r2_fmt);
+		cost->b2r2_bytes = src_bytes + cost->mcde_bytes;
+	}
+
+	cost->bytes_per_sec =
+		div_u64(cost->b2r2_bytes * USEC_PER_SEC, post_us) +
+		div_u64(cost->mcde_bytes * USEC_PER_SEC, refresh_us);
+	cost->b2r2_us = div_u64(cost->b2r2_bytes, B2R2_BYTES_PER_US);
+}
+
+static bool same_layer(struct compdev_plan_layer *layer,
+		struct compdev_img *img, enum compdev_transform mcde_transform,
+		bool b2r2_needed, u32 refresh_hz)
+{
+	return layer->valid &&
+		layer->fmt == img->fmt &&
+		!memcmp(&layer->src_rect, &img->src_rect,
+				sizeof(layer->src_rect)) &&
+		!memcmp(&layer->dst_rect, &img->dst_rect,
+				sizeof(layer->dst_rect)) &&
+		layer->transform == img->transform &&
+		layer->mcde_transform == mcde_transform &&
+		layer->flags == img->flags &&
+		layer->b2r2_needed == b2r2_needed &&
+		layer->refresh_hz == refresh_hz;
+}
+
+static void update_interval(struct compdev_plan_layer *layer)
+{
+	ktime_t now = ktime_get();
+	s64 delta;
+
+	if (layer->last_post.tv64) {
+		delta = ktime_us_delta(now, layer->last_post);
+		if (delta > 0 && delta < MAX_INTERVAL_US)
+			layer->interval_us =
+				(layer->interval_us * 7 + (u32)delta) >> 3;
+	}
+	layer->last_post = now;
+}
+
+/* Only opaque 32 bit layers lose nothing when packed to RGB888 */
+static bool pack_possible(struct compdev_img *img, enum compdev_fmt fmt)
+{
+	return fmt == COMPDEV_FMT_RGBX8888 &&
+		!(img->flags & COMPDEV_PROTECTED_FLAG);
+}
+
+static void replan(struct compdev_plan_layer *layer, struct compdev_img *img,
+		bool b2r2_needed, bool same, u32 refresh_hz)
+{
+	struct plan_cost base;
+	struct plan_cost pack;
+	struct plan_cost *cost = &base;
+	enum compdev_plan_path path;
+	enum compdev_fmt fmt;
+	u32 post_us = layer->interval_us;
+	u32 refresh_us = refresh_hz ? USEC_PER_SEC / refresh_hz : post_us;
+	bool use_pack = false;
+
+	if (b2r2_needed) {
+		path = COMPDEV_PLAN_B2R2;
+		fmt = find_compatible_fmt(img->fmt,
+				img->transform & COMPDEV_TRANSFORM_ROT_90_CW);
+	} else {
+		path = COMPDEV_PLAN_OVERLAY;
+		fmt = img->fmt;
+	}
+	path_cost(path, img, fmt, post_us, refresh_us, &base);
+
+	if (pack_possible(img, fmt)) {
+		path_cost(COMPDEV_PLAN_B2R2_PACK, img, COMPDEV_FMT_RGB888,
+				post_us, refresh_us, &pack);
+
+		/*
+		 * The post waits for B2R2, an extra blit must leave at least
+		 * half of the frame for MCDE.
+		 */
+		if (pack.b2r2_us <= base.b2r2_us ||
+				pack.b2r2_us <= min(post_us, refresh_us) / 2) {
+			if (same && layer->path == COMPDEV_PLAN_B2R2_PACK)
+				use_pack = base.bytes_per_sec >=
+					pack.bytes_per_sec -
+					(pack.bytes_per_sec >> HYSTERESIS_SHIFT);
+			else
+				use_pack = pack.bytes_per_sec <
+					base.bytes_per_sec -
+					(base.bytes_per_sec >> HYSTERESIS_SHIFT);
+		}
+	}
+
+	if (use_pack) {
+		path = COMPDEV_PLAN_B2R2_PACK;
+		fmt = COMPDEV_FMT_RGB888;
+		cost = &pack;
+	}
+
+	layer->path = path;
+	layer->b2r2_fmt = fmt;
+	layer->planned_interval_us = post_us;
+	layer->cost_kbps = div_u64(cost->bytes_per_sec, 1000);
+	layer->base_cost_kbps = div_u64(base.bytes_per_sec, 1000);
+	layer->b2r2_bytes = cost->b2r2_bytes;
+	if (base.bytes_per_sec > cost->bytes_per_sec)
+		layer->saved_bytes = div_u64((base.bytes_per_sec -
+				cost->bytes_per_sec) * post_us, USEC_PER_SEC);
+	else
+		layer->saved_bytes = 0;
+	layer->b2r2_us = cost->b2r2_us;
+}
+
+void compdev_planner_init(struct compdev_planner *planner)
+{
+	int i;
+
+	memset(planner, 0, sizeof(*planner));
+	for (i = 0; i < COMPDEV_PLAN_MAX_LAYERS; i++)
+		planner->layers[i].interval_us = DEFAULT_INTERVAL_US;
+}
+
+enum compdev_plan_path compdev_plan_layer(struct compdev_planner *planner,
+		int slot, struct compdev_img *img,
+		enum compdev_transform mcde_transform, bool b2r2_needed,
+		u32 refresh_hz, enum compdev_fmt *b2r2_fmt)
+{
+	struct compdev_plan_layer *layer;
+	bool same;
+
+	if (slot < 0 || slot >= COMPDEV_PLAN_MAX_LAYERS) {
+		*b2r2_fmt = find_compatible_fmt(img->fmt,
+				img->transform & COMPDEV_TRANSFORM_ROT_90_CW);
+		return b2r2_needed ? COMPDEV_PLAN_B2R2 : COMPDEV_PLAN_OVERLAY;
+	}
+
+	layer = &planner->layers[slot];
+	update_interval(layer);
+	planner->stats.layers++;
+
+	/* Keep the plan until the layer or its post rate changes */
+	same = same_layer(layer, img, mcde_transform, b2r2_needed,
+			refresh_hz);
+	if (same && layer->interval_us < layer->planned_interval_us * 2 &&
+			layer->interval_us * 2 > layer->planned_interval_us) {
+		planner->stats.cache_hits++;
+	} else {
+		planner->stats.replans++;
+		replan(layer, img, b2r2_needed, same, refresh_hz);
+
+		layer->valid = true;
+		layer->fmt = img->fmt;
+		layer->src_rect = img->src_rect;
+		layer->dst_rect = img->dst_rect;
+		layer->transform = img->transform;
+		layer->mcde_transform = mcde_transform;
+		layer->flags = img->flags;
+		layer->b2r2_needed = b2r2_needed;
+		layer->refresh_hz = refresh_hz;
+	}
+
+	planner->stats.path_count[layer->path]++;
+	planner->stats.b2r2_bytes += layer->b2r2_bytes;
+	planner->stats.saved_bytes += layer->saved_bytes;
+
+	*b2r2_fmt = layer->b2r2_fmt;
+	return layer->path;
+}
+
+ssize_t compdev_planner_show(struct compdev_planner *planner, char *buf)
+{
+	struct compdev_plan_stats *stats = &planner->stats;
+	ssize_t len;
+	int i;
+
+	len = scnprintf(buf, PAGE_SIZE,
+			"layers %u\ncache_hits %u\nreplans %u\n",
+			stats->layers, stats->cache_hits, stats->replans);
+	for (i = 0; i < COMPDEV_PLAN_NUM_PATHS; i++)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s %u\n",
+				path_names[i], stats->path_count[i]);
+	len += scnprintf(buf + len, PAGE_SIZE - len,
+			"b2r2_bytes %llu\nsaved_bytes %llu\n",
+			(unsigned long long)stats->b2r2_bytes,
+			(unsigned long long)stats->saved_bytes);
+
+	for (i = 0; i < COMPDEV_PLAN_MAX_LAYERS; i++) {
+		struct compdev_plan_layer *layer = &planner->layers[i];
+
+		if (!layer->valid)
+			continue;
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				"layer%d %s fmt %d interval_us %u "
+				"cost_kbps %u base_kbps %u b2r2_us %u\n",
+				i, path_names[layer->path], layer->b2r2_fmt,
+				layer->interval_us, layer->cost_kbps,
+				layer->base_cost_kbps, layer->b2r2_us);
+	}
+
+	return len;
+}
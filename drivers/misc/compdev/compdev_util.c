@@ -33,6 +33,7 @@ enum b2r2_blt_fmt compdev_to_blt_format(enum compdev_fmt fmt)
 {
 	switch (fmt) {
 	case COMPDEV_FMT_RGBA8888:
+	case COMPDEV_FMT_RGBX8888:
 		return B2R2_BLT_FMT_32_BIT_ARGB8888;
 	case COMPDEV_FMT_RGB888:
 		return B2R2_BLT_FMT_24_BIT_RGB888;
@@ -19,6 +19,11 @@
 
 #define U32_MAX (~(u32)0)
 
+/* Buffers with deferred synchronization, see cach_set_domain_deferred() */
+static LIST_HEAD(deferred_bufs);
+
+static struct cach_stats stats;
+
 enum hwmem_alloc_flags cachi_get_cache_settings(
 			enum hwmem_alloc_flags requested_cache_settings);
 void cachi_set_pgprot_cache_options(enum hwmem_alloc_flags cache_settings,
@@ -27,13 +32,20 @@ void cachi_set_pgprot_cache_options(enum hwmem_alloc_flags cache_settings,
 static void sync_buf_pre_cpu(struct cach_buf *buf, enum hwmem_access access,
 						struct hwmem_region *region);
 static void sync_buf_post_cpu(struct cach_buf *buf,
-	enum hwmem_access next_access, struct hwmem_region *next_region);
+	enum hwmem_access next_access, struct cach_range *next_range,
+							bool synced_all);
+static void sync_deferred_buf(struct cach_buf *buf);
+static void post_cpu_sync_length(struct cach_buf *buf,
+	enum hwmem_access next_access, struct cach_range *next_range,
+					u32 *clean_length, u32 *flush_length);
 
 static void invalidate_cpu_cache(struct cach_buf *buf,
 					struct cach_range *range_2b_used);
 static void clean_cpu_cache(struct cach_buf *buf,
-					struct cach_range *range_2b_used);
+			struct cach_range *range_2b_used, bool cleaned_all);
 static void flush_cpu_cache(struct cach_buf *buf,
+			struct cach_range *range_2b_used, bool flushed_all);
+static u32 sync_length(struct cach_range *range_in_cache,
 					struct cach_range *range_2b_used);
 
 static void null_range(struct cach_range *range);
@@ -79,6 +91,10 @@ void cach_init_buf(struct cach_buf *buf,
 	buf->mem_type = mem_type;
 
 	buf->cache_settings = cachi_get_cache_settings(cache_settings);
+
+	INIT_LIST_HEAD(&buf->deferred_list);
+	buf->bytes_cleaned = 0;
+	buf->bytes_invalidated = 0;
 }
 
 void cach_set_buf_addrs(struct cach_buf *buf, void* vaddr, u32 paddr)
@@ -122,6 +138,7 @@ void cach_set_domain(struct cach_buf *buf, enum hwmem_access access,
 {
 	struct hwmem_region *__region;
 	struct hwmem_region full_region;
+	struct cach_range range;
 
 	if (region != NULL) {
 		__region = region;
@@ -135,9 +152,13 @@ void cach_set_domain(struct cach_buf *buf, enum hwmem_access access,
 		__region = &full_region;
 	}
 
+	/* Don't let a deferred synchronization get reordered */
+	sync_deferred_buf(buf);
+
 	switch (domain) {
 	case HWMEM_DOMAIN_SYNC:
-		sync_buf_post_cpu(buf, access, __region);
+		region_2_range(__region, buf->size, &range);
+		sync_buf_post_cpu(buf, access, &range, false);
 
 		break;
 
@@ -148,6 +169,86 @@ void cach_set_domain(struct cach_buf *buf, enum hwmem_access access,
 	}
 }
 
+void cach_set_domain_deferred(struct cach_buf *buf, enum hwmem_access access,
+						struct hwmem_region *region)
+{
+	struct cach_range range;
+
+	if (region != NULL) {
+		region_2_range(region, buf->size, &range);
+	} else {
+		range.start = 0;
+		range.end = buf->size;
+		align_range_up(&range, get_dcache_granularity());
+	}
+
+	if (list_empty(&buf->deferred_list)) {
+		buf->deferred_access = access;
+		buf->deferred_range = range;
+		list_add_tail(&buf->deferred_list, &deferred_bufs);
+	} else {
+		buf->deferred_access |= access;
+		expand_range(&buf->deferred_range, &range);
+	}
+}
+
+void cach_sync_deferred(void)
+{
+	struct cach_buf *buf, *tmp;
+	u32 clean_length = 0;
+	u32 flush_length = 0;
+	bool inner_only = true;
+	bool synced_all = false;
+
+	if (list_empty(&deferred_bufs))
+		return;
+
+	list_for_each_entry(buf, &deferred_bufs, deferred_list) {
+		post_cpu_sync_length(buf, buf->deferred_access,
+			&buf->deferred_range, &clean_length, &flush_length);
+		/* Scattered buffers always need the outer cache flushed */
+		if (!(buf->cache_settings &
+					HWMEM_ALLOC_HINT_INNER_CACHE_ONLY) ||
+				buf->mem_type == HWMEM_MEM_SCATTERED_SYS)
+			inner_only = false;
+	}
+
+	/*
+	 * Flushing covers cleaning so if any buffer needs a flush then the
+	 * whole batch is handled as one flush.
+	 */
+	if (flush_length != 0 && clean_length + flush_length >=
+				get_dcache_all_breakpoint(true, inner_only)) {
+		flush_cpu_dcache_all(inner_only);
+		stats.nr_full_flushes++;
+		synced_all = true;
+	} else if (flush_length == 0 && clean_length >=
+				get_dcache_all_breakpoint(false, inner_only)) {
+		clean_cpu_dcache_all(inner_only);
+		stats.nr_full_cleans++;
+		synced_all = true;
+	}
+
+	list_for_each_entry_safe(buf, tmp, &deferred_bufs, deferred_list) {
+		list_del_init(&buf->deferred_list);
+		sync_buf_post_cpu(buf, buf->deferred_access,
+					&buf->deferred_range, synced_all);
+		stats.nr_deferred_bufs++;
+	}
+
+	stats.nr_deferred_syncs++;
+}
+
+void cach_release_buf(struct cach_buf *buf)
+{
+	list_del_init(&buf->deferred_list);
+}
+
+void cach_get_stats(struct cach_stats *stats_out)
+{
+	*stats_out = stats;
+}
+
 /*
  * Local functions
  */
@@ -239,36 +340,38 @@ static void sync_buf_pre_cpu(struct cach_buf *buf, enum hwmem_access access,
 	}
 }
 
+/*
+ * synced_all tells that the entire CPU cache has just been flushed, or
+ * cleaned if no flush was needed, which then replaces the range operations.
+ */
 static void sync_buf_post_cpu(struct cach_buf *buf,
-	enum hwmem_access next_access, struct hwmem_region *next_region)
+	enum hwmem_access next_access, struct cach_range *next_range,
+							bool synced_all)
 {
 	bool write = next_access & HWMEM_ACCESS_WRITE;
 	bool read = next_access & HWMEM_ACCESS_READ;
-	struct cach_range region_range;
 
 	if (!write && !read)
 		return;
 
-	region_2_range(next_region, buf->size, &region_range);
-
 	if (write) {
 		if (speculative_data_prefetch()) {
 			/* Defer invalidate */
 			struct cach_range intersection;
 
 			intersect_range(&buf->range_in_cpu_cache,
-						&region_range, &intersection);
+						next_range, &intersection);
 
 			expand_range(&buf->range_invalid_in_cpu_cache,
 								&intersection);
 
-			clean_cpu_cache(buf, &region_range);
+			clean_cpu_cache(buf, next_range, synced_all);
 		} else {
-			flush_cpu_cache(buf, &region_range);
+			flush_cpu_cache(buf, next_range, synced_all);
 		}
 	}
 	if (read)
-		clean_cpu_cache(buf, &region_range);
+		clean_cpu_cache(buf, next_range, synced_all);
 
 	if (buf->in_cpu_write_buf) {
 		drain_cpu_write_buf();
@@ -277,6 +380,35 @@ static void sync_buf_post_cpu(struct cach_buf *buf,
 	}
 }
 
+static void sync_deferred_buf(struct cach_buf *buf)
+{
+	if (list_empty(&buf->deferred_list))
+		return;
+
+	list_del_init(&buf->deferred_list);
+	sync_buf_post_cpu(buf, buf->deferred_access, &buf->deferred_range,
+									false);
+}
+
+/*
+ * Adds the lengths that sync_buf_post_cpu() would clean and flush to
+ * clean_length and flush_length.
+ */
+static void post_cpu_sync_length(struct cach_buf *buf,
+	enum hwmem_access next_access, struct cach_range *next_range,
+					u32 *clean_length, u32 *flush_length)
+{
+	bool write = next_access & HWMEM_ACCESS_WRITE;
+	bool read = next_access & HWMEM_ACCESS_READ;
+
+	if (write && !speculative_data_prefetch())
+		*flush_length += sync_length(&buf->range_in_cpu_cache,
+								next_range);
+	else if (write || read)
+		*clean_length += sync_length(&buf->range_dirty_in_cpu_cache,
+								next_range);
+}
+
 static void invalidate_cpu_cache(struct cach_buf *buf, struct cach_range *range)
 {
 	struct cach_range intersection;
@@ -301,6 +433,7 @@ static void invalidate_cpu_cache(struct cach_buf *buf, struct cach_range *range)
 				buf->cache_settings &
 					HWMEM_ALLOC_HINT_INNER_CACHE_ONLY,
 							&flushed_everything);
+		buf->bytes_invalidated += range_length(&intersection);
 
 		if (flushed_everything) {
 			null_range(&buf->range_invalid_in_cpu_cache);
@@ -317,24 +450,27 @@ static void invalidate_cpu_cache(struct cach_buf *buf, struct cach_range *range)
 	}
 }
 
-static void clean_cpu_cache(struct cach_buf *buf, struct cach_range *range)
+static void clean_cpu_cache(struct cach_buf *buf, struct cach_range *range,
+							bool cleaned_all)
 {
 	struct cach_range intersection;
 
 	intersect_range(&buf->range_dirty_in_cpu_cache, range, &intersection);
 	if (is_non_empty_range(&intersection)) {
-		bool cleaned_everything;
+		bool cleaned_everything = true;
 
 		expand_range_2_edge(&intersection,
 					&buf->range_dirty_in_cpu_cache);
 
-		clean_cpu_dcache(
+		if (!cleaned_all)
+			clean_cpu_dcache(
 				offset_2_vaddr(buf, intersection.start),
 				offset_2_paddr(buf, intersection.start),
 				range_length(&intersection),
 				buf->cache_settings &
 					HWMEM_ALLOC_HINT_INNER_CACHE_ONLY,
 							&cleaned_everything);
+		buf->bytes_cleaned += range_length(&intersection);
 
 		if (cleaned_everything)
 			null_range(&buf->range_dirty_in_cpu_cache);
@@ -342,28 +478,32 @@ static void clean_cpu_cache(struct cach_buf *buf, struct cach_range *range)
 			shrink_range(&buf->range_dirty_in_cpu_cache,
 								&intersection);
 
-		if (buf->mem_type == HWMEM_MEM_SCATTERED_SYS)
+		if (!cleaned_all && buf->mem_type == HWMEM_MEM_SCATTERED_SYS)
 			outer_flush_all();
 	}
 }
 
-static void flush_cpu_cache(struct cach_buf *buf, struct cach_range *range)
+static void flush_cpu_cache(struct cach_buf *buf, struct cach_range *range,
+							bool flushed_all)
 {
 	struct cach_range intersection;
 
 	intersect_range(&buf->range_in_cpu_cache, range, &intersection);
 	if (is_non_empty_range(&intersection)) {
-		bool flushed_everything;
+		bool flushed_everything = true;
 
 		expand_range_2_edge(&intersection, &buf->range_in_cpu_cache);
 
-		flush_cpu_dcache(
+		if (!flushed_all)
+			flush_cpu_dcache(
 				offset_2_vaddr(buf, intersection.start),
 				offset_2_paddr(buf, intersection.start),
 				range_length(&intersection),
 				buf->cache_settings &
 					HWMEM_ALLOC_HINT_INNER_CACHE_ONLY,
 							&flushed_everything);
+		buf->bytes_cleaned += range_length(&intersection);
+		buf->bytes_invalidated += range_length(&intersection);
 
 		if (flushed_everything) {
 			if (!speculative_data_prefetch())
@@ -382,6 +522,21 @@ static void flush_cpu_cache(struct cach_buf *buf, struct cach_range *range)
 	}
 }
 
+/* Length of the range operation clean_cpu_cache/flush_cpu_cache would do */
+static u32 sync_length(struct cach_range *range_in_cache,
+					struct cach_range *range_2b_used)
+{
+	struct cach_range intersection;
+
+	intersect_range(range_in_cache, range_2b_used, &intersection);
+	if (!is_non_empty_range(&intersection))
+		return 0;
+
+	expand_range_2_edge(&intersection, range_in_cache);
+
+	return range_length(&intersection);
+}
+
 static void null_range(struct cach_range *range)
 {
 	range->start = U32_MAX;
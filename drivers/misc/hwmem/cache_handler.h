@@ -18,6 +18,7 @@
 #define _CACHE_HANDLER_H_
 
 #include <linux/types.h>
+#include <linux/list.h>
 #include <linux/hwmem.h>
 
 /*
@@ -47,6 +48,22 @@ struct cach_buf {
 	struct cach_range range_in_cpu_cache;
 	struct cach_range range_dirty_in_cpu_cache;
 	struct cach_range range_invalid_in_cpu_cache;
+
+	/* Synchronization postponed until cach_sync_deferred() */
+	struct list_head deferred_list;
+	enum hwmem_access deferred_access;
+	struct cach_range deferred_range;
+
+	/* Statistics */
+	u64 bytes_cleaned;
+	u64 bytes_invalidated;
+};
+
+struct cach_stats {
+	u32 nr_deferred_syncs;
+	u32 nr_deferred_bufs;
+	u32 nr_full_cleans;
+	u32 nr_full_flushes;
 };
 
 void cach_init_buf(struct cach_buf *buf, enum hwmem_mem_type,
@@ -59,4 +76,21 @@ void cach_set_pgprot_cache_options(struct cach_buf *buf, pgprot_t *pgprot);
 void cach_set_domain(struct cach_buf *buf, enum hwmem_access access,
 			enum hwmem_domain domain, struct hwmem_region *region);
 
+/*
+ * Same as cach_set_domain() with domain HWMEM_DOMAIN_SYNC except that the
+ * cache maintenance is not performed until the next call to
+ * cach_sync_deferred(), which handles all buffers in one pass. This allows
+ * the maintenance of several buffers about to be used by hardware to be
+ * replaced by a single operation on the entire cache when that is faster.
+ */
+void cach_set_domain_deferred(struct cach_buf *buf, enum hwmem_access access,
+						struct hwmem_region *region);
+
+void cach_sync_deferred(void);
+
+/* Must be called before a buffer is freed */
+void cach_release_buf(struct cach_buf *buf);
+
+void cach_get_stats(struct cach_stats *stats);
+
 #endif /* _CACHE_HANDLER_H_ */
@@ -12,6 +12,8 @@
 #include <linux/kernel.h>
 #include <linux/err.h>
 #include <linux/list.h>
+#include <linux/math64.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/debugfs.h>
@@ -23,8 +25,19 @@
 
 #define MAX_INSTANCE_NAME_LENGTH 31
 
+/* Free blocks are bucketed by log2 of their size in pages in the debugfs */
+#define NR_FREE_ORDERS 12
+
+/*
+ * All allocs, used or free, are kept in address order in alloc_list so
+ * that neighbours can be merged on free. Free allocs are additionally
+ * indexed by size, and then by address, in free_tree which makes finding
+ * the best fit O(log n) in the number of free blocks instead of a walk of
+ * the whole region.
+ */
 struct alloc {
 	struct list_head list;
+	struct rb_node free_node;
 
 	bool in_use;
 	phys_addr_t paddr;
@@ -40,7 +53,13 @@ struct instance {
 	void *region_kaddr;
 	size_t region_size;
 
+	/* Protects the allocs of this instance */
+	struct mutex lock;
+
 	struct list_head alloc_list;
+	struct rb_root free_tree;
+	size_t free_size;
+	unsigned int nr_free;
 
 #ifdef CONFIG_DEBUG_FS
 	struct inode *debugfs_inode;
@@ -50,11 +69,15 @@ struct instance {
 	int cona_status_max_check;
 	int cona_status_biggest_free;
 	int cona_status_printed;
+	/* Failed allocs and those of them that failed due to fragmentation */
+	unsigned int cona_status_failed;
+	unsigned int cona_status_failed_frag;
 #endif /* #ifdef CONFIG_DEBUG_FS */
 };
 
 static LIST_HEAD(instance_list);
 
+/* Protects instance_list */
 static DEFINE_MUTEX(lock);
 
 void *cona_create(const char *name, phys_addr_t region_paddr,
@@ -67,10 +90,12 @@ size_t cona_get_alloc_size(void *alloc);
 
 static int init_alloc_list(struct instance *instance);
 static void clean_alloc_list(struct instance *instance);
+static void insert_free_alloc(struct instance *instance, struct alloc *alloc);
+static void remove_free_alloc(struct instance *instance, struct alloc *alloc);
 static struct alloc *find_free_alloc_bestfit(struct instance *instance,
 								size_t size);
-static struct alloc *split_allocation(struct alloc *alloc,
-							size_t new_alloc_size);
+static struct alloc *split_allocation(struct instance *instance,
+				struct alloc *alloc, size_t new_alloc_size);
 static phys_addr_t get_alloc_offset(struct instance *instance,
 							struct alloc *alloc);
 
@@ -134,7 +159,9 @@ void *cona_create(const char *name, phys_addr_t region_paddr,
 	 */
 	pasr_put(instance->region_paddr, instance->region_size);
 
+	mutex_init(&instance->lock);
 	INIT_LIST_HEAD(&instance->alloc_list);
+	instance->free_tree = RB_ROOT;
 	ret = init_alloc_list(instance);
 	if (ret < 0)
 		goto init_alloc_list_failed;
@@ -167,16 +194,23 @@ void *cona_alloc(void *instance, size_t size)
 	if (size == 0)
 		return ERR_PTR(-EINVAL);
 
-	mutex_lock(&lock);
+	mutex_lock(&instance_l->lock);
 
 	alloc = find_free_alloc_bestfit(instance_l, size);
-	if (IS_ERR(alloc))
+	if (IS_ERR(alloc)) {
+#ifdef CONFIG_DEBUG_FS
+		instance_l->cona_status_failed++;
+		if (instance_l->free_size >= size)
+			instance_l->cona_status_failed_frag++;
+#endif /* #ifdef CONFIG_DEBUG_FS */
 		goto out;
+	}
 	if (size < alloc->size) {
-		alloc = split_allocation(alloc, size);
+		alloc = split_allocation(instance_l, alloc, size);
 		if (IS_ERR(alloc))
 			goto out;
 	} else {
+		remove_free_alloc(instance_l, alloc);
 		alloc->in_use = true;
 	}
 
@@ -190,7 +224,7 @@ void *cona_alloc(void *instance, size_t size)
 #endif /* #ifdef CONFIG_DEBUG_FS */
 
 out:
-	mutex_unlock(&lock);
+	mutex_unlock(&instance_l->lock);
 
 	return alloc;
 }
@@ -201,7 +235,7 @@ void cona_free(void *instance, void *alloc)
 	struct alloc *alloc_l = (struct alloc *)alloc;
 	struct alloc *other;
 
-	mutex_lock(&lock);
+	mutex_lock(&instance_l->lock);
 
 	alloc_l->in_use = false;
 
@@ -214,6 +248,7 @@ void cona_free(void *instance, void *alloc)
 	other = list_entry(alloc_l->list.prev, struct alloc, list);
 	if ((alloc_l->list.prev != &instance_l->alloc_list) &&
 							!other->in_use) {
+		remove_free_alloc(instance_l, other);
 		other->size += alloc_l->size;
 		list_del(&alloc_l->list);
 		kfree(alloc_l);
@@ -222,12 +257,15 @@ void cona_free(void *instance, void *alloc)
 	other = list_entry(alloc_l->list.next, struct alloc, list);
 	if ((alloc_l->list.next != &instance_l->alloc_list) &&
 							!other->in_use) {
+		remove_free_alloc(instance_l, other);
 		alloc_l->size += other->size;
 		list_del(&other->list);
 		kfree(other);
 	}
 
-	mutex_unlock(&lock);
+	insert_free_alloc(instance_l, alloc_l);
+
+	mutex_unlock(&instance_l->lock);
 }
 
 phys_addr_t cona_get_alloc_paddr(void *alloc)
@@ -277,6 +315,7 @@ static int init_alloc_list(struct instance *instance)
 								PAGE_SIZE;
 			alloc->in_use = false;
 			list_add_tail(&alloc->list, &instance->alloc_list);
+			insert_free_alloc(instance, alloc);
 			curr_pos = alloc->paddr + alloc->size;
 		}
 
@@ -307,6 +346,7 @@ static int init_alloc_list(struct instance *instance)
 	alloc->size = region_end - curr_pos;
 	alloc->in_use = false;
 	list_add_tail(&alloc->list, &instance->alloc_list);
+	insert_free_alloc(instance, alloc);
 
 	return 0;
 
@@ -322,33 +362,70 @@ static void clean_alloc_list(struct instance *instance)
 		struct alloc *i = list_first_entry(&instance->alloc_list,
 							struct alloc, list);
 
+		if (!i->in_use)
+			remove_free_alloc(instance, i);
 		list_del(&i->list);
 
 		kfree(i);
 	}
 }
 
+static void insert_free_alloc(struct instance *instance, struct alloc *alloc)
+{
+	struct rb_node **p = &instance->free_tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct alloc *i;
+
+	while (*p) {
+		parent = *p;
+		i = rb_entry(parent, struct alloc, free_node);
+		if (alloc->size < i->size ||
+			(alloc->size == i->size && alloc->paddr < i->paddr))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&alloc->free_node, parent, p);
+	rb_insert_color(&alloc->free_node, &instance->free_tree);
+
+	instance->free_size += alloc->size;
+	instance->nr_free++;
+}
+
+static void remove_free_alloc(struct instance *instance, struct alloc *alloc)
+{
+	rb_erase(&alloc->free_node, &instance->free_tree);
+
+	instance->free_size -= alloc->size;
+	instance->nr_free--;
+}
+
+/*
+ * Returns the smallest free alloc that fits, the one with the lowest
+ * address if there are several.
+ */
 static struct alloc *find_free_alloc_bestfit(struct instance *instance,
 								size_t size)
 {
-	size_t best_diff = ~(size_t)0;
+	struct rb_node *n = instance->free_tree.rb_node;
 	struct alloc *alloc = NULL, *i;
 
-	list_for_each_entry(i, &instance->alloc_list, list) {
-		size_t diff = i->size - size;
-		if (i->in_use || i->size < size)
-			continue;
-		if (diff < best_diff) {
+	while (n) {
+		i = rb_entry(n, struct alloc, free_node);
+		if (i->size >= size) {
 			alloc = i;
-			best_diff = diff;
+			n = n->rb_left;
+		} else {
+			n = n->rb_right;
 		}
 	}
 
 	return alloc != NULL ? alloc : ERR_PTR(-ENOMEM);
 }
 
-static struct alloc *split_allocation(struct alloc *alloc,
-							size_t new_alloc_size)
+static struct alloc *split_allocation(struct instance *instance,
+				struct alloc *alloc, size_t new_alloc_size)
 {
 	struct alloc *new_alloc;
 
@@ -356,6 +433,8 @@ static struct alloc *split_allocation(struct alloc *alloc,
 	if (new_alloc == NULL)
 		return ERR_PTR(-ENOMEM);
 
+	remove_free_alloc(instance, alloc);
+
 	new_alloc->in_use = true;
 	new_alloc->paddr = alloc->paddr;
 	new_alloc->size = new_alloc_size;
@@ -364,6 +443,8 @@ static struct alloc *split_allocation(struct alloc *alloc,
 
 	list_add_tail(&new_alloc->list, &alloc->list);
 
+	insert_free_alloc(instance, alloc);
+
 	return new_alloc;
 }
 
@@ -379,6 +460,8 @@ static phys_addr_t get_alloc_offset(struct instance *instance,
 
 static int print_alloc(struct instance *instance, struct alloc *alloc,
 						char **buf, size_t buf_size);
+static void print_frag_status(struct instance *instance, char *buf,
+						size_t buf_size);
 static int print_alloc_status(struct instance *instance, char **buf,
 						size_t buf_size);
 static struct instance *get_instance_from_file(struct file *file);
@@ -438,11 +521,54 @@ static int print_alloc(struct instance *instance, struct alloc *alloc,
 	return 0;
 }
 
+/*
+ * Fragmentation is reported as the share of the free memory that is not
+ * in the biggest free block, 0% meaning all free memory is contiguous,
+ * together with a histogram of the free blocks by log2 of their size in
+ * pages, the last bucket also counting all bigger blocks.
+ */
+static void print_frag_status(struct instance *instance, char *buf,
+							size_t buf_size)
+{
+	unsigned int nr_free_order[NR_FREE_ORDERS] = { 0 };
+	size_t biggest_free = 0;
+	unsigned int frag = 0;
+	struct rb_node *n;
+	int len;
+	int i;
+
+	for (n = rb_first(&instance->free_tree); n != NULL; n = rb_next(n)) {
+		struct alloc *alloc = rb_entry(n, struct alloc, free_node);
+		int order = ilog2(max(alloc->size >> PAGE_SHIFT, (size_t)1));
+
+		nr_free_order[min(order, NR_FREE_ORDERS - 1)]++;
+		biggest_free = alloc->size;
+	}
+	if (instance->free_size != 0)
+		frag = 100 - div_u64((u64)biggest_free * 100,
+							instance->free_size);
+
+	len = scnprintf(buf, buf_size, "Free blocks:\t\t%10u\n"
+			"Fragmentation:\t\t%10u%%\n"
+			"Failed allocs:\t\t%10u (fragmented: %u)\n"
+			"Free blocks by order:\t",
+			instance->nr_free, frag,
+			instance->cona_status_failed,
+			instance->cona_status_failed_frag);
+	for (i = 0; i < NR_FREE_ORDERS; i++)
+		len += scnprintf(buf + len, buf_size - len, "%u%c",
+				nr_free_order[i],
+				i == NR_FREE_ORDERS - 1 ? '\n' : ' ');
+}
+
 static int print_alloc_status(struct instance *instance, char **buf,
 							size_t buf_size)
 {
 	int ret;
 	int i;
+	char frag_status[256];
+
+	print_frag_status(instance, frag_status, sizeof(frag_status));
 
 	for (i = 0; i < 2; i++) {
 		size_t buf_size_l;
@@ -453,13 +579,14 @@ static int print_alloc_status(struct instance *instance, char **buf,
 
 		ret = snprintf(*buf, buf_size_l, "Overall peak usage:\t%10u "
 				"(%dMB)\nCurrent max usage:\t%10u (%dMB)\n"
-				"Current biggest free:\t%10d (%dMB)\n",
+				"Current biggest free:\t%10d (%dMB)\n%s",
 				instance->cona_status_max_check,
 				instance->cona_status_max_check/1024/1024,
 				instance->cona_status_max_cont,
 				instance->cona_status_max_cont/1024/1024,
 				instance->cona_status_biggest_free,
-				instance->cona_status_biggest_free/1024/1024);
+				instance->cona_status_biggest_free/1024/1024,
+				frag_status);
 
 		if (ret < 0)
 			return -ENOMSG;
@@ -514,6 +641,8 @@ static int debugfs_allocs_read(struct file *file, char __user *buf,
 		goto out;
 	}
 
+	mutex_lock(&instance->lock);
+
 	list_for_each_entry(curr_alloc, &instance->alloc_list, list) {
 		phys_addr_t alloc_offset = get_alloc_offset(instance,
 								curr_alloc);
@@ -528,7 +657,7 @@ static int debugfs_allocs_read(struct file *file, char __user *buf,
 			readout_aborted = true;
 			break;
 		} else if (ret < 0) {
-			goto out;
+			goto out_unlock;
 		}
 		/*
 		 * There could be an overflow issue here in the unlikely case
@@ -551,7 +680,7 @@ static int debugfs_allocs_read(struct file *file, char __user *buf,
 		if (ret == -EINVAL) /* No more room */
 			readout_aborted = true;
 		else if (ret < 0)
-			goto out;
+			goto out_unlock;
 		else
 			instance->cona_status_printed = true;
 	}
@@ -562,6 +691,8 @@ static int debugfs_allocs_read(struct file *file, char __user *buf,
 		instance->cona_status_biggest_free = 0;
 	}
 
+	mutex_unlock(&instance->lock);
+
 	bytes_read = (size_t)(local_buf_pos - local_buf);
 
 	ret = copy_to_user(buf, local_buf, bytes_read);
@@ -569,7 +700,10 @@ static int debugfs_allocs_read(struct file *file, char __user *buf,
 		goto out;
 
 	ret = bytes_read;
+	goto out;
 
+out_unlock:
+	mutex_unlock(&instance->lock);
 out:
 	kfree(local_buf);
 	mutex_unlock(&lock);
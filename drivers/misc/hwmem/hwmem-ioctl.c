@@ -20,6 +20,7 @@
 #include <linux/hwmem.h>
 #include <linux/device.h>
 #include <linux/sched.h>
+#include <linux/dma-buf.h>
 
 static int hwmem_open(struct inode *inode, struct file *file);
 static int hwmem_ioctl_mmap(struct file *file, struct vm_area_struct *vma);
@@ -323,6 +324,27 @@ error:
 	return ret;
 }
 
+static int export_dma_buf(struct hwmem_file *hwfile, s32 id)
+{
+	int fd;
+	struct hwmem_alloc *alloc;
+	struct dma_buf *dmabuf;
+
+	alloc = resolve_id(hwfile, id);
+	if (IS_ERR(alloc))
+		return PTR_ERR(alloc);
+
+	dmabuf = hwmem_export_dma_buf(alloc);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	fd = dma_buf_fd(dmabuf, O_CLOEXEC);
+	if (fd < 0)
+		dma_buf_put(dmabuf);
+
+	return fd;
+}
+
 static int hwmem_open(struct inode *inode, struct file *file)
 {
 	struct hwmem_file *hwfile;
@@ -484,6 +506,9 @@ static long hwmem_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case HWMEM_IMPORT_FD_IOC:
 		ret = import_fd(hwfile, (s32)arg);
 		break;
+	case HWMEM_EXPORT_DMA_BUF_IOC:
+		ret = export_dma_buf(hwfile, (s32)arg);
+		break;
 	}
 
 	mutex_unlock(&hwfile->lock);
@@ -14,6 +14,7 @@
 #include <linux/kernel.h>
 #include <linux/device.h>
 #include <linux/dma-mapping.h>
+#include <linux/dma-buf.h>
 #include <linux/idr.h>
 #include <linux/mm.h>
 #include <linux/sched.h>
@@ -24,10 +25,12 @@
 #include <linux/list.h>
 #include <linux/hwmem.h>
 #include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/uaccess.h>
 #include <linux/io.h>
 #include <linux/kallsyms.h>
 #include <linux/vmalloc.h>
+#include <linux/fcntl.h>
 #include "cache_handler.h"
 
 #define S32_MAX 2147483647
@@ -154,6 +157,8 @@ static void destroy_alloc(struct hwmem_alloc *alloc)
 
 	clean_alloc_threadg_info_list(alloc);
 
+	cach_release_buf(&alloc->cach_buf);
+
 	kunmap_alloc(alloc);
 
 	if (!IS_ERR_OR_NULL(alloc->allocator_hndl))
@@ -348,6 +353,29 @@ int hwmem_set_domain(struct hwmem_alloc *alloc, enum hwmem_access access,
 }
 EXPORT_SYMBOL(hwmem_set_domain);
 
+int hwmem_set_domain_deferred(struct hwmem_alloc *alloc,
+		enum hwmem_access access, struct hwmem_region *region)
+{
+	mutex_lock(&lock);
+
+	cach_set_domain_deferred(&alloc->cach_buf, access, region);
+
+	mutex_unlock(&lock);
+
+	return 0;
+}
+EXPORT_SYMBOL(hwmem_set_domain_deferred);
+
+void hwmem_sync_deferred(void)
+{
+	mutex_lock(&lock);
+
+	cach_sync_deferred();
+
+	mutex_unlock(&lock);
+}
+EXPORT_SYMBOL(hwmem_sync_deferred);
+
 int hwmem_pin(struct hwmem_alloc *alloc, struct hwmem_mem_chunk *mem_chunks,
 							u32 *mem_chunks_length)
 {
@@ -657,6 +685,157 @@ out:
 }
 EXPORT_SYMBOL(hwmem_resolve_by_vm_addr);
 
+/* dma-buf exporter */
+
+#ifdef CONFIG_DMA_SHARED_BUFFER
+
+static enum hwmem_access dma_dir_to_access(enum dma_data_direction dir)
+{
+	switch (dir) {
+	case DMA_TO_DEVICE:
+		return HWMEM_ACCESS_READ;
+	case DMA_FROM_DEVICE:
+		return HWMEM_ACCESS_WRITE;
+	default:
+		return HWMEM_ACCESS_READ | HWMEM_ACCESS_WRITE;
+	}
+}
+
+static struct sg_table *hwmem_dma_buf_map(struct dma_buf_attachment *attach,
+					enum dma_data_direction dir)
+{
+	struct hwmem_alloc *alloc = attach->dmabuf->priv;
+	struct hwmem_region region = { .offset = 0, .count = 1, .start = 0 };
+	struct hwmem_mem_chunk *mem_chunks;
+	size_t mem_chunks_length;
+	struct sg_table *table;
+	struct scatterlist *sg;
+	int ret;
+	int i;
+
+	hwmem_pin(alloc, NULL, &mem_chunks_length);
+	mem_chunks = kmalloc(mem_chunks_length * sizeof(*mem_chunks),
+								GFP_KERNEL);
+	if (mem_chunks == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	ret = hwmem_pin(alloc, mem_chunks, &mem_chunks_length);
+	if (ret < 0)
+		goto pin_failed;
+
+	table = kzalloc(sizeof(*table), GFP_KERNEL);
+	if (table == NULL) {
+		ret = -ENOMEM;
+		goto alloc_table_failed;
+	}
+	ret = sg_alloc_table(table, mem_chunks_length, GFP_KERNEL);
+	if (ret < 0)
+		goto alloc_sg_failed;
+
+	for_each_sg(table->sgl, sg, table->nents, i) {
+		unsigned long pfn = mem_chunks[i].paddr >> PAGE_SHIFT;
+
+		/* Protected memory has no struct page, the address will do */
+		if (pfn_valid(pfn))
+			sg_set_page(sg, pfn_to_page(pfn), mem_chunks[i].size, 0);
+		else
+			sg->length = mem_chunks[i].size;
+		sg_dma_address(sg) = mem_chunks[i].paddr;
+		sg_dma_len(sg) = mem_chunks[i].size;
+	}
+	kfree(mem_chunks);
+
+	/*
+	 * Hand the buffer to the device. The cache handler only cleans or
+	 * invalidates what the CPU left behind for the access the attachment
+	 * asks for.
+	 */
+	region.end = region.size = alloc->size;
+	hwmem_set_domain(alloc, dma_dir_to_access(dir), HWMEM_DOMAIN_SYNC,
+								&region);
+
+	return table;
+
+alloc_sg_failed:
+	kfree(table);
+alloc_table_failed:
+	hwmem_unpin(alloc);
+pin_failed:
+	kfree(mem_chunks);
+
+	return ERR_PTR(ret);
+}
+
+static void hwmem_dma_buf_unmap(struct dma_buf_attachment *attach,
+			struct sg_table *table, enum dma_data_direction dir)
+{
+	struct hwmem_alloc *alloc = attach->dmabuf->priv;
+
+	sg_free_table(table);
+	kfree(table);
+	hwmem_unpin(alloc);
+}
+
+static void hwmem_dma_buf_release(struct dma_buf *dmabuf)
+{
+	hwmem_release((struct hwmem_alloc *)dmabuf->priv);
+}
+
+static const struct dma_buf_ops hwmem_dma_buf_ops = {
+	.map_dma_buf = hwmem_dma_buf_map,
+	.unmap_dma_buf = hwmem_dma_buf_unmap,
+	.release = hwmem_dma_buf_release,
+};
+
+struct dma_buf *hwmem_export_dma_buf(struct hwmem_alloc *alloc)
+{
+	struct dma_buf *dmabuf;
+
+	/* The dma-buf holds a buffer reference until its last fd is closed */
+	atomic_inc(&alloc->ref_cnt);
+
+	dmabuf = dma_buf_export(alloc, &hwmem_dma_buf_ops, alloc->size, O_RDWR);
+	if (IS_ERR(dmabuf))
+		hwmem_release(alloc);
+
+	return dmabuf;
+}
+EXPORT_SYMBOL(hwmem_export_dma_buf);
+
+struct hwmem_alloc *hwmem_resolve_by_dma_buf(struct dma_buf *dmabuf)
+{
+	struct hwmem_alloc *alloc;
+
+	if (dmabuf->ops != &hwmem_dma_buf_ops)
+		return ERR_PTR(-EINVAL);
+
+	mutex_lock(&lock);
+
+	alloc = dmabuf->priv;
+	atomic_inc(&alloc->ref_cnt);
+
+	mutex_unlock(&lock);
+
+	return alloc;
+}
+EXPORT_SYMBOL(hwmem_resolve_by_dma_buf);
+
+#else
+
+struct dma_buf *hwmem_export_dma_buf(struct hwmem_alloc *alloc)
+{
+	return ERR_PTR(-ENODEV);
+}
+EXPORT_SYMBOL(hwmem_export_dma_buf);
+
+struct hwmem_alloc *hwmem_resolve_by_dma_buf(struct dma_buf *dmabuf)
+{
+	return ERR_PTR(-ENODEV);
+}
+EXPORT_SYMBOL(hwmem_resolve_by_dma_buf);
+
+#endif /* #ifdef CONFIG_DMA_SHARED_BUFFER */
+
 /* Debug */
 
 #ifdef CONFIG_DEBUG_FS
@@ -697,13 +876,17 @@ static int print_alloc(struct hwmem_alloc *alloc, char **buf, size_t buf_size)
 				"\tPhysical address: %#x\n"
 				"\tKernel virtual address: %#x\n"
 				"\tCreator: %s\n"
-				"\tCreator thread group id: %u\n",
+				"\tCreator thread group id: %u\n"
+				"\tBytes cleaned: %llu\n"
+				"\tBytes invalidated: %llu\n",
 			(unsigned int)alloc, alloc->size, alloc->mem_type->id,
 			alloc->name, atomic_read(&alloc->ref_cnt),
 			alloc->flags, alloc->cach_buf.cache_settings,
 			alloc->default_access, alloc->paddr,
 			(unsigned int)alloc->kaddr, creator,
-			alloc->creator_tgid);
+			alloc->creator_tgid,
+			alloc->cach_buf.bytes_cleaned,
+			alloc->cach_buf.bytes_invalidated);
 		if (ret < 0)
 			return -ENOMSG;
 		else if (ret + 1 > buf_size)
@@ -769,12 +952,43 @@ out:
 	return ret;
 }
 
+static int debugfs_cache_show(struct seq_file *s, void *unused)
+{
+	struct cach_stats stats;
+
+	mutex_lock(&lock);
+	cach_get_stats(&stats);
+	mutex_unlock(&lock);
+
+	seq_printf(s, "Deferred syncs: %u\n", stats.nr_deferred_syncs);
+	seq_printf(s, "Deferred buffers: %u\n", stats.nr_deferred_bufs);
+	seq_printf(s, "Full cache cleans: %u\n", stats.nr_full_cleans);
+	seq_printf(s, "Full cache flushes: %u\n", stats.nr_full_flushes);
+
+	return 0;
+}
+
+static int debugfs_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, debugfs_cache_show, NULL);
+}
+
+static const struct file_operations debugfs_cache_fops = {
+	.owner = THIS_MODULE,
+	.open = debugfs_cache_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static void init_debugfs(void)
 {
 	/* Hwmem is never unloaded so dropping the dentrys is ok. */
 	struct dentry *debugfs_root_dir = debugfs_create_dir("hwmem", NULL);
 	(void)debugfs_create_file("allocs", 0444, debugfs_root_dir, 0,
 							&debugfs_allocs_fops);
+	(void)debugfs_create_file("cache", 0444, debugfs_root_dir, 0,
+							&debugfs_cache_fops);
 }
 
 #endif /* #ifdef CONFIG_DEBUG_FS */
@@ -19,6 +19,7 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -35,8 +36,9 @@
 #include <linux/vmalloc.h>
 
 #include "binder.h"
+#include "binder_trace.h"
 
-static DEFINE_MUTEX(binder_lock);
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 
 static HLIST_HEAD(binder_procs);
@@ -80,6 +82,13 @@ BINDER_DEBUG_ENTRY(proc);
 
 #define BINDER_SMALL_BUF_SIZE (PAGE_SIZE * 64)
 
+/*
+ * Transactions with at least this much payload copy it into the target
+ * buffer without holding binder_main_lock. Transactions that carry no
+ * objects do so at any size when they can also be queued unlocked.
+ */
+#define BINDER_UNLOCKED_COPY_MIN            SZ_1K
+
 enum {
 	BINDER_DEBUG_USER_ERROR             = 1U << 0,
 	BINDER_DEBUG_FAILED_TRANSACTION     = 1U << 1,
@@ -105,6 +114,10 @@ module_param_named(debug_mask, binder_debug_mask, uint, S_IWUSR | S_IRUGO);
 static int binder_debug_no_lock;
 module_param_named(proc_no_lock, binder_debug_no_lock, bool, S_IWUSR | S_IRUGO);
 
+static int binder_page_cache_pages = 16;
+module_param_named(page_cache_pages, binder_page_cache_pages, int,
+		   S_IWUSR | S_IRUGO);
+
 static DECLARE_WAIT_QUEUE_HEAD(binder_user_error_wait);
 static int binder_stop_on_user_error;
 
@@ -164,6 +177,89 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	binder_stats.obj_created[type]++;
 }
 
+/*
+ * binder_main_lock protects the object graph (procs, threads, nodes,
+ * refs and transaction stacks). Every acquisition goes through
+ * binder_lock()/binder_unlock() with the call site, which accounts how
+ * often each site had to wait for the lock and log2 histograms of the
+ * wait and hold times (debugfs "lock_stats"). The counters are updated
+ * with the lock held.
+ *
+ * The work lists of a proc (proc->todo, the todo lists of its threads,
+ * the async_todo lists of its nodes and delivered_death) are protected
+ * by proc->inner_lock instead, which nests inside binder_main_lock. A
+ * work item is only ever on lists of one proc. Transactions without
+ * objects are queued to their target with only inner_lock held, and
+ * waiters check their lists under it; everything else still queues and
+ * dequeues with binder_main_lock held too, so testing whether such an
+ * item is queued only needs binder_main_lock.
+ */
+enum binder_lock_site {
+	BINDER_LOCK_IOCTL,
+	BINDER_LOCK_THREAD_READ,
+	BINDER_LOCK_TRANSACTION,
+	BINDER_LOCK_POLL,
+	BINDER_LOCK_OPEN,
+	BINDER_LOCK_DEFERRED,
+	BINDER_LOCK_DEBUGFS,
+	BINDER_LOCK_SITE_COUNT
+};
+
+#define BINDER_LOCK_HIST_BUCKETS 16
+
+struct binder_lock_stats {
+	unsigned long acquired;
+	unsigned long contended;
+	u64 wait_us;
+	u64 hold_us;
+	unsigned long wait_hist[BINDER_LOCK_HIST_BUCKETS];
+	unsigned long hold_hist[BINDER_LOCK_HIST_BUCKETS];
+};
+
+static struct binder_lock_stats binder_lock_stats[BINDER_LOCK_SITE_COUNT];
+static enum binder_lock_site binder_lock_owner;
+static ktime_t binder_lock_time;
+
+static void binder_lock_account(unsigned long *hist, u64 *total, u64 us)
+{
+	unsigned int bucket = 0;
+
+	if (us)
+		bucket = min_t(unsigned int, ilog2(us) + 1,
+			       BINDER_LOCK_HIST_BUCKETS - 1);
+	hist[bucket]++;
+	*total += us;
+}
+
+static void binder_lock(enum binder_lock_site site)
+{
+	struct binder_lock_stats *ls = &binder_lock_stats[site];
+	ktime_t start;
+
+	if (mutex_trylock(&binder_main_lock)) {
+		binder_lock_time = ktime_get();
+		ls->wait_hist[0]++;
+	} else {
+		start = ktime_get();
+		mutex_lock(&binder_main_lock);
+		binder_lock_time = ktime_get();
+		ls->contended++;
+		binder_lock_account(ls->wait_hist, &ls->wait_us,
+			ktime_to_us(ktime_sub(binder_lock_time, start)));
+	}
+	ls->acquired++;
+	binder_lock_owner = site;
+}
+
+static void binder_unlock(void)
+{
+	struct binder_lock_stats *ls = &binder_lock_stats[binder_lock_owner];
+
+	binder_lock_account(ls->hold_hist, &ls->hold_us,
+		ktime_to_us(ktime_sub(ktime_get(), binder_lock_time)));
+	mutex_unlock(&binder_main_lock);
+}
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int call_type;
@@ -184,6 +280,57 @@ struct binder_transaction_log {
 static struct binder_transaction_log binder_transaction_log;
 static struct binder_transaction_log binder_transaction_log_failed;
 
+/*
+ * Per-proc and per-node transaction counters with a log2 histogram of
+ * latencies in us, from submit to reply for calls and from submit to
+ * delivery for one-way transactions.
+ */
+#define BINDER_LATENCY_BUCKETS 20
+
+struct binder_txn_stats {
+	unsigned long count;
+	u64 bytes;
+	unsigned long latency[BINDER_LATENCY_BUCKETS];
+};
+
+static void binder_txn_stats_add(struct binder_txn_stats *stats,
+				 size_t bytes)
+{
+	stats->count++;
+	stats->bytes += bytes;
+}
+
+static void binder_txn_stats_latency(struct binder_txn_stats *stats, s64 us)
+{
+	unsigned int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(unsigned int, ilog2(us) + 1,
+			       BINDER_LATENCY_BUCKETS - 1);
+	stats->latency[bucket]++;
+}
+
+/* Upper bound in us of the bucket holding the given percentile */
+static unsigned int binder_txn_stats_percentile(struct binder_txn_stats *stats,
+						unsigned int percent)
+{
+	unsigned long total = 0, target, sum = 0;
+	int i;
+
+	for (i = 0; i < BINDER_LATENCY_BUCKETS; i++)
+		total += stats->latency[i];
+	if (!total)
+		return 0;
+
+	target = DIV_ROUND_UP(total * percent, 100);
+	for (i = 0; i < BINDER_LATENCY_BUCKETS - 1; i++) {
+		sum += stats->latency[i];
+		if (sum >= target)
+			break;
+	}
+	return 1U << i;
+}
+
 static struct binder_transaction_log_entry *binder_transaction_log_add(
 	struct binder_transaction_log *log)
 {
@@ -228,10 +375,12 @@ struct binder_node {
 	unsigned pending_strong_ref:1;
 	unsigned has_weak_ref:1;
 	unsigned pending_weak_ref:1;
-	unsigned has_async_transaction:1;
 	unsigned accept_fds:1;
 	unsigned min_priority:8;
+	/* Not a bit field, it is written under proc->inner_lock only */
+	int has_async_transaction;
 	struct list_head async_todo;
+	struct binder_txn_stats txn_stats;
 };
 
 struct binder_ref_death {
@@ -291,6 +440,9 @@ struct binder_proc {
 	struct files_struct *files;
 	struct hlist_node deferred_work_node;
 	int deferred_work;
+	spinlock_t inner_lock; /* protects the work lists, see binder_lock() */
+	int tmp_ref; /* unlocked transactions in flight, under inner_lock */
+	int release_pending;
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
@@ -300,11 +452,22 @@ struct binder_proc {
 	size_t free_async_space;
 
 	struct page **pages;
+	unsigned long *page_cached;
 	size_t buffer_size;
 	uint32_t buffer_free;
+	int pages_mapped;
+	int pages_high;
+	int pages_cached;
+	unsigned long page_cache_hits;
+	unsigned long page_cache_misses;
+	size_t allocated_size;
+	size_t allocated_high;
+	unsigned long alloc_failed;
 	struct list_head todo;
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	struct binder_txn_stats txn_in;
+	struct binder_txn_stats txn_out;
 	struct list_head delivered_death;
 	int max_threads;
 	int requested_threads;
@@ -355,6 +518,9 @@ struct binder_transaction {
 	long	priority;
 	long	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	submit_time;
+	ktime_t	enqueue_time;
+	ktime_t	receive_time;
 };
 
 static void
@@ -607,15 +773,134 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 	return NULL;
 }
 
+static void binder_unmap_pages(struct binder_proc *proc,
+			       struct vm_area_struct *vma,
+			       size_t first, size_t count)
+{
+	void *page_addr = proc->buffer + first * PAGE_SIZE;
+	size_t i;
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, count * PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, count * PAGE_SIZE);
+	for (i = first; i < first + count; i++) {
+		__free_page(proc->pages[i]);
+		proc->pages[i] = NULL;
+	}
+	proc->pages_mapped -= count;
+}
+
+/*
+ * Allocate a run of missing pages and map them into the kernel with one
+ * map_vm_area() call and into the receiving process.
+ */
+static int binder_map_pages(struct binder_proc *proc,
+			    struct vm_area_struct *vma,
+			    size_t first, size_t count)
+{
+	void *page_addr = proc->buffer + first * PAGE_SIZE;
+	unsigned long user_page_addr;
+	struct vm_struct tmp_area;
+	struct page **page_array_ptr;
+	size_t i;
+	int ret;
+
+	for (i = first; i < first + count; i++) {
+		BUG_ON(proc->pages[i]);
+		proc->pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (proc->pages[i] == NULL) {
+			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+			       "for page at %p\n", proc->pid,
+			       proc->buffer + i * PAGE_SIZE);
+			goto err_alloc_page_failed;
+		}
+	}
+
+	tmp_area.addr = page_addr;
+	tmp_area.size = count * PAGE_SIZE + PAGE_SIZE /* guard page? */;
+	page_array_ptr = &proc->pages[first];
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "to map pages at %p in kernel\n",
+		       proc->pid, page_addr);
+		i = first;
+		goto err_map_failed;
+	}
+
+	for (i = first; i < first + count; i++) {
+		user_page_addr = (uintptr_t)proc->buffer + i * PAGE_SIZE +
+			proc->user_buffer_offset;
+		ret = vm_insert_page(vma, user_page_addr, proc->pages[i]);
+		if (ret) {
+			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+			       "to map page at %lx in userspace\n",
+			       proc->pid, user_page_addr);
+			goto err_map_failed;
+		}
+		/* vm_insert_page does not seem to increment the refcount */
+	}
+
+	proc->pages_mapped += count;
+	if (proc->pages_mapped > proc->pages_high)
+		proc->pages_high = proc->pages_mapped;
+	return 0;
+
+err_map_failed:
+	if (i > first)
+		zap_page_range(vma, (uintptr_t)page_addr +
+			proc->user_buffer_offset, (i - first) * PAGE_SIZE, NULL);
+	unmap_kernel_range((unsigned long)page_addr, count * PAGE_SIZE);
+	i = first + count;
+err_alloc_page_failed:
+	while (i-- > first) {
+		__free_page(proc->pages[i]);
+		proc->pages[i] = NULL;
+	}
+	return -ENOMEM;
+}
+
+/*
+ * Pages no longer used by any buffer go to the proc's page cache, where
+ * they stay mapped until a buffer needs that part of the area again.
+ * Past binder_page_cache_pages, the highest cached pages are unmapped
+ * and freed: best-fit allocation mostly reuses the start of the area.
+ */
+static void binder_release_pages(struct binder_proc *proc,
+				 struct vm_area_struct *vma,
+				 size_t first, size_t last)
+{
+	size_t npages = proc->buffer_size / PAGE_SIZE;
+	size_t i, start, end, excess;
+
+	for (i = first; i < last; i++) {
+		BUG_ON(proc->pages[i] == NULL);
+		BUG_ON(test_bit(i, proc->page_cached));
+		__set_bit(i, proc->page_cached);
+	}
+	proc->pages_cached += last - first;
+
+	while (proc->pages_cached > max(binder_page_cache_pages, 0)) {
+		excess = proc->pages_cached - max(binder_page_cache_pages, 0);
+		end = find_last_bit(proc->page_cached, npages) + 1;
+		start = end - 1;
+		while (start > 0 && end - start < excess &&
+		       test_bit(start - 1, proc->page_cached))
+			start--;
+		bitmap_clear(proc->page_cached, start, end - start);
+		proc->pages_cached -= end - start;
+		binder_unmap_pages(proc, vma, start, end - start);
+	}
+}
+
 static int binder_update_page_range(struct binder_proc *proc, int allocate,
 				    void *start, void *end,
 				    struct vm_area_struct *vma)
 {
-	void *page_addr;
-	unsigned long user_page_addr;
-	struct vm_struct tmp_area;
-	struct page **page;
 	struct mm_struct *mm;
+	size_t index, first, last, run;
+	int ret = 0;
 
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: %s pages %p-%p\n", proc->pid,
@@ -634,75 +919,51 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		vma = proc->vma;
 	}
 
-	if (allocate == 0)
-		goto free_range;
+	first = (start - proc->buffer) / PAGE_SIZE;
+	last = (end - proc->buffer) / PAGE_SIZE;
+
+	if (allocate == 0) {
+		binder_release_pages(proc, vma, first, last);
+		goto out;
+	}
 
 	if (vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
 		       "map pages in userspace, no vma\n", proc->pid);
-		goto err_no_vma;
+		ret = -ENOMEM;
+		goto out;
 	}
 
-	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-
-		BUG_ON(*page);
-		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (*page == NULL) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "for page at %p\n", proc->pid, page_addr);
-			goto err_alloc_page_failed;
+	index = first;
+	while (index < last) {
+		if (proc->pages[index]) {
+			BUG_ON(!test_bit(index, proc->page_cached));
+			__clear_bit(index, proc->page_cached);
+			proc->pages_cached--;
+			proc->page_cache_hits++;
+			index++;
+			continue;
 		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
+		for (run = 1; index + run < last; run++) {
+			if (proc->pages[index + run])
+				break;
 		}
-		user_page_addr =
-			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
+		ret = binder_map_pages(proc, vma, index, run);
 		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %lx in userspace\n",
-			       proc->pid, user_page_addr);
-			goto err_vm_insert_page_failed;
+			if (index > first)
+				binder_release_pages(proc, vma, first, index);
+			goto out;
 		}
-		/* vm_insert_page does not seem to increment the refcount */
-	}
-	if (mm) {
-		up_write(&mm->mmap_sem);
-		mmput(mm);
+		proc->page_cache_misses += run;
+		index += run;
 	}
-	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
-err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
-err_map_kernel_failed:
-		__free_page(*page);
-		*page = NULL;
-err_alloc_page_failed:
-		;
-	}
-err_no_vma:
+out:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
-	return -ENOMEM;
+	return ret;
 }
 
 static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
@@ -758,6 +1019,7 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	if (best_fit == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf size %zd failed, "
 		       "no address space\n", proc->pid, size);
+		proc->alloc_failed++;
 		return NULL;
 	}
 	if (n == NULL) {
@@ -794,6 +1056,9 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 		new_buffer->free = 1;
 		binder_insert_free_buffer(proc, new_buffer);
 	}
+	proc->allocated_size += binder_buffer_size(proc, buffer);
+	if (proc->allocated_size > proc->allocated_high)
+		proc->allocated_high = proc->allocated_size;
 	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
 		     "binder: %d: binder_alloc_buf size %zd got "
 		     "%p\n", proc->pid, size, buffer);
@@ -888,6 +1153,7 @@ static void binder_free_buf(struct binder_proc *proc,
 	BUG_ON((void *)buffer < proc->buffer);
 	BUG_ON((void *)buffer > proc->buffer + proc->buffer_size);
 
+	proc->allocated_size -= buffer_size;
 	if (buffer->async_transaction) {
 		proc->free_async_space += size + sizeof(struct binder_buffer);
 
@@ -982,6 +1248,34 @@ static struct binder_node *binder_new_node(struct binder_proc *proc,
 	return node;
 }
 
+static void binder_enqueue_work(struct binder_proc *proc,
+				struct binder_work *work,
+				struct list_head *target_list)
+{
+	spin_lock(&proc->inner_lock);
+	list_add_tail(&work->entry, target_list);
+	spin_unlock(&proc->inner_lock);
+}
+
+static void binder_dequeue_work(struct binder_proc *proc,
+				struct binder_work *work)
+{
+	spin_lock(&proc->inner_lock);
+	list_del_init(&work->entry);
+	spin_unlock(&proc->inner_lock);
+}
+
+static int binder_worklist_empty(struct binder_proc *proc,
+				 struct list_head *list)
+{
+	int ret;
+
+	spin_lock(&proc->inner_lock);
+	ret = list_empty(list);
+	spin_unlock(&proc->inner_lock);
+	return ret;
+}
+
 static int binder_inc_node(struct binder_node *node, int strong, int internal,
 			   struct list_head *target_list)
 {
@@ -999,8 +1293,10 @@ static int binder_inc_node(struct binder_node *node, int strong, int internal,
 		} else
 			node->local_strong_refs++;
 		if (!node->has_strong_ref && target_list) {
+			spin_lock(&node->proc->inner_lock);
 			list_del_init(&node->work.entry);
 			list_add_tail(&node->work.entry, target_list);
+			spin_unlock(&node->proc->inner_lock);
 		}
 	} else {
 		if (!internal)
@@ -1011,7 +1307,8 @@ static int binder_inc_node(struct binder_node *node, int strong, int internal,
 					"for %d\n", node->debug_id);
 				return -EINVAL;
 			}
-			list_add_tail(&node->work.entry, target_list);
+			binder_enqueue_work(node->proc, &node->work,
+					    target_list);
 		}
 	}
 	return 0;
@@ -1034,14 +1331,16 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 	}
 	if (node->proc && (node->has_strong_ref || node->has_weak_ref)) {
 		if (list_empty(&node->work.entry)) {
-			list_add_tail(&node->work.entry, &node->proc->todo);
+			binder_enqueue_work(node->proc, &node->work,
+					    &node->proc->todo);
 			wake_up_interruptible(&node->proc->wait);
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
 		    !node->local_weak_refs) {
-			list_del_init(&node->work.entry);
+			/* A dead node was dequeued when its proc went away */
 			if (node->proc) {
+				binder_dequeue_work(node->proc, &node->work);
 				rb_erase(&node->rb_node, &node->proc->nodes);
 				binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 					     "binder: refless node %d deleted\n",
@@ -1165,7 +1464,7 @@ static void binder_delete_ref(struct binder_ref *ref)
 			     "binder: %d delete ref %d desc %d "
 			     "has death notification\n", ref->proc->pid,
 			     ref->debug_id, ref->desc);
-		list_del(&ref->death->work.entry);
+		binder_dequeue_work(ref->proc, &ref->death->work);
 		kfree(ref->death);
 		binder_stats_deleted(BINDER_STAT_DEATH);
 	}
@@ -1375,6 +1674,138 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+/*
+ * Pin a proc while binder_main_lock is dropped: its deferred release is
+ * postponed until the last pin goes away. Unpinning does not need
+ * binder_main_lock, but the proc must not be touched after it.
+ */
+static void binder_proc_pin(struct binder_proc *proc)
+{
+	spin_lock(&proc->inner_lock);
+	proc->tmp_ref++;
+	spin_unlock(&proc->inner_lock);
+}
+
+static void binder_proc_unpin(struct binder_proc *proc)
+{
+	int release;
+
+	spin_lock(&proc->inner_lock);
+	release = --proc->tmp_ref == 0 && proc->release_pending;
+	if (release)
+		proc->release_pending = 0;
+	spin_unlock(&proc->inner_lock);
+	if (release)
+		binder_defer_work(proc, BINDER_DEFERRED_RELEASE);
+}
+
+/*
+ * A synchronous transaction is delivered to the innermost thread of the
+ * target proc that is waiting on a transaction from this thread, if any.
+ */
+static struct binder_thread *binder_stack_target_thread(
+	struct binder_thread *thread, struct binder_proc *target_proc)
+{
+	struct binder_transaction *tmp;
+	struct binder_thread *target_thread = NULL;
+
+	for (tmp = thread->transaction_stack; tmp; tmp = tmp->from_parent) {
+		if (tmp->from && tmp->from->proc == target_proc)
+			target_thread = tmp->from;
+	}
+	return target_thread;
+}
+
+static int binder_copy_transaction_data(struct binder_proc *proc,
+					struct binder_thread *thread,
+					struct binder_transaction_data *tr,
+					struct binder_buffer *buffer,
+					size_t *offp)
+{
+	if (copy_from_user(buffer->data, tr->data.ptr.buffer, tr->data_size)) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"data ptr\n", proc->pid, thread->pid);
+		return -EFAULT;
+	}
+	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"offsets ptr\n", proc->pid, thread->pid);
+		return -EFAULT;
+	}
+	return 0;
+}
+
+/*
+ * Account the round trip of call @t, which @proc is replying to, for the
+ * node it was sent to (if its buffer has not been freed yet, the node may
+ * be gone otherwise), the replying proc and the calling proc.
+ */
+static void binder_txn_reply_stats(struct binder_proc *proc,
+				   struct binder_proc *from_proc,
+				   struct binder_transaction *t, ktime_t now)
+{
+	s64 total_us = ktime_to_us(ktime_sub(now, t->submit_time));
+
+	trace_binder_transaction_reply(t,
+		ktime_to_us(ktime_sub(now, t->receive_time)), total_us);
+
+	if (t->buffer && t->buffer->target_node)
+		binder_txn_stats_latency(&t->buffer->target_node->txn_stats,
+					 total_us);
+	binder_txn_stats_latency(&proc->txn_in, total_us);
+	binder_txn_stats_latency(&from_proc->txn_out, total_us);
+}
+
+/*
+ * Queue call @t, which carries no objects, to its target proc with
+ * binder_main_lock dropped and the target proc pinned; the pin is
+ * released here. A synchronous call is only queued this way from an
+ * empty transaction stack, which no other thread pushes onto, so it
+ * goes to the proc and not to a waiting thread. @t may be received and
+ * freed as soon as it is queued.
+ */
+static void binder_queue_transaction_unlocked(struct binder_proc *proc,
+					      struct binder_thread *thread,
+					      struct binder_transaction *t,
+					      struct binder_work *tcomplete,
+					      struct binder_node *target_node,
+					      ktime_t submit_time)
+{
+	struct binder_proc *target_proc = t->to_proc;
+	struct list_head *target_list = &target_proc->todo;
+	int wake = 1;
+
+	t->submit_time = submit_time;
+	t->enqueue_time = ktime_get();
+	trace_binder_transaction(0, t, target_node,
+		ktime_to_us(ktime_sub(t->enqueue_time, submit_time)));
+	if (!(t->flags & TF_ONE_WAY)) {
+		BUG_ON(t->buffer->async_transaction != 0);
+		t->need_reply = 1;
+		t->from_parent = NULL;
+		thread->transaction_stack = t;
+	} else
+		BUG_ON(t->buffer->async_transaction != 1);
+
+	t->work.type = BINDER_WORK_TRANSACTION;
+	spin_lock(&target_proc->inner_lock);
+	if (t->flags & TF_ONE_WAY) {
+		if (target_node->has_async_transaction) {
+			target_list = &target_node->async_todo;
+			wake = 0;
+		} else
+			target_node->has_async_transaction = 1;
+	}
+	list_add_tail(&t->work.entry, target_list);
+	spin_unlock(&target_proc->inner_lock);
+	if (wake)
+		wake_up_interruptible(&target_proc->wait);
+	binder_proc_unpin(target_proc);
+
+	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
+	binder_enqueue_work(proc, tcomplete, &thread->todo);
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
 			       struct binder_transaction_data *tr, int reply)
@@ -1390,6 +1821,11 @@ static void binder_transaction(struct binder_proc *proc,
 	struct binder_transaction *in_reply_to = NULL;
 	struct binder_transaction_log_entry *e;
 	uint32_t return_error;
+	int ret;
+	int unlocked_queue;
+	ktime_t submit_time = ktime_get();
+
+	trace_binder_transaction_submit(reply, tr);
 
 	e = binder_transaction_log_add(&binder_transaction_log);
 	e->call_type = reply ? 2 : !!(tr->flags & TF_ONE_WAY);
@@ -1481,11 +1917,8 @@ static void binder_transaction(struct binder_proc *proc,
 				return_error = BR_FAILED_REPLY;
 				goto err_bad_call_stack;
 			}
-			while (tmp) {
-				if (tmp->from && tmp->from->proc == target_proc)
-					target_thread = tmp->from;
-				tmp = tmp->from_parent;
-			}
+			target_thread = binder_stack_target_thread(thread,
+								   target_proc);
 		}
 	}
 	if (target_thread) {
@@ -1558,15 +1991,61 @@ static void binder_transaction(struct binder_proc *proc,
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
-	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
+	/*
+	 * Without objects to translate and without a transaction stack to
+	 * pick the target thread from, nothing but the work lists is left
+	 * to touch once the payload is in, so the transaction is queued
+	 * with only the inner locks held.
+	 */
+	unlocked_queue = !reply && tr->offsets_size == 0 &&
+		((t->flags & TF_ONE_WAY) || thread->transaction_stack == NULL);
+
+	if (unlocked_queue ||
+	    (!reply &&
+	     tr->data_size + tr->offsets_size >= BINDER_UNLOCKED_COPY_MIN)) {
+		/*
+		 * The buffer is not reachable by the target until t is
+		 * queued, the node reference taken above keeps target_node
+		 * alive and the pin holds off the release of target_proc,
+		 * so the payload can be copied (and user pages faulted in)
+		 * without stalling every other binder caller. The thread
+		 * this transaction goes to may have exited meanwhile and is
+		 * looked up again.
+		 */
+		binder_proc_pin(target_proc);
+		binder_unlock();
+		ret = binder_copy_transaction_data(proc, thread, tr,
+						   t->buffer, offp);
+		if (!ret && unlocked_queue) {
+			binder_queue_transaction_unlocked(proc, thread, t,
+							  tcomplete,
+							  target_node,
+							  submit_time);
+			binder_lock(BINDER_LOCK_TRANSACTION);
+			binder_txn_stats_add(&proc->txn_out,
+					     tr->data_size + tr->offsets_size);
+			return;
+		}
+		binder_lock(BINDER_LOCK_TRANSACTION);
+		binder_proc_unpin(target_proc);
+
+		target_thread = NULL;
+		if (!(t->flags & TF_ONE_WAY))
+			target_thread = binder_stack_target_thread(thread,
+								   target_proc);
+		t->to_thread = target_thread;
+		e->to_thread = target_thread ? target_thread->pid : 0;
+		if (target_thread) {
+			target_list = &target_thread->todo;
+			target_wait = &target_thread->wait;
+		} else {
+			target_list = &target_proc->todo;
+			target_wait = &target_proc->wait;
+		}
+	} else
+		ret = binder_copy_transaction_data(proc, thread, tr,
+						   t->buffer, offp);
+	if (ret) {
 		return_error = BR_FAILED_REPLY;
 		goto err_copy_data_failed;
 	}
@@ -1715,27 +2194,41 @@ static void binder_transaction(struct binder_proc *proc,
 			goto err_bad_object_type;
 		}
 	}
+	t->submit_time = submit_time;
+	t->enqueue_time = ktime_get();
+	trace_binder_transaction(reply, t, target_node,
+		ktime_to_us(ktime_sub(t->enqueue_time, submit_time)));
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_txn_reply_stats(proc, target_thread->proc, in_reply_to,
+				       t->enqueue_time);
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_txn_stats_add(&proc->txn_out,
+				     tr->data_size + tr->offsets_size);
 		t->need_reply = 1;
 		t->from_parent = thread->transaction_stack;
 		thread->transaction_stack = t;
 	} else {
 		BUG_ON(target_node == NULL);
 		BUG_ON(t->buffer->async_transaction != 1);
+		binder_txn_stats_add(&proc->txn_out,
+				     tr->data_size + tr->offsets_size);
+	}
+	t->work.type = BINDER_WORK_TRANSACTION;
+	spin_lock(&target_proc->inner_lock);
+	if ((t->flags & TF_ONE_WAY) && !reply) {
 		if (target_node->has_async_transaction) {
 			target_list = &target_node->async_todo;
 			target_wait = NULL;
 		} else
 			target_node->has_async_transaction = 1;
 	}
-	t->work.type = BINDER_WORK_TRANSACTION;
 	list_add_tail(&t->work.entry, target_list);
+	spin_unlock(&target_proc->inner_lock);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
-	list_add_tail(&tcomplete->entry, &thread->todo);
+	binder_enqueue_work(proc, tcomplete, &thread->todo);
 	if (target_wait)
 		wake_up_interruptible(target_wait);
 	return;
@@ -1957,11 +2450,13 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				buffer->transaction = NULL;
 			}
 			if (buffer->async_transaction && buffer->target_node) {
+				spin_lock(&proc->inner_lock);
 				BUG_ON(!buffer->target_node->has_async_transaction);
 				if (list_empty(&buffer->target_node->async_todo))
 					buffer->target_node->has_async_transaction = 0;
 				else
 					list_move_tail(buffer->target_node->async_todo.next, &thread->todo);
+				spin_unlock(&proc->inner_lock);
 			}
 			binder_transaction_buffer_release(proc, buffer, NULL);
 			binder_free_buf(proc, buffer);
@@ -2080,9 +2575,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				if (ref->node->proc == NULL) {
 					ref->death->work.type = BINDER_WORK_DEAD_BINDER;
 					if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
-						list_add_tail(&ref->death->work.entry, &thread->todo);
+						binder_enqueue_work(proc, &ref->death->work, &thread->todo);
 					} else {
-						list_add_tail(&ref->death->work.entry, &proc->todo);
+						binder_enqueue_work(proc, &ref->death->work, &proc->todo);
 						wake_up_interruptible(&proc->wait);
 					}
 				}
@@ -2110,9 +2605,9 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				if (list_empty(&death->work.entry)) {
 					death->work.type = BINDER_WORK_CLEAR_DEATH_NOTIFICATION;
 					if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
-						list_add_tail(&death->work.entry, &thread->todo);
+						binder_enqueue_work(proc, &death->work, &thread->todo);
 					} else {
-						list_add_tail(&death->work.entry, &proc->todo);
+						binder_enqueue_work(proc, &death->work, &proc->todo);
 						wake_up_interruptible(&proc->wait);
 					}
 				} else {
@@ -2146,13 +2641,13 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 				break;
 			}
 
-			list_del_init(&death->work.entry);
+			binder_dequeue_work(proc, &death->work);
 			if (death->work.type == BINDER_WORK_DEAD_BINDER_AND_CLEAR) {
 				death->work.type = BINDER_WORK_CLEAR_DEATH_NOTIFICATION;
 				if (thread->looper & (BINDER_LOOPER_STATE_REGISTERED | BINDER_LOOPER_STATE_ENTERED)) {
-					list_add_tail(&death->work.entry, &thread->todo);
+					binder_enqueue_work(proc, &death->work, &thread->todo);
 				} else {
-					list_add_tail(&death->work.entry, &proc->todo);
+					binder_enqueue_work(proc, &death->work, &proc->todo);
 					wake_up_interruptible(&proc->wait);
 				}
 			}
@@ -2181,16 +2676,37 @@ void binder_stat_br(struct binder_proc *proc, struct binder_thread *thread,
 static int binder_has_proc_work(struct binder_proc *proc,
 				struct binder_thread *thread)
 {
-	return !list_empty(&proc->todo) ||
+	return !binder_worklist_empty(proc, &proc->todo) ||
 		(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN);
 }
 
 static int binder_has_thread_work(struct binder_thread *thread)
 {
-	return !list_empty(&thread->todo) || thread->return_error != BR_OK ||
+	return !binder_worklist_empty(thread->proc, &thread->todo) ||
+		thread->return_error != BR_OK ||
 		(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN);
 }
 
+/*
+ * The first work item for @thread, or NULL. Called with binder_main_lock
+ * held: other dequeuers are excluded and unlocked queueing only appends,
+ * so the item stays first until it is dequeued.
+ */
+static struct binder_work *binder_peek_work(struct binder_proc *proc,
+					    struct binder_thread *thread,
+					    int wait_for_proc_work)
+{
+	struct binder_work *w = NULL;
+
+	spin_lock(&proc->inner_lock);
+	if (!list_empty(&thread->todo))
+		w = list_first_entry(&thread->todo, struct binder_work, entry);
+	else if (!list_empty(&proc->todo) && wait_for_proc_work)
+		w = list_first_entry(&proc->todo, struct binder_work, entry);
+	spin_unlock(&proc->inner_lock);
+	return w;
+}
+
 static int binder_thread_read(struct binder_proc *proc,
 			      struct binder_thread *thread,
 			      void  __user *buffer, int size,
@@ -2210,7 +2726,7 @@ static int binder_thread_read(struct binder_proc *proc,
 
 retry:
 	wait_for_proc_work = thread->transaction_stack == NULL &&
-				list_empty(&thread->todo);
+				binder_worklist_empty(proc, &thread->todo);
 
 	if (thread->return_error != BR_OK && ptr < end) {
 		if (thread->return_error2 != BR_OK) {
@@ -2232,7 +2748,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2256,7 +2772,7 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	binder_lock(BINDER_LOCK_THREAD_READ);
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2270,11 +2786,8 @@ retry:
 		struct binder_work *w;
 		struct binder_transaction *t = NULL;
 
-		if (!list_empty(&thread->todo))
-			w = list_first_entry(&thread->todo, struct binder_work, entry);
-		else if (!list_empty(&proc->todo) && wait_for_proc_work)
-			w = list_first_entry(&proc->todo, struct binder_work, entry);
-		else {
+		w = binder_peek_work(proc, thread, wait_for_proc_work);
+		if (w == NULL) {
 			if (ptr - buffer == 4 && !(thread->looper & BINDER_LOOPER_STATE_NEED_RETURN)) /* no data added */
 				goto retry;
 			break;
@@ -2298,7 +2811,7 @@ retry:
 				     "binder: %d:%d BR_TRANSACTION_COMPLETE\n",
 				     proc->pid, thread->pid);
 
-			list_del(&w->entry);
+			binder_dequeue_work(proc, w);
 			kfree(w);
 			binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 		} break;
@@ -2345,7 +2858,7 @@ retry:
 					     "binder: %d:%d %s %d u%p c%p\n",
 					     proc->pid, thread->pid, cmd_name, node->debug_id, node->ptr, node->cookie);
 			} else {
-				list_del_init(&w->entry);
+				binder_dequeue_work(proc, w);
 				if (!weak && !strong) {
 					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 						     "binder: %d:%d node %d u%p c%p deleted\n",
@@ -2388,11 +2901,14 @@ retry:
 				      death->cookie);
 
 			if (w->type == BINDER_WORK_CLEAR_DEATH_NOTIFICATION) {
-				list_del(&w->entry);
+				binder_dequeue_work(proc, w);
 				kfree(death);
 				binder_stats_deleted(BINDER_STAT_DEATH);
-			} else
+			} else {
+				spin_lock(&proc->inner_lock);
 				list_move(&w->entry, &proc->delivered_death);
+				spin_unlock(&proc->inner_lock);
+			}
 			if (cmd == BR_DEAD_BINDER)
 				goto done; /* DEAD_BINDER notifications can cause transactions */
 		} break;
@@ -2402,8 +2918,25 @@ retry:
 			continue;
 
 		BUG_ON(t->buffer == NULL);
+		t->receive_time = ktime_get();
+		trace_binder_transaction_received(t,
+			ktime_to_us(ktime_sub(t->receive_time,
+					      t->enqueue_time)));
 		if (t->buffer->target_node) {
 			struct binder_node *target_node = t->buffer->target_node;
+			size_t bytes = t->buffer->data_size +
+				       t->buffer->offsets_size;
+
+			binder_txn_stats_add(&target_node->txn_stats, bytes);
+			binder_txn_stats_add(&proc->txn_in, bytes);
+			if (t->flags & TF_ONE_WAY) {
+				s64 us = ktime_to_us(ktime_sub(t->receive_time,
+							       t->submit_time));
+
+				binder_txn_stats_latency(
+					&target_node->txn_stats, us);
+				binder_txn_stats_latency(&proc->txn_in, us);
+			}
 			tr.target.ptr = target_node->ptr;
 			tr.cookie =  target_node->cookie;
 			t->saved_priority = task_nice(current);
@@ -2458,7 +2991,7 @@ retry:
 			     t->buffer->data_size, t->buffer->offsets_size,
 			     tr.data.ptr.buffer, tr.data.ptr.offsets);
 
-		list_del(&t->work.entry);
+		binder_dequeue_work(proc, &t->work);
 		t->buffer->allow_user_free = 1;
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
 			t->to_parent = thread->transaction_stack;
@@ -2490,12 +3023,21 @@ done:
 	return 0;
 }
 
-static void binder_release_work(struct list_head *list)
+static void binder_release_work(struct binder_proc *proc,
+				struct list_head *list)
 {
 	struct binder_work *w;
-	while (!list_empty(list)) {
-		w = list_first_entry(list, struct binder_work, entry);
-		list_del_init(&w->entry);
+
+	while (1) {
+		w = NULL;
+		spin_lock(&proc->inner_lock);
+		if (!list_empty(list)) {
+			w = list_first_entry(list, struct binder_work, entry);
+			list_del_init(&w->entry);
+		}
+		spin_unlock(&proc->inner_lock);
+		if (w == NULL)
+			break;
 		switch (w->type) {
 		case BINDER_WORK_TRANSACTION: {
 			struct binder_transaction *t;
@@ -2585,7 +3127,7 @@ static int binder_free_thread(struct binder_proc *proc,
 	}
 	if (send_reply)
 		binder_send_failed_reply(send_reply, BR_DEAD_REPLY);
-	binder_release_work(&thread->todo);
+	binder_release_work(proc, &thread->todo);
 	kfree(thread);
 	binder_stats_deleted(BINDER_STAT_THREAD);
 	return active_transactions;
@@ -2598,12 +3140,13 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock(BINDER_LOCK_POLL);
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
-		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+		binder_worklist_empty(proc, &thread->todo) &&
+		thread->return_error == BR_OK;
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2635,7 +3178,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	binder_lock(BINDER_LOCK_IOCTL);
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2669,7 +3212,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		}
 		if (bwr.read_size > 0) {
 			ret = binder_thread_read(proc, thread, (void __user *)bwr.read_buffer, bwr.read_size, &bwr.read_consumed, filp->f_flags & O_NONBLOCK);
-			if (!list_empty(&proc->todo))
+			if (!binder_worklist_empty(proc, &proc->todo))
 				wake_up_interruptible(&proc->wait);
 			if (ret < 0) {
 				if (copy_to_user(ubuf, &bwr, sizeof(bwr)))
@@ -2744,7 +3287,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2832,6 +3375,12 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 		failure_string = "alloc page array";
 		goto err_alloc_pages_failed;
 	}
+	proc->page_cached = kzalloc(BITS_TO_LONGS((vma->vm_end - vma->vm_start) / PAGE_SIZE) * sizeof(long), GFP_KERNEL);
+	if (proc->page_cached == NULL) {
+		ret = -ENOMEM;
+		failure_string = "alloc page cache bitmap";
+		goto err_alloc_page_cached_failed;
+	}
 	proc->buffer_size = vma->vm_end - vma->vm_start;
 
 	vma->vm_ops = &binder_vm_ops;
@@ -2857,6 +3406,9 @@ static int binder_mmap(struct file *filp, struct vm_area_struct *vma)
 	return 0;
 
 err_alloc_small_buf_failed:
+	kfree(proc->page_cached);
+	proc->page_cached = NULL;
+err_alloc_page_cached_failed:
 	kfree(proc->pages);
 	proc->pages = NULL;
 err_alloc_pages_failed:
@@ -2882,16 +3434,17 @@ static int binder_open(struct inode *nodp, struct file *filp)
 		return -ENOMEM;
 	get_task_struct(current);
 	proc->tsk = current;
+	spin_lock_init(&proc->inner_lock);
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	binder_lock(BINDER_LOCK_OPEN);
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -2972,7 +3525,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 
 		nodes++;
 		rb_erase(&node->rb_node, &proc->nodes);
-		list_del_init(&node->work.entry);
+		binder_dequeue_work(proc, &node->work);
 		if (hlist_empty(&node->refs)) {
 			kfree(node);
 			binder_stats_deleted(BINDER_STAT_NODE);
@@ -2991,7 +3544,9 @@ static void binder_deferred_release(struct binder_proc *proc)
 					death++;
 					if (list_empty(&ref->death->work.entry)) {
 						ref->death->work.type = BINDER_WORK_DEAD_BINDER;
-						list_add_tail(&ref->death->work.entry, &ref->proc->todo);
+						binder_enqueue_work(ref->proc,
+							&ref->death->work,
+							&ref->proc->todo);
 						wake_up_interruptible(&ref->proc->wait);
 					} else
 						BUG();
@@ -3010,7 +3565,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		outgoing_refs++;
 		binder_delete_ref(ref);
 	}
-	binder_release_work(&proc->todo);
+	binder_release_work(proc, &proc->todo);
 	buffers = 0;
 
 	while ((n = rb_first(&proc->allocated_buffers))) {
@@ -3037,11 +3592,12 @@ static void binder_deferred_release(struct binder_proc *proc)
 		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
 			if (proc->pages[i]) {
 				void *page_addr = proc->buffer + i * PAGE_SIZE;
-				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-					     "binder_release: %d: "
-					     "page %d at %p not freed\n",
-					     proc->pid, i,
-					     page_addr);
+				if (!test_bit(i, proc->page_cached))
+					binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+						     "binder_release: %d: "
+						     "page %d at %p not freed\n",
+						     proc->pid, i,
+						     page_addr);
 				unmap_kernel_range((unsigned long)page_addr,
 					PAGE_SIZE);
 				__free_page(proc->pages[i]);
@@ -3049,6 +3605,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 			}
 		}
 		kfree(proc->pages);
+		kfree(proc->page_cached);
 		vfree(proc->buffer);
 	}
 
@@ -3071,7 +3628,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock(BINDER_LOCK_DEFERRED);
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3095,10 +3652,19 @@ static void binder_deferred_func(struct work_struct *work)
 		if (defer & BINDER_DEFERRED_FLUSH)
 			binder_deferred_flush(proc);
 
-		if (defer & BINDER_DEFERRED_RELEASE)
-			binder_deferred_release(proc); /* frees proc */
+		if (defer & BINDER_DEFERRED_RELEASE) {
+			int pinned;
+
+			spin_lock(&proc->inner_lock);
+			pinned = proc->tmp_ref;
+			if (pinned)
+				proc->release_pending = 1;
+			spin_unlock(&proc->inner_lock);
+			if (!pinned)
+				binder_deferred_release(proc); /* frees proc */
+		}
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3211,9 +3777,11 @@ static void print_binder_thread(struct seq_file *m,
 			t = NULL;
 		}
 	}
+	spin_lock(&thread->proc->inner_lock);
 	list_for_each_entry(w, &thread->todo, entry) {
 		print_binder_work(m, "    ", "    pending transaction", w);
 	}
+	spin_unlock(&thread->proc->inner_lock);
 	if (!print_always && m->count == header_pos)
 		m->count = start_pos;
 }
@@ -3240,9 +3808,14 @@ static void print_binder_node(struct seq_file *m, struct binder_node *node)
 			seq_printf(m, " %d", ref->proc->pid);
 	}
 	seq_puts(m, "\n");
+	/* Nothing queues to a dead node, which has no proc to lock */
+	if (node->proc)
+		spin_lock(&node->proc->inner_lock);
 	list_for_each_entry(w, &node->async_todo, entry)
 		print_binder_work(m, "    ",
 				  "    pending async transaction", w);
+	if (node->proc)
+		spin_unlock(&node->proc->inner_lock);
 }
 
 static void print_binder_ref(struct seq_file *m, struct binder_ref *ref)
@@ -3282,12 +3855,14 @@ static void print_binder_proc(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	spin_lock(&proc->inner_lock);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
 		seq_puts(m, "  has delivered dead binder\n");
 		break;
 	}
+	spin_unlock(&proc->inner_lock);
 	if (!print_all && m->count == header_pos)
 		m->count = start_pos;
 }
@@ -3383,6 +3958,7 @@ static void print_binder_proc_stats(struct seq_file *m,
 	struct binder_work *w;
 	struct rb_node *n;
 	int count, strong, weak;
+	size_t free_size, largest_free;
 
 	seq_printf(m, "proc %d\n", proc->pid);
 	count = 0;
@@ -3414,8 +3990,31 @@ static void print_binder_proc_stats(struct seq_file *m,
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  buffer space: %zd allocated (high %zd) of %zd, "
+		   "failed %lu\n", proc->allocated_size,
+		   proc->allocated_high, proc->buffer_size,
+		   proc->alloc_failed);
 
 	count = 0;
+	free_size = 0;
+	for (n = rb_first(&proc->free_buffers); n != NULL; n = rb_next(n)) {
+		count++;
+		free_size += binder_buffer_size(proc, rb_entry(n,
+				struct binder_buffer, rb_node));
+	}
+	n = rb_last(&proc->free_buffers);
+	largest_free = n ? binder_buffer_size(proc, rb_entry(n,
+				struct binder_buffer, rb_node)) : 0;
+	seq_printf(m, "  free buffers: %d, %zd bytes, largest %zd "
+		   "(fragmentation %zd%%)\n", count, free_size, largest_free,
+		   free_size ? 100 - largest_free * 100 / free_size : 0);
+	seq_printf(m, "  pages: %d mapped (high %d), %d cached, "
+		   "cache hits %lu misses %lu\n", proc->pages_mapped,
+		   proc->pages_high, proc->pages_cached,
+		   proc->page_cache_hits, proc->page_cache_misses);
+
+	count = 0;
+	spin_lock(&proc->inner_lock);
 	list_for_each_entry(w, &proc->todo, entry) {
 		switch (w->type) {
 		case BINDER_WORK_TRANSACTION:
@@ -3425,6 +4024,7 @@ static void print_binder_proc_stats(struct seq_file *m,
 			break;
 		}
 	}
+	spin_unlock(&proc->inner_lock);
 	seq_printf(m, "  pending transactions: %d\n", count);
 
 	print_binder_stats(m, "  ", &proc->stats);
@@ -3439,7 +4039,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(BINDER_LOCK_DEBUGFS);
 
 	seq_puts(m, "binder state:\n");
 
@@ -3451,7 +4051,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3462,7 +4062,7 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(BINDER_LOCK_DEBUGFS);
 
 	seq_puts(m, "binder stats:\n");
 
@@ -3471,7 +4071,7 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3482,13 +4082,13 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(BINDER_LOCK_DEBUGFS);
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3498,11 +4098,104 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock(BINDER_LOCK_DEBUGFS);
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
+	return 0;
+}
+
+static const char *binder_lock_site_strings[] = {
+	"ioctl",
+	"thread_read",
+	"transaction",
+	"poll",
+	"open",
+	"deferred",
+	"debugfs"
+};
+
+static void print_binder_lock_hist(struct seq_file *m, const char *name,
+				   unsigned long *hist)
+{
+	int i;
+
+	seq_printf(m, "  %s:", name);
+	for (i = 0; i < BINDER_LOCK_HIST_BUCKETS; i++)
+		seq_printf(m, " %lu", hist[i]);
+	seq_puts(m, "\n");
+}
+
+static int binder_lock_stats_show(struct seq_file *m, void *unused)
+{
+	struct binder_lock_stats *ls;
+	int i;
+
+	BUILD_BUG_ON(ARRAY_SIZE(binder_lock_site_strings) !=
+		     BINDER_LOCK_SITE_COUNT);
+
+	binder_lock(BINDER_LOCK_DEBUGFS);
+	seq_puts(m, "binder lock stats:\n");
+	seq_puts(m, "histogram buckets (us): 0");
+	for (i = 1; i < BINDER_LOCK_HIST_BUCKETS; i++)
+		seq_printf(m, " %u", 1 << (i - 1));
+	seq_puts(m, "\n");
+	for (i = 0; i < BINDER_LOCK_SITE_COUNT; i++) {
+		ls = &binder_lock_stats[i];
+		if (!ls->acquired)
+			continue;
+		seq_printf(m, "%s: acquired %lu contended %lu "
+			   "wait %llu us hold %llu us\n",
+			   binder_lock_site_strings[i], ls->acquired,
+			   ls->contended, ls->wait_us, ls->hold_us);
+		print_binder_lock_hist(m, "wait", ls->wait_hist);
+		print_binder_lock_hist(m, "hold", ls->hold_hist);
+	}
+	binder_unlock();
+	return 0;
+}
+
+static void print_binder_txn_stats(struct seq_file *m, const char *prefix,
+				   struct binder_txn_stats *stats)
+{
+	seq_printf(m, "%s: count %lu bytes %llu p50 <%uus p99 <%uus\n",
+		   prefix, stats->count, stats->bytes,
+		   binder_txn_stats_percentile(stats, 50),
+		   binder_txn_stats_percentile(stats, 99));
+}
+
+static int binder_transaction_stats_show(struct seq_file *m, void *unused)
+{
+	struct binder_proc *proc;
+	struct hlist_node *pos;
+	struct rb_node *n;
+	char prefix[24];
+	int do_lock = !binder_debug_no_lock;
+
+	if (do_lock)
+		binder_lock(BINDER_LOCK_DEBUGFS);
+
+	seq_puts(m, "binder transaction stats:\n");
+	hlist_for_each_entry(proc, pos, &binder_procs, proc_node) {
+		if (!proc->txn_in.count && !proc->txn_out.count)
+			continue;
+		seq_printf(m, "proc %d\n", proc->pid);
+		print_binder_txn_stats(m, "  outgoing", &proc->txn_out);
+		print_binder_txn_stats(m, "  incoming", &proc->txn_in);
+		for (n = rb_first(&proc->nodes); n != NULL; n = rb_next(n)) {
+			struct binder_node *node = rb_entry(n,
+					struct binder_node, rb_node);
+
+			if (!node->txn_stats.count)
+				continue;
+			snprintf(prefix, sizeof(prefix), "  node %d",
+				 node->debug_id);
+			print_binder_txn_stats(m, prefix, &node->txn_stats);
+		}
+	}
+	if (do_lock)
+		binder_unlock();
 	return 0;
 }
 
@@ -3551,6 +4244,8 @@ BINDER_DEBUG_ENTRY(state);
 BINDER_DEBUG_ENTRY(stats);
 BINDER_DEBUG_ENTRY(transactions);
 BINDER_DEBUG_ENTRY(transaction_log);
+BINDER_DEBUG_ENTRY(lock_stats);
+BINDER_DEBUG_ENTRY(transaction_stats);
 
 static int __init binder_init(void)
 {
@@ -3591,10 +4286,23 @@ static int __init binder_init(void)
 				    binder_debugfs_dir_entry_root,
 				    &binder_transaction_log_failed,
 				    &binder_transaction_log_fops);
+		debugfs_create_file("transaction_stats",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_transaction_stats_fops);
+		debugfs_create_file("lock_stats",
+				    S_IRUGO,
+				    binder_debugfs_dir_entry_root,
+				    NULL,
+				    &binder_lock_stats_fops);
 	}
 	return ret;
 }
 
 device_initcall(binder_init);
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
 MODULE_LICENSE("GPL v2");
@@ -0,0 +1,147 @@
+/*
+ * binder_trace.h
+ *
+ * Android IPC Subsystem
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+struct binder_node;
+struct binder_proc;
+struct binder_thread;
+struct binder_transaction;
+
+/*
+ * A transaction goes through four events:
+ *   binder_transaction_submit    BC_TRANSACTION/BC_REPLY read from the
+ *                                sender (no debug id assigned yet)
+ *   binder_transaction           queued on the target todo list, with
+ *                                the time spent since submit
+ *   binder_transaction_received  picked up by a target thread, with the
+ *                                time spent queued
+ *   binder_transaction_reply     replied to, with the round trip time
+ *                                since the call was submitted
+ */
+
+TRACE_EVENT(binder_transaction_submit,
+	TP_PROTO(bool reply, struct binder_transaction_data *tr),
+	TP_ARGS(reply, tr),
+
+	TP_STRUCT__entry(
+		__field(int, reply)
+		__field(unsigned int, handle)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+		__field(size_t, data_size)
+		__field(size_t, offsets_size)
+	),
+
+	TP_fast_assign(
+		__entry->reply = reply;
+		__entry->handle = reply ? 0 : tr->target.handle;
+		__entry->code = tr->code;
+		__entry->flags = tr->flags;
+		__entry->data_size = tr->data_size;
+		__entry->offsets_size = tr->offsets_size;
+	),
+
+	TP_printk("reply=%d handle=%u code=0x%x flags=0x%x size=%zd-%zd",
+		  __entry->reply, __entry->handle, __entry->code,
+		  __entry->flags, __entry->data_size, __entry->offsets_size)
+);
+
+TRACE_EVENT(binder_transaction,
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 struct binder_node *target_node, s64 submit_us),
+	TP_ARGS(reply, t, target_node, submit_us),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+		__field(s64, submit_us)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node ? target_node->debug_id : 0;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = t->to_thread ? t->to_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+		__entry->submit_us = submit_us;
+	),
+
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x submit_us=%lld",
+		  __entry->debug_id, __entry->target_node, __entry->to_proc,
+		  __entry->to_thread, __entry->reply, __entry->flags,
+		  __entry->code, __entry->submit_us)
+);
+
+TRACE_EVENT(binder_transaction_received,
+	TP_PROTO(struct binder_transaction *t, s64 queued_us),
+	TP_ARGS(t, queued_us),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(s64, queued_us)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->queued_us = queued_us;
+	),
+
+	TP_printk("transaction=%d queued_us=%lld",
+		  __entry->debug_id, __entry->queued_us)
+);
+
+TRACE_EVENT(binder_transaction_reply,
+	TP_PROTO(struct binder_transaction *t, s64 service_us, s64 total_us),
+	TP_ARGS(t, service_us, total_us),
+
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(s64, service_us)
+		__field(s64, total_us)
+	),
+
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->service_us = service_us;
+		__entry->total_us = total_us;
+	),
+
+	TP_printk("transaction=%d service_us=%lld total_us=%lld",
+		  __entry->debug_id, __entry->service_us, __entry->total_us)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE binder_trace
+#include <trace/define_trace.h>
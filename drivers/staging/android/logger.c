@@ -19,6 +19,7 @@
 
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/device.h>
 #include <linux/fs.h>
 #include <linux/miscdevice.h>
 #include <linux/uaccess.h>
@@ -30,22 +31,50 @@
 #include <asm/ioctls.h>
 #include <mach/sec_debug.h>
 
+/*
+ * Writers do not take any lock. Positions in the ring are free-running
+ * byte counts that double as sequence numbers, and logger_offset() maps
+ * them into the buffer:
+ *
+ *	tail <= c_off <= w_off <= tail + size
+ *
+ *	[tail, c_off)	committed entries, readable
+ *	[c_off, w_off)	entries reserved by writers still copying them in
+ *
+ * A writer reserves room for its entry by advancing w_off with cmpxchg,
+ * first pushing tail past the oldest committed entries it overwrites.
+ * The payload is gathered from userspace before reserving, and the
+ * reservation, copy and commit run with preemption disabled, so a writer
+ * waiting for the writers ahead of it to commit only waits for their
+ * memcpy. Commits are made in reservation order.
+ *
+ * Readers are never fixed up by writers. A reader copies an entry out of
+ * the ring, then checks that tail has not moved past the entry's
+ * position, in which case it was lapped: the copy is discarded and the
+ * reader restarts at tail.
+ */
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting. The mutex 'mutex' protects the
+ * readers list and reader state; the ring positions are lock-free.
  */
 struct logger_log {
 	unsigned char 		*buffer;/* the ring buffer itself */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
-	size_t			head;	/* new readers start here */
+	struct mutex		mutex;	/* mutex protecting readers */
+	unsigned long		w_off;	/* end of reserved entries */
+	unsigned long		c_off;	/* end of committed entries */
+	unsigned long		tail;	/* oldest entry in the log */
+	unsigned long		head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	atomic_long_t		overwritten; /* bytes pushed out of the log */
+	atomic_long_t		dropped; /* bytes of entries not logged */
+	atomic_long_t		lapped;	/* bytes readers were lapped by */
 };
 
 /*
@@ -57,11 +86,18 @@ struct logger_log {
 struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
-	size_t			r_off;	/* current read head offset */
+	unsigned long		r_off;	/* current read position */
 	bool			r_all;	/* reader can read all entries */
 	int			r_ver;	/* reader ABI version */
+	unsigned char		*buf;	/* copy of the entry at r_off */
 };
 
+#define LOGGER_ENTRY_MAX_LEN \
+	(sizeof(struct logger_entry) + LOGGER_ENTRY_MAX_PAYLOAD)
+
+/* payloads up to this size are gathered on the writer's stack */
+#define LOGGER_STACK_PAYLOAD	256
+
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
 #define logger_offset(n)	((n) & (log->size - 1))
 
@@ -109,21 +145,6 @@ static struct logger_entry *get_entry_header(struct logger_log *log,
 	return (struct logger_entry *) (log->buffer + off);
 }
 
-/*
- * get_entry_msg_len - Grabs the length of the message of the entry
- * starting from from 'off'.
- *
- * Caller needs to hold log->mutex.
- */
-static __u32 get_entry_msg_len(struct logger_log *log, size_t off)
-{
-	struct logger_entry scratch;
-	struct logger_entry *entry;
-
-	entry = get_entry_header(log, off, &scratch);
-	return entry->len;
-}
-
 static size_t get_user_hdr_len(int ver)
 {
 	if (ver < 2)
@@ -157,78 +178,78 @@ static ssize_t copy_header_to_user(int ver, struct logger_entry *entry,
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
- *
- * Caller must hold log->mutex.
+ * copy_from_log - copies 'count' bytes at position 'pos' out of the ring
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void copy_from_log(struct logger_log *log, void *buf,
+			  unsigned long pos, size_t count)
 {
-	struct logger_entry scratch;
-	struct logger_entry *entry;
-	size_t len;
-	size_t msg_start;
-
-	/*
-	 * First, copy the header to userspace, using the version of
-	 * the header requested
-	 */
-	entry = get_entry_header(log, reader->r_off, &scratch);
-	if (copy_header_to_user(reader->r_ver, entry, buf))
-		return -EFAULT;
-
-	count -= get_user_hdr_len(reader->r_ver);
-	buf += get_user_hdr_len(reader->r_ver);
-	msg_start = logger_offset(reader->r_off + sizeof(struct logger_entry));
-
-	/*
-	 * We read from the msg in two disjoint operations. First, we read from
-	 * the current msg head offset up to 'count' bytes or to the end of
-	 * the log, whichever comes first.
-	 */
-	len = min(count, log->size - msg_start);
-	if (copy_to_user(buf, log->buffer + msg_start, len))
-		return -EFAULT;
+	size_t off = logger_offset(pos);
+	size_t len = min(count, log->size - off);
 
-	/*
-	 * Second, we read any remaining bytes, starting back at the head of
-	 * the log.
-	 */
+	memcpy(buf, log->buffer + off, len);
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
+		memcpy(buf + len, log->buffer, count - len);
+}
+
+/*
+ * fetch_entry - copies the entry at the reader's position into its
+ * buffer. Returns 0 on success or -EAGAIN if the reader has read every
+ * committed entry.
+ *
+ * Caller must hold log->mutex.
+ */
+static int fetch_entry(struct logger_log *log, struct logger_reader *reader)
+{
+	struct logger_entry *entry = (struct logger_entry *)reader->buf;
+	unsigned long c_off, tail;
 
-	reader->r_off = logger_offset(reader->r_off +
-		sizeof(struct logger_entry) + count);
+	while (1) {
+		c_off = ACCESS_ONCE(log->c_off);
+		smp_rmb();
+		if (reader->r_off == c_off)
+			return -EAGAIN;
+
+		tail = ACCESS_ONCE(log->tail);
+		if ((long)(tail - reader->r_off) > 0) {
+			atomic_long_add(tail - reader->r_off, &log->lapped);
+			reader->r_off = tail;
+			continue;
+		}
 
-	return count + get_user_hdr_len(reader->r_ver);
+		copy_from_log(log, entry, reader->r_off,
+			      sizeof(struct logger_entry));
+		/* a lapped copy is discarded below, just keep it in bounds */
+		copy_from_log(log, entry->msg,
+			      reader->r_off + sizeof(struct logger_entry),
+			      min_t(size_t, entry->len,
+				    LOGGER_ENTRY_MAX_PAYLOAD));
+
+		/* did a writer reserve over the entry while we copied it? */
+		smp_rmb();
+		if ((long)(ACCESS_ONCE(log->tail) - reader->r_off) <= 0)
+			return 0;
+	}
 }
 
 /*
- * get_next_entry_by_uid - Starting at 'off', returns an offset into
- * 'log->buffer' which contains the first entry readable by 'euid'
+ * fetch_next_entry - like fetch_entry, but skips the entries the reader
+ * may not read.
+ *
+ * Caller must hold log->mutex.
  */
-static size_t get_next_entry_by_uid(struct logger_log *log,
-		size_t off, uid_t euid)
+static int fetch_next_entry(struct logger_log *log,
+			    struct logger_reader *reader)
 {
-	while (off != log->w_off) {
-		struct logger_entry *entry;
-		struct logger_entry scratch;
-		size_t next_len;
-
-		entry = get_entry_header(log, off, &scratch);
+	struct logger_entry *entry = (struct logger_entry *)reader->buf;
+	int ret;
 
-		if (entry->euid == euid)
-			return off;
+	while (1) {
+		ret = fetch_entry(log, reader);
+		if (ret || reader->r_all || entry->euid == current_euid())
+			return ret;
 
-		next_len = sizeof(struct logger_entry) + entry->len;
-		off = logger_offset(off + next_len);
+		reader->r_off += sizeof(struct logger_entry) + entry->len;
 	}
-
-	return off;
 }
 
 /*
@@ -248,6 +269,7 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	struct logger_entry *entry = (struct logger_entry *)reader->buf;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
@@ -255,9 +277,7 @@ start:
 	while (1) {
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
-		mutex_lock(&log->mutex);
-		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		ret = (ACCESS_ONCE(log->c_off) == reader->r_off);
 		if (!ret)
 			break;
 
@@ -280,26 +300,28 @@ start:
 
 	mutex_lock(&log->mutex);
 
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
 	/* is there still something to read or did we race? */
-	if (unlikely(log->w_off == reader->r_off)) {
+	if (unlikely(fetch_next_entry(log, reader))) {
 		mutex_unlock(&log->mutex);
 		goto start;
 	}
 
 	/* get the size of the next entry */
-	ret = get_user_hdr_len(reader->r_ver) +
-		get_entry_msg_len(log, reader->r_off);
+	ret = get_user_hdr_len(reader->r_ver) + entry->len;
 	if (count < ret) {
 		ret = -EINVAL;
 		goto out;
 	}
 
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	if (copy_header_to_user(reader->r_ver, entry, buf) ||
+	    copy_to_user(buf + get_user_hdr_len(reader->r_ver), entry->msg,
+			 entry->len)) {
+		ret = -EFAULT;
+		goto out;
+	}
+
+	reader->r_off += sizeof(struct logger_entry) + entry->len;
 
 out:
 	mutex_unlock(&log->mutex);
@@ -308,121 +330,105 @@ out:
 }
 
 /*
- * get_next_entry - return the offset of the first valid entry at least 'len'
- * bytes after 'off'.
- *
- * Caller must hold log->mutex.
+ * push_tail - drops the oldest entry, at 'tail', to make room for a new
+ * one. Returns false if there is no committed entry to drop.
  */
-static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
+static bool push_tail(struct logger_log *log, unsigned long tail)
 {
-	size_t count = 0;
+	struct logger_entry scratch;
+	struct logger_entry *entry;
+	unsigned long next;
 
-	do {
-		size_t nr = sizeof(struct logger_entry) +
-			get_entry_msg_len(log, off);
-		off = logger_offset(off + nr);
-		count += nr;
-	} while (count < len);
+	if (ACCESS_ONCE(log->c_off) == tail)
+		return false;
+	smp_rmb();
+
+	/*
+	 * The header is only stable while tail stays put; if it moved, the
+	 * value read here is garbage but the cmpxchg below fails.
+	 */
+	entry = get_entry_header(log, logger_offset(tail), &scratch);
+	next = tail + sizeof(struct logger_entry) + entry->len;
 
-	return off;
+	if (cmpxchg(&log->tail, tail, next) == tail)
+		atomic_long_add(next - tail, &log->overwritten);
+
+	return true;
 }
 
 /*
- * clock_interval - is a < c < b in mod-space? Put another way, does the line
- * from a to b cross c?
+ * reserve_entry - reserves 'len' bytes at the write end of the log.
+ * Returns the position of the reservation in 'pos', or -ENOSPC if the
+ * log is full of entries that are still being written.
  */
-static inline int clock_interval(size_t a, size_t b, size_t c)
+static int reserve_entry(struct logger_log *log, size_t len,
+			 unsigned long *pos)
 {
-	if (b < a) {
-		if (a < c || b >= c)
-			return 1;
-	} else {
-		if (a < c && b >= c)
-			return 1;
-	}
+	unsigned long w_off, tail;
 
-	return 0;
+	while (1) {
+		w_off = ACCESS_ONCE(log->w_off);
+		tail = ACCESS_ONCE(log->tail);
+
+		if (w_off + len - tail > log->size) {
+			if (!push_tail(log, tail))
+				return -ENOSPC;
+			continue;
+		}
+
+		if (cmpxchg(&log->w_off, w_off, w_off + len) == w_off) {
+			*pos = w_off;
+			return 0;
+		}
+	}
 }
 
 /*
- * fix_up_readers - walk the list of all readers and "fix up" any who were
- * lapped by the writer; also do the same for the default "start head".
- * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
- *
- * The caller needs to hold log->mutex.
+ * commit_entry - makes the entry at [pos, end) visible to readers, once
+ * the entries reserved before it are.
  */
-static void fix_up_readers(struct logger_log *log, size_t len)
+static void commit_entry(struct logger_log *log, unsigned long pos,
+			 unsigned long end)
 {
-	size_t old = log->w_off;
-	size_t new = logger_offset(old + len);
-	struct logger_reader *reader;
+	while (ACCESS_ONCE(log->c_off) != pos)
+		cpu_relax();
 
-	if (clock_interval(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
-
-	list_for_each_entry(reader, &log->readers, list)
-		if (clock_interval(old, new, reader->r_off))
-			reader->r_off = get_next_entry(log, reader->r_off, len);
+	smp_wmb();
+	ACCESS_ONCE(log->c_off) = end;
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
- *
- * The caller needs to hold log->mutex.
+ * do_write_log - writes 'count' bytes from 'buf' at position 'pos' of 'log'
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static void do_write_log(struct logger_log *log, unsigned long pos,
+			 const void *buf, size_t count)
 {
+	size_t off = logger_offset(pos);
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
-
-	log->w_off = logger_offset(log->w_off + count);
-
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
- *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * print_marked_segment - print as kernel log if the log string starts
+ * with "!@"
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static void print_marked_segment(const unsigned char *buf, size_t count)
 {
-	size_t len;
-
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
-		return -EFAULT;
+	char tmp[256];
+	int i;
 
-	if (count != len)
-		if (copy_from_user(log->buffer, buf + len, count - len))
-			return -EFAULT;
-
-	/* print as kernel log if the log string starts with "!@" */
-	if (count >= 2) {
-		if (log->buffer[log->w_off] == '!'
-		    && log->buffer[logger_offset(log->w_off + 1)] == '@') {
-			char tmp[256];
-			int i;
-			for (i = 0; i < min(count, sizeof(tmp) - 1); i++)
-				tmp[i] =
-				    log->buffer[logger_offset(log->w_off + i)];
-			tmp[i] = '\0';
-			printk("%s\n", tmp);
-		}
-	}
+	if (count < 2 || buf[0] != '!' || buf[1] != '@')
+		return;
 
-	log->w_off = logger_offset(log->w_off + count);
-
-	return count;
+	for (i = 0; i < min(count, sizeof(tmp) - 1); i++)
+		tmp[i] = buf[i];
+	tmp[i] = '\0';
+	printk("%s\n", tmp);
 }
 
 /*
@@ -434,9 +440,11 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	unsigned char stack_payload[LOGGER_STACK_PAYLOAD];
+	unsigned char *payload = stack_payload;
 	struct logger_entry header;
 	struct timespec now;
+	unsigned long pos;
 	ssize_t ret = 0;
 
 	now = current_kernel_time();
@@ -453,42 +461,53 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
 	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
+	 * Gather the payload first: nothing may fault or sleep between
+	 * reserving the entry and committing it.
 	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
-
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	if (header.len > sizeof(stack_payload)) {
+		payload = kmalloc(header.len, GFP_KERNEL);
+		if (!payload)
+			return -ENOMEM;
+	}
 
-	while (nr_segs-- > 0) {
+	while (nr_segs-- > 0 && ret < header.len) {
 		size_t len;
-		ssize_t nr;
 
 		/* figure out how much of this vector we can keep */
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
-		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
+		if (copy_from_user(payload + ret, iov->iov_base, len)) {
+			ret = -EFAULT;
+			goto out;
 		}
+		print_marked_segment(payload + ret, len);
 
 		iov++;
-		ret += nr;
+		ret += len;
 	}
 
-	mutex_unlock(&log->mutex);
+	preempt_disable();
+	if (reserve_entry(log, sizeof(struct logger_entry) + header.len,
+			  &pos)) {
+		preempt_enable();
+		atomic_long_add(sizeof(struct logger_entry) + header.len,
+				&log->dropped);
+		goto out;
+	}
+	do_write_log(log, pos, &header, sizeof(struct logger_entry));
+	do_write_log(log, pos + sizeof(struct logger_entry), payload,
+		     header.len);
+	commit_entry(log, pos, pos + sizeof(struct logger_entry) + header.len);
+	preempt_enable();
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
+out:
+	if (payload != stack_payload)
+		kfree(payload);
+
 	return ret;
 }
 
@@ -519,6 +538,12 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->buf = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->buf) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		reader->r_ver = 1;
 		reader->r_all = in_egroup_p(inode->i_gid) ||
@@ -528,6 +553,8 @@ static int logger_open(struct inode *inode, struct file *file)
 
 		mutex_lock(&log->mutex);
 		reader->r_off = log->head;
+		if ((long)(ACCESS_ONCE(log->tail) - reader->r_off) > 0)
+			reader->r_off = ACCESS_ONCE(log->tail);
 		list_add_tail(&reader->list, &log->readers);
 		mutex_unlock(&log->mutex);
 
@@ -553,6 +580,7 @@ static int logger_release(struct inode *inode, struct file *file)
 		mutex_lock(&log->mutex);
 		list_del(&reader->list);
 		mutex_unlock(&log->mutex);
+		kfree(reader->buf);
 		kfree(reader);
 		pr_info("%s: took %d msec\n", __func__,
 			jiffies_to_msecs(jiffies - start));
@@ -585,11 +613,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	poll_wait(file, &log->wq, wait);
 
 	mutex_lock(&log->mutex);
-	if (!reader->r_all)
-		reader->r_off = get_next_entry_by_uid(log,
-			reader->r_off, current_euid());
-
-	if (log->w_off != reader->r_off)
+	if (!fetch_next_entry(log, reader))
 		ret |= POLLIN | POLLRDNORM;
 	mutex_unlock(&log->mutex);
 
@@ -613,6 +637,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
 	struct logger_reader *reader;
+	unsigned long c_off, tail;
 	long ret = -EINVAL;
 	void __user *argp = (void __user *) arg;
 
@@ -628,10 +653,12 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			break;
 		}
 		reader = file->private_data;
-		if (log->w_off >= reader->r_off)
-			ret = log->w_off - reader->r_off;
+		c_off = ACCESS_ONCE(log->c_off);
+		tail = ACCESS_ONCE(log->tail);
+		if ((long)(tail - reader->r_off) > 0)
+			ret = c_off - tail;
 		else
-			ret = (log->size - reader->r_off) + log->w_off;
+			ret = c_off - reader->r_off;
 		break;
 	case LOGGER_GET_NEXT_ENTRY_LEN:
 		if (!(file->f_mode & FMODE_READ)) {
@@ -640,13 +667,9 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		}
 		reader = file->private_data;
 
-		if (!reader->r_all)
-			reader->r_off = get_next_entry_by_uid(log,
-				reader->r_off, current_euid());
-
-		if (log->w_off != reader->r_off)
+		if (!fetch_next_entry(log, reader))
 			ret = get_user_hdr_len(reader->r_ver) +
-				get_entry_msg_len(log, reader->r_off);
+				((struct logger_entry *)reader->buf)->len;
 		else
 			ret = 0;
 		break;
@@ -655,9 +678,10 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 			ret = -EBADF;
 			break;
 		}
+		c_off = ACCESS_ONCE(log->c_off);
 		list_for_each_entry(reader, &log->readers, list)
-			reader->r_off = log->w_off;
-		log->head = log->w_off;
+			reader->r_off = c_off;
+		log->head = c_off;
 		ret = 0;
 		break;
 	case LOGGER_GET_VERSION:
@@ -713,8 +737,13 @@ static struct logger_log VAR = { \
 	.readers = LIST_HEAD_INIT(VAR .readers), \
 	.mutex = __MUTEX_INITIALIZER(VAR .mutex), \
 	.w_off = 0, \
+	.c_off = 0, \
+	.tail = 0, \
 	.head = 0, \
 	.size = SIZE, \
+	.overwritten = ATOMIC_LONG_INIT(0), \
+	.dropped = ATOMIC_LONG_INIT(0), \
+	.lapped = ATOMIC_LONG_INIT(0), \
 };
 
 DEFINE_LOGGER_DEVICE(log_main, LOGGER_LOG_MAIN, 2048*1024)
@@ -742,6 +771,55 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+static struct logger_log *dev_get_log(struct device *dev)
+{
+	struct miscdevice *misc = dev_get_drvdata(dev);
+
+	return container_of(misc, struct logger_log, misc);
+}
+
+static ssize_t overwritten_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct logger_log *log = dev_get_log(dev);
+
+	return sprintf(buf, "%lu\n",
+		(unsigned long)atomic_long_read(&log->overwritten));
+}
+
+static ssize_t dropped_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct logger_log *log = dev_get_log(dev);
+
+	return sprintf(buf, "%lu\n",
+		(unsigned long)atomic_long_read(&log->dropped));
+}
+
+static ssize_t lapped_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct logger_log *log = dev_get_log(dev);
+
+	return sprintf(buf, "%lu\n",
+		(unsigned long)atomic_long_read(&log->lapped));
+}
+
+static DEVICE_ATTR(overwritten, S_IRUGO, overwritten_show, NULL);
+static DEVICE_ATTR(dropped, S_IRUGO, dropped_show, NULL);
+static DEVICE_ATTR(lapped, S_IRUGO, lapped_show, NULL);
+
+static struct attribute *logger_attrs[] = {
+	&dev_attr_overwritten.attr,
+	&dev_attr_dropped.attr,
+	&dev_attr_lapped.attr,
+	NULL,
+};
+
+static struct attribute_group logger_attr_group = {
+	.attrs = logger_attrs,
+};
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
@@ -753,6 +831,12 @@ static int __init init_log(struct logger_log *log)
 		return ret;
 	}
 
+	/* the counters are informational, the log works without them */
+	if (sysfs_create_group(&log->misc.this_device->kobj,
+			       &logger_attr_group))
+		printk(KERN_WARNING "logger: failed to create sysfs "
+		       "attributes for log '%s'\n", log->misc.name);
+
 	printk(KERN_INFO "logger: created %luK log '%s'\n",
 	       (unsigned long) log->size >> 10, log->misc.name);
 
@@ -16,6 +16,20 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * Processes are kept in lists by oom_adj, so only the processes with the
+ * highest oom_adj values are looked at when selecting what to kill. The
+ * number of kills, the time from the first scan that found memory low to
+ * the kill, the time spent selecting and the number of scans per kill are
+ * in kill_count, kill_latency_us, select_us and scans_per_kill.
+ *
+ * Memory pressure is reported before anything has to be killed through
+ * /dev/lmk_pressure. Every 512 pages scanned by page reclaim the share of
+ * the scanned pages that could not be reclaimed gives the pressure level,
+ * "medium" from pressure_medium percent, "critical" from pressure_critical
+ * percent and "low" below that. Reading the device returns the highest
+ * level seen since the last read, a poll waits for one. Writing a level to
+ * the device makes it ignore the levels below it.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +49,15 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 #define ENHANCED_LMK_ROUTINE
 
 #ifdef CONFIG_ZRAM_FOR_ANDROID
@@ -99,12 +122,95 @@ static struct task_struct *lowmem_deathpending;
 #endif
 static unsigned long lowmem_deathpending_timeout;
 
+/* Thread group leaders by oom_adj, OOM_DISABLE first */
+#define LOWMEM_INDEX_SIZE (OOM_ADJUST_MAX - OOM_DISABLE + 1)
+static struct list_head lowmem_index[LOWMEM_INDEX_SIZE];
+static DEFINE_SPINLOCK(lowmem_index_lock);
+static bool lowmem_index_ready;
+
+static uint32_t lowmem_kill_count;
+static uint32_t lowmem_kill_latency_us;
+static uint32_t lowmem_select_us;
+static uint32_t lowmem_scans_per_kill;
+static uint32_t lowmem_scans;
+static ktime_t lowmem_scan_start;
+
 #define lowmem_print(level, x...)			\
 	do {						\
 		if (lowmem_debug_level >= (level))	\
 			printk(x);			\
 	} while (0)
 
+static struct list_head *lowmem_bucket(int oom_adj)
+{
+	return &lowmem_index[clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX) -
+			     OOM_DISABLE];
+}
+
+/* Called with tasklist_lock write locked */
+void lowmem_index_add(struct task_struct *p)
+{
+	spin_lock(&lowmem_index_lock);
+	if (lowmem_index_ready)
+		list_add_tail(&p->lowmem_node, lowmem_bucket(p->signal->oom_adj));
+	spin_unlock(&lowmem_index_lock);
+}
+
+/* Called with tasklist_lock write locked */
+void lowmem_index_del(struct task_struct *p)
+{
+	spin_lock(&lowmem_index_lock);
+	list_del_init(&p->lowmem_node);
+	spin_unlock(&lowmem_index_lock);
+}
+
+/* Called with tasklist_lock write locked, when a thread takes over as leader */
+void lowmem_index_replace(struct task_struct *old, struct task_struct *new)
+{
+	spin_lock(&lowmem_index_lock);
+	if (!list_empty(&old->lowmem_node))
+		list_replace_init(&old->lowmem_node, &new->lowmem_node);
+	spin_unlock(&lowmem_index_lock);
+}
+
+/*
+ * Called after the oom_adj of a process has changed. The process is moved
+ * to the list of its current oom_adj, so concurrent changes end up in the
+ * list of the last value written.
+ */
+void lowmem_index_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+
+	read_lock(&tasklist_lock);
+	if (pid_alive(p)) {
+		leader = p->group_leader;
+		spin_lock(&lowmem_index_lock);
+		if (!list_empty(&leader->lowmem_node))
+			list_move_tail(&leader->lowmem_node,
+				       lowmem_bucket(leader->signal->oom_adj));
+		spin_unlock(&lowmem_index_lock);
+	}
+	read_unlock(&tasklist_lock);
+}
+
+static void lowmem_index_init(void)
+{
+	struct task_struct *p;
+	int i;
+
+	for (i = 0; i < LOWMEM_INDEX_SIZE; i++)
+		INIT_LIST_HEAD(&lowmem_index[i]);
+
+	write_lock_irq(&tasklist_lock);
+	spin_lock(&lowmem_index_lock);
+	for_each_process(p)
+		list_add_tail(&p->lowmem_node, lowmem_bucket(p->signal->oom_adj));
+	lowmem_index_ready = true;
+	spin_unlock(&lowmem_index_lock);
+	write_unlock_irq(&tasklist_lock);
+}
+
 static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data);
 
@@ -142,7 +248,10 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int rem = 0;
 	int tasksize;
 	int i;
+	int adj;
 	int min_adj = OOM_ADJUST_MAX + 1;
+	ktime_t select_start;
+	bool killed = false;
 #ifdef ENHANCED_LMK_ROUTINE
 	int selected_tasksize[LOWMEM_DEATHPENDING_DEPTH] = {0,};
 	int selected_oom_adj[LOWMEM_DEATHPENDING_DEPTH] = {OOM_ADJUST_MAX,};
@@ -208,82 +317,103 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	selected_oom_adj = min_adj;
 #endif
 
+	select_start = ktime_get();
+	if (!lowmem_scans++)
+		lowmem_scan_start = select_start;
+
 	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
+	spin_lock(&lowmem_index_lock);
+	/*
+	 * Nothing in a list with a lower oom_adj can replace a selected
+	 * process once enough processes have been selected.
+	 */
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj; adj--) {
+#ifdef ENHANCED_LMK_ROUTINE
+		if (all_selected_oom == LOWMEM_DEATHPENDING_DEPTH)
+			break;
+#else
+		if (selected)
+			break;
+#endif
+		list_for_each_entry(p, lowmem_bucket(adj), lowmem_node) {
+			struct mm_struct *mm;
+			struct signal_struct *sig;
+			int oom_adj;
 #ifdef ENHANCED_LMK_ROUTINE
-		int is_exist_oom_task = 0;
+			int is_exist_oom_task = 0;
 #endif
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
+			task_lock(p);
+			mm = p->mm;
+			sig = p->signal;
+			if (!mm || !sig) {
+				task_unlock(p);
+				continue;
+			}
+			oom_adj = sig->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(mm);
 			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
+			if (tasksize <= 0)
+				continue;
 
 #ifdef ENHANCED_LMK_ROUTINE
-		if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH) {
-			for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
-				if (!selected[i]) {
-					is_exist_oom_task = 1;
-					max_selected_oom_idx = i;
-					break;
-				}
-			}
-		} else if (selected_oom_adj[max_selected_oom_idx] < oom_adj ||
-			(selected_oom_adj[max_selected_oom_idx] == oom_adj &&
-			selected_tasksize[max_selected_oom_idx] < tasksize)) {
-			is_exist_oom_task = 1;
-		}
-
-		if (is_exist_oom_task) {
-			selected[max_selected_oom_idx] = p;
-			selected_tasksize[max_selected_oom_idx] = tasksize;
-			selected_oom_adj[max_selected_oom_idx] = oom_adj;
-
-			if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH)
-				all_selected_oom++;
-
-			if (all_selected_oom == LOWMEM_DEATHPENDING_DEPTH) {
+			if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH) {
 				for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
-					if (selected_oom_adj[i] < selected_oom_adj[max_selected_oom_idx])
-						max_selected_oom_idx = i;
-					else if (selected_oom_adj[i] == selected_oom_adj[max_selected_oom_idx] &&
-						selected_tasksize[i] < selected_tasksize[max_selected_oom_idx])
+					if (!selected[i]) {
+						is_exist_oom_task = 1;
 						max_selected_oom_idx = i;
+						break;
+					}
 				}
+			} else if (selected_oom_adj[max_selected_oom_idx] < oom_adj ||
+				(selected_oom_adj[max_selected_oom_idx] == oom_adj &&
+				selected_tasksize[max_selected_oom_idx] < tasksize)) {
+				is_exist_oom_task = 1;
 			}
 
-			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-				p->pid, p->comm, oom_adj, tasksize);
-		}
+			if (is_exist_oom_task) {
+				selected[max_selected_oom_idx] = p;
+				selected_tasksize[max_selected_oom_idx] = tasksize;
+				selected_oom_adj[max_selected_oom_idx] = oom_adj;
+
+				if (all_selected_oom < LOWMEM_DEATHPENDING_DEPTH)
+					all_selected_oom++;
+
+				if (all_selected_oom == LOWMEM_DEATHPENDING_DEPTH) {
+					for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
+						if (selected_oom_adj[i] < selected_oom_adj[max_selected_oom_idx])
+							max_selected_oom_idx = i;
+						else if (selected_oom_adj[i] == selected_oom_adj[max_selected_oom_idx] &&
+							selected_tasksize[i] < selected_tasksize[max_selected_oom_idx])
+							max_selected_oom_idx = i;
+					}
+				}
+
+				lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+					p->pid, p->comm, oom_adj, tasksize);
+			}
 #else
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+				     p->pid, p->comm, oom_adj, tasksize);
 #endif
+		}
 	}
+	/* tasklist_lock keeps the selected processes from being reaped */
+	spin_unlock(&lowmem_index_lock);
+
 #ifdef ENHANCED_LMK_ROUTINE
 	for (i = 0; i < LOWMEM_DEATHPENDING_DEPTH; i++) {
 		if (selected[i]) {
@@ -294,6 +424,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			lowmem_deathpending_timeout = jiffies + HZ;
 			force_sig(SIGKILL, selected[i]);
 			rem -= selected_tasksize[i];
+			killed = true;
 		}
 	}
 #else
@@ -305,11 +436,22 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_deathpending_timeout = jiffies + HZ;
 		force_sig(SIGKILL, selected);
 		rem -= selected_tasksize;
+		killed = true;
 	}
 #endif
+	read_unlock(&tasklist_lock);
+
+	if (killed) {
+		ktime_t now = ktime_get();
+
+		lowmem_kill_count++;
+		lowmem_kill_latency_us = ktime_us_delta(now, lowmem_scan_start);
+		lowmem_select_us = ktime_us_delta(now, select_start);
+		lowmem_scans_per_kill = lowmem_scans;
+		lowmem_scans = 0;
+	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -318,6 +460,242 @@ static struct shrinker lowmem_shrinker = {
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+/* Pages scanned by reclaim between pressure reports, 2MB */
+#define LOWMEM_PRESSURE_WINDOW 512
+
+enum lowmem_pressure_level {
+	LOWMEM_PRESSURE_LOW,
+	LOWMEM_PRESSURE_MEDIUM,
+	LOWMEM_PRESSURE_CRITICAL,
+	LOWMEM_PRESSURE_NUM_LEVELS,
+};
+
+static const char * const lowmem_pressure_names[] = {
+	[LOWMEM_PRESSURE_LOW] = "low",
+	[LOWMEM_PRESSURE_MEDIUM] = "medium",
+	[LOWMEM_PRESSURE_CRITICAL] = "critical",
+};
+
+struct lowmem_pressure_listener {
+	struct list_head list;
+	int min_level;
+	int pending;	/* highest level not read, -1 if none */
+};
+
+static uint32_t lowmem_pressure_medium = 60;
+static uint32_t lowmem_pressure_critical = 95;
+static unsigned long lowmem_pressure_scanned;
+static unsigned long lowmem_pressure_reclaimed;
+static LIST_HEAD(lowmem_pressure_listeners);
+static DEFINE_SPINLOCK(lowmem_pressure_lock);
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_pressure_waitq);
+
+static void lowmem_pressure_work_func(struct work_struct *work)
+{
+	struct lowmem_pressure_listener *listener;
+	unsigned long scanned;
+	unsigned long reclaimed;
+	unsigned long pressure = 0;
+	int level = LOWMEM_PRESSURE_LOW;
+
+	spin_lock(&lowmem_pressure_lock);
+	scanned = lowmem_pressure_scanned;
+	reclaimed = lowmem_pressure_reclaimed;
+	lowmem_pressure_scanned = 0;
+	lowmem_pressure_reclaimed = 0;
+	spin_unlock(&lowmem_pressure_lock);
+
+	if (!scanned)
+		return;
+
+	/* Pages may be reclaimed from lists other than the scanned ones */
+	if (reclaimed < scanned)
+		pressure = (scanned - reclaimed) * 100 / scanned;
+	if (pressure >= lowmem_pressure_critical)
+		level = LOWMEM_PRESSURE_CRITICAL;
+	else if (pressure >= lowmem_pressure_medium)
+		level = LOWMEM_PRESSURE_MEDIUM;
+
+	lowmem_print(4, "lowmem_pressure %lu/%lu, %lu%%, %s\n",
+		     reclaimed, scanned, pressure, lowmem_pressure_names[level]);
+
+	spin_lock(&lowmem_pressure_lock);
+	list_for_each_entry(listener, &lowmem_pressure_listeners, list) {
+		if (level >= listener->min_level && level > listener->pending)
+			listener->pending = level;
+	}
+	spin_unlock(&lowmem_pressure_lock);
+
+	wake_up_interruptible(&lowmem_pressure_waitq);
+}
+
+static DECLARE_WORK(lowmem_pressure_work, lowmem_pressure_work_func);
+
+/* Called by page reclaim with the number of pages scanned and reclaimed */
+void lowmem_vmpressure(gfp_t gfp_mask, unsigned long scanned,
+		       unsigned long reclaimed)
+{
+	bool report;
+
+	/* Only reclaim for user space memory tells about user space */
+	if (!(gfp_mask & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+	if (!scanned)
+		return;
+
+	spin_lock(&lowmem_pressure_lock);
+	lowmem_pressure_scanned += scanned;
+	lowmem_pressure_reclaimed += reclaimed;
+	report = lowmem_pressure_scanned >= LOWMEM_PRESSURE_WINDOW;
+	spin_unlock(&lowmem_pressure_lock);
+
+	if (report)
+		schedule_work(&lowmem_pressure_work);
+}
+
+static int lowmem_pressure_open(struct inode *inode, struct file *file)
+{
+	struct lowmem_pressure_listener *listener;
+
+	listener = kzalloc(sizeof(*listener), GFP_KERNEL);
+	if (!listener)
+		return -ENOMEM;
+
+	listener->min_level = LOWMEM_PRESSURE_LOW;
+	listener->pending = -1;
+
+	spin_lock(&lowmem_pressure_lock);
+	list_add_tail(&listener->list, &lowmem_pressure_listeners);
+	spin_unlock(&lowmem_pressure_lock);
+
+	file->private_data = listener;
+
+	return 0;
+}
+
+static int lowmem_pressure_release(struct inode *inode, struct file *file)
+{
+	struct lowmem_pressure_listener *listener = file->private_data;
+
+	spin_lock(&lowmem_pressure_lock);
+	list_del(&listener->list);
+	spin_unlock(&lowmem_pressure_lock);
+
+	kfree(listener);
+
+	return 0;
+}
+
+static int lowmem_pressure_take(struct lowmem_pressure_listener *listener)
+{
+	int level;
+
+	spin_lock(&lowmem_pressure_lock);
+	level = listener->pending;
+	listener->pending = -1;
+	spin_unlock(&lowmem_pressure_lock);
+
+	return level;
+}
+
+/* Puts back a level taken by a read that could not return it */
+static void lowmem_pressure_untake(struct lowmem_pressure_listener *listener,
+				   int level)
+{
+	spin_lock(&lowmem_pressure_lock);
+	if (level >= listener->min_level && level > listener->pending)
+		listener->pending = level;
+	spin_unlock(&lowmem_pressure_lock);
+}
+
+static ssize_t lowmem_pressure_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct lowmem_pressure_listener *listener = file->private_data;
+	char level_buf[16];
+	int level;
+	int len;
+	int ret;
+
+	for (;;) {
+		level = lowmem_pressure_take(listener);
+		if (level >= 0)
+			break;
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+		ret = wait_event_interruptible(lowmem_pressure_waitq,
+					       listener->pending >= 0);
+		if (ret)
+			return ret;
+	}
+
+	len = snprintf(level_buf, sizeof(level_buf), "%s\n",
+		       lowmem_pressure_names[level]);
+	if (count < len) {
+		lowmem_pressure_untake(listener, level);
+		return -EINVAL;
+	}
+	if (copy_to_user(buf, level_buf, len)) {
+		lowmem_pressure_untake(listener, level);
+		return -EFAULT;
+	}
+
+	return len;
+}
+
+static ssize_t lowmem_pressure_write(struct file *file,
+				     const char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct lowmem_pressure_listener *listener = file->private_data;
+	char level_buf[16];
+	int i;
+
+	if (count >= sizeof(level_buf))
+		return -EINVAL;
+	if (copy_from_user(level_buf, buf, count))
+		return -EFAULT;
+	level_buf[count] = '\0';
+
+	for (i = 0; i < LOWMEM_PRESSURE_NUM_LEVELS; i++) {
+		if (!strcmp(strim(level_buf), lowmem_pressure_names[i])) {
+			spin_lock(&lowmem_pressure_lock);
+			listener->min_level = i;
+			if (listener->pending < i)
+				listener->pending = -1;
+			spin_unlock(&lowmem_pressure_lock);
+			return count;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static unsigned int lowmem_pressure_poll(struct file *file, poll_table *wait)
+{
+	struct lowmem_pressure_listener *listener = file->private_data;
+
+	poll_wait(file, &lowmem_pressure_waitq, wait);
+
+	return listener->pending >= 0 ? POLLIN | POLLRDNORM : 0;
+}
+
+static const struct file_operations lowmem_pressure_fops = {
+	.owner = THIS_MODULE,
+	.open = lowmem_pressure_open,
+	.release = lowmem_pressure_release,
+	.read = lowmem_pressure_read,
+	.write = lowmem_pressure_write,
+	.poll = lowmem_pressure_poll,
+	.llseek = noop_llseek,
+};
+
+static struct miscdevice lowmem_pressure_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "lmk_pressure",
+	.fops = &lowmem_pressure_fops,
+};
+
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 /*
  * zone_id_shrink_pagelist() clear page flags,
@@ -517,8 +895,11 @@ static int __init lowmem_init(void)
 	unsigned int low_wmark = 0;
 #endif
 
+	lowmem_index_init();
 	task_free_register(&task_nb);
 	register_shrinker(&lowmem_shrinker);
+	if (misc_register(&lowmem_pressure_dev))
+		printk(KERN_ERR "Failed to register lmk_pressure\n");
 
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 	for_each_zone(zone) {
@@ -552,6 +933,8 @@ static int __init lowmem_init(void)
 
 static void __exit lowmem_exit(void)
 {
+	misc_deregister(&lowmem_pressure_dev);
+	cancel_work_sync(&lowmem_pressure_work);
 	unregister_shrinker(&lowmem_shrinker);
 	task_free_unregister(&task_nb);
 }
@@ -562,6 +945,14 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(kill_count, lowmem_kill_count, uint, S_IRUGO);
+module_param_named(kill_latency_us, lowmem_kill_latency_us, uint, S_IRUGO);
+module_param_named(select_us, lowmem_select_us, uint, S_IRUGO);
+module_param_named(scans_per_kill, lowmem_scans_per_kill, uint, S_IRUGO);
+module_param_named(pressure_medium, lowmem_pressure_medium, uint,
+		   S_IRUGO | S_IWUSR);
+module_param_named(pressure_critical, lowmem_pressure_critical, uint,
+		   S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
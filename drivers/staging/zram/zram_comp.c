@@ -0,0 +1,213 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/crypto.h>
+#include <linux/err.h>
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/wait.h>
+
+#include "zram_drv.h"
+
+/*
+ * Compression streams
+ *
+ * Each stream owns a transform of the device's compression algorithm
+ * (through the crypto compress API) and an output buffer, so readers and
+ * writers holding different streams run the compressor in parallel.
+ * Streams are allocated up front, from process context, when the device
+ * is initialized or max_comp_streams is raised; the I/O path never
+ * allocates them. A request that finds no idle stream sleeps until
+ * another one puts its stream back.
+ */
+
+static void zram_strm_free(struct zram_strm *zstrm)
+{
+	if (!IS_ERR_OR_NULL(zstrm->tfm))
+		crypto_free_comp(zstrm->tfm);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+static struct zram_strm *zram_strm_alloc(struct zram_comp *comp)
+{
+	struct zram_strm *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), GFP_KERNEL);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->tfm = crypto_alloc_comp(comp->name, 0, 0);
+
+	/*
+	 * Compressed output may be larger than the input page for
+	 * incompressible data, so use two pages for the buffer.
+	 */
+	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (IS_ERR(zstrm->tfm) || !zstrm->buffer) {
+		zram_strm_free(zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+/*
+ * Get an idle stream, waiting for one if all are busy.
+ * May sleep: must not be called from atomic context.
+ */
+struct zram_strm *zram_strm_find(struct zram_comp *comp)
+{
+	struct zram_strm *zstrm;
+
+	while (1) {
+		spin_lock(&comp->strm_lock);
+		if (!list_empty(&comp->idle_strm)) {
+			zstrm = list_entry(comp->idle_strm.next,
+					struct zram_strm, list);
+			list_del(&zstrm->list);
+			spin_unlock(&comp->strm_lock);
+			return zstrm;
+		}
+
+		comp->num_waits++;
+		spin_unlock(&comp->strm_lock);
+		wait_event(comp->strm_wait, !list_empty(&comp->idle_strm));
+	}
+}
+
+void zram_strm_release(struct zram_comp *comp, struct zram_strm *zstrm)
+{
+	spin_lock(&comp->strm_lock);
+	if (comp->avail_strm <= comp->max_strm) {
+		list_add(&zstrm->list, &comp->idle_strm);
+		spin_unlock(&comp->strm_lock);
+		wake_up(&comp->strm_wait);
+		return;
+	}
+
+	/* max_strm was lowered while this stream was in use */
+	comp->avail_strm--;
+	spin_unlock(&comp->strm_lock);
+	zram_strm_free(zstrm);
+}
+
+/* Allocate streams until comp->max_strm of them exist */
+static int zram_comp_grow(struct zram_comp *comp)
+{
+	struct zram_strm *zstrm;
+
+	spin_lock(&comp->strm_lock);
+	while (comp->avail_strm < comp->max_strm) {
+		comp->avail_strm++;
+		spin_unlock(&comp->strm_lock);
+
+		zstrm = zram_strm_alloc(comp);
+
+		spin_lock(&comp->strm_lock);
+		if (!zstrm) {
+			comp->avail_strm--;
+			spin_unlock(&comp->strm_lock);
+			return -ENOMEM;
+		}
+		list_add(&zstrm->list, &comp->idle_strm);
+		wake_up(&comp->strm_wait);
+	}
+	spin_unlock(&comp->strm_lock);
+
+	return 0;
+}
+
+/*
+ * Change the stream limit. Idle streams above the new limit are freed
+ * now, busy ones when they are released. If the device is initialized,
+ * streams up to the new limit are allocated now.
+ */
+int zram_comp_set_max_streams(struct zram_comp *comp, int num_strm,
+			int active)
+{
+	struct zram_strm *zstrm;
+
+	spin_lock(&comp->strm_lock);
+	comp->max_strm = num_strm;
+	while (comp->avail_strm > num_strm &&
+			!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zram_strm, list);
+		list_del(&zstrm->list);
+		comp->avail_strm--;
+		spin_unlock(&comp->strm_lock);
+		zram_strm_free(zstrm);
+		spin_lock(&comp->strm_lock);
+	}
+	spin_unlock(&comp->strm_lock);
+
+	if (!active)
+		return 0;
+
+	return zram_comp_grow(comp);
+}
+
+/* Select the compression algorithm; device must not be initialized */
+int zram_comp_set_algorithm(struct zram_comp *comp, const char *name)
+{
+	if (!crypto_has_comp(name, 0, 0))
+		return -ENOENT;
+
+	strlcpy(comp->name, name, sizeof(comp->name));
+	return 0;
+}
+
+void zram_comp_init(struct zram_comp *comp, int max_strm)
+{
+	spin_lock_init(&comp->strm_lock);
+	INIT_LIST_HEAD(&comp->idle_strm);
+	init_waitqueue_head(&comp->strm_wait);
+	strlcpy(comp->name, default_compressor, sizeof(comp->name));
+	comp->avail_strm = 0;
+	comp->max_strm = max_strm;
+	comp->num_waits = 0;
+}
+
+int zram_comp_create(struct zram_comp *comp)
+{
+	int ret;
+
+	ret = zram_comp_grow(comp);
+	if (ret)
+		zram_comp_destroy(comp);
+
+	return ret;
+}
+
+/* Called with no I/O in flight (device init failure or reset) */
+void zram_comp_destroy(struct zram_comp *comp)
+{
+	struct zram_strm *zstrm;
+
+	while (!list_empty(&comp->idle_strm)) {
+		zstrm = list_entry(comp->idle_strm.next,
+				struct zram_strm, list);
+		list_del(&zstrm->list);
+		zram_strm_free(zstrm);
+	}
+	comp->avail_strm = 0;
+	comp->num_waits = 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#include <linux/jhash.h>
+#include <linux/kernel.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "zram_drv.h"
+
+/*
+ * Deduplication
+ *
+ * Identical pages, e.g. copied across processes forked from the same
+ * parent, compress to identical data. Compressed objects are indexed
+ * by a hash of their contents in a per-device rbtree, and table slots
+ * storing the same data share one refcounted entry and allocation.
+ *
+ * Hashing the compressed data rather than the page keeps the cost of
+ * a lookup well below that of the compression itself. Hash matches are
+ * confirmed by comparing the data, so collisions are harmless.
+ */
+
+u32 zram_dedup_checksum(const void *data, unsigned int len)
+{
+	return jhash(data, len, 0);
+}
+
+/*
+ * Look for an entry holding the given compressed data and take a
+ * reference to it. @buf is a bounce buffer for zs_map_object().
+ */
+struct zram_entry *zram_dedup_find(struct zram *zram, const void *data,
+			unsigned int len, u32 checksum, void *buf)
+{
+	struct rb_node *rb_node;
+	struct zram_entry *entry, *found = NULL;
+	void *cmem;
+	int match;
+
+	spin_lock(&zram->dedup_lock);
+
+	rb_node = zram->dedup_root.rb_node;
+	while (rb_node) {
+		entry = rb_entry(rb_node, struct zram_entry, rb_node);
+		if (checksum < entry->checksum) {
+			rb_node = rb_node->rb_left;
+			continue;
+		}
+		if (checksum > entry->checksum) {
+			rb_node = rb_node->rb_right;
+			continue;
+		}
+		break;
+	}
+
+	/* Entries with equal checksums are adjacent in order */
+	if (rb_node) {
+		while (rb_prev(rb_node) && rb_entry(rb_prev(rb_node),
+				struct zram_entry, rb_node)->checksum == checksum)
+			rb_node = rb_prev(rb_node);
+	}
+
+	for (; rb_node; rb_node = rb_next(rb_node)) {
+		entry = rb_entry(rb_node, struct zram_entry, rb_node);
+		if (entry->checksum != checksum)
+			break;
+		if (entry->len != len)
+			continue;
+
+		cmem = zs_map_object(zram->mem_pool, entry->handle, buf);
+		match = !memcmp(cmem, data, len);
+		zs_unmap_object(zram->mem_pool, cmem, buf);
+
+		if (match) {
+			entry->refcount++;
+			found = entry;
+			break;
+		}
+	}
+
+	spin_unlock(&zram->dedup_lock);
+
+	return found;
+}
+
+/*
+ * Make a newly stored object available for sharing. Returns the entry
+ * holding one reference, or NULL if no memory is available, in which
+ * case the object is simply not deduplicated.
+ */
+struct zram_entry *zram_dedup_insert(struct zram *zram, unsigned long handle,
+			unsigned int len, u32 checksum)
+{
+	struct rb_node **rb_node, *parent = NULL;
+	struct zram_entry *entry, *tmp;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->handle = handle;
+	entry->len = len;
+	entry->refcount = 1;
+
+	spin_lock(&zram->dedup_lock);
+
+	rb_node = &zram->dedup_root.rb_node;
+	while (*rb_node) {
+		parent = *rb_node;
+		tmp = rb_entry(parent, struct zram_entry, rb_node);
+		if (checksum < tmp->checksum)
+			rb_node = &parent->rb_left;
+		else
+			rb_node = &parent->rb_right;
+	}
+
+	rb_link_node(&entry->rb_node, parent, rb_node);
+	rb_insert_color(&entry->rb_node, &zram->dedup_root);
+	zram->stats.dedup_entries++;
+
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/*
+ * Drop a reference, freeing the entry and its object with the last one.
+ * Returns the no. of references left.
+ */
+int zram_dedup_put(struct zram *zram, struct zram_entry *entry)
+{
+	int refcount;
+
+	spin_lock(&zram->dedup_lock);
+	refcount = --entry->refcount;
+	if (!refcount) {
+		rb_erase(&entry->rb_node, &zram->dedup_root);
+		zram->stats.dedup_entries--;
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	if (!refcount) {
+		zs_free(zram->mem_pool, entry->handle);
+		kfree(entry);
+	}
+
+	return refcount;
+}
+
+void zram_dedup_init(struct zram *zram)
+{
+	spin_lock_init(&zram->dedup_lock);
+	zram->dedup_root = RB_ROOT;
+}
@@ -29,8 +29,9 @@
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
 #include <linux/vmalloc.h>
 #ifdef CONFIG_ZRAM_FOR_ANDROID
 #include <linux/swap.h>
@@ -45,65 +46,36 @@ struct zram *zram_devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
-{
-	*v = *v + 1;
-}
-
-static void zram_stat_dec(u32 *v)
-{
-	*v = *v - 1;
-}
-
-static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
-{
-	spin_lock(&zram->stat64_lock);
-	*v = *v + inc;
-	spin_unlock(&zram->stat64_lock);
-}
-
-static void zram_stat64_sub(struct zram *zram, u64 *v, u64 dec)
+/*
+ * Account one compression or decompression that started at @start
+ * into the given time histogram.
+ */
+static void zram_stat_time(struct zram *zram, u64 *hist, ktime_t start)
 {
-	spin_lock(&zram->stat64_lock);
-	*v = *v - dec;
-	spin_unlock(&zram->stat64_lock);
-}
+	unsigned int bucket = 0;
+	u64 us = ktime_to_us(ktime_sub(ktime_get(), start));
 
-static void zram_stat64_inc(struct zram *zram, u64 *v)
-{
-	zram_stat64_add(zram, v, 1);
-}
+	if (us)
+		bucket = min_t(unsigned int, ilog2(us) + 1,
+				ZRAM_TIME_BUCKETS - 1);
 
-static int zram_test_flag(struct zram *zram, u32 index,
-			enum zram_pageflags flag)
-{
-	return zram->table[index].flags & BIT(flag);
-}
-
-static void zram_set_flag(struct zram *zram, u32 index,
-			enum zram_pageflags flag)
-{
-	zram->table[index].flags |= BIT(flag);
+	zram_stat64_inc(zram, &hist[bucket]);
 }
 
-static void zram_clear_flag(struct zram *zram, u32 index,
-			enum zram_pageflags flag)
-{
-	zram->table[index].flags &= ~BIT(flag);
-}
-
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
+
 	return 1;
 }
 
@@ -152,39 +124,64 @@ static void setup_swap_header(struct zram *zram, union swap_header *s)
 }
 #endif /* CONFIG_ZRAM_FOR_ANDROID */
 
-static void zram_free_page(struct zram *zram, size_t index)
+/* Called with table_lock held for writing */
+void zram_free_page(struct zram *zram, size_t index)
 {
 	u32 clen;
-	void *obj;
+	unsigned long handle = zram->table[index].handle;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	/* Slot is rewritten or discarded: abort any writeback */
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_bd_free_block(zram, handle);
+		zram_stat_dec(&zram->stats.bd_count);
+		zram_stat_dec(&zram->stats.pages_stored);
+
+		zram->table[index].handle = 0;
+		zram->table[index].size = 0;
+		return;
+	}
+#endif
+
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (!handle)
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].handle = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
 		clen = PAGE_SIZE;
-		__free_page(page);
+		__free_page((struct page *)handle);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
-
-	xv_free(zram->mem_pool, page, offset);
+	clen = zram->table[index].size;
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		if (zram_dedup_put(zram, (struct zram_entry *)handle)) {
+			zram_stat_dec(&zram->stats.pages_dup);
+			zram_stat64_sub(zram, &zram->stats.dup_data_size,
+					clen);
+		}
+	} else {
+		zs_free(zram->mem_pool, handle);
+	}
 	if (clen <= PAGE_SIZE / 2)
 		zram_stat_dec(&zram->stats.good_compress);
 
@@ -192,16 +189,22 @@ out:
 	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].handle = 0;
+	zram->table[index].size = 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
-	void *user_mem;
+	unsigned int pos;
+	unsigned long *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*user_mem); pos++)
+			user_mem[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -213,80 +216,117 @@ static void handle_uncompressed_page(struct zram *zram,
 	unsigned char *user_mem, *cmem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = kmap_atomic((struct page *)zram->table[index].handle, KM_USER1);
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
-static void zram_read(struct zram *zram, struct bio *bio)
+/*
+ * Read the slot at @index into @page. Called from the request path and
+ * by writeback, so it must not depend on the bio being served.
+ */
+int zram_read_page(struct zram *zram, struct page *page, u32 index)
 {
+	int ret;
+	unsigned int clen;
+	unsigned long handle;
+	ktime_t start;
+	struct zram_strm *zstrm;
+	unsigned char *user_mem, *cmem;
 
-	int i;
-	u32 index;
-	struct bio_vec *bvec;
+	/*
+	 * Decompression needs a transform of its own. The table
+	 * lock spins, so get it before looking up the slot.
+	 */
+	zstrm = zram_strm_find(&zram->comp);
+
+	read_lock(&zram->table_lock);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Page was written back: read it from the backing device */
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		handle = zram->table[index].handle;
+		read_unlock(&zram->table_lock);
+		zram_strm_release(&zram->comp, zstrm);
+		return zram_bd_read(zram, page, handle);
+	}
+#endif
 
-	zram_stat64_inc(zram, &zram->stats.num_reads);
-	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = zram->table[index].handle;
 
-	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+		read_unlock(&zram->table_lock);
+		zram_strm_release(&zram->comp, zstrm);
+		handle_same_page(page, element);
+		return 0;
+	}
 
-		page = bvec->bv_page;
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].handle)) {
+		read_unlock(&zram->table_lock);
+		zram_strm_release(&zram->comp, zstrm);
+		pr_debug("Read before write: page=%u\n", index);
+		handle_same_page(page, 0);
+		return 0;
+	}
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		read_unlock(&zram->table_lock);
+		zram_strm_release(&zram->comp, zstrm);
+		return 0;
+	}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
-			continue;
-		}
+	handle = zram->table[index].handle;
+	if (zram_test_flag(zram, index, ZRAM_DEDUP))
+		handle = ((struct zram_entry *)handle)->handle;
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
-		}
+	user_mem = kmap_atomic(page, KM_USER0);
+	clen = PAGE_SIZE;
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+	cmem = zs_map_object(zram->mem_pool, handle, zstrm->buffer);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+	start = ktime_get();
+	ret = crypto_comp_decompress(zstrm->tfm, cmem,
+		zram->table[index].size, user_mem, &clen);
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+	zs_unmap_object(zram->mem_pool, cmem, zstrm->buffer);
+	kunmap_atomic(user_mem, KM_USER0);
+	read_unlock(&zram->table_lock);
+	zram_strm_release(&zram->comp, zstrm);
+
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret)) {
+		pr_err("Decompression failed! err=%d, page=%u\n",
+			ret, index);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return ret;
+	}
+	zram_stat_time(zram, zram->stats.decomp_time, start);
 
-		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+	flush_dcache_page(page);
+	return 0;
+}
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
-			zram_stat64_inc(zram, &zram->stats.failed_reads);
-			goto out;
-		}
+static void zram_read(struct zram *zram, struct bio *bio)
+{
 
-		flush_dcache_page(page);
+	int i;
+	u32 index;
+	struct bio_vec *bvec;
+
+	zram_stat64_inc(zram, &zram->stats.num_reads);
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (zram_read_page(zram, bvec->bv_page, index))
+			goto out;
 		index++;
 	}
 
@@ -308,47 +348,61 @@ static void zram_write(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
+		int ret, dup = 0;
+		u32 checksum = 0;
+		unsigned int clen;
+		unsigned long handle, element;
+		ktime_t start;
+		struct zram_strm *zstrm;
+		struct zram_entry *entry = NULL;
 		struct page *page, *page_store;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
 
 		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
+		 * Only the compression stream is exclusive to this writer;
+		 * compression itself runs in parallel with other writers.
 		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
+		zstrm = zram_strm_find(&zram->comp);
+		src = zstrm->buffer;
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+			zram_strm_release(&zram->comp, zstrm);
+
+			/*
+			 * System overwrites unused sectors. Free memory
+			 * associated with this sector now.
+			 */
+			write_lock(&zram->table_lock);
+			zram_free_page(zram, index);
+			if (!element)
+				zram_stat_inc(&zram->stats.pages_zero);
+			zram_stat_inc(&zram->stats.pages_same);
+			zram->table[index].handle = element;
+			zram_set_flag(zram, index, ZRAM_SAME);
+			write_unlock(&zram->table_lock);
 			index++;
 			continue;
 		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		/* Output buffer is two pages, see zram_strm_alloc() */
+		clen = 2 * PAGE_SIZE;
+		start = ktime_get();
+		ret = crypto_comp_compress(zstrm->tfm, user_mem, PAGE_SIZE,
+					src, &clen);
 
 		kunmap_atomic(user_mem, KM_USER0);
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+		if (unlikely(ret)) {
+			zram_strm_release(&zram->comp, zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
+		zram_stat_time(zram, zram->stats.comp_time, start);
 
 		/*
 		 * Page is incompressible. Store it as-is (uncompressed)
@@ -359,7 +413,7 @@ static void zram_write(struct zram *zram, struct bio *bio)
 			clen = PAGE_SIZE;
 			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
 			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
+				zram_strm_release(&zram->comp, zstrm);
 				pr_info("Error allocating memory for "
 					"incompressible page: %u\n", index);
 				zram_stat64_inc(zram,
@@ -367,44 +421,70 @@ static void zram_write(struct zram *zram, struct bio *bio)
 				goto out;
 			}
 
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
 			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
-		}
+			cmem = kmap_atomic(page_store, KM_USER1);
+			memcpy(cmem, src, clen);
+			kunmap_atomic(cmem, KM_USER1);
+			kunmap_atomic(src, KM_USER0);
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
-		}
+			handle = (unsigned long)page_store;
+		} else {
+			/*
+			 * Second page of the stream buffer serves as bounce
+			 * buffer for comparing against stored objects.
+			 */
+			if (zram->use_dedup) {
+				checksum = zram_dedup_checksum(src, clen);
+				entry = zram_dedup_find(zram, src, clen,
+						checksum, src + PAGE_SIZE);
+				if (entry) {
+					dup = 1;
+					goto memstored;
+				}
+			}
 
-memstore:
-		zram->table[index].offset = offset;
+			if (zs_malloc(zram->mem_pool, clen, &handle,
+					GFP_NOIO | __GFP_HIGHMEM)) {
+				zram_strm_release(&zram->comp, zstrm);
+				pr_info("Error allocating memory for "
+					"compressed page: %u, size=%u\n",
+					index, clen);
+				zram_stat64_inc(zram,
+					&zram->stats.failed_writes);
+				goto out;
+			}
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+			zs_write_object(zram->mem_pool, handle, src, clen);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+			if (zram->use_dedup)
+				entry = zram_dedup_insert(zram, handle, clen,
+						checksum);
 		}
-#endif
 
-		memcpy(cmem, src, clen);
+memstored:
+		zram_strm_release(&zram->comp, zstrm);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now and publish the new object.
+		 */
+		write_lock(&zram->table_lock);
+		zram_free_page(zram, index);
+
+		if (entry) {
+			zram->table[index].handle = (unsigned long)entry;
+			zram_set_flag(zram, index, ZRAM_DEDUP);
+		} else
+			zram->table[index].handle = handle;
+		zram->table[index].size = clen;
+		if (unlikely(clen == PAGE_SIZE)) {
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_stat_inc(&zram->stats.pages_expand);
+		}
+		if (dup) {
+			zram_stat_inc(&zram->stats.pages_dup);
+			zram_stat64_add(zram, &zram->stats.dup_data_size, clen);
+		}
 
 		/* Update stats */
 		zram_stat64_add(zram, &zram->stats.compr_size, clen);
@@ -412,7 +492,7 @@ memstore:
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		write_unlock(&zram->table_lock);
 		index++;
 	}
 
@@ -480,33 +560,20 @@ void zram_reset_device(struct zram *zram)
 	zram->init_done = 0;
 
 	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	zram_comp_destroy(&zram->comp);
 
 	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
-
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
-
-		if (!page)
-			continue;
-
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
-	}
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++)
+		zram_free_page(zram, index);
 
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_backing_dev(zram);
+#endif
+
+	zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
 	/* Reset stats */
@@ -534,17 +601,10 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_comp_create(&zram->comp);
+	if (ret) {
+		pr_err("Error allocating %s compression streams\n",
+			zram->comp.name);
 		goto fail;
 	}
 
@@ -565,7 +625,8 @@ int zram_init_device(struct zram *zram)
 		ret = -ENOMEM;
 		goto fail;
 	}
-	zram->table[0].page = page;
+	zram->table[0].handle = (unsigned long)page;
+	zram->table[0].size = PAGE_SIZE;
 	zram_set_flag(zram, 0, ZRAM_UNCOMPRESSED);
 	swap_header = kmap(page);
 	setup_swap_header(zram, swap_header);
@@ -576,7 +637,7 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool();
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -602,7 +663,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -615,9 +678,14 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->table_lock);
+	zram_dedup_init(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bd_lock);
+#endif
+	zram_comp_init(&zram->comp, num_online_cpus());
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -749,6 +817,10 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+		/* Backing device may be set on an uninitialized device */
+		zram_reset_backing_dev(zram);
+#endif
 	}
 
 	unregister_blkdev(zram_major, "zram");
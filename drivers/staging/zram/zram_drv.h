@@ -15,10 +15,15 @@
 #ifndef _ZRAM_DRV_H_
 #define _ZRAM_DRV_H_
 
+#include <linux/bitops.h>
+#include <linux/crypto.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/rbtree.h>
+#include <linux/wait.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,23 +31,14 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
 static const unsigned default_disksize_perc_ram = 25;
 
+/* Compression algorithm used unless set through sysfs */
+static const char default_compressor[] = "lzo";
+
 /*
  * Pages that compress to size greater than this are stored
  * uncompressed in memory.
@@ -51,8 +47,8 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
  * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ *   ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * otherwise, zs_malloc() would always return failure.
  */
 
 /*-- End of configurable params */
@@ -63,23 +59,50 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
 #define ZRAM_LOGICAL_BLOCK_SIZE	4096
 
+/*
+ * Compression and decompression times are accounted in log2 buckets
+ * of microseconds: bucket 0 counts operations taking less than 1us,
+ * bucket n those taking [2^(n-1), 2^n) us and the last bucket all
+ * slower ones.
+ */
+#define ZRAM_TIME_BUCKETS	12
+
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/*
+	 * Page consists entirely of one repeated word (e.g. zeros),
+	 * stored in the handle field; no memory is allocated for it
+	 */
+	ZRAM_SAME,
+
+	/* Page shares a deduplicated object: handle is a zram_entry */
+	ZRAM_DEDUP,
+
+	/* Page was not accessed since last marked idle */
+	ZRAM_IDLE,
+
+	/* Page is on the backing device: handle is the block no. */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
-/* Allocated for each disk page */
+/*
+ * Allocated for each disk page. handle refers to the zsmalloc object
+ * holding the compressed page or, depending on flags, is the struct
+ * page holding the data, the fill word or the dedup entry.
+ */
 struct table {
-	struct page *page;
-	u16 offset;
+	unsigned long handle;
+	u16 size;	/* object size (excluding header) */
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
 } __attribute__((aligned(4)));
@@ -93,22 +116,63 @@ struct zram_stats {
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same filled pages (incl. zero) */
+	u32 pages_dup;		/* no. of pages sharing another's object */
+	u32 dedup_entries;	/* no. of objects available for sharing */
+	u64 dup_data_size;	/* compressed bytes saved by deduplication */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	u32 bd_count;		/* no. of pages on backing device */
+	u64 bd_reads;		/* no. of reads from backing device */
+	u64 bd_writes;		/* no. of pages written back */
+#endif
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
+	u64 comp_time[ZRAM_TIME_BUCKETS];	/* compression times */
+	u64 decomp_time[ZRAM_TIME_BUCKETS];	/* decompression times */
+};
+
+/* Compressor transform and output buffer for one reader or writer */
+struct zram_strm {
+	struct crypto_comp *tfm;
+	void *buffer;
+	struct list_head list;
+};
+
+/* Pool of compression streams shared by concurrent requests */
+struct zram_comp {
+	spinlock_t strm_lock;	/* protect idle list and counters */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	int avail_strm;		/* no. of allocated streams */
+	int max_strm;		/* max. no. of streams */
+	u64 num_waits;		/* no. of times a request had to wait */
+	char name[CRYPTO_MAX_ALG_NAME];	/* compression algorithm */
+};
+
+/* Shared compressed object, indexed by checksum */
+struct zram_entry {
+	struct rb_node rb_node;
+	u32 checksum;
+	unsigned long handle;
+	unsigned int len;
+	int refcount;		/* no. of table slots referring to it */
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zram_comp comp;
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries and the 32-bit
+				 * stats updated along with them */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
+	int use_dedup;
+	/* Dedup entries indexed by checksum */
+	struct rb_root dedup_root;
+	spinlock_t dedup_lock;
 	/* Prevent concurrent execution of device init and reset */
 	struct mutex init_lock;
 	/*
@@ -118,6 +182,21 @@ struct zram {
 	u64 disksize;	/* bytes */
 
 	struct zram_stats stats;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Backing device and its block allocation bitmap */
+	struct file *backing_dev;
+	struct block_device *bdev;
+	unsigned long *bd_bitmap;
+	unsigned long bd_nr_blocks;
+	spinlock_t bd_lock;	/* protect bd_bitmap */
+	struct workqueue_struct *bd_wq;	/* issues backing device reads */
+#endif
+};
+
+/* Writeback modes */
+enum zram_wb_mode {
+	ZRAM_WB_IDLE,	/* pages not accessed since marked idle */
+	ZRAM_WB_HUGE,	/* incompressible pages */
 };
 
 extern struct zram *zram_devices;
@@ -126,7 +205,83 @@ extern unsigned int num_devices;
 extern struct attribute_group zram_disk_attr_group;
 #endif
 
+static inline void zram_stat_inc(u32 *v)
+{
+	*v = *v + 1;
+}
+
+static inline void zram_stat_dec(u32 *v)
+{
+	*v = *v - 1;
+}
+
+static inline void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
+{
+	spin_lock(&zram->stat64_lock);
+	*v = *v + inc;
+	spin_unlock(&zram->stat64_lock);
+}
+
+static inline void zram_stat64_sub(struct zram *zram, u64 *v, u64 dec)
+{
+	spin_lock(&zram->stat64_lock);
+	*v = *v - dec;
+	spin_unlock(&zram->stat64_lock);
+}
+
+static inline void zram_stat64_inc(struct zram *zram, u64 *v)
+{
+	zram_stat64_add(zram, v, 1);
+}
+
+static inline int zram_test_flag(struct zram *zram, u32 index,
+			enum zram_pageflags flag)
+{
+	return zram->table[index].flags & BIT(flag);
+}
+
+static inline void zram_set_flag(struct zram *zram, u32 index,
+			enum zram_pageflags flag)
+{
+	zram->table[index].flags |= BIT(flag);
+}
+
+static inline void zram_clear_flag(struct zram *zram, u32 index,
+			enum zram_pageflags flag)
+{
+	zram->table[index].flags &= ~BIT(flag);
+}
+
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern void zram_free_page(struct zram *zram, size_t index);
+extern int zram_read_page(struct zram *zram, struct page *page, u32 index);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_backing_dev(struct zram *zram);
+extern int zram_bd_read(struct zram *zram, struct page *page,
+			unsigned long blk);
+extern void zram_bd_free_block(struct zram *zram, unsigned long blk);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, enum zram_wb_mode mode);
+#endif
+
+extern void zram_dedup_init(struct zram *zram);
+extern u32 zram_dedup_checksum(const void *data, unsigned int len);
+extern struct zram_entry *zram_dedup_find(struct zram *zram, const void *data,
+			unsigned int len, u32 checksum, void *buf);
+extern struct zram_entry *zram_dedup_insert(struct zram *zram,
+			unsigned long handle, unsigned int len, u32 checksum);
+extern int zram_dedup_put(struct zram *zram, struct zram_entry *entry);
+
+extern void zram_comp_init(struct zram_comp *comp, int max_strm);
+extern int zram_comp_create(struct zram_comp *comp);
+extern void zram_comp_destroy(struct zram_comp *comp);
+extern int zram_comp_set_max_streams(struct zram_comp *comp, int num_strm,
+			int active);
+extern int zram_comp_set_algorithm(struct zram_comp *comp, const char *name);
+extern struct zram_strm *zram_strm_find(struct zram_comp *comp);
+extern void zram_strm_release(struct zram_comp *comp, struct zram_strm *zstrm);
 
 #endif
@@ -0,0 +1,442 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#define KMSG_COMPONENT "zram"
+#define pr_fmt(fmt) KMSG_COMPONENT ": " fmt
+
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/completion.h>
+#include <linux/err.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "zram_drv.h"
+
+/*
+ * Writeback
+ *
+ * Pages that are never accessed again, or that could not be compressed,
+ * can be moved from memory to a backing block device. Block 0 of the
+ * backing device is never used so that a zero handle keeps meaning
+ * "no data" for written back slots too.
+ */
+
+/* Max. no. of pages written back with one batch of bios */
+#define ZRAM_WB_BATCH	32
+
+#define ZRAM_BD_MODE	(FMODE_READ | FMODE_WRITE | FMODE_EXCL)
+
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	destroy_workqueue(zram->bd_wq);
+	blkdev_put(zram->bdev, ZRAM_BD_MODE);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bd_bitmap);
+
+	zram->backing_dev = NULL;
+	zram->bdev = NULL;
+	zram->bd_bitmap = NULL;
+	zram->bd_wq = NULL;
+	zram->bd_nr_blocks = 0;
+}
+
+/* Called with init_lock held, on an uninitialized device */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	int ret;
+	unsigned long nr_blocks, *bitmap = NULL;
+	struct workqueue_struct *wq = NULL;
+	struct file *backing_dev;
+	struct block_device *bdev = NULL;
+	struct inode *inode;
+
+	backing_dev = filp_open(path, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev))
+		return PTR_ERR(backing_dev);
+
+	inode = backing_dev->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		ret = -ENOTBLK;
+		goto fail;
+	}
+
+	bdev = blkdev_get_by_dev(inode->i_rdev, ZRAM_BD_MODE, zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		bdev = NULL;
+		goto fail;
+	}
+
+	nr_blocks = i_size_read(inode) >> PAGE_SHIFT;
+	if (nr_blocks < 2) {
+		ret = -EINVAL;
+		goto fail;
+	}
+
+	bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	if (!bitmap) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	ret = set_blocksize(bdev, PAGE_SIZE);
+	if (ret)
+		goto fail;
+
+	/*
+	 * Swap-in waits on these reads, so they must make progress when
+	 * no new worker can be created for lack of memory.
+	 */
+	wq = alloc_workqueue("zram_bd", WQ_MEM_RECLAIM | WQ_UNBOUND, 1);
+	if (!wq) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	zram_reset_backing_dev(zram);
+
+	zram->backing_dev = backing_dev;
+	zram->bdev = bdev;
+	zram->bd_bitmap = bitmap;
+	zram->bd_nr_blocks = nr_blocks;
+	zram->bd_wq = wq;
+
+	pr_info("setup backing device %s\n", path);
+	return 0;
+
+fail:
+	vfree(bitmap);
+	if (bdev)
+		blkdev_put(bdev, ZRAM_BD_MODE);
+	filp_close(backing_dev, NULL);
+	return ret;
+}
+
+/* Returns a free block no. or 0 if the backing device is full */
+static unsigned long zram_bd_alloc_block(struct zram *zram)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bd_lock);
+	blk = find_next_zero_bit(zram->bd_bitmap, zram->bd_nr_blocks, 1);
+	if (blk == zram->bd_nr_blocks) {
+		spin_unlock(&zram->bd_lock);
+		return 0;
+	}
+	__set_bit(blk, zram->bd_bitmap);
+	spin_unlock(&zram->bd_lock);
+
+	return blk;
+}
+
+void zram_bd_free_block(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bd_lock);
+	WARN_ON(!test_bit(blk, zram->bd_bitmap));
+	__clear_bit(blk, zram->bd_bitmap);
+	spin_unlock(&zram->bd_lock);
+}
+
+static struct bio *zram_bd_bio(struct zram *zram, struct page *page,
+			unsigned long blk, bio_end_io_t *end_io, void *private,
+			gfp_t flags)
+{
+	struct bio *bio;
+
+	bio = bio_alloc(flags, 1);
+	if (!bio)
+		return NULL;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = end_io;
+	bio->bi_private = private;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return NULL;
+	}
+
+	return bio;
+}
+
+struct zram_bd_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	struct completion done;
+	int error;
+};
+
+static void zram_bd_end_io(struct bio *bio, int err)
+{
+	struct zram_bd_work *bd_work = bio->bi_private;
+
+	bd_work->error = err;
+	complete(&bd_work->done);
+}
+
+static void zram_bd_read_work(struct work_struct *work)
+{
+	struct zram_bd_work *bd_work =
+		container_of(work, struct zram_bd_work, work);
+	struct bio *bio;
+
+	bio = zram_bd_bio(bd_work->zram, bd_work->page, bd_work->blk,
+			zram_bd_end_io, bd_work, GFP_NOIO);
+	if (!bio) {
+		bd_work->error = -ENOMEM;
+		return;
+	}
+
+	submit_bio(READ_SYNC, bio);
+	wait_for_completion(&bd_work->done);
+	bio_put(bio);
+}
+
+/*
+ * Read a written back page. Bios submitted from within zram's own
+ * make_request function are only dispatched once it returns, so the
+ * read is issued and waited for from a worker instead.
+ *
+ * The block is not pinned: a page freed while being read may return
+ * stale data, which is fine since nobody owns it anymore.
+ */
+int zram_bd_read(struct zram *zram, struct page *page, unsigned long blk)
+{
+	struct zram_bd_work bd_work;
+
+	bd_work.zram = zram;
+	bd_work.page = page;
+	bd_work.blk = blk;
+	bd_work.error = 0;
+	init_completion(&bd_work.done);
+
+	INIT_WORK_ONSTACK(&bd_work.work, zram_bd_read_work);
+	queue_work(zram->bd_wq, &bd_work.work);
+	flush_work(&bd_work.work);
+	destroy_work_on_stack(&bd_work.work);
+
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+	if (unlikely(bd_work.error)) {
+		pr_err("Read from backing device failed! err=%d, blk=%lu\n",
+			bd_work.error, blk);
+		zram_stat64_inc(zram, &zram->stats.failed_reads);
+		return bd_work.error;
+	}
+
+	flush_dcache_page(page);
+	return 0;
+}
+
+/* Mark all slots holding data in memory as idle */
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		write_lock(&zram->table_lock);
+		if (zram->table[index].handle &&
+				!zram_test_flag(zram, index, ZRAM_SAME) &&
+				!zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		write_unlock(&zram->table_lock);
+	}
+}
+
+/* Called with table_lock held for writing */
+static int zram_wb_eligible(struct zram *zram, u32 index,
+			enum zram_wb_mode mode)
+{
+	if (!zram->table[index].handle ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return 0;
+
+	if (mode == ZRAM_WB_IDLE)
+		return zram_test_flag(zram, index, ZRAM_IDLE);
+
+	return zram_test_flag(zram, index, ZRAM_UNCOMPRESSED);
+}
+
+struct zram_wb_req {
+	struct bio *bio;
+	struct page *page;
+	u32 index;
+	unsigned long blk;
+};
+
+struct zram_wb_batch {
+	atomic_t pending;
+	struct completion done;
+};
+
+static void zram_wb_end_io(struct bio *bio, int err)
+{
+	struct zram_wb_batch *batch = bio->bi_private;
+
+	if (atomic_dec_and_test(&batch->pending))
+		complete(&batch->done);
+}
+
+/*
+ * Submit the bios of a batch at once and wait for all of them. Slots
+ * whose contents made it to the backing device then release their
+ * memory, unless they were rewritten or freed in the meantime (which
+ * clears ZRAM_UNDER_WB).
+ */
+static int zram_wb_submit(struct zram *zram, struct zram_wb_req *reqs,
+			int nr)
+{
+	int i, written = 0;
+	struct blk_plug plug;
+	struct zram_wb_batch batch;
+
+	atomic_set(&batch.pending, nr);
+	init_completion(&batch.done);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr; i++) {
+		reqs[i].bio->bi_private = &batch;
+		submit_bio(WRITE, reqs[i].bio);
+	}
+	blk_finish_plug(&plug);
+
+	wait_for_completion(&batch.done);
+
+	for (i = 0; i < nr; i++) {
+		struct zram_wb_req *req = &reqs[i];
+		int ok = test_bit(BIO_UPTODATE, &req->bio->bi_flags);
+
+		bio_put(req->bio);
+		req->bio = NULL;
+
+		write_lock(&zram->table_lock);
+		if (!ok || !zram_test_flag(zram, req->index, ZRAM_UNDER_WB)) {
+			if (zram_test_flag(zram, req->index, ZRAM_UNDER_WB))
+				zram_clear_flag(zram, req->index,
+						ZRAM_UNDER_WB);
+			write_unlock(&zram->table_lock);
+			zram_bd_free_block(zram, req->blk);
+			continue;
+		}
+
+		zram_free_page(zram, req->index);
+		zram->table[req->index].handle = req->blk;
+		zram_set_flag(zram, req->index, ZRAM_WB);
+		zram_stat_inc(&zram->stats.pages_stored);
+		zram_stat_inc(&zram->stats.bd_count);
+		write_unlock(&zram->table_lock);
+
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+		written++;
+	}
+
+	return written;
+}
+
+/*
+ * Write eligible slots to the backing device. Called with init_lock
+ * held on an initialized device. Returns the no. of pages written back
+ * or a negative error if nothing could be written.
+ */
+int zram_writeback(struct zram *zram, enum zram_wb_mode mode)
+{
+	int i, nr = 0, ret = 0, written = 0;
+	u32 index;
+	struct zram_wb_req *reqs;
+
+	if (!zram->backing_dev)
+		return -ENODEV;
+
+	reqs = kcalloc(ZRAM_WB_BATCH, sizeof(*reqs), GFP_KERNEL);
+	if (!reqs)
+		return -ENOMEM;
+
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		struct zram_wb_req *req = &reqs[nr];
+		int eligible;
+
+		if (!req->page) {
+			req->page = alloc_page(GFP_KERNEL);
+			if (!req->page) {
+				ret = -ENOMEM;
+				break;
+			}
+		}
+
+		write_lock(&zram->table_lock);
+		eligible = zram_wb_eligible(zram, index, mode);
+		if (eligible)
+			zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->table_lock);
+
+		if (!eligible)
+			continue;
+
+		req->index = index;
+		req->blk = zram_bd_alloc_block(zram);
+		if (!req->blk) {
+			ret = -ENOSPC;
+			goto abort;
+		}
+
+		if (zram_read_page(zram, req->page, index))
+			goto abort_blk;
+
+		req->bio = zram_bd_bio(zram, req->page, req->blk,
+				zram_wb_end_io, NULL, GFP_KERNEL);
+		if (!req->bio) {
+			ret = -ENOMEM;
+			goto abort_blk;
+		}
+
+		if (++nr == ZRAM_WB_BATCH) {
+			written += zram_wb_submit(zram, reqs, nr);
+			nr = 0;
+		}
+
+		cond_resched();
+		continue;
+
+abort_blk:
+		zram_bd_free_block(zram, req->blk);
+abort:
+		write_lock(&zram->table_lock);
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->table_lock);
+		if (ret)
+			break;
+	}
+
+	if (nr)
+		written += zram_wb_submit(zram, reqs, nr);
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		if (reqs[i].page)
+			__free_page(reqs[i].page);
+	}
+	kfree(reqs);
+
+	pr_debug("Written back %d pages\n", written);
+	return written ? written : ret;
+}
@@ -0,0 +1,509 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are packed into per size class "zspages" instead of being
+ * carved out of individual pages, so allocation is a bitmap lookup and
+ * the slack of a page is bounded by the class granularity. Pages that
+ * become sparse after many frees are emptied on demand by zs_compact(),
+ * which migrates their objects into fuller zspages of the same class.
+ *
+ * Users get an opaque handle; the object location is only stable while
+ * it is mapped with zs_map_object().
+ */
+
+#ifdef CONFIG_ZRAM_DEBUG
+#define DEBUG
+#endif
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/bitops.h>
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/init.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+/*
+ * Get index of the size class holding objects of given size
+ * (including the handle back-reference).
+ */
+static u32 get_class_idx(u32 size)
+{
+	if (unlikely(size < ZS_MIN_ALLOC_SIZE))
+		size = ZS_MIN_ALLOC_SIZE;
+	return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA);
+}
+
+/*
+ * Find the no. of pages per zspage which wastes the least space
+ * for objects of given size.
+ */
+static u32 get_pages_per_zspage(u32 size)
+{
+	u32 i, best = 1, best_usedpc = 0;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		u32 zspage_size = i * PAGE_SIZE;
+		u32 usedpc = (zspage_size - zspage_size % size) * 100 /
+				zspage_size;
+
+		if (usedpc > best_usedpc) {
+			best_usedpc = usedpc;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static void free_zspage(struct zs_pool *pool, struct size_class *class,
+			struct zspage *zspage)
+{
+	u32 i;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+}
+
+static struct zspage *alloc_zspage(struct zs_pool *pool,
+			struct size_class *class, u32 class_idx, gfp_t flags)
+{
+	u32 i;
+	struct zspage *zspage;
+
+	zspage = kzalloc(sizeof(*zspage), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class_idx = class_idx;
+	atomic_long_add(class->pages_per_zspage, &pool->pages_allocated);
+
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+/*
+ * Copy @len bytes at offset @off of given object to or from @buf,
+ * handling objects that span two pages.
+ */
+static void obj_copy(struct size_class *class, struct zspage *zspage,
+			u32 obj_idx, u32 off, void *buf, u32 len, int write)
+{
+	u32 pos = obj_idx * class->size + off;
+
+	while (len) {
+		u32 page_off = pos & ~PAGE_MASK;
+		u32 chunk = min_t(u32, len, PAGE_SIZE - page_off);
+		unsigned char *addr;
+
+		addr = kmap_atomic(zspage->pages[pos >> PAGE_SHIFT], KM_USER0);
+		if (write)
+			memcpy(addr + page_off, buf, chunk);
+		else
+			memcpy(buf, addr + page_off, chunk);
+		kunmap_atomic(addr, KM_USER0);
+
+		buf += chunk;
+		pos += chunk;
+		len -= chunk;
+	}
+}
+
+/*
+ * Create a memory pool. Allocates size classes and other
+ * per-pool metadata.
+ */
+struct zs_pool *zs_create_pool(void)
+{
+	u32 i;
+	struct zs_pool *pool;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		spin_lock_init(&class->lock);
+		INIT_LIST_HEAD(&class->partial);
+		INIT_LIST_HEAD(&class->full);
+		class->size = ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA;
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+						class->size;
+	}
+
+	rwlock_init(&pool->migrate_lock);
+
+	return pool;
+}
+EXPORT_SYMBOL_GPL(zs_create_pool);
+
+/*
+ * Destroy a pool. Live objects are freed along with it; handles
+ * referring to them become invalid.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	u32 i, idx;
+	struct zspage *zspage, *tmp;
+	struct zs_handle *handle;
+
+	if (!pool)
+		return;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		list_splice_init(&class->full, &class->partial);
+		list_for_each_entry_safe(zspage, tmp, &class->partial, list) {
+			for_each_set_bit(idx, zspage->used,
+					class->objs_per_zspage) {
+				obj_copy(class, zspage, idx, 0, &handle,
+					ZS_HANDLE_SIZE, 0);
+				kfree(handle);
+			}
+			free_zspage(pool, class, zspage);
+		}
+	}
+
+	kfree(pool);
+}
+EXPORT_SYMBOL_GPL(zs_destroy_pool);
+
+/**
+ * zs_malloc - Allocate object of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of object to allocate
+ * @handle: handle referring to the object
+ * @flags: allocation flags for pool growth
+ *
+ * On success, @handle identifies the object allocated and 0 is
+ * returned. On failure, @handle is set to 0 and -ENOMEM is returned.
+ *
+ * Allocation requests with size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE
+ * will fail.
+ */
+int zs_malloc(struct zs_pool *pool, u32 size, unsigned long *handle,
+		gfp_t flags)
+{
+	u32 class_idx, obj_idx;
+	struct size_class *class;
+	struct zspage *zspage, *new_zspage = NULL;
+	struct zs_handle *zh;
+
+	*handle = 0;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE - ZS_HANDLE_SIZE))
+		return -ENOMEM;
+
+	class_idx = get_class_idx(size + ZS_HANDLE_SIZE);
+	class = &pool->classes[class_idx];
+
+	zh = kmalloc(sizeof(*zh), flags & ~__GFP_HIGHMEM);
+	if (!zh)
+		return -ENOMEM;
+
+	spin_lock(&class->lock);
+
+	if (list_empty(&class->partial)) {
+		spin_unlock(&class->lock);
+		new_zspage = alloc_zspage(pool, class, class_idx, flags);
+		if (unlikely(!new_zspage))
+			goto fail;
+
+		spin_lock(&class->lock);
+		list_add(&new_zspage->list, &class->partial);
+		class->zspages++;
+	}
+
+	zspage = list_first_entry(&class->partial, struct zspage, list);
+	obj_idx = find_first_zero_bit(zspage->used, class->objs_per_zspage);
+	__set_bit(obj_idx, zspage->used);
+	if (++zspage->inuse == class->objs_per_zspage)
+		list_move(&zspage->list, &class->full);
+	class->objs_used++;
+
+	zh->zspage = zspage;
+	zh->obj_idx = obj_idx;
+	obj_copy(class, zspage, obj_idx, 0, &zh, ZS_HANDLE_SIZE, 1);
+
+	spin_unlock(&class->lock);
+
+	*handle = (unsigned long)zh;
+
+	return 0;
+
+fail:
+	kfree(zh);
+	return -ENOMEM;
+}
+EXPORT_SYMBOL_GPL(zs_malloc);
+
+/*
+ * Free object identified with @handle
+ */
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *zh = (struct zs_handle *)handle;
+	struct size_class *class;
+	struct zspage *zspage;
+
+	/* Keep compaction from freeing the zspage under us */
+	read_lock(&pool->migrate_lock);
+
+	zspage = zh->zspage;
+	class = &pool->classes[zspage->class_idx];
+
+	spin_lock(&class->lock);
+
+	/* Catch double free bugs */
+	BUG_ON(!test_bit(zh->obj_idx, zspage->used));
+
+	__clear_bit(zh->obj_idx, zspage->used);
+	if (zspage->inuse-- == class->objs_per_zspage)
+		list_move(&zspage->list, &class->partial);
+	class->objs_used--;
+
+	/* No live objects in this zspage. Free it. */
+	if (!zspage->inuse) {
+		list_del(&zspage->list);
+		class->zspages--;
+		spin_unlock(&class->lock);
+
+		free_zspage(pool, class, zspage);
+		read_unlock(&pool->migrate_lock);
+		kfree(zh);
+		return;
+	}
+
+	spin_unlock(&class->lock);
+	read_unlock(&pool->migrate_lock);
+	kfree(zh);
+}
+EXPORT_SYMBOL_GPL(zs_free);
+
+/*
+ * Fill a newly allocated object. @size must not exceed the size
+ * given to zs_malloc().
+ */
+void zs_write_object(struct zs_pool *pool, unsigned long handle,
+			const void *src, u32 size)
+{
+	struct zs_handle *zh = (struct zs_handle *)handle;
+	struct size_class *class;
+
+	read_lock(&pool->migrate_lock);
+	class = &pool->classes[zh->zspage->class_idx];
+	obj_copy(class, zh->zspage, zh->obj_idx, ZS_HANDLE_SIZE,
+		(void *)src, size, 1);
+	read_unlock(&pool->migrate_lock);
+}
+EXPORT_SYMBOL_GPL(zs_write_object);
+
+/**
+ * zs_map_object - Get a pointer to the contents of an object.
+ * @pool: pool the object belongs to
+ * @handle: handle of the object
+ * @buf: bounce buffer of at least ZS_MAX_ALLOC_SIZE bytes
+ *
+ * Objects within a single page are mapped in place. Objects spanning
+ * two pages are copied into @buf, which is then returned. The mapping
+ * is read-only and atomic: it must be released with zs_unmap_object()
+ * without sleeping in between.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle, void *buf)
+{
+	struct zs_handle *zh = (struct zs_handle *)handle;
+	struct size_class *class;
+	u32 pos, page_off;
+	unsigned char *addr;
+
+	read_lock(&pool->migrate_lock);
+
+	class = &pool->classes[zh->zspage->class_idx];
+	pos = zh->obj_idx * class->size;
+	page_off = pos & ~PAGE_MASK;
+
+	if (page_off + class->size > PAGE_SIZE) {
+		obj_copy(class, zh->zspage, zh->obj_idx, ZS_HANDLE_SIZE,
+			buf, class->size - ZS_HANDLE_SIZE, 0);
+		return buf;
+	}
+
+	addr = kmap_atomic(zh->zspage->pages[pos >> PAGE_SHIFT], KM_USER1);
+	return addr + page_off + ZS_HANDLE_SIZE;
+}
+EXPORT_SYMBOL_GPL(zs_map_object);
+
+void zs_unmap_object(struct zs_pool *pool, void *obj, void *buf)
+{
+	if (obj != buf)
+		kunmap_atomic(obj, KM_USER1);
+
+	read_unlock(&pool->migrate_lock);
+}
+EXPORT_SYMBOL_GPL(zs_unmap_object);
+
+/*
+ * Move all objects of the sparsest partial zspage of @class into other
+ * partial zspages, if they have room for them, and free it.
+ * Returns the no. of pages freed. Called with pool->migrate_lock held
+ * for writing.
+ */
+static u32 compact_class(struct zs_pool *pool, struct size_class *class,
+			void *buf)
+{
+	u32 src_idx, dst_idx, free_slots = 0;
+	struct zspage *src = NULL, *dst, *zspage;
+	struct zs_handle *zh;
+
+	spin_lock(&class->lock);
+
+	list_for_each_entry(zspage, &class->partial, list) {
+		free_slots += class->objs_per_zspage - zspage->inuse;
+		if (!src || zspage->inuse < src->inuse)
+			src = zspage;
+	}
+
+	/* Not enough room elsewhere to empty the sparsest zspage */
+	if (!src || free_slots - (class->objs_per_zspage - src->inuse) <
+			src->inuse) {
+		spin_unlock(&class->lock);
+		return 0;
+	}
+
+	list_del(&src->list);
+
+	for_each_set_bit(src_idx, src->used, class->objs_per_zspage) {
+		/* Fill the fullest zspage first */
+		dst = NULL;
+		list_for_each_entry(zspage, &class->partial, list) {
+			if (!dst || zspage->inuse > dst->inuse)
+				dst = zspage;
+		}
+
+		dst_idx = find_first_zero_bit(dst->used,
+					class->objs_per_zspage);
+
+		obj_copy(class, src, src_idx, 0, buf, class->size, 0);
+		obj_copy(class, dst, dst_idx, 0, buf, class->size, 1);
+
+		/* Object starts with the back-reference to its handle */
+		zh = *(struct zs_handle **)buf;
+		zh->zspage = dst;
+		zh->obj_idx = dst_idx;
+
+		__set_bit(dst_idx, dst->used);
+		if (++dst->inuse == class->objs_per_zspage)
+			list_move(&dst->list, &class->full);
+
+		atomic_long_inc(&pool->objs_migrated);
+	}
+
+	class->zspages--;
+	spin_unlock(&class->lock);
+
+	free_zspage(pool, class, src);
+	atomic_long_add(class->pages_per_zspage, &pool->pages_compacted);
+
+	return class->pages_per_zspage;
+}
+
+/*
+ * Migrate objects out of sparse zspages so that they can be freed.
+ * Returns the no. of pages freed, or 0 if nothing could be freed
+ * (or no memory was available for the bounce buffer).
+ */
+u64 zs_compact(struct zs_pool *pool)
+{
+	u32 i, freed;
+	u64 total = 0;
+	void *buf;
+
+	buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+	if (!buf)
+		return 0;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		/* Keep readers stalled for one zspage at most */
+		do {
+			write_lock(&pool->migrate_lock);
+			freed = compact_class(pool, class, buf);
+			write_unlock(&pool->migrate_lock);
+
+			total += freed;
+			cond_resched();
+		} while (freed);
+	}
+
+	kfree(buf);
+
+	return total;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/*
+ * Returns total memory used by allocator (userdata + metadata)
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return (u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT;
+}
+EXPORT_SYMBOL_GPL(zs_get_total_size_bytes);
+
+void zs_get_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
+{
+	u32 i;
+
+	memset(stats, 0, sizeof(*stats));
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->classes[i];
+
+		spin_lock(&class->lock);
+		stats->objs_allocated += class->zspages *
+						class->objs_per_zspage;
+		stats->objs_used += class->objs_used;
+		stats->bytes_used += class->objs_used * class->size;
+		spin_unlock(&class->lock);
+	}
+
+	stats->pages_allocated = atomic_long_read(&pool->pages_allocated);
+	stats->pages_compacted = atomic_long_read(&pool->pages_compacted);
+	stats->objs_migrated = atomic_long_read(&pool->objs_migrated);
+}
+EXPORT_SYMBOL_GPL(zs_get_stats);
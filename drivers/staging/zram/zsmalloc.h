@@ -0,0 +1,46 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_H_
+#define _ZS_MALLOC_H_
+
+#include <linux/types.h>
+
+struct zs_pool;
+
+struct zs_pool_stats {
+	u64 pages_allocated;	/* pages backing the pool */
+	u64 objs_allocated;	/* object slots in those pages */
+	u64 objs_used;		/* slots holding live objects */
+	u64 bytes_used;		/* bytes of slots holding live objects */
+	u64 pages_compacted;	/* pages freed by compaction */
+	u64 objs_migrated;	/* objects moved by compaction */
+};
+
+struct zs_pool *zs_create_pool(void);
+void zs_destroy_pool(struct zs_pool *pool);
+
+int zs_malloc(struct zs_pool *pool, u32 size, unsigned long *handle,
+			gfp_t flags);
+void zs_free(struct zs_pool *pool, unsigned long handle);
+
+void zs_write_object(struct zs_pool *pool, unsigned long handle,
+			const void *src, u32 size);
+void *zs_map_object(struct zs_pool *pool, unsigned long handle, void *buf);
+void zs_unmap_object(struct zs_pool *pool, void *obj, void *buf);
+
+u64 zs_compact(struct zs_pool *pool);
+
+u64 zs_get_total_size_bytes(struct zs_pool *pool);
+void zs_get_stats(struct zs_pool *pool, struct zs_pool_stats *stats);
+
+#endif
@@ -0,0 +1,87 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/*
+ * Objects are grouped in "zspages" of up to this many (not necessarily
+ * contiguous) 0-order pages, so that size classes which do not divide
+ * PAGE_SIZE evenly waste little space. Objects may span a page boundary.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+/*
+ * Every object starts with a back-reference to its handle, used to
+ * update the handle when compaction migrates the object.
+ */
+#define ZS_HANDLE_SIZE		sizeof(unsigned long)
+
+/* Must be a multiple of ZS_HANDLE_SIZE so that headers never straddle */
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/* Size classes are separated by ZS_SIZE_CLASS_DELTA bytes */
+#define ZS_SIZE_CLASS_DELTA	16
+#define ZS_SIZE_CLASSES		((ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE) \
+				/ ZS_SIZE_CLASS_DELTA + 1)
+
+#define ZS_MAX_OBJS_PER_ZSPAGE	(ZS_MAX_PAGES_PER_ZSPAGE * PAGE_SIZE \
+				/ ZS_MIN_ALLOC_SIZE)
+
+/* End of user params */
+
+/* Location of an object, pointed to by the handle given to users */
+struct zs_handle {
+	struct zspage *zspage;
+	unsigned int obj_idx;
+};
+
+struct zspage {
+	struct list_head list;	/* in size_class partial or full list */
+	unsigned int class_idx;
+	unsigned int inuse;	/* no. of live objects */
+	unsigned long used[BITS_TO_LONGS(ZS_MAX_OBJS_PER_ZSPAGE)];
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head partial;	/* zspages with free slots */
+	struct list_head full;
+	u32 size;			/* object slot size */
+	u32 pages_per_zspage;
+	u32 objs_per_zspage;
+	u64 zspages;			/* stats */
+	u64 objs_used;
+};
+
+struct zs_pool {
+	struct size_class classes[ZS_SIZE_CLASSES];
+	/*
+	 * Taken for reading while an object is mapped or written, and for
+	 * writing while compaction moves objects around.
+	 */
+	rwlock_t migrate_lock;
+	atomic_long_t pages_allocated;	/* stats */
+	atomic_long_t pages_compacted;
+	atomic_long_t objs_migrated;
+};
+
+#endif
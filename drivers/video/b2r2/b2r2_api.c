@@ -36,6 +36,7 @@
 #include <linux/err.h>
 #include <linux/hwmem.h>
 #include <linux/kref.h>
+#include <linux/anon_inodes.h>
 
 #include "b2r2_internal.h"
 #include "b2r2_control.h"
@@ -698,6 +699,8 @@ static void b2r2_free_request(struct b2r2_blt_request *request)
 				request->clut_phys_addr);
 		request->clut = NULL;
 		request->clut_phys_addr = 0;
+		if (request->batch_done)
+			b2r2_blt_batch_done_put(request->batch_done);
 		kfree(request);
 	}
 }
@@ -716,6 +719,7 @@ static int b2r2_alloc_request(struct b2r2_blt_req *user_req,
 
 	/* Initialize the structure */
 	INIT_LIST_HEAD(&request->list);
+	INIT_LIST_HEAD(&request->batch);
 
 	/*
 	 * If the user specified a color look-up table,
@@ -766,7 +770,7 @@ exit:
  */
 static int b2r2_blt_blit_internal(int handle,
 		struct b2r2_blt_req *user_req,
-		bool us_req)
+		bool us_req, ktime_t deadline)
 {
 	int request_id;
 	int i;
@@ -849,6 +853,7 @@ static int b2r2_blt_blit_internal(int handle,
 		split_requests[i]->instance = ctl[i];
 		split_requests[i]->job.job_id = request_id;
 		split_requests[i]->job.data = (int) ctl[i]->control->data;
+		split_requests[i]->job.deadline = deadline;
 	}
 
 	/* Split the request */
@@ -955,6 +960,7 @@ static int b2r2_blt_blit_internal(int handle,
 		request_gen->core_mask = 1;
 		request_gen->job.job_id = request_id;
 		request_gen->job.data = (int) ctl[0]->control->data;
+		request_gen->job.deadline = deadline;
 
 		ret = b2r2_generic_blt(request_gen);
 		b2r2_log_info(b2r2_blt->dev, "\nb2r2_generic_blt=%d "
@@ -969,6 +975,288 @@ exit:
 	return ret;
 }
 
+static void b2r2_blt_batch_done_release(struct kref *ref)
+{
+	struct b2r2_blt_batch_done *done =
+		container_of(ref, struct b2r2_blt_batch_done, ref);
+
+	kfree(done);
+}
+
+void b2r2_blt_batch_done_put(struct b2r2_blt_batch_done *done)
+{
+	kref_put(&done->ref, b2r2_blt_batch_done_release);
+}
+
+void b2r2_blt_batch_done_signal(struct b2r2_blt_batch_done *done,
+		bool cancelled)
+{
+	done->cancelled = cancelled;
+	done->done = true;
+	wake_up_interruptible_all(&done->waitq);
+}
+
+/**
+ * b2r2_blt_batch_done_poll - Polls the done file of a batch
+ */
+static unsigned int b2r2_blt_batch_done_poll(struct file *filp,
+		poll_table *wait)
+{
+	struct b2r2_blt_batch_done *done = filp->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(filp, &done->waitq, wait);
+
+	if (done->done) {
+		mask |= POLLIN | POLLRDNORM;
+		if (done->cancelled)
+			mask |= POLLERR;
+	}
+
+	return mask;
+}
+
+/**
+ * b2r2_blt_batch_done_release_file - Last close of the done file of a batch
+ */
+static int b2r2_blt_batch_done_release_file(struct inode *inode,
+		struct file *filp)
+{
+	b2r2_blt_batch_done_put(filp->private_data);
+
+	return 0;
+}
+
+static const struct file_operations b2r2_blt_batch_done_fops = {
+	.owner =          THIS_MODULE,
+	.poll =           b2r2_blt_batch_done_poll,
+	.release =        b2r2_blt_batch_done_release_file,
+};
+
+/**
+ * Perform the requests of a batch one by one, used when a request can not
+ * be chained with the others.
+ */
+static int b2r2_blt_batch_unchained(int handle, struct b2r2_blt_batch *batch)
+{
+	int ret = 0;
+	int i;
+
+	b2r2_log_info(b2r2_blt->dev, "%s: count=%d\n", __func__,
+		batch->count);
+
+	for (i = 0; i < batch->count; i++) {
+		int request_id;
+
+		request_id = b2r2_blt_blit_internal(handle, &batch->reqs[i],
+				true, ns_to_ktime(batch->deadline));
+		if (request_id < 0)
+			return request_id;
+
+		/* There is only one completion for the batch */
+		ret = b2r2_blt_synch(handle, request_id);
+		if (ret < 0)
+			return ret;
+
+		ret = request_id;
+	}
+
+	return ret;
+}
+
+/**
+ * Perform a batch of blit requests as one job.
+ *
+ * The whole batch is performed on one core, the node lists are not split
+ * between cores.
+ */
+static int b2r2_blt_batch_internal(int handle, struct b2r2_blt_batch *batch)
+{
+	int request_id;
+	int i;
+	int n_instance = 0;
+	int n_alloc = 0;
+	int ret = 0;
+	int done_fd = -1;
+	struct file *done_file = NULL;
+	struct b2r2_blt_batch_done *done = NULL;
+	struct b2r2_blt_data *blt_data;
+	struct b2r2_blt_req *ureqs = NULL;
+	struct b2r2_blt_request *requests[B2R2_BLT_MAX_BATCH_COUNT];
+	struct b2r2_control_instance *ctl[B2R2_MAX_NBR_DEVICES];
+
+	batch->done_fd = -1;
+
+	if (batch->size != sizeof(*batch) || batch->count == 0 ||
+			batch->count > B2R2_BLT_MAX_BATCH_COUNT) {
+		b2r2_log_warn(b2r2_blt->dev, "%s: Invalid batch, size=%d, "
+			"count=%d\n", __func__, batch->size, batch->count);
+		return -EINVAL;
+	}
+
+	blt_data = get_data(handle);
+	if (blt_data == NULL) {
+		b2r2_log_warn(b2r2_blt->dev,
+			"%s, blitter instance not found (handle=%d)\n",
+			__func__, handle);
+		return -ENOSYS;
+	}
+
+	/* Get the b2r2 core controls for the job */
+	get_control_instances(blt_data, ctl, B2R2_MAX_NBR_DEVICES, &n_instance);
+	if (n_instance == 0) {
+		b2r2_log_err(b2r2_blt->dev, "%s: No b2r2 cores available.\n",
+			__func__);
+		return -ENOSYS;
+	}
+
+	/* Get the user data */
+	ureqs = kmalloc(batch->count * sizeof(*ureqs), GFP_KERNEL);
+	if (ureqs == NULL) {
+		ret = -ENOMEM;
+		goto exit;
+	}
+	if (copy_from_user(ureqs, batch->reqs,
+			batch->count * sizeof(*ureqs))) {
+		b2r2_log_err(b2r2_blt->dev, "%s: copy_from_user failed\n",
+			__func__);
+		ret = -EFAULT;
+		goto exit;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		struct b2r2_blt_req *ureq = &ureqs[i];
+
+		if (ureq->flags & (B2R2_BLT_FLAG_DRY_RUN |
+				B2R2_BLT_FLAG_REPORT_WHEN_DONE |
+				B2R2_BLT_FLAG_REPORT_PERFORMANCE)) {
+			b2r2_log_warn(b2r2_blt->dev, "%s: Unsupported flags "
+				"0x%08X in batch\n", __func__, ureq->flags);
+			ret = -EINVAL;
+			goto exit;
+		}
+
+		b2r2_recalculate_rects(b2r2_blt->dev, ureq);
+
+		if (!b2r2_validate_user_req(b2r2_blt->dev, ureq)) {
+			b2r2_log_warn(b2r2_blt->dev,
+				"%s: b2r2_validate_user_req failed.\n",
+				__func__);
+			ret = -EINVAL;
+			goto exit;
+		}
+
+		/* The batch is one job */
+		ureq->flags &= ~B2R2_BLT_FLAG_ASYNCH;
+		if (batch->flags & B2R2_BLT_BATCH_FLAG_ASYNCH)
+			ureq->flags |= B2R2_BLT_FLAG_ASYNCH;
+		ureq->prio = batch->prio;
+	}
+
+	/* The id needs to be universal on all cores */
+	request_id = get_next_job_id();
+
+	for (n_alloc = 0; n_alloc < batch->count; n_alloc++) {
+		struct b2r2_blt_request *request;
+
+		ret = b2r2_alloc_request(&ureqs[n_alloc], true, &request);
+		if (ret < 0) {
+			b2r2_log_err(b2r2_blt->dev, "%s: Failed to alloc mem\n",
+				__func__);
+			goto free_requests;
+		}
+
+		request->instance = ctl[0];
+		request->job.job_id = request_id;
+		request->job.data = (int) ctl[0]->control->data;
+		request->job.deadline = ns_to_ktime(batch->deadline);
+		request->core_mask = (1 << ctl[0]->control_id);
+		memcpy(&request->user_req, &ureqs[n_alloc],
+				sizeof(request->user_req));
+		requests[n_alloc] = request;
+	}
+
+	if (batch->flags & B2R2_BLT_BATCH_FLAG_DONE_FD) {
+		done = kzalloc(sizeof(*done), GFP_KERNEL);
+		if (done == NULL) {
+			ret = -ENOMEM;
+			goto free_requests;
+		}
+		kref_init(&done->ref);
+		init_waitqueue_head(&done->waitq);
+
+		done_fd = get_unused_fd();
+		if (done_fd < 0) {
+			ret = -ENFILE;
+			goto free_done;
+		}
+
+		/* The file takes over the initial reference */
+		done_file = anon_inode_getfile("b2r2_batch_done",
+				&b2r2_blt_batch_done_fops, done, O_RDONLY);
+		if (IS_ERR_OR_NULL(done_file)) {
+			ret = -ENFILE;
+			put_unused_fd(done_fd);
+			goto free_done;
+		}
+
+		kref_get(&done->ref);
+		requests[0]->batch_done = done;
+	}
+
+#ifndef CONFIG_B2R2_GENERIC_ONLY
+	/* The requests are released by b2r2_control_blt_batch */
+	ret = b2r2_control_blt_batch(requests, batch->count);
+#else
+	/* Node lists of the generic path can not be chained */
+	for (i = 0; i < n_alloc; i++)
+		b2r2_free_request(requests[i]);
+	ret = -ENOSYS;
+#endif
+	if (ret == -ENOSYS) {
+		b2r2_log_info(b2r2_blt->dev, "%s: Batch can not be chained, "
+			"performing requests one by one\n", __func__);
+		ret = b2r2_blt_batch_unchained(handle, batch);
+		if (ret >= 0 && done != NULL)
+			b2r2_blt_batch_done_signal(done, false);
+	} else if (ret == 0) {
+		/* Blit jobs omitted through debugfs */
+		ret = request_id;
+		if (done != NULL)
+			b2r2_blt_batch_done_signal(done, false);
+	} else if (ret > 0) {
+		int rtmp = b2r2_control_waitjob(requests[0]);
+
+		if (rtmp < 0)
+			b2r2_log_err(b2r2_blt->dev,
+				"%s: b2r2_control_waitjob failed.\n",
+				__func__);
+		ret = request_id;
+	}
+
+	if (done_file != NULL) {
+		if (ret < 0) {
+			fput(done_file);
+			put_unused_fd(done_fd);
+		} else {
+			fd_install(done_fd, done_file);
+			batch->done_fd = done_fd;
+		}
+	}
+	goto exit;
+
+free_done:
+	kfree(done);
+free_requests:
+	for (i = 0; i < n_alloc; i++)
+		b2r2_free_request(requests[i]);
+exit:
+	kfree(ureqs);
+	release_control_instances(ctl, n_instance);
+
+	return ret;
+}
+
 /**
  * Free the memory used for the b2r2_blt device
  */
@@ -1101,8 +1389,8 @@ exit:
 }
 EXPORT_SYMBOL(b2r2_blt_close);
 
-int b2r2_blt_request(int handle,
-		struct b2r2_blt_req *user_req)
+int b2r2_blt_request_deadline(int handle,
+		struct b2r2_blt_req *user_req, __s64 deadline)
 {
 	int ret = 0;
 
@@ -1120,13 +1408,21 @@ int b2r2_blt_request(int handle,
 		goto exit;
 	}
 
-	ret = b2r2_blt_blit_internal(handle, user_req, false);
+	ret = b2r2_blt_blit_internal(handle, user_req, false,
+			ns_to_ktime(deadline));
 
 exit:
 	kref_put(&blt_refcount, b2r2_blt_release);
 
 	return ret;
 }
+EXPORT_SYMBOL(b2r2_blt_request_deadline);
+
+int b2r2_blt_request(int handle,
+		struct b2r2_blt_req *user_req)
+{
+	return b2r2_blt_request_deadline(handle, user_req, 0);
+}
 EXPORT_SYMBOL(b2r2_blt_request);
 
 int b2r2_blt_synch(int handle, int request_id)
@@ -1264,7 +1560,34 @@ static long b2r2_blt_ioctl_us(struct file *file,
 	case B2R2_BLT_IOC: {
 		/* arg is user pointer to struct b2r2_blt_request */
 		ret = b2r2_blt_blit_internal(handle,
-				(struct b2r2_blt_req *) arg, true);
+				(struct b2r2_blt_req *) arg, true,
+				ktime_set(0, 0));
+		break;
+	}
+
+	case B2R2_BLT_BATCH_IOC: {
+		/* arg is user pointer to struct b2r2_blt_batch */
+		struct b2r2_blt_batch batch;
+
+		if (copy_from_user(&batch, (void *)arg, sizeof(batch))) {
+			b2r2_log_err(b2r2_blt->dev,
+				"%s: copy_from_user failed\n",
+				__func__);
+			ret = -EFAULT;
+			goto exit;
+		}
+
+		ret = b2r2_blt_batch_internal(handle, &batch);
+
+		/* Return the done fd to user */
+		if (ret >= 0 && copy_to_user((void *)arg, &batch,
+				sizeof(batch))) {
+			b2r2_log_err(b2r2_blt->dev,
+				"%s: copy_to_user failed\n",
+				__func__);
+			ret = -EFAULT;
+			goto exit;
+		}
 		break;
 	}
 
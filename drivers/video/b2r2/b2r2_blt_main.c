@@ -39,6 +39,7 @@
 #include "b2r2_internal.h"
 #include "b2r2_control.h"
 #include "b2r2_node_split.h"
+#include "b2r2_node_cache.h"
 #include "b2r2_generic.h"
 #include "b2r2_mem_alloc.h"
 #include "b2r2_profiler_socket.h"
@@ -89,6 +90,8 @@ static int resolve_buf(struct b2r2_control *cont,
 		bool is_dst, struct b2r2_resolved_buf *resolved);
 static void unresolve_buf(struct b2r2_control *cont,
 		struct b2r2_blt_buf *buf, struct b2r2_resolved_buf *resolved);
+static void unresolve_request_bufs(struct b2r2_control *cont,
+		struct b2r2_blt_request *request);
 static void sync_buf(struct b2r2_control *cont, struct b2r2_blt_img *img,
 		struct b2r2_resolved_buf *resolved, bool is_dst,
 		struct b2r2_blt_rect *rect);
@@ -388,6 +391,7 @@ int b2r2_control_blt(struct b2r2_blt_request *request)
 	int request_id = 0;
 	struct b2r2_node *last_node = request->first_node;
 	int node_count;
+	struct b2r2_node_cache_entry *cache_entry = NULL;
 	struct b2r2_control_instance *instance = request->instance;
 	struct b2r2_control *cont = instance->control;
 
@@ -509,6 +513,9 @@ int b2r2_control_blt(struct b2r2_blt_request *request)
 		goto resolve_dst_buf_failed;
 	}
 
+	/* Cache maintenance of all hwmem buffers in one pass */
+	hwmem_sync_deferred();
+
 	/* Debug prints of resolved buffers */
 	b2r2_log_info(cont->dev, "src.rbuf={%X,%p,%d} {%p,%X,%X,%d}\n",
 		request->src_resolved.physical_address,
@@ -538,6 +545,14 @@ int b2r2_control_blt(struct b2r2_blt_request *request)
 		request->dst_resolved.file_virtual_start,
 		request->dst_resolved.file_len);
 
+	/* Reuse the node list of an identical previous request if possible */
+	cache_entry = b2r2_node_cache_lookup(cont, request, &node_count);
+	if (cache_entry != NULL) {
+		b2r2_log_info(cont->dev, "%s: Node list found in cache\n",
+			__func__);
+		goto allocate_nodes;
+	}
+
 	/* Calculate the number of nodes (and resources) needed for this job */
 	ret = b2r2_node_split_analyze(request, MAX_TMP_BUF_SIZE, &node_count,
 		&request->bufs, &request->buf_count,
@@ -572,6 +587,7 @@ int b2r2_control_blt(struct b2r2_blt_request *request)
 		goto generate_nodes_failed;
 	}
 
+allocate_nodes:
 	/* Allocate the nodes needed */
 #ifdef B2R2_USE_NODE_GEN
 	request->first_node = b2r2_blt_alloc_nodes(cont,
@@ -591,22 +607,33 @@ int b2r2_control_blt(struct b2r2_blt_request *request)
 	}
 #endif
 
-	/* Build the B2R2 node list */
-	ret = b2r2_node_split_configure(cont, &request->node_split_job,
-			request->first_node);
+	if (cache_entry != NULL) {
+		/* Build the B2R2 node list from the cached one */
+		b2r2_node_cache_apply(cont, cache_entry, request,
+				request->first_node);
+		b2r2_node_cache_put(cache_entry);
+		cache_entry = NULL;
+	} else {
+		/* Build the B2R2 node list */
+		ret = b2r2_node_split_configure(cont,
+				&request->node_split_job, request->first_node);
 
-	if (ret < 0) {
-		b2r2_log_warn(cont->dev, "%s:"
-			" Failed to perform node split, ret = %d\n",
-			__func__, ret);
-		goto generate_nodes_failed;
+		if (ret < 0) {
+			b2r2_log_warn(cont->dev, "%s:"
+				" Failed to perform node split, ret = %d\n",
+				__func__, ret);
+			goto generate_nodes_failed;
+		}
+
+		b2r2_node_cache_insert(cont, request, node_count);
 	}
 
 	/*
 	 * Exit here if dry run or if we choose to
 	 * omit blit jobs through debugfs
 	 */
-	if (request->user_req.flags & B2R2_BLT_FLAG_DRY_RUN || cont->bypass)
+	if ((request->user_req.flags & B2R2_BLT_FLAG_DRY_RUN || cont->bypass) &&
+			!request->batched)
 		goto exit_dry_run;
 
 	/* Configure the request */
@@ -684,6 +711,17 @@ int b2r2_control_blt(struct b2r2_blt_request *request)
 	mutex_unlock(&cont->last_req_lock);
 #endif
 
+	/*
+	 * Batched requests are submitted as one job by
+	 * b2r2_control_blt_batch. They are not verified since later requests
+	 * in the batch may overwrite the result.
+	 */
+	if (request->batched)
+		return 0;
+
+	/* Save the destination if the job is to be verified */
+	b2r2_debug_verify_prepare(cont, request);
+
 	/* Submit the job */
 	b2r2_log_info(cont->dev, "%s: Submitting job\n", __func__);
 
@@ -721,6 +759,8 @@ job_add_failed:
 exit_dry_run:
 no_optimized_path:
 generate_nodes_failed:
+	if (cache_entry != NULL)
+		b2r2_node_cache_put(cache_entry);
 	unresolve_buf(cont, &request->user_req.dst_img.buf,
 		&request->dst_resolved);
 resolve_dst_buf_failed:
@@ -747,6 +787,130 @@ synch_interrupted:
 	return ret;
 }
 
+/**
+ * release_batch() - Releases requests of a batch that was not submitted
+ *
+ * @requests: The requests of the batch, NULL for already released ones
+ * @prepared: Number of requests prepared by b2r2_control_blt
+ * @count:    Number of requests in the batch
+ */
+static void release_batch(struct b2r2_control *cont,
+		struct b2r2_blt_request **requests, int prepared, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct b2r2_blt_request *request = requests[i];
+
+		/* Already released */
+		if (request == NULL)
+			continue;
+
+		if (i < prepared) {
+			unresolve_request_bufs(cont, request);
+			dec_stat(cont, &cont->stat_n_in_blt);
+		}
+		job_release(&request->job);
+		dec_stat(cont, &cont->stat_n_jobs_released);
+	}
+}
+
+/**
+ * b2r2_control_blt_batch - Performs several blit requests as one job
+ *
+ * @requests: The requests, all for the same instance
+ * @count:    Number of requests
+ *
+ * The node lists of the requests are chained so that B2R2 performs them
+ * all in one go. The first request owns the job and is the one to wait for
+ * with b2r2_control_waitjob. All requests are released by this function
+ * on failure.
+ *
+ * Returns the request id if OK, -ENOSYS if any of the requests needs the
+ * generic path, else a negative error code.
+ */
+int b2r2_control_blt_batch(struct b2r2_blt_request **requests, int count)
+{
+	int ret = 0;
+	int request_id;
+	int i;
+	struct b2r2_blt_request *head = requests[0];
+	struct b2r2_blt_request *member;
+	struct b2r2_control_instance *instance = head->instance;
+	struct b2r2_control *cont = instance->control;
+	struct b2r2_node *last_node = NULL;
+
+	b2r2_log_info(cont->dev, "%s: %d requests\n", __func__, count);
+
+	/* Resolve the buffers and build the node lists */
+	for (i = 0; i < count; i++) {
+		requests[i]->batched = true;
+		ret = b2r2_control_blt(requests[i]);
+		if (ret < 0) {
+			/* The failing request is released by b2r2_control_blt */
+			requests[i] = NULL;
+			release_batch(cont, requests, i, count);
+			return ret;
+		}
+	}
+
+	if (cont->bypass) {
+		release_batch(cont, requests, count, count);
+		return 0;
+	}
+
+	/* Chain the node lists */
+	for (i = 0; i < count; i++) {
+		if (last_node != NULL)
+			last_node->node.GROUP0.B2R2_NIP =
+				requests[i]->first_node->physical_address;
+
+		last_node = requests[i]->first_node;
+		while (last_node->next)
+			last_node = last_node->next;
+
+		if (i > 0) {
+			list_add_tail(&requests[i]->batch, &head->batch);
+			/* Only the first request is waited for */
+			dec_stat(cont, &cont->stat_n_in_blt);
+		}
+	}
+	head->job.last_node_address = last_node->physical_address;
+
+	/* Submit the job */
+	b2r2_log_info(cont->dev, "%s: Submitting job\n", __func__);
+
+	inc_stat(cont, &cont->stat_n_in_blt_add);
+
+	mutex_lock(&instance->lock);
+
+	request_id = b2r2_core_job_add(cont, &head->job);
+	head->request_id = request_id;
+
+	dec_stat(cont, &cont->stat_n_in_blt_add);
+
+	if (request_id < 0) {
+		b2r2_log_warn(cont->dev, "%s: Failed to add job, ret = %d\n",
+			__func__, request_id);
+		mutex_unlock(&instance->lock);
+		unresolve_request_bufs(cont, head);
+		list_for_each_entry(member, &head->batch, batch)
+			unresolve_request_bufs(cont, member);
+		/* Releases the other requests of the batch as well */
+		job_release(&head->job);
+		dec_stat(cont, &cont->stat_n_jobs_released);
+		dec_stat(cont, &cont->stat_n_in_blt);
+		return request_id;
+	}
+
+	inc_stat(cont, &cont->stat_n_jobs_added);
+
+	instance->no_of_active_requests++;
+	mutex_unlock(&instance->lock);
+
+	return request_id;
+}
+
 int b2r2_control_waitjob(struct b2r2_blt_request *request)
 {
 	int ret = 0;
@@ -790,6 +954,7 @@ int b2r2_control_waitjob(struct b2r2_blt_request *request)
 static void job_callback(struct b2r2_core_job *job)
 {
 	struct b2r2_blt_request *request = NULL;
+	struct b2r2_blt_request *member;
 	struct b2r2_core *core = NULL;
 	struct b2r2_control *cont = NULL;
 
@@ -803,18 +968,19 @@ static void job_callback(struct b2r2_core_job *job)
 	/* Local addref / release within this func */
 	b2r2_core_job_addref(job, __func__);
 
-	b2r2_debug_buffers_unresolve(cont, request);
+	b2r2_debug_verify(cont, request);
 
 	/* Unresolve the buffers */
-	unresolve_buf(cont, &request->user_req.src_img.buf,
-		&request->src_resolved);
-	unresolve_buf(cont, &request->user_req.src_mask.buf,
-		&request->src_mask_resolved);
-	unresolve_buf(cont, &request->user_req.dst_img.buf,
-		&request->dst_resolved);
-	if (request->user_req.flags & B2R2_BLT_FLAG_BG_BLEND)
-		unresolve_buf(cont, &request->user_req.bg_img.buf,
-			&request->bg_resolved);
+	b2r2_debug_buffers_unresolve(cont, request);
+	unresolve_request_bufs(cont, request);
+	list_for_each_entry(member, &request->batch, batch) {
+		b2r2_debug_buffers_unresolve(cont, member);
+		unresolve_request_bufs(cont, member);
+	}
+
+	if (request->batch_done != NULL)
+		b2r2_blt_batch_done_signal(request->batch_done,
+			job->job_state == B2R2_CORE_JOB_CANCELED);
 
 	/* Move to report list if the job shall be reported */
 	/* FIXME: Use a smaller struct? */
@@ -891,6 +1057,8 @@ static void job_callback(struct b2r2_core_job *job)
 static void job_release(struct b2r2_core_job *job)
 {
 	struct b2r2_blt_request *request = NULL;
+	struct b2r2_blt_request *member;
+	struct b2r2_blt_request *tmp;
 	struct b2r2_core *core = NULL;
 	struct b2r2_control *cont = NULL;
 
@@ -903,7 +1071,17 @@ static void job_release(struct b2r2_core_job *job)
 	b2r2_log_info(cont->dev, "%s, first_node=%p, ref_count=%d\n",
 		__func__, request->first_node, request->job.ref_count);
 
+	/* The other requests of a batch are owned by the batch job */
+	list_for_each_entry_safe(member, tmp, &request->batch, batch) {
+		list_del_init(&member->batch);
+		job_release(&member->job);
+	}
+
+	if (request->batch_done != NULL)
+		b2r2_blt_batch_done_put(request->batch_done);
+
 	b2r2_node_split_cancel(cont, &request->node_split_job);
+	b2r2_debug_verify_release(request);
 
 	if (request->first_node) {
 		b2r2_debug_job_done(cont, request->first_node);
@@ -924,6 +1102,44 @@ static void job_release(struct b2r2_core_job *job)
 	kfree(request);
 }
 
+/**
+ * Assigns the temporary buffers to the nodes of a request
+ *
+ * @request: The request
+ */
+static int assign_tmp_bufs(struct b2r2_control *cont,
+		struct b2r2_blt_request *request)
+{
+	int ret;
+	int i;
+
+	for (i = 0; i < request->buf_count; i++) {
+		if (cont->tmp_bufs[i].buf.size < request->bufs[i].size) {
+			b2r2_log_err(cont->dev, "%s: "
+					"cont->tmp_bufs[i].buf.size < "
+					"request->bufs[i].size\n", __func__);
+			return -ENOMSG;
+		}
+
+		cont->tmp_bufs[i].in_use = true;
+		request->bufs[i].phys_addr = cont->tmp_bufs[i].buf.phys_addr;
+		request->bufs[i].virt_addr = cont->tmp_bufs[i].buf.virt_addr;
+
+		b2r2_log_info(cont->dev, "%s: phys=%p, virt=%p\n",
+				__func__, (void *)request->bufs[i].phys_addr,
+				request->bufs[i].virt_addr);
+
+		ret = b2r2_node_split_assign_buffers(cont,
+				&request->node_split_job,
+				request->first_node, request->bufs,
+				request->buf_count);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
 /**
  * Tells the job to try to allocate the resources needed to execute the job.
  * Called just before execution of a job.
@@ -937,17 +1153,24 @@ static int job_acquire_resources(struct b2r2_core_job *job, bool atomic)
 {
 	struct b2r2_blt_request *request =
 		container_of(job, struct b2r2_blt_request, job);
+	struct b2r2_blt_request *member;
 	struct b2r2_core *core = (struct b2r2_core *) job->data;
 	struct b2r2_control *cont = core->control;
+	u32 buf_count;
 	int ret;
 	int i;
 
 	b2r2_log_info(cont->dev, "%s\n", __func__);
 
-	if (request->buf_count == 0)
+	/* The requests of a batch are performed one after the other */
+	buf_count = request->buf_count;
+	list_for_each_entry(member, &request->batch, batch)
+		buf_count = max(buf_count, member->buf_count);
+
+	if (buf_count == 0)
 		return 0;
 
-	if (request->buf_count > MAX_TMP_BUFS_NEEDED) {
+	if (buf_count > MAX_TMP_BUFS_NEEDED) {
 		b2r2_log_err(cont->dev,
 				"%s: request->buf_count > MAX_TMP_BUFS_NEEDED\n",
 				__func__);
@@ -965,27 +1188,12 @@ static int job_acquire_resources(struct b2r2_core_job *job, bool atomic)
 	if (cont->tmp_bufs[0].in_use)
 		return -EAGAIN;
 
-	for (i = 0; i < request->buf_count; i++) {
-		if (cont->tmp_bufs[i].buf.size < request->bufs[i].size) {
-			b2r2_log_err(cont->dev, "%s: "
-					"cont->tmp_bufs[i].buf.size < "
-					"request->bufs[i].size\n", __func__);
-			ret = -ENOMSG;
-			goto error;
-		}
-
-		cont->tmp_bufs[i].in_use = true;
-		request->bufs[i].phys_addr = cont->tmp_bufs[i].buf.phys_addr;
-		request->bufs[i].virt_addr = cont->tmp_bufs[i].buf.virt_addr;
-
-		b2r2_log_info(cont->dev, "%s: phys=%p, virt=%p\n",
-				__func__, (void *)request->bufs[i].phys_addr,
-				request->bufs[i].virt_addr);
+	ret = assign_tmp_bufs(cont, request);
+	if (ret < 0)
+		goto error;
 
-		ret = b2r2_node_split_assign_buffers(cont,
-				&request->node_split_job,
-				request->first_node, request->bufs,
-				request->buf_count);
+	list_for_each_entry(member, &request->batch, batch) {
+		ret = assign_tmp_bufs(cont, member);
 		if (ret < 0)
 			goto error;
 	}
@@ -993,31 +1201,23 @@ static int job_acquire_resources(struct b2r2_core_job *job, bool atomic)
 	return 0;
 
 error:
-	for (i = 0; i < request->buf_count; i++)
+	for (i = 0; i < buf_count; i++)
 		cont->tmp_bufs[i].in_use = false;
 
 	return ret;
 }
 
 /**
- * Tells the job to free the resources needed to execute the job.
- * Called after execution of a job.
+ * Frees the temporary buffers and nodes of a request
  *
- * @job: The job
- * @atomic: true if called from atomic (i.e. interrupt) context. If function
- *          can't allocate in atomic context it should return error, it
- *          will then be called later from non-atomic context.
+ * @request: The request
+ * @atomic: true if called from atomic context
  */
-static void job_release_resources(struct b2r2_core_job *job, bool atomic)
+static void release_request_resources(struct b2r2_control *cont,
+		struct b2r2_blt_request *request, bool atomic)
 {
-	struct b2r2_blt_request *request =
-		container_of(job, struct b2r2_blt_request, job);
-	struct b2r2_core *core = (struct b2r2_core *) job->data;
-	struct b2r2_control *cont = core->control;
 	int i;
 
-	b2r2_log_info(cont->dev, "%s\n", __func__);
-
 	/* Free any temporary buffers */
 	for (i = 0; i < request->buf_count; i++) {
 
@@ -1044,6 +1244,30 @@ static void job_release_resources(struct b2r2_core_job *job, bool atomic)
 	}
 }
 
+/**
+ * Tells the job to free the resources needed to execute the job.
+ * Called after execution of a job.
+ *
+ * @job: The job
+ * @atomic: true if called from atomic (i.e. interrupt) context. If function
+ *          can't allocate in atomic context it should return error, it
+ *          will then be called later from non-atomic context.
+ */
+static void job_release_resources(struct b2r2_core_job *job, bool atomic)
+{
+	struct b2r2_blt_request *request =
+		container_of(job, struct b2r2_blt_request, job);
+	struct b2r2_blt_request *member;
+	struct b2r2_core *core = (struct b2r2_core *) job->data;
+	struct b2r2_control *cont = core->control;
+
+	b2r2_log_info(cont->dev, "%s\n", __func__);
+
+	release_request_resources(cont, request, atomic);
+	list_for_each_entry(member, &request->batch, batch)
+		release_request_resources(cont, member, atomic);
+}
+
 #endif /* !CONFIG_B2R2_GENERIC_ONLY */
 
 #ifdef CONFIG_B2R2_GENERIC
@@ -1385,6 +1609,9 @@ int b2r2_generic_blt(struct b2r2_blt_request *request)
 		goto resolve_dst_buf_failed;
 	}
 
+	/* Cache maintenance of all hwmem buffers in one pass */
+	hwmem_sync_deferred();
+
 	/* Debug prints of resolved buffers */
 	b2r2_log_info(cont->dev, "src.rbuf={%X,%p,%d} {%p,%X,%X,%d}\n",
 		request->src_resolved.physical_address,
@@ -1614,6 +1841,7 @@ int b2r2_generic_blt(struct b2r2_blt_request *request)
 			tile_job->tag = request->job.tag;
 			tile_job->data = request->job.data;
 			tile_job->prio = request->job.prio;
+			tile_job->deadline = request->job.deadline;
 			tile_job->first_node_address =
 					request->job.first_node_address;
 			tile_job->last_node_address =
@@ -1732,6 +1960,7 @@ int b2r2_generic_blt(struct b2r2_blt_request *request)
 			tile_job->tag = request->job.tag;
 			tile_job->data = request->job.data;
 			tile_job->prio = request->job.prio;
+			tile_job->deadline = request->job.deadline;
 			tile_job->first_node_address =
 				request->job.first_node_address;
 			tile_job->last_node_address =
@@ -2099,8 +2328,9 @@ static int resolve_hwmem(struct b2r2_control *cont,
 	resolved_buf->file_physical_start = mem_chunk.paddr;
 
 	set_up_hwmem_region(cont, img, rect_2b_used, &region);
-	return_value = hwmem_set_domain(resolved_buf->hwmem_alloc,
-		required_access, HWMEM_DOMAIN_SYNC, &region);
+	/* Synchronized by hwmem_sync_deferred() once all bufs are resolved */
+	return_value = hwmem_set_domain_deferred(resolved_buf->hwmem_alloc,
+		required_access, &region);
 	if (return_value < 0) {
 		b2r2_log_info(cont->dev, "%s: hwmem_set_domain failed, "
 			"error code: %i\n", __func__, return_value);
@@ -2134,6 +2364,106 @@ static void unresolve_hwmem(struct b2r2_resolved_buf *resolved_buf)
 	hwmem_release(resolved_buf->hwmem_alloc);
 }
 
+static int resolve_dma_buf(struct b2r2_control *cont,
+		struct b2r2_blt_img *img,
+		bool is_dst,
+		struct b2r2_resolved_buf *resolved_buf)
+{
+	int return_value = 0;
+	struct scatterlist *sg;
+	dma_addr_t next_addr;
+	int i;
+
+	resolved_buf->dma_buf = dma_buf_get(img->buf.fd);
+	if (IS_ERR(resolved_buf->dma_buf)) {
+		return_value = PTR_ERR(resolved_buf->dma_buf);
+		b2r2_log_info(cont->dev, "%s: dma_buf_get failed, "
+			"error code: %i\n", __func__, return_value);
+		goto get_failed;
+	}
+
+	resolved_buf->dma_buf_attach = dma_buf_attach(resolved_buf->dma_buf,
+			cont->dev);
+	if (IS_ERR(resolved_buf->dma_buf_attach)) {
+		return_value = PTR_ERR(resolved_buf->dma_buf_attach);
+		b2r2_log_info(cont->dev, "%s: dma_buf_attach failed, "
+			"error code: %i\n", __func__, return_value);
+		goto attach_failed;
+	}
+
+	/*
+	 * The destination is read as well as written when blending, so it
+	 * is mapped bidirectional. The exporter does the cache maintenance
+	 * the direction asks for.
+	 */
+	resolved_buf->dma_buf_dir = is_dst ? DMA_BIDIRECTIONAL : DMA_TO_DEVICE;
+	resolved_buf->dma_buf_sgt = dma_buf_map_attachment(
+			resolved_buf->dma_buf_attach, resolved_buf->dma_buf_dir);
+	if (IS_ERR_OR_NULL(resolved_buf->dma_buf_sgt)) {
+		return_value = resolved_buf->dma_buf_sgt ?
+				PTR_ERR(resolved_buf->dma_buf_sgt) : -ENOMEM;
+		b2r2_log_info(cont->dev, "%s: dma_buf_map_attachment failed, "
+			"error code: %i\n", __func__, return_value);
+		goto map_failed;
+	}
+
+	/* B2R2 has no MMU, so the buffer has to be physically contiguous */
+	sg = resolved_buf->dma_buf_sgt->sgl;
+	next_addr = sg_dma_address(sg);
+	for_each_sg(resolved_buf->dma_buf_sgt->sgl, sg,
+			resolved_buf->dma_buf_sgt->nents, i) {
+		if (sg_dma_address(sg) != next_addr) {
+			b2r2_log_info(cont->dev, "%s: dma-buf is scattered.\n",
+				__func__);
+			return_value = -EINVAL;
+			goto buf_scattered;
+		}
+		next_addr += sg_dma_len(sg);
+	}
+
+	resolved_buf->file_physical_start =
+			sg_dma_address(resolved_buf->dma_buf_sgt->sgl);
+	resolved_buf->file_len = resolved_buf->dma_buf->size;
+
+	if (resolved_buf->file_len <
+			img->buf.offset +
+			(__u32)b2r2_get_img_size(cont->dev, img)) {
+		b2r2_log_info(cont->dev, "%s: dma-buf too small. (%d < "
+			"%d)\n", __func__, resolved_buf->file_len,
+			img->buf.offset +
+			(__u32)b2r2_get_img_size(cont->dev, img));
+		return_value = -EINVAL;
+		goto size_check_failed;
+	}
+
+	resolved_buf->physical_address =
+			resolved_buf->file_physical_start + img->buf.offset;
+
+	goto out;
+
+size_check_failed:
+buf_scattered:
+	dma_buf_unmap_attachment(resolved_buf->dma_buf_attach,
+			resolved_buf->dma_buf_sgt, resolved_buf->dma_buf_dir);
+map_failed:
+	dma_buf_detach(resolved_buf->dma_buf, resolved_buf->dma_buf_attach);
+attach_failed:
+	dma_buf_put(resolved_buf->dma_buf);
+get_failed:
+	resolved_buf->dma_buf = NULL;
+
+out:
+	return return_value;
+}
+
+static void unresolve_dma_buf(struct b2r2_resolved_buf *resolved_buf)
+{
+	dma_buf_unmap_attachment(resolved_buf->dma_buf_attach,
+			resolved_buf->dma_buf_sgt, resolved_buf->dma_buf_dir);
+	dma_buf_detach(resolved_buf->dma_buf, resolved_buf->dma_buf_attach);
+	dma_buf_put(resolved_buf->dma_buf);
+}
+
 /**
  * unresolve_buf() - Must be called after resolve_buf
  *
@@ -2152,6 +2482,27 @@ static void unresolve_buf(struct b2r2_control *cont,
 #endif
 	if (resolved->hwmem_alloc != NULL)
 		unresolve_hwmem(resolved);
+	if (resolved->dma_buf != NULL)
+		unresolve_dma_buf(resolved);
+}
+
+/**
+ * unresolve_request_bufs() - Unresolves all buffers of a request
+ *
+ * @request: The request, with all buffers resolved
+ */
+static void unresolve_request_bufs(struct b2r2_control *cont,
+		struct b2r2_blt_request *request)
+{
+	unresolve_buf(cont, &request->user_req.src_img.buf,
+		&request->src_resolved);
+	unresolve_buf(cont, &request->user_req.src_mask.buf,
+		&request->src_mask_resolved);
+	unresolve_buf(cont, &request->user_req.dst_img.buf,
+		&request->dst_resolved);
+	if (request->user_req.flags & B2R2_BLT_FLAG_BG_BLEND)
+		unresolve_buf(cont, &request->user_req.bg_img.buf,
+			&request->bg_resolved);
 }
 
 /**
@@ -2276,6 +2627,10 @@ static int resolve_buf(struct b2r2_control *cont,
 		ret = resolve_hwmem(cont, img, rect_2b_used, is_dst, resolved);
 		break;
 
+	case B2R2_BLT_PTR_DMA_BUF_FD_OFFSET:
+		ret = resolve_dma_buf(cont, img, is_dst, resolved);
+		break;
+
 	default:
 		b2r2_log_warn(cont->dev, "%s: Failed to resolve buf type %d\n",
 			__func__, img->buf.type);
@@ -2309,8 +2664,10 @@ static void sync_buf(struct b2r2_control *cont,
 	struct sync_args sa;
 	u32 start_phys, end_phys;
 
+	/* hwmem and dma-buf exporters do their own cache maintenance */
 	if (B2R2_BLT_PTR_NONE == img->buf.type ||
-			B2R2_BLT_PTR_HWMEM_BUF_NAME_OFFSET == img->buf.type)
+			B2R2_BLT_PTR_HWMEM_BUF_NAME_OFFSET == img->buf.type ||
+			B2R2_BLT_PTR_DMA_BUF_FD_OFFSET == img->buf.type)
 		return;
 
 	start_phys = resolved->physical_address;
@@ -3018,6 +3375,8 @@ int b2r2_control_init(struct b2r2_control *cont)
 		goto b2r2_node_split_init_fail;
 	}
 
+	b2r2_node_cache_init(cont);
+
 	b2r2_log_info(cont->dev, "%s: device registered\n", __func__);
 
 	cont->dev->coherent_dma_mask = 0xFFFFFFFF;
@@ -3067,6 +3426,7 @@ int b2r2_control_init(struct b2r2_control *cont)
 b2r2_mem_init_fail:
 	b2r2_filters_exit(cont);
 b2r2_filter_init_fail:
+	b2r2_node_cache_exit(cont);
 	b2r2_node_split_exit(cont);
 b2r2_node_split_init_fail:
 #ifdef CONFIG_B2R2_GENERIC
@@ -3088,6 +3448,7 @@ void b2r2_control_exit(struct b2r2_control *cont)
 			cont->debugfs_root_dir = NULL;
 		}
 #endif
+		b2r2_node_cache_exit(cont);
 		b2r2_mem_exit(cont);
 		destroy_tmp_bufs(cont);
 		b2r2_node_split_exit(cont);
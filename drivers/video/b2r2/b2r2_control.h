@@ -20,6 +20,7 @@ int b2r2_control_open(struct b2r2_control_instance *instance);
 int b2r2_control_release(struct b2r2_control_instance *instance);
 
 int b2r2_control_blt(struct b2r2_blt_request *request);
+int b2r2_control_blt_batch(struct b2r2_blt_request **requests, int count);
 int b2r2_generic_blt(struct b2r2_blt_request *request);
 int b2r2_control_waitjob(struct b2r2_blt_request *request);
 int b2r2_control_synch(struct b2r2_control_instance *instance,
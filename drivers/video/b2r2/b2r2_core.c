@@ -131,6 +131,11 @@
 static struct b2r2_core   *b2r2_core[B2R2_MAX_NBR_DEVICES];
 
 /* Local functions */
+static inline bool has_deadline(struct b2r2_core_job *job)
+{
+	return ktime_to_ns(job->deadline) != 0;
+}
+
 static void check_prio_list(struct b2r2_core *core, bool atomic);
 static void  clear_interrupts(struct b2r2_core *core);
 static void trigger_job(struct b2r2_core *core, struct b2r2_core_job *job);
@@ -1011,7 +1016,14 @@ static void init_job(struct b2r2_core_job *job)
 	else if (job->prio > B2R2_CORE_HIGHEST_PRIO)
 		job->prio = B2R2_CORE_HIGHEST_PRIO;
 
-	if (job->prio > 10) {
+	/*
+	 * Jobs with a deadline all go to the queue with the highest HW
+	 * priority. The B2R2 arbitrates between the application queues at
+	 * node boundaries, so a deadline job never waits for a whole
+	 * background node list to finish. Using a single queue also keeps
+	 * the deadline jobs in order.
+	 */
+	if (job->prio > 10 || has_deadline(job)) {
 		job->queue = B2R2_CORE_QUEUE_AQ1;
 		job->interrupt_context =
 			(B2R2BLT_ITSAQ1_LNA_Reached);
@@ -1047,9 +1059,32 @@ static void  clear_interrupts(struct b2r2_core *core)
 	writel(0x0, &core->hw->BLT_ITM3);
 }
 
+/**
+ * job_before() - Tells if a job shall be dispatched before another job
+ *
+ * @job: Job to check
+ * @other: Job to compare with
+ *
+ * Jobs with a deadline go first, earliest deadline first. Jobs without a
+ * deadline follow in priority order. Jobs that compare equal are
+ * dispatched in the order they were added.
+ */
+static bool job_before(struct b2r2_core_job *job, struct b2r2_core_job *other)
+{
+	if (has_deadline(job) != has_deadline(other))
+		return has_deadline(job);
+
+	if (has_deadline(job))
+		return ktime_to_ns(ktime_sub(job->deadline,
+				other->deadline)) < 0;
+
+	return job->prio > other->prio;
+}
+
 /**
  * insert_into_prio_list() - Inserts the job into the sorted list of jobs.
- *                           The list is sorted by priority.
+ *                           The list is sorted by deadline and priority,
+ *                           see job_before().
  *
  * @core: The b2r2 core entity
  * @job: Job to insert
@@ -1059,6 +1094,8 @@ static void  clear_interrupts(struct b2r2_core *core)
 static void insert_into_prio_list(struct b2r2_core *core,
 		struct b2r2_core_job *job)
 {
+	struct b2r2_core_job *list_job;
+
 	/*
 	 * Ref count is increased when job put in list,
 	 * should be released when job is removed from list
@@ -1067,37 +1104,20 @@ static void insert_into_prio_list(struct b2r2_core *core,
 
 	core->stat_n_jobs_in_prio_list++;
 
-	/* Sort in the job */
-	if (list_empty(&core->prio_queue))
+	/* Sort in the job, most jobs go last */
+	if (list_empty(&core->prio_queue) ||
+			!job_before(job, list_entry(core->prio_queue.prev,
+				struct b2r2_core_job, list))) {
 		list_add_tail(&job->list, &core->prio_queue);
-	else {
-		struct b2r2_core_job *first_job = list_entry(
-			core->prio_queue.next,
-				   struct b2r2_core_job, list);
-		struct b2r2_core_job *last_job = list_entry(
-			core->prio_queue.prev,
-				   struct b2r2_core_job, list);
-
-		if (job->prio > first_job->prio)
-			list_add(&job->list, &core->prio_queue);
-		else if (job->prio <= last_job->prio)
-			list_add_tail(&job->list, &core->prio_queue);
-		else {
-			/* We need to find where to put it */
-			struct list_head *ptr;
-
-			list_for_each(ptr, &core->prio_queue) {
-				struct b2r2_core_job *list_job =
-					list_entry(ptr, struct b2r2_core_job,
-						list);
-				if (job->prio > list_job->prio) {
-					list_add_tail(&job->list,
-						&list_job->list);
-					break;
-				}
+	} else {
+		list_for_each_entry(list_job, &core->prio_queue, list) {
+			if (job_before(job, list_job)) {
+				list_add_tail(&job->list, &list_job->list);
+				break;
 			}
 		}
 	}
+
 	/* The job is now queued */
 	job->job_state = B2R2_CORE_JOB_QUEUED;
 }
@@ -1109,28 +1129,27 @@ static void insert_into_prio_list(struct b2r2_core *core,
  * @core: The b2r2 core entity
  * @atomic: true if in atomic context (i.e. interrupt context)
  *
+ * The prio list is walked in order and each job whose B2R2 queue is free
+ * is dispatched. A job waiting for a busy queue does not hold back jobs
+ * for the other queues, but later jobs for the same queue wait behind it
+ * so that the jobs of each queue keep their order.
+ *
  * core->lock _must_ be held
  */
 static void check_prio_list(struct b2r2_core *core, bool atomic)
 {
-	bool dispatched_job;
+	u32 blocked_queues = 0;
 	int n_dispatched = 0;
 	struct b2r2_core_job *job;
+	struct b2r2_core_job *tmp;
 
-	do {
-		dispatched_job = false;
-
-		/* Do we have anything in our prio list? */
-		if (list_empty(&core->prio_queue))
-			break;
-
-		/* The first job waiting */
-		job = list_first_entry(&core->prio_queue,
-				 struct b2r2_core_job, list);
-
+	list_for_each_entry_safe(job, tmp, &core->prio_queue, list) {
 		/* Is the B2R2 queue available? */
-		if (core->active_jobs[job->queue] != NULL)
-			break;
+		if (core->active_jobs[job->queue] != NULL ||
+				(blocked_queues & BIT(job->queue))) {
+			blocked_queues |= BIT(job->queue);
+			continue;
+		}
 
 		/* Can we acquire resources? */
 		if (!job->acquire_resources ||
@@ -1148,7 +1167,6 @@ static void check_prio_list(struct b2r2_core *core, bool atomic)
 
 			/* Kick off B2R2 */
 			trigger_job(core, job);
-			dispatched_job = true;
 			n_dispatched++;
 
 #ifdef HANDLE_TIMEOUTED_JOBS
@@ -1163,8 +1181,9 @@ static void check_prio_list(struct b2r2_core *core, bool atomic)
 					"%s: No resource", __func__);
 				cancel_job(core, job);
 			}
+			break;
 		}
-	} while (dispatched_job);
+	}
 
 	core->stat_n_jobs_in_prio_list -= n_dispatched;
 }
@@ -1439,6 +1458,31 @@ static void trigger_job(struct b2r2_core *core, struct b2r2_core_job *job)
 
 }
 
+/**
+ * check_deadline() - Updates the deadline statistics for a finished job
+ *
+ * @core: The b2r2 core entity
+ * @job: The finished job, with a deadline
+ *
+ * core->lock _must_ be held
+ */
+static void check_deadline(struct b2r2_core *core, struct b2r2_core_job *job)
+{
+	s64 late_us = ktime_us_delta(ktime_get(), job->deadline);
+
+	core->stat_n_deadline_jobs++;
+	if (late_us <= 0)
+		return;
+
+	core->stat_n_deadline_missed++;
+	core->stat_deadline_total_late_us += late_us;
+	if (late_us > core->stat_deadline_max_late_us)
+		core->stat_deadline_max_late_us = late_us;
+
+	b2r2_log_info(core->dev, "%s: Job %d missed its deadline by %lld us\n",
+		__func__, job->job_id, late_us);
+}
+
 /**
  * handle_queue_event() - Handles interrupt event for specified B2R2 queue
  *
@@ -1486,6 +1530,9 @@ static void handle_queue_event(struct b2r2_core *core,
 	/* Job is done */
 	job->job_state = B2R2_CORE_JOB_DONE;
 
+	if (has_deadline(job))
+		check_deadline(core, job);
+
 	/* Handle done */
 	wake_up_interruptible(&job->event);
 
@@ -2024,6 +2071,16 @@ static int debugfs_b2r2_stat_read(struct file *filp, char __user *buf,
 			core->stat_n_jobs_removed);
 	dev_size += sprintf(tmpbuf + dev_size, "Jobs in prio list : %lu\n",
 			core->stat_n_jobs_in_prio_list);
+	dev_size += sprintf(tmpbuf + dev_size, "Deadline jobs     : %lu\n",
+			core->stat_n_deadline_jobs);
+	dev_size += sprintf(tmpbuf + dev_size, "Missed deadlines  : %lu\n",
+			core->stat_n_deadline_missed);
+	dev_size += sprintf(tmpbuf + dev_size, "Max late (us)     : %lu\n",
+			core->stat_deadline_max_late_us);
+	dev_size += sprintf(tmpbuf + dev_size, "Avg late (us)     : %llu\n",
+			core->stat_n_deadline_missed ?
+			div_u64(core->stat_deadline_total_late_us,
+				core->stat_n_deadline_missed) : 0);
 	dev_size += sprintf(tmpbuf + dev_size, "Active jobs       : %lu\n",
 			core->n_active_jobs);
 	for (i = 0; i < ARRAY_SIZE(core->active_jobs); i++)
@@ -2820,7 +2877,8 @@ void b2r2_core_print_stats(struct b2r2_core *core)
 		"%s: n_irq %ld, n_irq_exit %ld, n_irq_skipped %ld,\n"
 		"n_jobs_added %ld, n_active_jobs %ld, "
 		"n_jobs_in_prio_list %ld,\n"
-		"n_jobs_removed %ld\n",
+		"n_jobs_removed %ld,\n"
+		"n_deadline_jobs %ld, n_deadline_missed %ld\n",
 		__func__,
 		core->stat_n_irq,
 		core->stat_n_irq_exit,
@@ -2828,7 +2886,9 @@ void b2r2_core_print_stats(struct b2r2_core *core)
 		core->stat_n_jobs_added,
 		core->n_active_jobs,
 		core->stat_n_jobs_in_prio_list,
-		core->stat_n_jobs_removed);
+		core->stat_n_jobs_removed,
+		core->stat_n_deadline_jobs,
+		core->stat_n_deadline_missed);
 }
 
 /**
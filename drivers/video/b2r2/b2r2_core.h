@@ -106,7 +106,7 @@ struct addref_release {
  * @pmu_b2r2_clock: Control of B2R2 clock
  * @log_dev: Device used for logging via dev_... functions
  *
- * @prio_queue: Queue of jobs sorted in priority order
+ * @prio_queue: Queue of jobs sorted in deadline and priority order
  * @active_jobs: Array containing pointer to zero or one job per queue
  * @n_active_jobs: Number of active jobs
  * @jiffies_last_active: jiffie value when adding last active job
@@ -126,6 +126,12 @@ struct addref_release {
  * @stat_n_jobs_added: Number of jobs added (statistics)
  * @stat_n_jobs_removed: Number of jobs removed (statistics)
  * @stat_n_jobs_in_prio_list: Number of jobs in prio list (statistics)
+ * @stat_n_deadline_jobs: Number of finished jobs with a deadline (statistics)
+ * @stat_n_deadline_missed: Number of jobs that finished after their
+ *                          deadline (statistics)
+ * @stat_deadline_max_late_us: Largest deadline overrun in us (statistics)
+ * @stat_deadline_total_late_us: Sum of all deadline overruns in us
+ *                               (statistics)
  *
  * @debugfs_root_dir: Root directory for B2R2 debugfs
  *
@@ -175,6 +181,11 @@ struct b2r2_core {
 
 	unsigned long    stat_n_jobs_in_prio_list;
 
+	unsigned long    stat_n_deadline_jobs;
+	unsigned long    stat_n_deadline_missed;
+	unsigned long    stat_deadline_max_late_us;
+	u64              stat_deadline_total_late_us;
+
 #ifdef CONFIG_DEBUG_FS
 	struct dentry *debugfs_root_dir;
 	struct dentry *debugfs_core_root_dir;
@@ -14,7 +14,9 @@
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
 #include <linux/uaccess.h>
+#include <linux/hwmem.h>
 #include "b2r2_debug.h"
+#include "b2r2_exec.h"
 #include "b2r2_utils.h"
 
 int b2r2_log_levels[B2R2_LOG_LEVEL_COUNT];
@@ -690,6 +692,357 @@ static const struct file_operations capture_buffers_fops = {
 	.write = debugfs_capture_write,
 };
 
+#ifdef CONFIG_B2R2_VERIFY
+
+/*
+ * Returns the kernel virtual address of a resolved buffer, or NULL if the
+ * buffer is not accessible by the CPU.
+ */
+static void *resolved_vaddr(struct b2r2_resolved_buf *buf, u32 *paddr,
+		u32 *size)
+{
+	if (buf->hwmem_alloc != NULL) {
+		if (IS_ERR_OR_NULL(buf->virtual_address))
+			return NULL;
+		*paddr = buf->file_physical_start;
+		*size = buf->file_len;
+		return buf->virtual_address;
+	}
+
+	if (buf->file_virtual_start != 0) {
+		*paddr = buf->file_physical_start;
+		*size = buf->file_len;
+		return (void *)buf->file_virtual_start;
+	}
+
+	return NULL;
+}
+
+static void *dst_img_vaddr(struct b2r2_control *cont,
+		struct b2r2_blt_request *request, u32 *size)
+{
+	struct b2r2_resolved_buf *dst = &request->dst_resolved;
+	void *vaddr;
+	u32 paddr;
+	u32 len;
+	s32 img_size;
+
+	vaddr = resolved_vaddr(dst, &paddr, &len);
+	if (vaddr == NULL)
+		return NULL;
+
+	img_size = b2r2_get_img_size(cont->dev, &request->user_req.dst_img);
+	if (img_size <= 0 || dst->physical_address < paddr ||
+			dst->physical_address + img_size > paddr + len)
+		return NULL;
+
+	*size = img_size;
+	return vaddr + (dst->physical_address - paddr);
+}
+
+static void add_resolved_mem(struct b2r2_exec_ctx *ctx,
+		struct b2r2_resolved_buf *buf)
+{
+	void *vaddr;
+	u32 paddr;
+	u32 size;
+
+	vaddr = resolved_vaddr(buf, &paddr, &size);
+	if (vaddr != NULL)
+		(void)b2r2_exec_add_mem(ctx, paddr, size, vaddr);
+}
+
+/* Makes the CPU view of a hwmem buffer coherent with the memory */
+static void set_cpu_domain(struct b2r2_resolved_buf *buf)
+{
+	struct hwmem_region region;
+
+	if (buf->hwmem_alloc == NULL)
+		return;
+
+	region.offset = 0;
+	region.count = 1;
+	region.start = 0;
+	region.end = buf->file_len;
+	region.size = buf->file_len;
+	(void)hwmem_set_domain(buf->hwmem_alloc, HWMEM_ACCESS_READ |
+			HWMEM_ACCESS_WRITE, HWMEM_DOMAIN_CPU, &region);
+}
+
+/**
+ * b2r2_debug_verify_prepare() - Saves the destination before a job is run
+ *
+ * @cont: The B2R2 control
+ * @request: The request about to be submitted
+ */
+void b2r2_debug_verify_prepare(struct b2r2_control *cont,
+		struct b2r2_blt_request *request)
+{
+	void *dst;
+	u32 size;
+
+	request->verify_snapshot = NULL;
+
+	if (!cont->verify.enabled)
+		return;
+
+	dst = dst_img_vaddr(cont, request, &size);
+	if (dst == NULL) {
+		mutex_lock(&cont->verify.lock);
+		cont->verify.n_skipped++;
+		mutex_unlock(&cont->verify.lock);
+		return;
+	}
+
+	request->verify_snapshot = vmalloc(size);
+	if (request->verify_snapshot == NULL) {
+		b2r2_log_warn(cont->dev, "%s: Failed to allocate %d bytes\n",
+				__func__, size);
+		return;
+	}
+
+	memcpy(request->verify_snapshot, dst, size);
+}
+
+/**
+ * b2r2_debug_verify() - Verifies the result of a job using the CPU executor
+ *
+ * @cont: The B2R2 control
+ * @request: The request that has been executed by the hardware
+ *
+ * Runs the node list of the request on the CPU, starting from the saved
+ * destination contents, and compares the result with what the hardware
+ * produced. The hardware result is always what is left in the destination.
+ */
+void b2r2_debug_verify(struct b2r2_control *cont,
+		struct b2r2_blt_request *request)
+{
+	struct b2r2_blt_img *dst_img = &request->user_req.dst_img;
+	struct b2r2_exec_ctx *ctx = NULL;
+	struct b2r2_exec_diff diff;
+	void *tmp_bufs[MAX_TMP_BUFS_NEEDED];
+	void *hw = NULL;
+	void *dst;
+	u32 size;
+	int ret;
+	int i;
+
+	if (request->verify_snapshot == NULL)
+		return;
+
+	memset(tmp_bufs, 0, sizeof(tmp_bufs));
+
+	mutex_lock(&cont->verify.lock);
+
+	dst = dst_img_vaddr(cont, request, &size);
+	if (dst == NULL)
+		goto skip;
+
+	ctx = kmalloc(sizeof(*ctx), GFP_KERNEL);
+	hw = vmalloc(size);
+	if (ctx == NULL || hw == NULL)
+		goto skip;
+
+	b2r2_exec_init(ctx);
+	add_resolved_mem(ctx, &request->dst_resolved);
+	add_resolved_mem(ctx, &request->src_resolved);
+	add_resolved_mem(ctx, &request->src_mask_resolved);
+	if (request->user_req.flags & B2R2_BLT_FLAG_BG_BLEND)
+		add_resolved_mem(ctx, &request->bg_resolved);
+
+	/*
+	 * The temporary buffers may already be used by the next job, give the
+	 * executor its own copies.
+	 */
+	for (i = 0; i < request->buf_count && i < MAX_TMP_BUFS_NEEDED; i++) {
+		tmp_bufs[i] = vmalloc(request->bufs[i].size);
+		if (tmp_bufs[i] == NULL)
+			goto skip;
+		(void)b2r2_exec_add_mem(ctx, request->bufs[i].phys_addr,
+				request->bufs[i].size, tmp_bufs[i]);
+	}
+
+	/* Save the hardware result and run the job again on the CPU */
+	set_cpu_domain(&request->dst_resolved);
+	memcpy(hw, dst, size);
+	memcpy(dst, request->verify_snapshot, size);
+
+	ret = b2r2_exec_run(cont, ctx, request->first_node);
+	if (ret < 0) {
+		memcpy(dst, hw, size);
+		if (ret == -ENOSYS)
+			cont->verify.n_unsupported++;
+		else
+			cont->verify.n_skipped++;
+		goto out;
+	}
+
+	ret = b2r2_exec_compare(dst, hw, dst_img->fmt, dst_img->width,
+			dst_img->height,
+			b2r2_get_img_pitch(cont->dev, dst_img),
+			cont->verify.tolerance, &diff);
+	if (ret == -ENOSYS) {
+		memset(&diff, 0, sizeof(diff));
+		diff.mismatches = memcmp(dst, hw, size) ? 1 : 0;
+		diff.first_x = -1;
+		diff.first_y = -1;
+	}
+
+	memcpy(dst, hw, size);
+
+	cont->verify.n_jobs++;
+	if (diff.mismatches == 0) {
+		cont->verify.n_passed++;
+		goto out;
+	}
+
+	cont->verify.n_failed++;
+	cont->verify.last_fail_id = request->request_id;
+	cont->verify.last_fail_mismatches = diff.mismatches;
+	cont->verify.last_fail_max_diff = diff.max_diff;
+	cont->verify.last_fail_x = diff.first_x;
+	cont->verify.last_fail_y = diff.first_y;
+
+	b2r2_log_warn(cont->dev, "%s: Request %d differs from the CPU result "
+			"in %u pixels, first at (%d, %d), max diff %u\n",
+			__func__, request->request_id, diff.mismatches,
+			diff.first_x, diff.first_y, diff.max_diff);
+	goto out;
+
+skip:
+	cont->verify.n_skipped++;
+out:
+	mutex_unlock(&cont->verify.lock);
+
+	for (i = 0; i < MAX_TMP_BUFS_NEEDED; i++)
+		vfree(tmp_bufs[i]);
+	vfree(hw);
+	kfree(ctx);
+
+	b2r2_debug_verify_release(request);
+}
+
+/**
+ * b2r2_debug_verify_release() - Frees the verification data of a request
+ *
+ * @request: The request
+ */
+void b2r2_debug_verify_release(struct b2r2_blt_request *request)
+{
+	vfree(request->verify_snapshot);
+	request->verify_snapshot = NULL;
+}
+
+static int debugfs_verify_stats_read(struct file *filp, char __user *buf,
+		size_t count, loff_t *f_pos)
+{
+	struct b2r2_control *cont = filp->f_dentry->d_inode->i_private;
+	char str[512];
+	size_t len;
+
+	mutex_lock(&cont->verify.lock);
+	len = scnprintf(str, sizeof(str),
+			"jobs:        %lu\n"
+			"passed:      %lu\n"
+			"failed:      %lu\n"
+			"unsupported: %lu\n"
+			"skipped:     %lu\n"
+			"last failure:\n"
+			"  request:    %d\n"
+			"  mismatches: %u\n"
+			"  max diff:   %u\n"
+			"  first at:   (%d, %d)\n",
+			cont->verify.n_jobs, cont->verify.n_passed,
+			cont->verify.n_failed, cont->verify.n_unsupported,
+			cont->verify.n_skipped, cont->verify.last_fail_id,
+			cont->verify.last_fail_mismatches,
+			cont->verify.last_fail_max_diff,
+			cont->verify.last_fail_x, cont->verify.last_fail_y);
+	mutex_unlock(&cont->verify.lock);
+
+	return simple_read_from_buffer(buf, count, f_pos, str, len);
+}
+
+static const struct file_operations verify_stats_fops = {
+	.read = debugfs_verify_stats_read,
+};
+
+static void verify_init(struct b2r2_control *cont)
+{
+	mutex_init(&cont->verify.lock);
+
+	if (IS_ERR_OR_NULL(cont->debugfs_debug_root_dir))
+		return;
+
+	cont->verify.debugfs_root_dir = debugfs_create_dir("verify",
+			cont->debugfs_debug_root_dir);
+	if (IS_ERR_OR_NULL(cont->verify.debugfs_root_dir))
+		return;
+
+	/* No need to save the files, they will be removed recursively */
+	(void)debugfs_create_bool("enable", 0644,
+			cont->verify.debugfs_root_dir, &cont->verify.enabled);
+	(void)debugfs_create_u32("tolerance", 0644,
+			cont->verify.debugfs_root_dir,
+			&cont->verify.tolerance);
+	(void)debugfs_create_file("stats", 0444,
+			cont->verify.debugfs_root_dir, cont,
+			&verify_stats_fops);
+}
+
+#else
+
+static inline void verify_init(struct b2r2_control *cont)
+{
+}
+
+#endif /* CONFIG_B2R2_VERIFY */
+
+static int debugfs_node_cache_stats_read(struct file *filp, char __user *buf,
+		size_t count, loff_t *f_pos)
+{
+	struct b2r2_control *cont = filp->f_dentry->d_inode->i_private;
+	struct b2r2_node_cache *cache = &cont->node_cache;
+	char str[256];
+	size_t len;
+
+	/* The counters are only read, a consistent snapshot is not needed */
+	len = scnprintf(str, sizeof(str),
+			"entries:     %u\n"
+			"hits:        %lu\n"
+			"misses:      %lu\n"
+			"inserts:     %lu\n"
+			"evictions:   %lu\n"
+			"uncacheable: %lu\n",
+			cache->entry_count, cache->n_hits, cache->n_misses,
+			cache->n_inserts, cache->n_evictions,
+			cache->n_uncacheable);
+
+	return simple_read_from_buffer(buf, count, f_pos, str, len);
+}
+
+static const struct file_operations node_cache_stats_fops = {
+	.read = debugfs_node_cache_stats_read,
+};
+
+static void node_cache_debugfs_init(struct b2r2_control *cont)
+{
+	struct dentry *dir;
+
+	if (IS_ERR_OR_NULL(cont->debugfs_debug_root_dir))
+		return;
+
+	dir = debugfs_create_dir("node_cache", cont->debugfs_debug_root_dir);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	/* No need to save the files, they will be removed recursively */
+	(void)debugfs_create_bool("enable", 0644, dir,
+			&cont->node_cache.enabled);
+	(void)debugfs_create_file("stats", 0444, dir, cont,
+			&node_cache_stats_fops);
+}
+
 int b2r2_debug_init(struct b2r2_control *cont)
 {
 	int i;
@@ -753,6 +1106,9 @@ int b2r2_debug_init(struct b2r2_control *cont)
 	mutex_init(&cont->last_job_lock);
 	mutex_init(&cont->dump.lock);
 
+	verify_init(cont);
+	node_cache_debugfs_init(cont);
+
 	return 0;
 }
 
@@ -106,4 +106,31 @@ static inline void b2r2_debug_buffers_unresolve(struct b2r2_control *cont,
 
 #endif
 
+#ifdef CONFIG_B2R2_VERIFY
+
+void b2r2_debug_verify_prepare(struct b2r2_control *cont,
+		struct b2r2_blt_request *request);
+void b2r2_debug_verify(struct b2r2_control *cont,
+		struct b2r2_blt_request *request);
+void b2r2_debug_verify_release(struct b2r2_blt_request *request);
+
+#else
+
+static inline void b2r2_debug_verify_prepare(struct b2r2_control *cont,
+		struct b2r2_blt_request *request)
+{
+	return;
+}
+static inline void b2r2_debug_verify(struct b2r2_control *cont,
+		struct b2r2_blt_request *request)
+{
+	return;
+}
+static inline void b2r2_debug_verify_release(struct b2r2_blt_request *request)
+{
+	return;
+}
+
+#endif
+
 #endif
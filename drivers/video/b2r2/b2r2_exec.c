@@ -0,0 +1,927 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * ST-Ericsson B2R2 node list CPU executor
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+
+#include "b2r2_exec.h"
+#include "b2r2_hw.h"
+#include "b2r2_filters.h"
+#include "b2r2_utils.h"
+#include "b2r2_debug.h"
+
+/*
+ * The executor models the B2R2 pipeline as follows:
+ *
+ *   S1 (fetch or color fill) ---------------------------\
+ *                                                        ALU -> oVMx -> T
+ *   S2 (fetch or color fill) -> resize -> iVMx -> ckey -/
+ *
+ * Pixels are kept in the internal B2R2 representation: three 8 bit color
+ * components in the order R/Cr, G/Y, B/Cb and an alpha in the 0 - 128 range.
+ *
+ * The results are not guaranteed to be bit exact. Rounding in the resizer,
+ * the VMX and the blender differs slightly from the hardware and dithering
+ * is not modelled, compare with a tolerance.
+ */
+
+#define B2R2_TY_PITCH_MASK 0xffff
+#define B2R2_TY_FMT_MASK (0x1f << B2R2_TY_COLOR_FORM_SHIFT)
+#define B2R2_TY_RGB_EXPANSION_LSB_ZERO BIT(29)
+
+#define B2R2_INS_SOURCE_1_MASK (0x7 << B2R2_INS_SOURCE_1_SHIFT)
+#define B2R2_INS_SOURCE_2_MASK (0x3 << B2R2_INS_SOURCE_2_SHIFT)
+#define B2R2_ACK_MODE_MASK (0xf << B2R2_ACK_MODE_SHIFT)
+#define B2R2_ACK_CKEY_SEL_MASK (0x3 << B2R2_ACK_CKEY_SEL_SHIFT)
+
+/* Features the executor does not model */
+#define INS_UNSUPPORTED (B2R2_INS_SOURCE_3_FETCH_FROM_MEM | \
+		B2R2_INS_CLUTOP_ENABLED | B2R2_INS_FLICK_FILT_ENABLED | \
+		B2R2_INS_DEI_ENABLED | B2R2_INS_PLANE_MASK_ENABLED | \
+		B2R2_INS_XYL_ENABLED | B2R2_INS_DOT_ENABLED | \
+		B2R2_INS_VC1R_ENABLED)
+
+#define ALPHA_MAX 128
+
+/**
+ * struct exec_pixel - A pixel in the internal B2R2 representation
+ */
+struct exec_pixel {
+	s32 a;
+	s32 c[3];
+};
+
+/**
+ * struct exec_surf - A source or target surface as described by a node
+ *
+ * @base:       Physical base address
+ * @fmt:        The native color format
+ * @bpp:        Bytes per pixel
+ * @pitch:      Byte pitch
+ * @x:          X coordinate of the first pixel
+ * @y:          Y coordinate of the first pixel
+ * @width:      Window width, 0 if unknown
+ * @height:     Window height, 0 if unknown
+ * @rtl:        Right to left scan order
+ * @btt:        Bottom to top scan order
+ * @big_endian: Byte order of the pixels is reversed
+ * @alpha_255:  Alpha is in the 0 - 255 range
+ * @lsb_zero:   Expand RGB components by zero padding instead of duplicating
+ *              the most significant bits
+ */
+struct exec_surf {
+	u32 base;
+	u32 fmt;
+	int bpp;
+	u32 pitch;
+	s32 x;
+	s32 y;
+	s32 width;
+	s32 height;
+	bool rtl;
+	bool btt;
+	bool big_endian;
+	bool alpha_255;
+	bool lsb_zero;
+};
+
+/**
+ * struct exec_rescale - Resizer settings of a node
+ *
+ * @h_inc:   Horizontal source increment (6.10 fixed point)
+ * @v_inc:   Vertical source increment (6.10 fixed point)
+ * @h_init:  Initial horizontal phase (0.10 fixed point)
+ * @v_init:  Initial vertical phase (0.10 fixed point)
+ * @hf:      Horizontal filter coefficients, NULL for nearest sample
+ * @vf:      Vertical filter coefficients, NULL for nearest sample
+ * @h_alpha: Filter the alpha channel horizontally
+ * @v_alpha: Filter the alpha channel vertically
+ */
+struct exec_rescale {
+	u32 h_inc;
+	u32 v_inc;
+	u32 h_init;
+	u32 v_init;
+	const s8 *hf;
+	const s8 *vf;
+	bool h_alpha;
+	bool v_alpha;
+};
+
+/**
+ * struct exec_node - Decoded state of the node being executed
+ */
+struct exec_node {
+	struct b2r2_node *node;
+	u32 ins;
+	u32 ack;
+
+	struct exec_surf t;
+	struct exec_surf s1;
+	struct exec_surf s2;
+
+	bool rotate;
+	bool rescale;
+	struct exec_rescale rsz;
+
+	bool clip;
+	s32 clip_l;
+	s32 clip_t;
+	s32 clip_r;
+	s32 clip_b;
+};
+
+static inline s32 sext(u32 value, int bits)
+{
+	return (s32)(value << (32 - bits)) >> (32 - bits);
+}
+
+static inline s32 clamp_comp(s32 value, s32 max)
+{
+	return clamp_t(s32, value, 0, max);
+}
+
+static int native_bpp(u32 fmt)
+{
+	switch (fmt) {
+	case B2R2_NATIVE_A8:
+		return 1;
+	case B2R2_NATIVE_RGB565:
+	case B2R2_NATIVE_ARGB1555:
+	case B2R2_NATIVE_ARGB4444:
+		return 2;
+	case B2R2_NATIVE_RGB888:
+	case B2R2_NATIVE_ARGB8565:
+	case B2R2_NATIVE_YCBCR888:
+		return 3;
+	case B2R2_NATIVE_ARGB8888:
+	case B2R2_NATIVE_AYCBCR8888:
+		return 4;
+	default:
+		/* Sub-byte, CLUT and multi-buffer formats are not modelled */
+		return 0;
+	}
+}
+
+static bool native_has_alpha(u32 fmt)
+{
+	switch (fmt) {
+	case B2R2_NATIVE_A8:
+	case B2R2_NATIVE_ARGB1555:
+	case B2R2_NATIVE_ARGB4444:
+	case B2R2_NATIVE_ARGB8565:
+	case B2R2_NATIVE_ARGB8888:
+	case B2R2_NATIVE_AYCBCR8888:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline s32 alpha_from_255(u32 alpha)
+{
+	return (alpha + (alpha >> 7)) >> 1;
+}
+
+static inline u32 alpha_to_255(s32 alpha)
+{
+	return alpha >= ALPHA_MAX ? 255 : alpha << 1;
+}
+
+static inline s32 expand(u32 value, int bits, bool lsb_zero)
+{
+	value <<= 8 - bits;
+	if (!lsb_zero)
+		value |= value >> bits;
+	return value & 0xff;
+}
+
+static void unpack(u32 fmt, bool alpha_255, bool lsb_zero, u32 value,
+		struct exec_pixel *px)
+{
+	u32 alpha = 0xff;
+
+	switch (fmt) {
+	case B2R2_NATIVE_A8:
+		alpha = value & 0xff;
+		px->c[0] = px->c[1] = px->c[2] = 0;
+		break;
+	case B2R2_NATIVE_ARGB8565:
+		alpha = (value >> 16) & 0xff;
+		/* Fall through */
+	case B2R2_NATIVE_RGB565:
+		px->c[0] = expand((value >> 11) & 0x1f, 5, lsb_zero);
+		px->c[1] = expand((value >> 5) & 0x3f, 6, lsb_zero);
+		px->c[2] = expand(value & 0x1f, 5, lsb_zero);
+		break;
+	case B2R2_NATIVE_ARGB1555:
+		px->a = (value & 0x8000) ? ALPHA_MAX : 0;
+		px->c[0] = expand((value >> 10) & 0x1f, 5, lsb_zero);
+		px->c[1] = expand((value >> 5) & 0x1f, 5, lsb_zero);
+		px->c[2] = expand(value & 0x1f, 5, lsb_zero);
+		return;
+	case B2R2_NATIVE_ARGB4444:
+		px->a = alpha_from_255(((value >> 12) & 0xf) * 0x11);
+		px->c[0] = expand((value >> 8) & 0xf, 4, lsb_zero);
+		px->c[1] = expand((value >> 4) & 0xf, 4, lsb_zero);
+		px->c[2] = expand(value & 0xf, 4, lsb_zero);
+		return;
+	case B2R2_NATIVE_ARGB8888:
+	case B2R2_NATIVE_AYCBCR8888:
+		alpha = value >> 24;
+		/* Fall through */
+	default:
+		px->c[0] = (value >> 16) & 0xff;
+		px->c[1] = (value >> 8) & 0xff;
+		px->c[2] = value & 0xff;
+		break;
+	}
+
+	if (!native_has_alpha(fmt))
+		px->a = ALPHA_MAX;
+	else if (alpha_255)
+		px->a = alpha_from_255(alpha);
+	else
+		px->a = min_t(s32, alpha, ALPHA_MAX);
+}
+
+static u32 pack(u32 fmt, bool alpha_255, const struct exec_pixel *px)
+{
+	u32 r = px->c[0];
+	u32 g = px->c[1];
+	u32 b = px->c[2];
+	u32 alpha = alpha_255 ? alpha_to_255(px->a) : px->a;
+
+	switch (fmt) {
+	case B2R2_NATIVE_A8:
+		return alpha;
+	case B2R2_NATIVE_RGB565:
+		return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+	case B2R2_NATIVE_ARGB8565:
+		return (alpha << 16) | ((r >> 3) << 11) | ((g >> 2) << 5) |
+				(b >> 3);
+	case B2R2_NATIVE_ARGB1555:
+		return (px->a >= ALPHA_MAX / 2 ? 0x8000 : 0) |
+				((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+	case B2R2_NATIVE_ARGB4444:
+		return ((alpha_to_255(px->a) >> 4) << 12) | ((r >> 4) << 8) |
+				((g >> 4) << 4) | (b >> 4);
+	case B2R2_NATIVE_ARGB8888:
+	case B2R2_NATIVE_AYCBCR8888:
+		return (alpha << 24) | (r << 16) | (g << 8) | b;
+	default:
+		return (r << 16) | (g << 8) | b;
+	}
+}
+
+static u32 read_raw(const u8 *p, int bpp, bool big_endian)
+{
+	u32 value = 0;
+	int i;
+
+	for (i = 0; i < bpp; i++) {
+		if (big_endian)
+			value = (value << 8) | p[i];
+		else
+			value |= p[i] << (8 * i);
+	}
+
+	return value;
+}
+
+static void write_raw(u8 *p, int bpp, bool big_endian, u32 value)
+{
+	int i;
+
+	for (i = 0; i < bpp; i++) {
+		if (big_endian)
+			p[bpp - 1 - i] = value >> (8 * i);
+		else
+			p[i] = value >> (8 * i);
+	}
+}
+
+static void *map(struct b2r2_exec_ctx *ctx, u32 addr, u32 len)
+{
+	struct b2r2_exec_mem *mem = ctx->last_mem;
+	int i;
+
+	if (mem && addr >= mem->paddr && addr + len <= mem->paddr + mem->size)
+		return mem->vaddr + (addr - mem->paddr);
+
+	for (i = 0; i < ctx->mem_count; i++) {
+		mem = &ctx->mem[i];
+		if (addr >= mem->paddr &&
+				addr + len <= mem->paddr + mem->size) {
+			ctx->last_mem = mem;
+			return mem->vaddr + (addr - mem->paddr);
+		}
+	}
+
+	return NULL;
+}
+
+static int surf_init(struct exec_surf *s, u32 ba, u32 ty, u32 xy, u32 sz)
+{
+	s->base = ba;
+	s->fmt = ty & B2R2_TY_FMT_MASK;
+	s->bpp = native_bpp(s->fmt);
+	s->pitch = ty & B2R2_TY_PITCH_MASK;
+	s->x = (s16)((xy >> B2R2_XY_X_SHIFT) & 0xffff);
+	s->y = (s16)((xy >> B2R2_XY_Y_SHIFT) & 0xffff);
+	s->width = (sz >> B2R2_SZ_WIDTH_SHIFT) & 0xfff;
+	s->height = (sz >> B2R2_SZ_HEIGHT_SHIFT) & 0xfff;
+	s->rtl = (ty & B2R2_TY_HSO_RIGHT_TO_LEFT) != 0;
+	s->btt = (ty & B2R2_TY_VSO_BOTTOM_TO_TOP) != 0;
+	s->big_endian = (ty & B2R2_TY_ENDIAN_BIG_NOT_LITTLE) != 0;
+	s->alpha_255 = (ty & B2R2_TY_ALPHA_RANGE_255) != 0;
+	s->lsb_zero = (ty & B2R2_TY_RGB_EXPANSION_LSB_ZERO) != 0;
+
+	return s->bpp ? 0 : -ENOSYS;
+}
+
+/*
+ * Returns the address of the pixel n steps along a line and m lines away
+ * from the first pixel of the surface, following its scan order.
+ */
+static u8 *surf_pixel(struct b2r2_exec_ctx *ctx, struct exec_surf *s,
+		s32 n, s32 m)
+{
+	s32 x = s->x + (s->rtl ? -n : n);
+	s32 y = s->y + (s->btt ? -m : m);
+
+	if (x < 0 || y < 0)
+		return NULL;
+
+	return map(ctx, s->base + y * s->pitch + x * s->bpp, s->bpp);
+}
+
+static int surf_read(struct b2r2_exec_ctx *ctx, struct exec_surf *s,
+		s32 n, s32 m, struct exec_pixel *px)
+{
+	u8 *p = surf_pixel(ctx, s, n, m);
+
+	if (p == NULL)
+		return -EFAULT;
+
+	unpack(s->fmt, s->alpha_255, s->lsb_zero,
+			read_raw(p, s->bpp, s->big_endian), px);
+	return 0;
+}
+
+static void vmx_apply(const struct b2r2_vm *vm, struct exec_pixel *px)
+{
+	const u32 row[3] = { vm->B2R2_VMX0, vm->B2R2_VMX1, vm->B2R2_VMX2 };
+	s32 out[3];
+	int i;
+
+	/*
+	 * Each row holds the coefficients of one output component as
+	 * 11, 11 and 10 bit signed values with 8 fractional bits. VMX3 holds
+	 * the three 10 bit signed offsets.
+	 */
+	for (i = 0; i < 3; i++) {
+		s32 c0 = sext(row[i] >> 21, 11);
+		s32 c1 = sext((row[i] >> 10) & 0x7ff, 11);
+		s32 c2 = sext(row[i] & 0x3ff, 10);
+		s32 offset = sext((vm->B2R2_VMX3 >> (20 - 10 * i)) & 0x3ff,
+				10);
+
+		out[i] = ((c0 * px->c[0] + c1 * px->c[1] + c2 * px->c[2] +
+				128) >> 8) + offset;
+	}
+
+	for (i = 0; i < 3; i++)
+		px->c[i] = clamp_comp(out[i], 255);
+}
+
+/* Horizontal resize of one source line at fixed point position pos */
+static int resize_line(struct b2r2_exec_ctx *ctx, struct exec_node *en,
+		u32 pos, s32 line, struct exec_pixel *px)
+{
+	struct exec_surf *s = &en->s2;
+	struct exec_rescale *rsz = &en->rsz;
+	s32 n = pos >> 10;
+	struct exec_pixel tap;
+	s32 sum[4] = { 0, 0, 0, 0 };
+	int phase;
+	int k;
+	int ret;
+
+	line = clamp_t(s32, line, 0, max(s->height - 1, 0));
+
+	if (rsz->hf == NULL)
+		return surf_read(ctx, s, min(n, max(s->width - 1, 0)), line,
+				px);
+
+	/* 8 phases with 8 taps each, the coefficients sum up to 64 */
+	phase = (pos >> 7) & 0x7;
+	for (k = 0; k < 8; k++) {
+		s32 coeff = rsz->hf[phase * 8 + k];
+		s32 tn = clamp_t(s32, n + 4 - k, 0, max(s->width - 1, 0));
+
+		ret = surf_read(ctx, s, tn, line, &tap);
+		if (ret < 0)
+			return ret;
+
+		sum[0] += coeff * tap.c[0];
+		sum[1] += coeff * tap.c[1];
+		sum[2] += coeff * tap.c[2];
+		if (rsz->h_alpha || k == 4)
+			sum[3] += (rsz->h_alpha ? coeff : 64) * tap.a;
+	}
+
+	px->c[0] = clamp_comp((sum[0] + 32) >> 6, 255);
+	px->c[1] = clamp_comp((sum[1] + 32) >> 6, 255);
+	px->c[2] = clamp_comp((sum[2] + 32) >> 6, 255);
+	px->a = clamp_comp((sum[3] + 32) >> 6, ALPHA_MAX);
+
+	return 0;
+}
+
+static int resize(struct b2r2_exec_ctx *ctx, struct exec_node *en,
+		s32 n, s32 m, struct exec_pixel *px)
+{
+	struct exec_rescale *rsz = &en->rsz;
+	u32 h_pos = rsz->h_init + n * rsz->h_inc;
+	u32 v_pos = rsz->v_init + m * rsz->v_inc;
+	s32 line = v_pos >> 10;
+	struct exec_pixel tap;
+	s32 sum[4] = { 0, 0, 0, 0 };
+	int phase;
+	int k;
+	int ret;
+
+	if (rsz->vf == NULL)
+		return resize_line(ctx, en, h_pos, line, px);
+
+	/* 8 phases with 5 taps each, the coefficients sum up to 64 */
+	phase = (v_pos >> 7) & 0x7;
+	for (k = 0; k < 5; k++) {
+		s32 coeff = rsz->vf[phase * 5 + k];
+
+		ret = resize_line(ctx, en, h_pos, line + 2 - k, &tap);
+		if (ret < 0)
+			return ret;
+
+		sum[0] += coeff * tap.c[0];
+		sum[1] += coeff * tap.c[1];
+		sum[2] += coeff * tap.c[2];
+		if (rsz->v_alpha || k == 2)
+			sum[3] += (rsz->v_alpha ? coeff : 64) * tap.a;
+	}
+
+	px->c[0] = clamp_comp((sum[0] + 32) >> 6, 255);
+	px->c[1] = clamp_comp((sum[1] + 32) >> 6, 255);
+	px->c[2] = clamp_comp((sum[2] + 32) >> 6, 255);
+	px->a = clamp_comp((sum[3] + 32) >> 6, ALPHA_MAX);
+
+	return 0;
+}
+
+static int fetch_s1(struct b2r2_exec_ctx *ctx, struct exec_node *en,
+		s32 i, s32 j, struct exec_pixel *px)
+{
+	switch (en->ins & B2R2_INS_SOURCE_1_MASK) {
+	case B2R2_INS_SOURCE_1_FETCH_FROM_MEM:
+		return surf_read(ctx, &en->s1, i, j, px);
+	case B2R2_INS_SOURCE_1_COLOR_FILL_REGISTER:
+		unpack(en->s1.fmt, en->s1.alpha_255, false,
+				en->node->node.GROUP2.B2R2_S1CF, px);
+		return 0;
+	default:
+		memset(px, 0, sizeof(*px));
+		return 0;
+	}
+}
+
+static int fetch_s2(struct b2r2_exec_ctx *ctx, struct exec_node *en,
+		s32 i, s32 j, struct exec_pixel *px)
+{
+	s32 n = en->rotate ? j : i;
+	s32 m = en->rotate ? i : j;
+
+	switch (en->ins & B2R2_INS_SOURCE_2_MASK) {
+	case B2R2_INS_SOURCE_2_FETCH_FROM_MEM:
+		if (en->rescale)
+			return resize(ctx, en, n, m, px);
+		return surf_read(ctx, &en->s2, n, m, px);
+	case B2R2_INS_SOURCE_2_COLOR_FILL_REGISTER:
+		unpack(en->s2.fmt, en->s2.alpha_255, false,
+				en->node->node.GROUP2.B2R2_S2CF, px);
+		return 0;
+	default:
+		memset(px, 0, sizeof(*px));
+		return 0;
+	}
+}
+
+/* Returns true if the pixel matches the color key */
+static bool ckey_match(struct exec_node *en, const struct exec_pixel *px)
+{
+	static const int shift[3] = {
+		B2R2_ACK_CKEY_RED_SHIFT,
+		B2R2_ACK_CKEY_GREEN_SHIFT,
+		B2R2_ACK_CKEY_BLUE_SHIFT,
+	};
+	u32 key1 = en->node->node.GROUP12.B2R2_KEY1;
+	u32 key2 = en->node->node.GROUP12.B2R2_KEY2;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		u32 mode = (en->ack >> shift[i]) & 0x3;
+		s32 lo = (key1 >> (16 - 8 * i)) & 0xff;
+		s32 hi = (key2 >> (16 - 8 * i)) & 0xff;
+		bool between = px->c[i] >= lo && px->c[i] <= hi;
+
+		if ((mode == 1 && !between) || (mode == 2 && between))
+			return false;
+	}
+
+	return true;
+}
+
+static u32 rop(u32 rop_id, u32 s, u32 d)
+{
+	switch (rop_id) {
+	case 0x0:
+		return 0;
+	case 0x1:
+		return s & d;
+	case 0x2:
+		return s & ~d;
+	case 0x3:
+		return s;
+	case 0x4:
+		return ~s & d;
+	case 0x5:
+		return d;
+	case 0x6:
+		return s ^ d;
+	case 0x7:
+		return s | d;
+	case 0x8:
+		return ~(s | d);
+	case 0x9:
+		return ~(s ^ d);
+	case 0xa:
+		return ~d;
+	case 0xb:
+		return s | ~d;
+	case 0xc:
+		return ~s;
+	case 0xd:
+		return ~s | d;
+	case 0xe:
+		return ~(s & d);
+	default:
+		return ~0;
+	}
+}
+
+static void blend(struct exec_node *en, const struct exec_pixel *s1,
+		const struct exec_pixel *s2, struct exec_pixel *out)
+{
+	const struct exec_pixel *fg = s2;
+	const struct exec_pixel *bg = s1;
+	s32 galpha = min_t(s32, (en->ack >> B2R2_ACK_GALPHA_ROPID_SHIFT) & 0xff,
+			ALPHA_MAX);
+	s32 a;
+	int i;
+
+	if (en->ack & B2R2_ACK_SWAP_FG_BG) {
+		fg = s1;
+		bg = s2;
+	}
+
+	a = (fg->a * galpha + 64) >> 7;
+
+	for (i = 0; i < 3; i++) {
+		if ((en->ack & B2R2_ACK_MODE_MASK) ==
+				B2R2_ACK_MODE_BLEND_PREMULT)
+			out->c[i] = ((fg->c[i] * galpha + 64) >> 7) +
+				((bg->c[i] * (ALPHA_MAX - a) + 64) >> 7);
+		else
+			out->c[i] = (fg->c[i] * a +
+				bg->c[i] * (ALPHA_MAX - a) + 64) >> 7;
+
+		out->c[i] = clamp_comp(out->c[i], 255);
+	}
+
+	out->a = clamp_comp(a + ((bg->a * (ALPHA_MAX - a) + 64) >> 7),
+			ALPHA_MAX);
+}
+
+static int exec_pixel(struct b2r2_exec_ctx *ctx, struct exec_node *en,
+		s32 i, s32 j, u8 *dst)
+{
+	struct b2r2_link_list *regs = &en->node->node;
+	struct exec_pixel s1;
+	struct exec_pixel s2;
+	struct exec_pixel out;
+	int ret;
+
+	ret = fetch_s1(ctx, en, i, j, &s1);
+	if (ret < 0)
+		return ret;
+
+	ret = fetch_s2(ctx, en, i, j, &s2);
+	if (ret < 0)
+		return ret;
+
+	if (en->ins & B2R2_INS_CKEY_ENABLED) {
+		bool match;
+
+		if ((en->ack & B2R2_ACK_CKEY_SEL_MASK) == B2R2_ACK_CKEY_SEL_DEST)
+			match = ckey_match(en, &s1);
+		else
+			match = ckey_match(en, &s2);
+
+		/* Matching pixels are transparent */
+		if (match)
+			return 0;
+	}
+
+	if (en->ins & B2R2_INS_IVMX_ENABLED)
+		vmx_apply(&regs->GROUP15, &s2);
+
+	switch (en->ack & B2R2_ACK_MODE_MASK) {
+	case B2R2_ACK_MODE_BYPASS_S2_S3:
+		out = s2;
+		break;
+	case B2R2_ACK_MODE_LOGICAL_OPERATION: {
+		u32 rop_id = (en->ack >> B2R2_ACK_GALPHA_ROPID_SHIFT) & 0xf;
+		u32 value = rop(rop_id,
+				(s2.c[0] << 16) | (s2.c[1] << 8) | s2.c[2],
+				(s1.c[0] << 16) | (s1.c[1] << 8) | s1.c[2]);
+
+		out.c[0] = (value >> 16) & 0xff;
+		out.c[1] = (value >> 8) & 0xff;
+		out.c[2] = value & 0xff;
+		out.a = s2.a;
+		break;
+	}
+	case B2R2_ACK_MODE_BLEND_NOT_PREMULT:
+	case B2R2_ACK_MODE_BLEND_PREMULT:
+		blend(en, &s1, &s2, &out);
+		break;
+	default:
+		return -ENOSYS;
+	}
+
+	if (en->ins & B2R2_INS_OVMX_ENABLED)
+		vmx_apply(&regs->GROUP16, &out);
+
+	write_raw(dst, en->t.bpp, en->t.big_endian,
+			pack(en->t.fmt, en->t.alpha_255, &out));
+
+	return 0;
+}
+
+static int exec_node(struct b2r2_control *cont, struct b2r2_exec_ctx *ctx,
+		struct b2r2_node *node)
+{
+	struct b2r2_link_list *regs = &node->node;
+	struct exec_node en;
+	u32 s1_mode;
+	s32 i;
+	s32 j;
+	int ret;
+
+	memset(&en, 0, sizeof(en));
+	en.node = node;
+	en.ins = regs->GROUP0.B2R2_INS;
+	en.ack = regs->GROUP0.B2R2_ACK;
+
+	if (en.ins & INS_UNSUPPORTED)
+		return -ENOSYS;
+
+	/* Writing chroma planes is not modelled */
+	if (regs->GROUP1.B2R2_TTY & B2R2_TTY_CHROMA_NOT_LUMA)
+		return -ENOSYS;
+
+	ret = surf_init(&en.t, regs->GROUP1.B2R2_TBA, regs->GROUP1.B2R2_TTY,
+			regs->GROUP1.B2R2_TXY, regs->GROUP1.B2R2_TSZ);
+	if (ret < 0)
+		return ret;
+
+	s1_mode = en.ins & B2R2_INS_SOURCE_1_MASK;
+	if (s1_mode != 0) {
+		/* Source 1 has no size register */
+		ret = surf_init(&en.s1, regs->GROUP3.B2R2_SBA,
+				regs->GROUP3.B2R2_STY, regs->GROUP3.B2R2_SXY,
+				0);
+		if (ret < 0 && s1_mode != B2R2_INS_SOURCE_1_DIRECT_FILL)
+			return ret;
+	}
+
+	if (en.ins & B2R2_INS_SOURCE_2_MASK) {
+		ret = surf_init(&en.s2, regs->GROUP4.B2R2_SBA,
+				regs->GROUP4.B2R2_STY, regs->GROUP4.B2R2_SXY,
+				regs->GROUP4.B2R2_SSZ);
+		if (ret < 0)
+			return ret;
+	}
+
+	en.rotate = (en.ins & B2R2_INS_ROTATION_ENABLED) != 0;
+
+	if (en.ins & B2R2_INS_RESCALE2D_ENABLED) {
+		u32 fctl = regs->GROUP8.B2R2_FCTL;
+
+		/* Raster sources are resized using the color channel */
+		en.rescale = true;
+		en.rsz.h_inc = 1 << 10;
+		en.rsz.v_inc = 1 << 10;
+
+		if (fctl & B2R2_FCTL_HF2D_MODE_ENABLE_RESIZER) {
+			en.rsz.h_inc = (regs->GROUP9.B2R2_RSF >>
+					B2R2_RSF_HSRC_INC_SHIFT) & 0xffff;
+			en.rsz.h_init = (regs->GROUP9.B2R2_RZI >>
+					B2R2_RZI_HSRC_INIT_SHIFT) & 0x3ff;
+		}
+		if (fctl & B2R2_FCTL_VF2D_MODE_ENABLE_RESIZER) {
+			en.rsz.v_inc = (regs->GROUP9.B2R2_RSF >>
+					B2R2_RSF_VSRC_INC_SHIFT) & 0xffff;
+			en.rsz.v_init = (regs->GROUP9.B2R2_RZI >>
+					B2R2_RZI_VSRC_INIT_SHIFT) & 0x3ff;
+		}
+		if (fctl & B2R2_FCTL_HF2D_MODE_ENABLE_COLOR_CHANNEL_FILTER) {
+			en.rsz.hf = (const s8 *)b2r2_filter_coeffs(
+					regs->GROUP9.B2R2_HFP, false);
+			if (en.rsz.hf == NULL)
+				return -EFAULT;
+			en.rsz.h_alpha = (fctl &
+				B2R2_FCTL_HF2D_MODE_ENABLE_ALPHA_CHANNEL_FILTER)
+				!= 0;
+		}
+		if (fctl & B2R2_FCTL_VF2D_MODE_ENABLE_COLOR_CHANNEL_FILTER) {
+			en.rsz.vf = (const s8 *)b2r2_filter_coeffs(
+					regs->GROUP9.B2R2_VFP, true);
+			if (en.rsz.vf == NULL)
+				return -EFAULT;
+			en.rsz.v_alpha = (fctl &
+				B2R2_FCTL_VF2D_MODE_ENABLE_ALPHA_CHANNEL_FILTER)
+				!= 0;
+		}
+
+		/* Combined rescale and rotation is done in separate nodes */
+		if (en.rotate)
+			return -ENOSYS;
+	}
+
+	if (en.ins & B2R2_INS_RECT_CLIP_ENABLED) {
+		en.clip = true;
+		en.clip_l = (regs->GROUP6.B2R2_CWO >> B2R2_CWO_X_SHIFT) &
+				0x7fff;
+		en.clip_t = (regs->GROUP6.B2R2_CWO >> B2R2_CWO_Y_SHIFT) &
+				0x7fff;
+		en.clip_r = (regs->GROUP6.B2R2_CWS >> B2R2_CWS_X_SHIFT) &
+				0x7fff;
+		en.clip_b = (regs->GROUP6.B2R2_CWS >> B2R2_CWS_Y_SHIFT) &
+				0x7fff;
+	}
+
+	if ((en.ack & B2R2_ACK_CKEY_SEL_MASK) ==
+			B2R2_ACK_CKEY_SEL_BLANKING_S2_ALPHA &&
+			(en.ins & B2R2_INS_CKEY_ENABLED))
+		return -ENOSYS;
+
+	for (j = 0; j < en.t.height; j++) {
+		for (i = 0; i < en.t.width; i++) {
+			s32 x = en.t.x + (en.t.rtl ? -i : i);
+			s32 y = en.t.y + (en.t.btt ? -j : j);
+			u8 *dst;
+
+			if (en.clip && (x < en.clip_l || x > en.clip_r ||
+					y < en.clip_t || y > en.clip_b))
+				continue;
+
+			dst = surf_pixel(ctx, &en.t, i, j);
+			if (dst == NULL)
+				return -EFAULT;
+
+			if (s1_mode == B2R2_INS_SOURCE_1_DIRECT_FILL) {
+				write_raw(dst, en.t.bpp, en.t.big_endian,
+					regs->GROUP2.B2R2_S1CF);
+			} else if (s1_mode == B2R2_INS_SOURCE_1_DIRECT_COPY) {
+				u8 *src = surf_pixel(ctx, &en.s1, i, j);
+
+				if (src == NULL || en.s1.bpp != en.t.bpp)
+					return -EFAULT;
+				memcpy(dst, src, en.t.bpp);
+			} else {
+				ret = exec_pixel(ctx, &en, i, j, dst);
+				if (ret < 0)
+					return ret;
+			}
+		}
+	}
+
+	return 0;
+}
+
+void b2r2_exec_init(struct b2r2_exec_ctx *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+}
+
+int b2r2_exec_add_mem(struct b2r2_exec_ctx *ctx, u32 paddr, u32 size,
+		void *vaddr)
+{
+	if (ctx->mem_count >= B2R2_EXEC_MAX_MEM)
+		return -ENOMEM;
+
+	if (vaddr == NULL || size == 0)
+		return -EINVAL;
+
+	ctx->mem[ctx->mem_count].paddr = paddr;
+	ctx->mem[ctx->mem_count].size = size;
+	ctx->mem[ctx->mem_count].vaddr = vaddr;
+	ctx->mem_count++;
+
+	return 0;
+}
+
+int b2r2_exec_run(struct b2r2_control *cont, struct b2r2_exec_ctx *ctx,
+		struct b2r2_node *first)
+{
+	struct b2r2_node *node;
+	int ret;
+
+	for (node = first; node != NULL; node = node->next) {
+		ret = exec_node(cont, ctx, node);
+		if (ret < 0) {
+			b2r2_log_info(cont->dev, "%s: node %p (INS=0x%08x, "
+				"ACK=0x%08x) not executed (%d)\n", __func__,
+				node, node->node.GROUP0.B2R2_INS,
+				node->node.GROUP0.B2R2_ACK, ret);
+			ctx->unsupported++;
+			return ret;
+		}
+		ctx->nodes_run++;
+	}
+
+	return 0;
+}
+
+int b2r2_exec_compare(const void *expected, const void *actual,
+		enum b2r2_blt_fmt fmt, u32 width, u32 height, u32 pitch,
+		u32 tolerance, struct b2r2_exec_diff *diff)
+{
+	u32 native = b2r2_to_native_fmt(fmt);
+	int bpp = native_bpp(native);
+	bool big_endian = fmt == B2R2_BLT_FMT_24_BIT_VUY888 ||
+			fmt == B2R2_BLT_FMT_32_BIT_VUYA8888;
+	bool alpha_255 = b2r2_get_alpha_range(fmt) == B2R2_TY_ALPHA_RANGE_255;
+	bool has_alpha = native_has_alpha(native);
+	u32 x;
+	u32 y;
+
+	memset(diff, 0, sizeof(*diff));
+	diff->first_x = -1;
+	diff->first_y = -1;
+
+	if (bpp == 0 || b2r2_get_fmt_type(fmt) != B2R2_FMT_TYPE_RASTER)
+		return -ENOSYS;
+
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			u32 offset = y * pitch + x * bpp;
+			struct exec_pixel e;
+			struct exec_pixel a;
+			u32 d = 0;
+			int i;
+
+			unpack(native, alpha_255, false,
+				read_raw(expected + offset, bpp, big_endian),
+				&e);
+			unpack(native, alpha_255, false,
+				read_raw(actual + offset, bpp, big_endian),
+				&a);
+
+			for (i = 0; i < 3; i++)
+				d = max_t(u32, d, abs(e.c[i] - a.c[i]));
+			if (has_alpha)
+				d = max_t(u32, d, abs(e.a - a.a));
+
+			diff->pixels++;
+			diff->max_diff = max(diff->max_diff, d);
+			if (d <= tolerance)
+				continue;
+
+			if (diff->mismatches == 0) {
+				diff->first_x = x;
+				diff->first_y = y;
+			}
+			diff->mismatches++;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * ST-Ericsson B2R2 node list CPU executor
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#ifndef _LINUX_DRIVERS_VIDEO_B2R2_EXEC_H_
+#define _LINUX_DRIVERS_VIDEO_B2R2_EXEC_H_
+
+#include <linux/types.h>
+
+#include "b2r2_internal.h"
+
+/* Max number of memory areas a node list may reference */
+#define B2R2_EXEC_MAX_MEM 16
+
+/**
+ * struct b2r2_exec_mem - A memory area accessible to the executor
+ *
+ * @paddr: Physical start address as seen by B2R2
+ * @size:  Size of the area in bytes
+ * @vaddr: Kernel virtual address corresponding to @paddr
+ */
+struct b2r2_exec_mem {
+	u32 paddr;
+	u32 size;
+	void *vaddr;
+};
+
+/**
+ * struct b2r2_exec_ctx - Context of a CPU execution of a node list
+ *
+ * @mem:           The memory areas the node list may access
+ * @mem_count:     Number of valid entries in @mem
+ * @last_mem:      Memory area of the last translated address
+ * @nodes_run:     Number of nodes executed
+ * @unsupported:   Number of nodes that could not be executed
+ */
+struct b2r2_exec_ctx {
+	struct b2r2_exec_mem mem[B2R2_EXEC_MAX_MEM];
+	int mem_count;
+	struct b2r2_exec_mem *last_mem;
+
+	u32 nodes_run;
+	u32 unsupported;
+};
+
+/**
+ * struct b2r2_exec_diff - Result of comparing two images
+ *
+ * @pixels:     Number of pixels compared
+ * @mismatches: Number of pixels with a component differing more than the
+ *              tolerance
+ * @max_diff:   Largest component difference found
+ * @first_x:    X coordinate of the first mismatching pixel
+ * @first_y:    Y coordinate of the first mismatching pixel
+ */
+struct b2r2_exec_diff {
+	u32 pixels;
+	u32 mismatches;
+	u32 max_diff;
+	s32 first_x;
+	s32 first_y;
+};
+
+/**
+ * b2r2_exec_init() - Initializes an executor context
+ *
+ * @ctx: The context to initialize
+ */
+void b2r2_exec_init(struct b2r2_exec_ctx *ctx);
+
+/**
+ * b2r2_exec_add_mem() - Makes a memory area accessible to the executor
+ *
+ * @ctx:   The executor context
+ * @paddr: Physical address of the area
+ * @size:  Size of the area
+ * @vaddr: Kernel virtual address of the area
+ *
+ * Returns 0 if OK else negative error code
+ */
+int b2r2_exec_add_mem(struct b2r2_exec_ctx *ctx, u32 paddr, u32 size,
+		void *vaddr);
+
+/**
+ * b2r2_exec_run() - Executes a node list on the CPU
+ *
+ * @cont:  The B2R2 control
+ * @ctx:   The executor context
+ * @first: The first node of the list
+ *
+ * Interprets the register values of each node the same way B2R2 does and
+ * writes the result to memory. Only a subset of the B2R2 features are
+ * modelled: raster formats, direct fill and copy, color fill, rotation,
+ * rescaling with the b2r2_filters coefficients, the iVMx and oVMx
+ * matrices, source color keying, rectangular clipping, alpha blending and
+ * raster operations.
+ *
+ * Returns 0 if all nodes were executed, -ENOSYS if a node uses a feature
+ * that is not modelled and -EFAULT if a node references memory outside of
+ * the areas added with b2r2_exec_add_mem(). Execution stops at the first
+ * failing node.
+ */
+int b2r2_exec_run(struct b2r2_control *cont, struct b2r2_exec_ctx *ctx,
+		struct b2r2_node *first);
+
+/**
+ * b2r2_exec_compare() - Compares two images component by component
+ *
+ * @expected:  The reference image
+ * @actual:    The image to check
+ * @fmt:       Format of the images
+ * @width:     Width in pixels
+ * @height:    Height in pixels
+ * @pitch:     Byte pitch of the images
+ * @tolerance: Max allowed difference of a color component
+ * @diff:      Comparison result
+ *
+ * Returns 0 if OK or -ENOSYS if the executor does not model the format, in
+ * which case the caller has to fall back to comparing bytes.
+ */
+int b2r2_exec_compare(const void *expected, const void *actual,
+		enum b2r2_blt_fmt fmt, u32 width, u32 height, u32 pitch,
+		u32 tolerance, struct b2r2_exec_diff *diff);
+
+#endif /* _LINUX_DRIVERS_VIDEO_B2R2_EXEC_H_ */
@@ -323,6 +323,40 @@ struct b2r2_filter_spec *b2r2_filter_blur()
 	return &blur_filter;
 }
 
+static const u8 *filter_coeffs_at(struct b2r2_filter_spec *filter,
+		u32 phys_addr, bool vertical)
+{
+	if (vertical)
+		return (filter->v_coeffs_dma_addr &&
+				filter->v_coeffs_phys_addr == phys_addr) ?
+			filter->v_coeffs : NULL;
+	else
+		return (filter->h_coeffs_dma_addr &&
+				filter->h_coeffs_phys_addr == phys_addr) ?
+			filter->h_coeffs : NULL;
+}
+
+const u8 *b2r2_filter_coeffs(u32 phys_addr, bool vertical)
+{
+	int i;
+	const u8 *coeffs;
+
+	for (i = 0; i < filters_size; i++) {
+		coeffs = filter_coeffs_at(&filters[i], phys_addr, vertical);
+		if (coeffs)
+			return coeffs;
+	}
+
+	coeffs = filter_coeffs_at(&bilinear_filter, phys_addr, vertical);
+	if (coeffs)
+		return coeffs;
+	coeffs = filter_coeffs_at(&default_downscale_filter, phys_addr,
+			vertical);
+	if (coeffs)
+		return coeffs;
+	return filter_coeffs_at(&blur_filter, phys_addr, vertical);
+}
+
 /* Private functions */
 static int alloc_filter_coeffs(struct device *dev,
 		struct b2r2_filter_spec *filter)
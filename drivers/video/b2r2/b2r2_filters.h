@@ -70,4 +70,15 @@ struct b2r2_filter_spec *b2r2_filter_find(u16 scale_factor);
  */
 struct b2r2_filter_spec *b2r2_filter_blur(void);
 
+/**
+ * b2r2_filter_coeffs() - Finds the filter coefficients at an address
+ *
+ *   @param phys_addr - Physical address of the coefficients, as used in a node
+ *   @param vertical - true for the vertical coefficients
+ *
+ * Returns the coefficient table or NULL if @phys_addr is not the address
+ * of any filter coefficients.
+ */
+const u8 *b2r2_filter_coeffs(u32 phys_addr, bool vertical);
+
 #endif /* _LINUX_VIDEO_B2R2_FILTERS_H */
@@ -338,11 +338,15 @@ static bool validate_img(struct device *dev,
 	 * To keep the entire image inside s32 range.
 	 */
 	if ((B2R2_BLT_PTR_HWMEM_BUF_NAME_OFFSET == img->buf.type ||
-				B2R2_BLT_PTR_FD_OFFSET == img->buf.type) &&
+				B2R2_BLT_PTR_FD_OFFSET == img->buf.type ||
+				B2R2_BLT_PTR_DMA_BUF_FD_OFFSET ==
+					img->buf.type) &&
 			img->buf.offset > (u32)b2r2_s32_max - (u32)img_size) {
 		b2r2_log_info(dev, "Validation Error: "
 				"(B2R2_BLT_PTR_HWMEM_BUF_NAME_OFFSET == "
 				"img->buf.type || B2R2_BLT_PTR_FD_OFFSET == "
+				"img->buf.type || "
+				"B2R2_BLT_PTR_DMA_BUF_FD_OFFSET == "
 				"img->buf.type) && img->buf.offset > "
 				"(u32)B2R2_MAX_S32 - (u32)img_size\n");
 		return false;
@@ -18,6 +18,7 @@
 #include <linux/ktime.h>
 #include <video/b2r2_blt.h>
 #include <linux/debugfs.h>
+#include <linux/dma-buf.h>
 
 #include "b2r2_global.h"
 #include "b2r2_hw.h"
@@ -197,6 +198,10 @@ struct b2r2_node {
  * @is_pmem: true if buffer is from pmem
  * @hwmem_session: Hwmem session
  * @hwmem_alloc: Hwmem alloc
+ * @dma_buf: Imported dma-buf
+ * @dma_buf_attach: Attachment of the B2R2 device to the dma-buf
+ * @dma_buf_sgt: The dma-buf mapped for B2R2
+ * @dma_buf_dir: Direction the dma-buf is mapped for
  * @filep: File pointer of mapped file (like pmem device, frame buffer device)
  * @file_physical_start: Physical address of file start
  * @file_virtual_start: Virtual address of file start
@@ -208,6 +213,10 @@ struct b2r2_resolved_buf {
 	void                 *virtual_address;
 	bool                  is_pmem;
 	struct hwmem_alloc   *hwmem_alloc;
+	struct dma_buf       *dma_buf;
+	struct dma_buf_attachment *dma_buf_attach;
+	struct sg_table      *dma_buf_sgt;
+	enum dma_data_direction dma_buf_dir;
 	/* Data for validation below */
 	struct file          *filep;
 	u32                   file_physical_start;
@@ -350,6 +359,10 @@ struct b2r2_node_split_job {
  *                      in by the client.
  * @last_node_address: Physical address of the last node. Filled
  *                     in by the client.
+ * @deadline: Monotonic time (ktime_get()) by which the job should be done,
+ *            e.g. the vsync the result is shown at. Zero if the job has no
+ *            deadline. Jobs with a deadline are scheduled earliest deadline
+ *            first, ahead of jobs without one. Filled in by the client.
  *
  * @callback: Function that will be called when the job is done.
  * @acquire_resources: Function that allocates the resources needed
@@ -387,6 +400,7 @@ struct b2r2_core_job {
 	int prio;
 	u32 first_node_address;
 	u32 last_node_address;
+	ktime_t deadline;
 	void (*callback)(struct b2r2_core_job *);
 	int (*acquire_resources)(struct b2r2_core_job *,
 		bool atomic);
@@ -422,6 +436,21 @@ struct b2r2_core_job {
 	u32 end_sentinel;
 };
 
+/**
+ * struct b2r2_blt_batch_done - Completion of a batch of blit requests
+ *
+ * @ref: Reference count, held by the batch job and the done file
+ * @waitq: Wait queue woken up when the batch is done
+ * @done: true when all requests of the batch are done
+ * @cancelled: true if the batch job was cancelled
+ */
+struct b2r2_blt_batch_done {
+	struct kref ref;
+	wait_queue_head_t waitq;
+	bool done;
+	bool cancelled;
+};
+
 /**
  * struct b2r2_blt_request - Represents one B2R2 blit request
  *
@@ -446,6 +475,11 @@ struct b2r2_core_job {
  *                      processing the job.
  * @total_time_nsec:    Total job execution time including context switches and
  *                      queue time.
+ * @batched:            True if the request is part of a batch, in which case
+ *                      the first request of the batch owns the job
+ * @batch:              List of the other requests of the batch when first in
+ *                      the batch, list item otherwise
+ * @batch_done:         Completion signalled when the batch job is done
  */
 struct b2r2_blt_request {
 	struct b2r2_control_instance   *instance;
@@ -463,6 +497,9 @@ struct b2r2_blt_request {
 	struct b2r2_resolved_buf bg_resolved;
 	struct b2r2_resolved_buf dst_resolved;
 
+	/* Destination contents before the job, used for verification */
+	void *verify_snapshot;
+
 	/* TBD: Info about SRAM usage & needs */
 	struct b2r2_work_buf *bufs;
 	u32 buf_count;
@@ -476,6 +513,11 @@ struct b2r2_blt_request {
 	struct timespec ts_start;
 	s64 nsec_active_in_cpu;
 	s64 total_time_nsec;
+
+	/* Batch of requests performed as one job */
+	bool batched;
+	struct list_head batch;
+	struct b2r2_blt_batch_done *batch_done;
 };
 
 /**
@@ -532,6 +574,66 @@ struct b2r2_mem_dump {
 	struct dentry                 *debugfs_dst_info;
 };
 
+/**
+ * struct b2r2_verify - Verification of jobs against the CPU executor
+ *
+ * @debugfs_root_dir: Debugfs verify root dir, e.g. /debugfs/b2r2/debug/verify
+ * @enabled: Verify each job after the hardware has executed it
+ * @tolerance: Max allowed difference of a color component
+ * @lock: Protects the verification and the statistics
+ * @n_jobs: Number of jobs verified
+ * @n_passed: Number of jobs where the results matched
+ * @n_failed: Number of jobs where the results differed
+ * @n_unsupported: Number of jobs using features the executor does not model
+ * @n_skipped: Number of jobs with buffers not accessible by the CPU
+ * @last_fail_id: Request id of the last failing job
+ * @last_fail_mismatches: Number of mismatching pixels in the last failure
+ * @last_fail_max_diff: Largest component difference in the last failure
+ * @last_fail_x: X coordinate of the first mismatch in the last failure
+ * @last_fail_y: Y coordinate of the first mismatch in the last failure
+ */
+struct b2r2_verify {
+	struct dentry                 *debugfs_root_dir;
+	u32                           enabled;
+	u32                           tolerance;
+	struct mutex                  lock;
+	unsigned long                 n_jobs;
+	unsigned long                 n_passed;
+	unsigned long                 n_failed;
+	unsigned long                 n_unsupported;
+	unsigned long                 n_skipped;
+	int                           last_fail_id;
+	u32                           last_fail_mismatches;
+	u32                           last_fail_max_diff;
+	s32                           last_fail_x;
+	s32                           last_fail_y;
+};
+
+/**
+ * struct b2r2_node_cache - Cache of node lists of previous requests
+ *
+ * @lock: Lock protecting the cache
+ * @entries: Cached node lists, most recently used first
+ * @entry_count: Number of entries in @entries
+ * @enabled: Indicates if node lists are looked up in and added to the cache
+ * @n_hits: Number of requests that reused a cached node list
+ * @n_misses: Number of cacheable requests not found in the cache
+ * @n_inserts: Number of node lists added to the cache
+ * @n_evictions: Number of node lists dropped to make room for new ones
+ * @n_uncacheable: Number of node lists that could not be cached
+ */
+struct b2r2_node_cache {
+	struct mutex                  lock;
+	struct list_head              entries;
+	u32                           entry_count;
+	u32                           enabled;
+	unsigned long                 n_hits;
+	unsigned long                 n_misses;
+	unsigned long                 n_inserts;
+	unsigned long                 n_evictions;
+	unsigned long                 n_uncacheable;
+};
+
 /**
  * struct b2r2_control - The b2r2 core control structure
  *
@@ -571,6 +673,9 @@ struct b2r2_mem_dump {
  * @last_job: The last running job on this b2r2 instance
  * @last_job_chars: Temporary buffer used in printing last_job
  * @prev_node_count: Node cound of last_job
+ * @dump: Buffer dump parameters
+ * @verify: Verification of jobs against the CPU executor
+ * @node_cache: Cache of generated node lists
  */
 struct b2r2_control {
 	struct device                   *dev;
@@ -608,6 +713,8 @@ struct b2r2_control {
 	char                            *last_job_chars;
 	int                             prev_node_count;
 	struct b2r2_mem_dump            dump;
+	struct b2r2_verify              verify;
+	struct b2r2_node_cache          node_cache;
 };
 
 /* FIXME: The functions below should be removed when we are
@@ -653,4 +760,18 @@ void b2r2_blt_add_control(struct b2r2_control *cont);
  */
 void b2r2_blt_remove_control(struct b2r2_control *cont);
 
+/**
+ * b2r2_blt_batch_done_signal() - Signal that a batch job is done
+ *
+ * @done: The batch completion
+ * @cancelled: true if the batch job was cancelled
+ */
+void b2r2_blt_batch_done_signal(struct b2r2_blt_batch_done *done,
+		bool cancelled);
+
+/**
+ * b2r2_blt_batch_done_put() - Release a reference to a batch completion
+ */
+void b2r2_blt_batch_done_put(struct b2r2_blt_batch_done *done);
+
 #endif
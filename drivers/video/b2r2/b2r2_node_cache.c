@@ -0,0 +1,602 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * ST-Ericsson B2R2 node list cache
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/kref.h>
+#include <linux/mutex.h>
+#include <linux/jhash.h>
+#include <linux/string.h>
+
+#include "b2r2_node_cache.h"
+#include "b2r2_internal.h"
+#include "b2r2_debug.h"
+#include "b2r2_utils.h"
+
+/*
+ * Flags that do not affect the generated node list. They are masked out of
+ * the cache key so that e.g. synchronous and asynchronous requests can share
+ * node lists.
+ */
+#define B2R2_NODE_CACHE_IGNORED_FLAGS (B2R2_BLT_FLAG_ASYNCH | \
+		B2R2_BLT_FLAG_DRY_RUN | \
+		B2R2_BLT_FLAG_INHERIT_PRIO | \
+		B2R2_BLT_FLAG_SRC_NO_CACHE_FLUSH | \
+		B2R2_BLT_FLAG_SRC_MASK_NO_CACHE_FLUSH | \
+		B2R2_BLT_FLAG_DST_NO_CACHE_FLUSH | \
+		B2R2_BLT_FLAG_BG_NO_CACHE_FLUSH | \
+		B2R2_BLT_FLAG_REPORT_WHEN_DONE | \
+		B2R2_BLT_FLAG_REPORT_PERFORMANCE)
+
+/* Buffers a node register address may be relative to */
+enum b2r2_node_cache_buf {
+	B2R2_NODE_CACHE_BUF_NONE = 0,
+	B2R2_NODE_CACHE_BUF_SRC,
+	B2R2_NODE_CACHE_BUF_BG,
+	B2R2_NODE_CACHE_BUF_DST,
+	B2R2_NODE_CACHE_BUF_COUNT,
+};
+
+/* Address registers of a node, in the order of b2r2_node_cache_node.reloc */
+enum b2r2_node_cache_reg {
+	B2R2_NODE_CACHE_REG_TBA = 0,
+	B2R2_NODE_CACHE_REG_S1_SBA,
+	B2R2_NODE_CACHE_REG_S2_SBA,
+	B2R2_NODE_CACHE_REG_S3_SBA,
+	B2R2_NODE_CACHE_REG_COUNT,
+};
+
+/* Buffer aliasing bits of the cache key */
+#define B2R2_NODE_CACHE_SRC_IS_BG  BIT(0)
+#define B2R2_NODE_CACHE_SRC_IS_DST BIT(1)
+#define B2R2_NODE_CACHE_BG_IS_DST  BIT(2)
+
+/**
+ * struct b2r2_node_cache_img - The parts of an image the node list depends on
+ */
+struct b2r2_node_cache_img {
+	u32 fmt;
+	u32 width;
+	u32 height;
+	u32 pitch;
+	u32 buf_type;
+};
+
+/**
+ * struct b2r2_node_cache_key - The parameters a node list is generated from
+ *
+ * Buffer addresses are not part of the key, they are patched into the nodes
+ * when a cached node list is reused. Only whether buffers are the same is,
+ * since that determines how addresses are relocated.
+ */
+struct b2r2_node_cache_key {
+	u32 flags;
+	u32 transform;
+	u32 global_alpha;
+	u32 src_color;
+	u32 dst_color;
+	u32 aliases;
+	struct b2r2_node_cache_img src_img;
+	struct b2r2_node_cache_img bg_img;
+	struct b2r2_node_cache_img dst_img;
+	struct b2r2_blt_rect src_rect;
+	struct b2r2_blt_rect bg_rect;
+	struct b2r2_blt_rect dst_rect;
+	struct b2r2_blt_rect dst_clip_rect;
+};
+
+/**
+ * struct b2r2_node_cache_node - Register template of one node
+ *
+ * @regs:          The register values, with buffer addresses as generated
+ *                 for the request the node list was cached from
+ * @src_tmp_index: Intermediate buffer used as source, offset by one
+ * @dst_tmp_index: Intermediate buffer used as target, offset by one
+ * @src_index:     Source the intermediate buffer is fetched through
+ * @reloc:         Buffer each address register is relative to, indexed by
+ *                 enum b2r2_node_cache_reg
+ */
+struct b2r2_node_cache_node {
+	struct b2r2_link_list regs;
+	int src_tmp_index;
+	int dst_tmp_index;
+	int src_index;
+	u8 reloc[B2R2_NODE_CACHE_REG_COUNT];
+};
+
+/**
+ * struct b2r2_node_cache_entry - A cached node list
+ *
+ * @list:       Position in the LRU list of the cache
+ * @ref:        Reference count, the cache holds one reference
+ * @hash:       Hash of @key
+ * @key:        The request parameters the node list was generated from
+ * @base:       Physical addresses of the buffers the node list was
+ *              generated for, indexed by enum b2r2_node_cache_buf
+ * @job:        The node split job after b2r2_node_split_configure()
+ * @buf_count:  Number of intermediate buffers needed
+ * @node_count: Number of nodes in @nodes
+ * @nodes:      The register templates
+ */
+struct b2r2_node_cache_entry {
+	struct list_head list;
+	struct kref ref;
+	u32 hash;
+	struct b2r2_node_cache_key key;
+	u32 base[B2R2_NODE_CACHE_BUF_COUNT];
+	struct b2r2_node_split_job job;
+	u32 buf_count;
+	u32 node_count;
+	struct b2r2_node_cache_node nodes[0];
+};
+
+/**
+ * struct b2r2_node_cache_range - Memory occupied by one of the request images
+ */
+struct b2r2_node_cache_range {
+	u32 start;
+	u32 end;
+};
+
+static void set_key_img(struct b2r2_node_cache_img *key_img,
+		const struct b2r2_blt_img *img)
+{
+	key_img->fmt = img->fmt;
+	key_img->width = img->width;
+	key_img->height = img->height;
+	key_img->pitch = img->pitch;
+	key_img->buf_type = img->buf.type;
+}
+
+static bool src_is_used(const struct b2r2_blt_req *req)
+{
+	return !(req->flags & (B2R2_BLT_FLAG_SOURCE_FILL |
+			B2R2_BLT_FLAG_SOURCE_FILL_RAW)) &&
+		req->src_img.buf.type != B2R2_BLT_PTR_NONE;
+}
+
+static bool bg_is_used(const struct b2r2_blt_req *req)
+{
+	return (req->flags & B2R2_BLT_FLAG_BG_BLEND) != 0;
+}
+
+/**
+ * get_key() - Builds the cache key of a request
+ *
+ * Returns false if the node list of the request can not be cached.
+ */
+static bool get_key(const struct b2r2_blt_request *request,
+		struct b2r2_node_cache_key *key, u32 *hash)
+{
+	const struct b2r2_blt_req *req = &request->user_req;
+	u32 src = request->src_resolved.physical_address;
+	u32 bg = request->bg_resolved.physical_address;
+	u32 dst = request->dst_resolved.physical_address;
+
+	/* The CLUT is allocated per request and referenced by the nodes */
+	if (req->flags & B2R2_BLT_FLAG_CLUT_COLOR_CORRECTION)
+		return false;
+
+	/* Zero everything, including padding, since the key is hashed */
+	memset(key, 0, sizeof(*key));
+
+	key->flags = req->flags & ~B2R2_NODE_CACHE_IGNORED_FLAGS;
+	key->transform = req->transform;
+	key->global_alpha = req->global_alpha;
+	key->src_color = req->src_color;
+	key->dst_color = req->dst_color;
+
+	if (src_is_used(req)) {
+		set_key_img(&key->src_img, &req->src_img);
+		key->src_rect = req->src_rect;
+	}
+	if (bg_is_used(req)) {
+		set_key_img(&key->bg_img, &req->bg_img);
+		key->bg_rect = req->bg_rect;
+	}
+	set_key_img(&key->dst_img, &req->dst_img);
+	key->dst_rect = req->dst_rect;
+	if (req->flags & B2R2_BLT_FLAG_DESTINATION_CLIP)
+		key->dst_clip_rect = req->dst_clip_rect;
+
+	if (src_is_used(req) && bg_is_used(req) && src == bg)
+		key->aliases |= B2R2_NODE_CACHE_SRC_IS_BG;
+	if (src_is_used(req) && src == dst)
+		key->aliases |= B2R2_NODE_CACHE_SRC_IS_DST;
+	if (bg_is_used(req) && bg == dst)
+		key->aliases |= B2R2_NODE_CACHE_BG_IS_DST;
+
+	*hash = jhash2((u32 *)key, sizeof(*key) / sizeof(u32), 0);
+
+	return true;
+}
+
+static void free_entry(struct kref *ref)
+{
+	struct b2r2_node_cache_entry *entry =
+		container_of(ref, struct b2r2_node_cache_entry, ref);
+
+	kfree(entry);
+}
+
+/**
+ * remove_entry() - Removes an entry from the cache
+ *
+ * The cache lock must be held.
+ */
+static void remove_entry(struct b2r2_node_cache *cache,
+		struct b2r2_node_cache_entry *entry)
+{
+	list_del(&entry->list);
+	cache->entry_count--;
+	kref_put(&entry->ref, free_entry);
+}
+
+static u32 *reg_addr(struct b2r2_link_list *regs, enum b2r2_node_cache_reg reg)
+{
+	switch (reg) {
+	case B2R2_NODE_CACHE_REG_TBA:
+		return &regs->GROUP1.B2R2_TBA;
+	case B2R2_NODE_CACHE_REG_S1_SBA:
+		return &regs->GROUP3.B2R2_SBA;
+	case B2R2_NODE_CACHE_REG_S2_SBA:
+		return &regs->GROUP4.B2R2_SBA;
+	case B2R2_NODE_CACHE_REG_S3_SBA:
+		return &regs->GROUP5.B2R2_SBA;
+	default:
+		BUG();
+		return NULL;
+	}
+}
+
+/**
+ * reg_is_fetched() - Checks if B2R2 accesses the memory an address register
+ *                    points to
+ */
+static bool reg_is_fetched(const struct b2r2_node *node,
+		enum b2r2_node_cache_reg reg)
+{
+	u32 ins = node->node.GROUP0.B2R2_INS;
+
+	switch (reg) {
+	case B2R2_NODE_CACHE_REG_TBA:
+		return true;
+	case B2R2_NODE_CACHE_REG_S1_SBA:
+		return (ins & 0x7) == B2R2_INS_SOURCE_1_FETCH_FROM_MEM ||
+			(ins & 0x7) == B2R2_INS_SOURCE_1_DIRECT_COPY;
+	case B2R2_NODE_CACHE_REG_S2_SBA:
+		return (ins & (0x3 << B2R2_INS_SOURCE_2_SHIFT)) ==
+			B2R2_INS_SOURCE_2_FETCH_FROM_MEM;
+	case B2R2_NODE_CACHE_REG_S3_SBA:
+		return (ins & B2R2_INS_SOURCE_3_FETCH_FROM_MEM) != 0;
+	default:
+		return false;
+	}
+}
+
+/**
+ * reg_is_tmp() - Checks if an address register will be set to an
+ *                intermediate buffer by b2r2_node_split_assign_buffers()
+ */
+static bool reg_is_tmp(const struct b2r2_node *node,
+		enum b2r2_node_cache_reg reg)
+{
+	if (reg == B2R2_NODE_CACHE_REG_TBA)
+		return node->dst_tmp_index != 0;
+
+	return node->src_tmp_index != 0 &&
+		node->src_index == reg - B2R2_NODE_CACHE_REG_S1_SBA + 1;
+}
+
+/**
+ * classify() - Finds the buffer an address belongs to
+ *
+ * Returns the buffer, B2R2_NODE_CACHE_BUF_NONE if the address is outside
+ * all buffers, or a negative value if it is inside several different
+ * buffers.
+ */
+static int classify(const struct b2r2_node_cache_range *ranges, u32 addr)
+{
+	int found = B2R2_NODE_CACHE_BUF_NONE;
+	int i;
+
+	for (i = B2R2_NODE_CACHE_BUF_SRC; i < B2R2_NODE_CACHE_BUF_COUNT; i++) {
+		if (ranges[i].start == ranges[i].end ||
+				addr < ranges[i].start ||
+				addr >= ranges[i].end)
+			continue;
+
+		/*
+		 * Buffers starting at the same address are aliases, which is
+		 * recorded in the key, so either one may be used.
+		 */
+		if (found != B2R2_NODE_CACHE_BUF_NONE &&
+				ranges[found].start != ranges[i].start)
+			return -EINVAL;
+
+		if (found == B2R2_NODE_CACHE_BUF_NONE)
+			found = i;
+	}
+
+	return found;
+}
+
+static void set_range(struct b2r2_control *cont,
+		struct b2r2_node_cache_range *range, u32 addr,
+		struct b2r2_blt_img *img)
+{
+	s32 size = b2r2_get_img_size(cont->dev, img);
+
+	range->start = addr;
+	range->end = size > 0 ? addr + size : addr;
+}
+
+static u32 relocate(u32 addr, u32 old_base, u32 new_base)
+{
+	if (addr == 0)
+		return 0;
+
+	return addr - old_base + new_base;
+}
+
+static void relocate_job_buf(struct b2r2_node_split_buf *buf,
+		u32 old_base, u32 new_base)
+{
+	buf->addr = relocate(buf->addr, old_base, new_base);
+	buf->chroma_addr = relocate(buf->chroma_addr, old_base, new_base);
+	buf->chroma_cr_addr = relocate(buf->chroma_cr_addr, old_base,
+			new_base);
+}
+
+static void get_bases(const struct b2r2_blt_request *request, u32 *base)
+{
+	base[B2R2_NODE_CACHE_BUF_NONE] = 0;
+	base[B2R2_NODE_CACHE_BUF_SRC] = request->src_resolved.physical_address;
+	base[B2R2_NODE_CACHE_BUF_BG] = request->bg_resolved.physical_address;
+	base[B2R2_NODE_CACHE_BUF_DST] = request->dst_resolved.physical_address;
+}
+
+void b2r2_node_cache_init(struct b2r2_control *cont)
+{
+	struct b2r2_node_cache *cache = &cont->node_cache;
+
+	mutex_init(&cache->lock);
+	INIT_LIST_HEAD(&cache->entries);
+	cache->entry_count = 0;
+	cache->enabled = 1;
+}
+
+void b2r2_node_cache_flush(struct b2r2_control *cont)
+{
+	struct b2r2_node_cache *cache = &cont->node_cache;
+	struct b2r2_node_cache_entry *entry;
+	struct b2r2_node_cache_entry *tmp;
+
+	mutex_lock(&cache->lock);
+	list_for_each_entry_safe(entry, tmp, &cache->entries, list)
+		remove_entry(cache, entry);
+	mutex_unlock(&cache->lock);
+}
+
+void b2r2_node_cache_exit(struct b2r2_control *cont)
+{
+	b2r2_node_cache_flush(cont);
+}
+
+struct b2r2_node_cache_entry *b2r2_node_cache_lookup(
+		struct b2r2_control *cont, struct b2r2_blt_request *request,
+		u32 *node_count)
+{
+	struct b2r2_node_cache *cache = &cont->node_cache;
+	struct b2r2_node_cache_entry *entry;
+	struct b2r2_node_cache_key key;
+	u32 base[B2R2_NODE_CACHE_BUF_COUNT];
+	u32 hash;
+	int i;
+
+	if (!cache->enabled || !get_key(request, &key, &hash))
+		return NULL;
+
+	mutex_lock(&cache->lock);
+	list_for_each_entry(entry, &cache->entries, list) {
+		if (entry->hash == hash &&
+				memcmp(&entry->key, &key, sizeof(key)) == 0)
+			goto found;
+	}
+	cache->n_misses++;
+	mutex_unlock(&cache->lock);
+
+	return NULL;
+
+found:
+	/* Move to the front of the LRU list */
+	list_move(&entry->list, &cache->entries);
+	kref_get(&entry->ref);
+	cache->n_hits++;
+	mutex_unlock(&cache->lock);
+
+	/* Set up the request as b2r2_node_split_analyze would have */
+	request->node_split_job = entry->job;
+	get_bases(request, base);
+	relocate_job_buf(&request->node_split_job.src,
+			entry->base[B2R2_NODE_CACHE_BUF_SRC],
+			base[B2R2_NODE_CACHE_BUF_SRC]);
+	relocate_job_buf(&request->node_split_job.bg,
+			entry->base[B2R2_NODE_CACHE_BUF_BG],
+			base[B2R2_NODE_CACHE_BUF_BG]);
+	relocate_job_buf(&request->node_split_job.dst,
+			entry->base[B2R2_NODE_CACHE_BUF_DST],
+			base[B2R2_NODE_CACHE_BUF_DST]);
+
+	for (i = 0; i < entry->buf_count; i++) {
+		request->node_split_job.work_bufs[i].phys_addr = 0;
+		request->node_split_job.work_bufs[i].virt_addr = NULL;
+	}
+	request->buf_count = entry->buf_count;
+	if (entry->buf_count > 0)
+		request->bufs = &request->node_split_job.work_bufs[0];
+
+	*node_count = entry->node_count;
+
+	return entry;
+}
+
+void b2r2_node_cache_apply(struct b2r2_control *cont,
+		struct b2r2_node_cache_entry *entry,
+		struct b2r2_blt_request *request, struct b2r2_node *first)
+{
+	struct b2r2_node *node = first;
+	u32 base[B2R2_NODE_CACHE_BUF_COUNT];
+	u32 i;
+
+	get_bases(request, base);
+
+	for (i = 0; i < entry->node_count && node != NULL; i++) {
+		const struct b2r2_node_cache_node *tmpl = &entry->nodes[i];
+		int reg;
+
+		node->node = tmpl->regs;
+		node->src_tmp_index = tmpl->src_tmp_index;
+		node->dst_tmp_index = tmpl->dst_tmp_index;
+		node->src_index = tmpl->src_index;
+
+		for (reg = 0; reg < B2R2_NODE_CACHE_REG_COUNT; reg++) {
+			int buf = tmpl->reloc[reg];
+			u32 *addr;
+
+			if (buf == B2R2_NODE_CACHE_BUF_NONE)
+				continue;
+
+			addr = reg_addr(&node->node, reg);
+			*addr = *addr - entry->base[buf] + base[buf];
+		}
+
+		node->node.GROUP0.B2R2_NIP = node->next != NULL ?
+			node->next->physical_address : 0;
+
+		node = node->next;
+	}
+
+	BUG_ON(i != entry->node_count || node != NULL);
+}
+
+void b2r2_node_cache_put(struct b2r2_node_cache_entry *entry)
+{
+	kref_put(&entry->ref, free_entry);
+}
+
+void b2r2_node_cache_insert(struct b2r2_control *cont,
+		struct b2r2_blt_request *request, u32 node_count)
+{
+	struct b2r2_node_cache *cache = &cont->node_cache;
+	struct b2r2_node_cache_entry *entry;
+	struct b2r2_node_cache_entry *old;
+	struct b2r2_node_cache_range ranges[B2R2_NODE_CACHE_BUF_COUNT];
+	const struct b2r2_blt_req *req = &request->user_req;
+	struct b2r2_node *node;
+	u32 i;
+
+	if (!cache->enabled)
+		return;
+
+	if (node_count > B2R2_NODE_CACHE_MAX_NODES)
+		goto uncacheable;
+
+	entry = kzalloc(sizeof(*entry) +
+			node_count * sizeof(struct b2r2_node_cache_node),
+			GFP_KERNEL);
+	if (entry == NULL)
+		return;
+
+	if (!get_key(request, &entry->key, &entry->hash))
+		goto uncacheable_free;
+
+	memset(ranges, 0, sizeof(ranges));
+	if (src_is_used(req))
+		set_range(cont, &ranges[B2R2_NODE_CACHE_BUF_SRC],
+			request->src_resolved.physical_address,
+			&request->user_req.src_img);
+	if (bg_is_used(req))
+		set_range(cont, &ranges[B2R2_NODE_CACHE_BUF_BG],
+			request->bg_resolved.physical_address,
+			&request->user_req.bg_img);
+	set_range(cont, &ranges[B2R2_NODE_CACHE_BUF_DST],
+		request->dst_resolved.physical_address,
+		&request->user_req.dst_img);
+
+	/* Find the buffer each address register is relative to */
+	for (i = 0, node = request->first_node; i < node_count;
+			i++, node = node->next) {
+		struct b2r2_node_cache_node *tmpl = &entry->nodes[i];
+		int reg;
+
+		BUG_ON(node == NULL);
+
+		tmpl->regs = node->node;
+		tmpl->src_tmp_index = node->src_tmp_index;
+		tmpl->dst_tmp_index = node->dst_tmp_index;
+		tmpl->src_index = node->src_index;
+
+		for (reg = 0; reg < B2R2_NODE_CACHE_REG_COUNT; reg++) {
+			int buf;
+
+			if (reg_is_tmp(node, reg) || !reg_is_fetched(node, reg))
+				continue;
+
+			buf = classify(ranges, *reg_addr(&node->node, reg));
+			if (buf <= B2R2_NODE_CACHE_BUF_NONE)
+				goto uncacheable_free;
+
+			tmpl->reloc[reg] = buf;
+		}
+	}
+
+	get_bases(request, entry->base);
+	entry->job = request->node_split_job;
+	entry->buf_count = request->buf_count;
+	entry->node_count = node_count;
+	kref_init(&entry->ref);
+
+	mutex_lock(&cache->lock);
+
+	/* Another thread may have inserted the same node list meanwhile */
+	list_for_each_entry(old, &cache->entries, list) {
+		if (old->hash == entry->hash &&
+				memcmp(&old->key, &entry->key,
+					sizeof(entry->key)) == 0) {
+			mutex_unlock(&cache->lock);
+			kfree(entry);
+			return;
+		}
+	}
+
+	if (cache->entry_count >= B2R2_NODE_CACHE_MAX_ENTRIES) {
+		old = list_entry(cache->entries.prev,
+				struct b2r2_node_cache_entry, list);
+		remove_entry(cache, old);
+		cache->n_evictions++;
+	}
+
+	list_add(&entry->list, &cache->entries);
+	cache->entry_count++;
+	cache->n_inserts++;
+
+	mutex_unlock(&cache->lock);
+
+	b2r2_log_info(cont->dev, "%s: cached %d nodes\n", __func__,
+		node_count);
+	return;
+
+uncacheable_free:
+	kfree(entry);
+uncacheable:
+	mutex_lock(&cache->lock);
+	cache->n_uncacheable++;
+	mutex_unlock(&cache->lock);
+}
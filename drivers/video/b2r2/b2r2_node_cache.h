@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * ST-Ericsson B2R2 node list cache
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#ifndef _LINUX_DRIVERS_VIDEO_B2R2_NODE_CACHE_H_
+#define _LINUX_DRIVERS_VIDEO_B2R2_NODE_CACHE_H_
+
+#include "b2r2_internal.h"
+
+/* Max number of node lists kept in the cache */
+#define B2R2_NODE_CACHE_MAX_ENTRIES 16
+
+/* Node lists longer than this are not cached */
+#define B2R2_NODE_CACHE_MAX_NODES 64
+
+struct b2r2_node_cache_entry;
+
+/**
+ * b2r2_node_cache_init() - Initializes the node list cache
+ *
+ * @cont: The B2R2 control
+ */
+void b2r2_node_cache_init(struct b2r2_control *cont);
+
+/**
+ * b2r2_node_cache_exit() - Frees all cached node lists
+ *
+ * @cont: The B2R2 control
+ */
+void b2r2_node_cache_exit(struct b2r2_control *cont);
+
+/**
+ * b2r2_node_cache_lookup() - Looks up the node list of a request
+ *
+ * @cont:       The B2R2 control
+ * @request:    The request, with all buffers resolved
+ * @node_count: Number of nodes required for the job, set on a hit
+ *
+ * On a hit the node split job and the intermediate buffer needs of the
+ * cached node list are copied to the request, in the same way as
+ * b2r2_node_split_analyze() would have set them up. The caller then
+ * allocates @node_count nodes and calls b2r2_node_cache_apply() instead of
+ * b2r2_node_split_configure().
+ *
+ * Returns the cache entry, which must be released with
+ * b2r2_node_cache_put(), or NULL on a miss.
+ */
+struct b2r2_node_cache_entry *b2r2_node_cache_lookup(
+		struct b2r2_control *cont, struct b2r2_blt_request *request,
+		u32 *node_count);
+
+/**
+ * b2r2_node_cache_apply() - Fills a node list from a cache entry
+ *
+ * @cont:    The B2R2 control
+ * @entry:   The cache entry returned by b2r2_node_cache_lookup()
+ * @request: The request
+ * @first:   The first node of the allocated node list
+ *
+ * Copies the cached register values to the nodes and relocates the buffer
+ * addresses to the buffers of @request.
+ */
+void b2r2_node_cache_apply(struct b2r2_control *cont,
+		struct b2r2_node_cache_entry *entry,
+		struct b2r2_blt_request *request, struct b2r2_node *first);
+
+/**
+ * b2r2_node_cache_put() - Releases a cache entry
+ *
+ * @entry: The cache entry returned by b2r2_node_cache_lookup()
+ */
+void b2r2_node_cache_put(struct b2r2_node_cache_entry *entry);
+
+/**
+ * b2r2_node_cache_insert() - Stores the node list of a request
+ *
+ * @cont:       The B2R2 control
+ * @request:    The request, after b2r2_node_split_configure()
+ * @node_count: Number of nodes in the node list of the request
+ *
+ * Node lists that can not be relocated to other buffers, e.g. because they
+ * reference a color look-up table, are not stored.
+ */
+void b2r2_node_cache_insert(struct b2r2_control *cont,
+		struct b2r2_blt_request *request, u32 node_count);
+
+/**
+ * b2r2_node_cache_flush() - Drops all cached node lists
+ *
+ * @cont: The B2R2 control
+ */
+void b2r2_node_cache_flush(struct b2r2_control *cont);
+
+#endif /* _LINUX_DRIVERS_VIDEO_B2R2_NODE_CACHE_H_ */
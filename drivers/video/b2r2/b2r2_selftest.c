@@ -0,0 +1,862 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * ST-Ericsson B2R2 node generation selftest
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/string.h>
+#include <linux/platform_device.h>
+#include <linux/dma-mapping.h>
+
+#include <video/b2r2_blt.h>
+
+#include "b2r2_internal.h"
+#include "b2r2_node_split.h"
+#include "b2r2_generic.h"
+#include "b2r2_filters.h"
+#include "b2r2_exec.h"
+#include "b2r2_utils.h"
+
+/* Same work buffer limit as the blt path uses for the node split */
+#define SELFTEST_TMP_BUF_SIZE (128 * PAGE_SIZE)
+#define SELFTEST_MAX_TMP_BUFS 4
+
+/*
+ * Physical addresses given to the test buffers. They are only ever
+ * translated by the CPU executor, the hardware is never involved.
+ */
+#define SELFTEST_SRC_PADDR 0x40000000
+#define SELFTEST_DST_PADDR 0x48000000
+#define SELFTEST_TMP_PADDR 0x50000000
+#define SELFTEST_TMP_STRIDE 0x01000000
+
+enum selftest_path {
+	SELFTEST_NODE_SPLIT,
+	SELFTEST_GENERIC,
+};
+
+static const char * const selftest_path_names[] = {
+	[SELFTEST_NODE_SPLIT] = "node_split",
+	[SELFTEST_GENERIC] = "generic",
+};
+
+/**
+ * struct selftest_case - A blit to run and check against the CPU reference
+ *
+ * @name:         Name printed in the report
+ * @flags:        Request flags
+ * @transform:    Request transform
+ * @src_fmt:      Source format
+ * @src_w:        Source width, the whole source is blitted
+ * @src_h:        Source height
+ * @dst_fmt:      Destination format
+ * @dst_w:        Destination width
+ * @dst_h:        Destination height
+ * @dst_rect:     Destination rectangle
+ * @src_color:    Fill color, ARGB8888
+ * @global_alpha: Global alpha
+ * @flat:         Source is a single color, used for the scaling cases
+ *                where the reference does not model the filters
+ * @src_alpha:    Source has an alpha gradient
+ * @tolerance:    Max allowed difference of a color component
+ */
+struct selftest_case {
+	const char *name;
+	u32 flags;
+	enum b2r2_blt_transform transform;
+	enum b2r2_blt_fmt src_fmt;
+	s32 src_w;
+	s32 src_h;
+	enum b2r2_blt_fmt dst_fmt;
+	s32 dst_w;
+	s32 dst_h;
+	struct b2r2_blt_rect dst_rect;
+	u32 src_color;
+	u8 global_alpha;
+	bool flat;
+	bool src_alpha;
+	u32 tolerance;
+};
+
+static const struct selftest_case selftest_cases[] = {
+	{
+		.name = "fill argb8888",
+		.flags = B2R2_BLT_FLAG_SOURCE_FILL,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 16, .src_h = 16,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 8, 4, 40, 30 },
+		.src_color = 0xff3080c0,
+	},
+	{
+		.name = "fill rgb565",
+		.flags = B2R2_BLT_FLAG_SOURCE_FILL,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 16, .src_h = 16,
+		.dst_fmt = B2R2_BLT_FMT_16_BIT_RGB565,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 3, 5, 50, 21 },
+		.src_color = 0xfff8a010,
+		.tolerance = 7,
+	},
+	{
+		.name = "copy argb8888",
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 200, .src_h = 40,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 208, .dst_h = 48,
+		.dst_rect = { 4, 4, 200, 40 },
+		.src_alpha = true,
+	},
+	{
+		.name = "argb8888 to rgb565",
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_16_BIT_RGB565,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+		.tolerance = 7,
+	},
+	{
+		.name = "rgb565 to argb8888",
+		.src_fmt = B2R2_BLT_FMT_16_BIT_RGB565,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+		.tolerance = 7,
+	},
+	{
+		.name = "argb8888 to rgb888",
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_24_BIT_RGB888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+	},
+	{
+		.name = "argb8888 to abgr8888",
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ABGR8888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+		.src_alpha = true,
+		.tolerance = 1,
+	},
+	{
+		.name = "flip h",
+		.transform = B2R2_BLT_TRANSFORM_FLIP_H,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+	},
+	{
+		.name = "rotate 180",
+		.transform = B2R2_BLT_TRANSFORM_CCW_ROT_180,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+	},
+	{
+		.name = "rotate 90",
+		.transform = B2R2_BLT_TRANSFORM_CCW_ROT_90,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 48, .dst_h = 64,
+		.dst_rect = { 0, 0, 48, 64 },
+	},
+	{
+		.name = "rotate 270 to rgb565",
+		.transform = B2R2_BLT_TRANSFORM_CCW_ROT_270,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 40, .src_h = 24,
+		.dst_fmt = B2R2_BLT_FMT_16_BIT_RGB565,
+		.dst_w = 32, .dst_h = 48,
+		.dst_rect = { 4, 4, 24, 40 },
+		.tolerance = 7,
+	},
+	{
+		.name = "upscale",
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 32, .src_h = 24,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+		.flat = true,
+		.tolerance = 2,
+	},
+	{
+		.name = "downscale to rgb888",
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 96, .src_h = 64,
+		.dst_fmt = B2R2_BLT_FMT_24_BIT_RGB888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 10, 6, 40, 30 },
+		.flat = true,
+		.tolerance = 2,
+	},
+	{
+		.name = "upscale and rotate 90",
+		.transform = B2R2_BLT_TRANSFORM_CCW_ROT_90,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 32, .src_h = 24,
+		.dst_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.dst_w = 48, .dst_h = 64,
+		.dst_rect = { 0, 0, 48, 64 },
+		.flat = true,
+		.tolerance = 2,
+	},
+	{
+		.name = "per pixel alpha blend",
+		.flags = B2R2_BLT_FLAG_PER_PIXEL_ALPHA_BLEND |
+				B2R2_BLT_FLAG_SRC_IS_NOT_PREMULT,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 64, .src_h = 48,
+		.dst_fmt = B2R2_BLT_FMT_24_BIT_RGB888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 0, 0, 64, 48 },
+		.global_alpha = 255,
+		.src_alpha = true,
+		.tolerance = 3,
+	},
+	{
+		.name = "global alpha blend",
+		.flags = B2R2_BLT_FLAG_GLOBAL_ALPHA_BLEND,
+		.src_fmt = B2R2_BLT_FMT_32_BIT_ARGB8888,
+		.src_w = 48, .src_h = 32,
+		.dst_fmt = B2R2_BLT_FMT_24_BIT_RGB888,
+		.dst_w = 64, .dst_h = 48,
+		.dst_rect = { 8, 8, 48, 32 },
+		.global_alpha = 128,
+		.tolerance = 3,
+	},
+};
+
+/* A pixel with 8 bit components */
+struct selftest_px {
+	u8 a;
+	u8 r;
+	u8 g;
+	u8 b;
+};
+
+/**
+ * struct b2r2_selftest - State of a selftest run
+ *
+ * @pdev:     Device used for logging and the filter coefficients
+ * @cont:     B2R2 control that is never connected to any hardware
+ * @instance: Instance the requests are made through
+ * @req:      The request of the current case
+ * @ctx:      CPU executor context
+ * @src:      Source buffer
+ * @dst:      Destination buffer
+ * @ref:      Reference image of the destination
+ * @tmp:      Work buffers of the current node list
+ * @passed:   Number of passed case runs
+ * @failed:   Number of failed case runs
+ * @skipped:  Number of case runs a path or the executor does not support
+ */
+struct b2r2_selftest {
+	struct platform_device *pdev;
+	struct b2r2_control *cont;
+	struct b2r2_control_instance instance;
+	struct b2r2_blt_request req;
+	struct b2r2_exec_ctx ctx;
+
+	void *src;
+	void *dst;
+	void *ref;
+	void *tmp[SELFTEST_MAX_TMP_BUFS];
+
+	u32 passed;
+	u32 failed;
+	u32 skipped;
+};
+
+static void px_read(enum b2r2_blt_fmt fmt, const u8 *p, struct selftest_px *px)
+{
+	u32 v;
+
+	switch (fmt) {
+	case B2R2_BLT_FMT_16_BIT_RGB565:
+		v = p[0] | (p[1] << 8);
+		px->a = 0xff;
+		px->r = ((v >> 8) & 0xf8) | (v >> 13);
+		px->g = ((v >> 3) & 0xfc) | ((v >> 9) & 0x3);
+		px->b = ((v << 3) & 0xf8) | ((v >> 2) & 0x7);
+		break;
+	case B2R2_BLT_FMT_24_BIT_RGB888:
+		px->a = 0xff;
+		px->b = p[0];
+		px->g = p[1];
+		px->r = p[2];
+		break;
+	case B2R2_BLT_FMT_32_BIT_ABGR8888:
+		px->r = p[0];
+		px->g = p[1];
+		px->b = p[2];
+		px->a = p[3];
+		break;
+	default:
+		px->b = p[0];
+		px->g = p[1];
+		px->r = p[2];
+		px->a = p[3];
+		break;
+	}
+}
+
+static void px_write(enum b2r2_blt_fmt fmt, u8 *p,
+		const struct selftest_px *px)
+{
+	u32 v;
+
+	switch (fmt) {
+	case B2R2_BLT_FMT_16_BIT_RGB565:
+		v = ((px->r >> 3) << 11) | ((px->g >> 2) << 5) | (px->b >> 3);
+		p[0] = v & 0xff;
+		p[1] = v >> 8;
+		break;
+	case B2R2_BLT_FMT_24_BIT_RGB888:
+		p[0] = px->b;
+		p[1] = px->g;
+		p[2] = px->r;
+		break;
+	case B2R2_BLT_FMT_32_BIT_ABGR8888:
+		p[0] = px->r;
+		p[1] = px->g;
+		p[2] = px->b;
+		p[3] = px->a;
+		break;
+	default:
+		p[0] = px->b;
+		p[1] = px->g;
+		p[2] = px->r;
+		p[3] = px->a;
+		break;
+	}
+}
+
+/*
+ * The patterns only use component values that survive RGB565 so that the
+ * format conversions can be checked exactly.
+ */
+static void src_pattern(const struct selftest_case *tc, s32 x, s32 y,
+		struct selftest_px *px)
+{
+	if (tc->flat) {
+		px->a = 0xff;
+		px->r = 0x40;
+		px->g = 0x80;
+		px->b = 0xc0;
+		return;
+	}
+
+	px->a = tc->src_alpha ? (x * 8 + y * 4) & 0xff : 0xff;
+	px->r = (x * 8) & 0xf8;
+	px->g = (y * 4) & 0xfc;
+	px->b = ((x + y) * 8) & 0xf8;
+}
+
+static void dst_pattern(s32 x, s32 y, struct selftest_px *px)
+{
+	px->a = 0xff;
+	px->r = (y * 8) & 0xf8;
+	px->g = 0x60;
+	px->b = (0xff - x * 8) & 0xf8;
+}
+
+/* Returns the source pixel that ends up at (u, v) in the dst rectangle */
+static void src_coord(const struct selftest_case *tc, s32 u, s32 v,
+		s32 *x, s32 *y)
+{
+	s32 dw = tc->dst_rect.width;
+	s32 dh = tc->dst_rect.height;
+
+	switch (tc->transform) {
+	case B2R2_BLT_TRANSFORM_CCW_ROT_90:
+		*x = tc->src_w - 1 - v * tc->src_w / dh;
+		*y = u * tc->src_h / dw;
+		break;
+	case B2R2_BLT_TRANSFORM_CCW_ROT_270:
+		*x = v * tc->src_w / dh;
+		*y = tc->src_h - 1 - u * tc->src_h / dw;
+		break;
+	default:
+		*x = u * tc->src_w / dw;
+		*y = v * tc->src_h / dh;
+		if (tc->transform & B2R2_BLT_TRANSFORM_FLIP_H)
+			*x = tc->src_w - 1 - *x;
+		if (tc->transform & B2R2_BLT_TRANSFORM_FLIP_V)
+			*y = tc->src_h - 1 - *y;
+		break;
+	}
+}
+
+static void blend(const struct selftest_case *tc, const struct selftest_px *s,
+		const struct selftest_px *d, struct selftest_px *out)
+{
+	u32 a = 255;
+
+	if (tc->flags & B2R2_BLT_FLAG_PER_PIXEL_ALPHA_BLEND)
+		a = s->a;
+	if (tc->flags & B2R2_BLT_FLAG_GLOBAL_ALPHA_BLEND)
+		a = a * tc->global_alpha / 255;
+
+	out->r = (s->r * a + d->r * (255 - a) + 127) / 255;
+	out->g = (s->g * a + d->g * (255 - a) + 127) / 255;
+	out->b = (s->b * a + d->b * (255 - a) + 127) / 255;
+	out->a = a + d->a * (255 - a) / 255;
+}
+
+static void make_images(struct b2r2_selftest *st,
+		const struct selftest_case *tc)
+{
+	struct device *dev = &st->pdev->dev;
+	u32 src_pitch = b2r2_get_img_pitch(dev, &st->req.user_req.src_img);
+	u32 dst_pitch = b2r2_get_img_pitch(dev, &st->req.user_req.dst_img);
+	u32 src_bpp = b2r2_get_fmt_bpp(dev, tc->src_fmt) / 8;
+	u32 dst_bpp = b2r2_get_fmt_bpp(dev, tc->dst_fmt) / 8;
+	struct selftest_px px;
+	s32 x;
+	s32 y;
+
+	for (y = 0; y < tc->src_h; y++) {
+		for (x = 0; x < tc->src_w; x++) {
+			src_pattern(tc, x, y, &px);
+			px_write(tc->src_fmt, st->src + y * src_pitch +
+					x * src_bpp, &px);
+		}
+	}
+
+	for (y = 0; y < tc->dst_h; y++) {
+		for (x = 0; x < tc->dst_w; x++) {
+			dst_pattern(x, y, &px);
+			px_write(tc->dst_fmt, st->dst + y * dst_pitch +
+					x * dst_bpp, &px);
+		}
+	}
+}
+
+/* Computes what the destination should look like after the blit */
+static void make_reference(struct b2r2_selftest *st,
+		const struct selftest_case *tc)
+{
+	struct device *dev = &st->pdev->dev;
+	u32 src_pitch = b2r2_get_img_pitch(dev, &st->req.user_req.src_img);
+	u32 dst_pitch = b2r2_get_img_pitch(dev, &st->req.user_req.dst_img);
+	u32 src_bpp = b2r2_get_fmt_bpp(dev, tc->src_fmt) / 8;
+	u32 dst_bpp = b2r2_get_fmt_bpp(dev, tc->dst_fmt) / 8;
+	u32 size = dst_pitch * tc->dst_h;
+	struct selftest_px s;
+	struct selftest_px d;
+	struct selftest_px out;
+	s32 u;
+	s32 v;
+
+	memcpy(st->ref, st->dst, size);
+
+	for (v = 0; v < tc->dst_rect.height; v++) {
+		for (u = 0; u < tc->dst_rect.width; u++) {
+			u8 *p = st->ref + (tc->dst_rect.y + v) * dst_pitch +
+				(tc->dst_rect.x + u) * dst_bpp;
+
+			if (tc->flags & B2R2_BLT_FLAG_SOURCE_FILL) {
+				s.a = tc->src_color >> 24;
+				s.r = tc->src_color >> 16;
+				s.g = tc->src_color >> 8;
+				s.b = tc->src_color;
+			} else {
+				s32 x;
+				s32 y;
+
+				src_coord(tc, u, v, &x, &y);
+				px_read(tc->src_fmt, st->src + y * src_pitch +
+						x * src_bpp, &s);
+			}
+
+			px_read(tc->dst_fmt, p, &d);
+			if (tc->flags & (B2R2_BLT_FLAG_PER_PIXEL_ALPHA_BLEND |
+					B2R2_BLT_FLAG_GLOBAL_ALPHA_BLEND))
+				blend(tc, &s, &d, &out);
+			else
+				out = s;
+			px_write(tc->dst_fmt, p, &out);
+		}
+	}
+}
+
+static void setup_img(struct b2r2_blt_img *img, enum b2r2_blt_fmt fmt,
+		s32 width, s32 height, u32 paddr)
+{
+	memset(img, 0, sizeof(*img));
+	img->fmt = fmt;
+	img->width = width;
+	img->height = height;
+	img->buf.type = B2R2_BLT_PTR_PHYSICAL;
+	img->buf.offset = paddr;
+}
+
+static void setup_request(struct b2r2_selftest *st,
+		const struct selftest_case *tc)
+{
+	struct b2r2_blt_request *req = &st->req;
+	struct device *dev = &st->pdev->dev;
+
+	memset(req, 0, sizeof(*req));
+	req->instance = &st->instance;
+
+	req->user_req.size = sizeof(req->user_req);
+	req->user_req.flags = tc->flags;
+	req->user_req.transform = tc->transform;
+	req->user_req.src_color = tc->src_color;
+	req->user_req.global_alpha = tc->global_alpha;
+
+	setup_img(&req->user_req.src_img, tc->src_fmt, tc->src_w, tc->src_h,
+			SELFTEST_SRC_PADDR);
+	req->user_req.src_img.pitch = b2r2_get_img_pitch(dev,
+			&req->user_req.src_img);
+	req->user_req.src_rect.width = tc->src_w;
+	req->user_req.src_rect.height = tc->src_h;
+
+	setup_img(&req->user_req.dst_img, tc->dst_fmt, tc->dst_w, tc->dst_h,
+			SELFTEST_DST_PADDR);
+	req->user_req.dst_img.pitch = b2r2_get_img_pitch(dev,
+			&req->user_req.dst_img);
+	req->user_req.dst_rect = tc->dst_rect;
+
+	req->src_resolved.physical_address = SELFTEST_SRC_PADDR;
+	req->dst_resolved.physical_address = SELFTEST_DST_PADDR;
+}
+
+static void free_nodes(struct b2r2_node *first)
+{
+	while (first != NULL) {
+		struct b2r2_node *next = first->next;
+
+		kfree(first);
+		first = next;
+	}
+}
+
+/*
+ * The executor follows the next pointers, so the nodes do not have to be
+ * allocated from the DMA pool of a real B2R2.
+ */
+static int alloc_nodes(u32 count, struct b2r2_node **first)
+{
+	struct b2r2_node **next = first;
+
+	*first = NULL;
+	while (count--) {
+		*next = kzalloc(sizeof(**next), GFP_KERNEL);
+		if (*next == NULL) {
+			free_nodes(*first);
+			*first = NULL;
+			return -ENOMEM;
+		}
+		next = &(*next)->next;
+	}
+
+	return 0;
+}
+
+static void free_tmp_bufs(struct b2r2_selftest *st)
+{
+	int i;
+
+	for (i = 0; i < SELFTEST_MAX_TMP_BUFS; i++) {
+		vfree(st->tmp[i]);
+		st->tmp[i] = NULL;
+	}
+}
+
+static int alloc_tmp_bufs(struct b2r2_selftest *st,
+		struct b2r2_work_buf *bufs, u32 count)
+{
+	int ret;
+	u32 i;
+
+	if (count > SELFTEST_MAX_TMP_BUFS)
+		return -ENOSYS;
+
+	for (i = 0; i < count; i++) {
+		st->tmp[i] = vmalloc(bufs[i].size);
+		if (st->tmp[i] == NULL)
+			return -ENOMEM;
+
+		bufs[i].phys_addr = SELFTEST_TMP_PADDR +
+				i * SELFTEST_TMP_STRIDE;
+		bufs[i].virt_addr = st->tmp[i];
+
+		ret = b2r2_exec_add_mem(&st->ctx, bufs[i].phys_addr,
+				bufs[i].size, bufs[i].virt_addr);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int run_node_split(struct b2r2_selftest *st)
+{
+	struct b2r2_blt_request *req = &st->req;
+	struct b2r2_node *first = NULL;
+	struct b2r2_work_buf *bufs;
+	u32 buf_count;
+	u32 node_count;
+	int ret;
+
+	ret = b2r2_node_split_analyze(req, SELFTEST_TMP_BUF_SIZE, &node_count,
+			&bufs, &buf_count, &req->node_split_job);
+	if (ret < 0)
+		goto out;
+
+	ret = alloc_nodes(node_count, &first);
+	if (ret < 0)
+		goto out;
+
+	ret = b2r2_node_split_configure(st->cont, &req->node_split_job,
+			first);
+	if (ret < 0)
+		goto out;
+
+	ret = alloc_tmp_bufs(st, bufs, buf_count);
+	if (ret < 0)
+		goto out;
+
+	ret = b2r2_node_split_assign_buffers(st->cont, &req->node_split_job,
+			first, bufs, buf_count);
+	if (ret < 0)
+		goto out;
+
+	ret = b2r2_exec_run(st->cont, &st->ctx, first);
+
+out:
+	b2r2_node_split_cancel(st->cont, &req->node_split_job);
+	free_nodes(first);
+	return ret;
+}
+
+/* Runs the node list once per tile, the way b2r2_generic_blt does */
+static int run_generic(struct b2r2_selftest *st)
+{
+	struct b2r2_blt_request *req = &st->req;
+	struct b2r2_blt_rect *dst_rect = &req->user_req.dst_rect;
+	struct b2r2_work_buf bufs[SELFTEST_MAX_TMP_BUFS];
+	struct b2r2_node *first = NULL;
+	struct b2r2_blt_rect tile;
+	s32 tmp_w;
+	s32 tmp_h;
+	u32 buf_count;
+	u32 node_count;
+	u32 i;
+	int ret;
+
+	ret = b2r2_generic_analyze(req, &tmp_w, &tmp_h, &buf_count,
+			&node_count);
+	if (ret < 0)
+		return ret;
+
+	if (buf_count > SELFTEST_MAX_TMP_BUFS)
+		return -ENOSYS;
+
+	ret = alloc_nodes(node_count, &first);
+	if (ret < 0)
+		return ret;
+
+	memset(bufs, 0, sizeof(bufs));
+	for (i = 0; i < buf_count; i++)
+		bufs[i].size = tmp_w * tmp_h * 4;
+
+	ret = alloc_tmp_bufs(st, bufs, buf_count);
+	if (ret < 0)
+		goto out;
+
+	ret = b2r2_generic_configure(req, first, bufs, buf_count);
+	if (ret < 0)
+		goto out;
+
+	for (tile.y = 0; tile.y < dst_rect->height; tile.y += tmp_h) {
+		tile.height = min(tmp_h, dst_rect->height - tile.y);
+
+		for (tile.x = 0; tile.x < dst_rect->width; tile.x += tmp_w) {
+			tile.width = min(tmp_w, dst_rect->width - tile.x);
+
+			b2r2_generic_set_areas(req, first, &tile);
+			ret = b2r2_exec_run(st->cont, &st->ctx, first);
+			if (ret < 0)
+				goto out;
+		}
+	}
+
+out:
+	free_nodes(first);
+	return ret;
+}
+
+static void run_case(struct b2r2_selftest *st, const struct selftest_case *tc,
+		enum selftest_path path)
+{
+	struct device *dev = &st->pdev->dev;
+	struct b2r2_exec_diff diff;
+	u32 src_size;
+	u32 dst_size;
+	int ret;
+
+	setup_request(st, tc);
+	src_size = b2r2_get_img_size(dev, &st->req.user_req.src_img);
+	dst_size = b2r2_get_img_size(dev, &st->req.user_req.dst_img);
+
+	st->src = vzalloc(src_size);
+	st->dst = vzalloc(dst_size);
+	st->ref = vzalloc(dst_size);
+	if (st->src == NULL || st->dst == NULL || st->ref == NULL) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	make_images(st, tc);
+	make_reference(st, tc);
+
+	b2r2_exec_init(&st->ctx);
+	(void)b2r2_exec_add_mem(&st->ctx, SELFTEST_SRC_PADDR, src_size,
+			st->src);
+	(void)b2r2_exec_add_mem(&st->ctx, SELFTEST_DST_PADDR, dst_size,
+			st->dst);
+
+	if (path == SELFTEST_NODE_SPLIT)
+		ret = run_node_split(st);
+	else
+		ret = run_generic(st);
+
+	if (ret == -ENOSYS) {
+		dev_info(dev, "%s (%s): not supported\n", tc->name,
+				selftest_path_names[path]);
+		st->skipped++;
+		goto out;
+	} else if (ret < 0) {
+		goto fail;
+	}
+
+	ret = b2r2_exec_compare(st->ref, st->dst, tc->dst_fmt, tc->dst_w,
+			tc->dst_h, st->req.user_req.dst_img.pitch,
+			tc->tolerance, &diff);
+	if (ret < 0)
+		goto fail;
+
+	if (diff.mismatches) {
+		dev_err(dev, "%s (%s): FAIL, %u of %u pixels differ, first at "
+				"(%d, %d), max diff %u\n", tc->name,
+				selftest_path_names[path], diff.mismatches,
+				diff.pixels, diff.first_x, diff.first_y,
+				diff.max_diff);
+		st->failed++;
+		goto out;
+	}
+
+	dev_info(dev, "%s (%s): pass, max diff %u\n", tc->name,
+			selftest_path_names[path], diff.max_diff);
+	st->passed++;
+	goto out;
+
+fail:
+	dev_err(dev, "%s (%s): FAIL, error %d\n", tc->name,
+			selftest_path_names[path], ret);
+	st->failed++;
+out:
+	free_tmp_bufs(st);
+	vfree(st->ref);
+	vfree(st->dst);
+	vfree(st->src);
+	st->ref = NULL;
+	st->dst = NULL;
+	st->src = NULL;
+}
+
+static int __init b2r2_selftest_init(void)
+{
+	struct b2r2_selftest *st;
+	int ret;
+	int i;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (st == NULL)
+		return -ENOMEM;
+
+	st->cont = kzalloc(sizeof(*st->cont), GFP_KERNEL);
+	if (st->cont == NULL) {
+		ret = -ENOMEM;
+		goto cont_alloc_failed;
+	}
+
+	st->pdev = platform_device_alloc("b2r2_selftest", -1);
+	if (st->pdev == NULL) {
+		ret = -ENOMEM;
+		goto pdev_alloc_failed;
+	}
+	st->pdev->dev.coherent_dma_mask = DMA_BIT_MASK(32);
+
+	ret = platform_device_add(st->pdev);
+	if (ret < 0)
+		goto pdev_add_failed;
+
+	st->cont->dev = &st->pdev->dev;
+	st->instance.control = st->cont;
+
+	/*
+	 * The filter coefficients are shared by all B2R2 controls. Only
+	 * allocate them if no B2R2 has been probed, the executor finds them
+	 * by address either way.
+	 */
+	if (b2r2_filter_find(1 << 10) == NULL)
+		b2r2_filters_init(st->cont);
+
+	for (i = 0; i < ARRAY_SIZE(selftest_cases); i++) {
+		run_case(st, &selftest_cases[i], SELFTEST_NODE_SPLIT);
+		run_case(st, &selftest_cases[i], SELFTEST_GENERIC);
+	}
+
+	if (st->failed)
+		dev_err(st->cont->dev, "FAIL: %u passed, %u failed, "
+				"%u not supported\n", st->passed, st->failed,
+				st->skipped);
+	else
+		dev_info(st->cont->dev, "pass: %u passed, %u not supported\n",
+				st->passed, st->skipped);
+
+	b2r2_filters_exit(st->cont);
+	platform_device_unregister(st->pdev);
+	kfree(st->cont);
+	kfree(st);
+
+	return 0;
+
+pdev_add_failed:
+	platform_device_put(st->pdev);
+pdev_alloc_failed:
+	kfree(st->cont);
+cont_alloc_failed:
+	kfree(st);
+
+	return ret;
+}
+module_init(b2r2_selftest_init);
+
+MODULE_AUTHOR("ST-Ericsson SA");
+MODULE_DESCRIPTION("B2R2 node generation selftest");
+MODULE_LICENSE("GPL");
@@ -175,11 +175,21 @@ struct overlay_info {
 	 */
 };
 
+struct transfer_info {
+	u32 frames;
+	u32 partial_frames;
+	u32 bytes_last_frame;
+	u64 bytes_total;
+	u64 bytes_saved;
+};
+
 struct channel_info {
 	u8 id;
 	struct dentry *dentry;
 	struct mcde_chnl_state *chnl;
 	struct fps_info fps;
+	struct transfer_info transfer;
+	u32 partial_update;
 	struct overlay_info overlays[MAX_NUM_OVERLAYS];
 	struct mcde_chnl_state channel_snapshot;
 	u8 dump_flags;
@@ -1746,6 +1756,24 @@ static void create_fps_files(struct dentry *dentry, struct fps_info *fps)
 							&fps->enable_dmesg);
 }
 
+static void create_transfer_files(struct dentry *dentry,
+						struct transfer_info *transfer)
+{
+	dentry = debugfs_create_dir("transfer", dentry);
+	if (!dentry)
+		return;
+
+	debugfs_create_u32("frames", S_IRUGO, dentry, &transfer->frames);
+	debugfs_create_u32("partial_frames", S_IRUGO, dentry,
+						&transfer->partial_frames);
+	debugfs_create_u32("bytes_last_frame", S_IRUGO, dentry,
+						&transfer->bytes_last_frame);
+	debugfs_create_u64("bytes_total", S_IRUGO, dentry,
+						&transfer->bytes_total);
+	debugfs_create_u64("bytes_saved", S_IRUGO, dentry,
+						&transfer->bytes_saved);
+}
+
 static void create_channel_files(
 	struct dentry *dentry,
 	struct channel_info *ci)
@@ -1759,6 +1787,9 @@ static void create_channel_files(
 							&ci->sync_mode);
 	debugfs_create_u32("trig_mode", S_IRUGO|S_IWUSR|S_IWGRP, dentry,
 							&ci->trig_mode);
+	debugfs_create_u32("partial_update", S_IRUGO|S_IWUSR|S_IWGRP, dentry,
+							&ci->partial_update);
+	create_transfer_files(dentry, &ci->transfer);
 }
 
 static int create_overlay_files(
@@ -1883,6 +1914,7 @@ int mcde_debugfs_channel_create(u8 chnl_id, struct mcde_chnl_state *chnl)
 	 */
 	ci->sync_mode = 0;
 	ci->trig_mode = 0;
+	ci->partial_update = 1;
 
 	return 0;
 }
@@ -1943,6 +1975,23 @@ void mcde_debugfs_channel_update(u8 chnl_id)
 		ci->chnl->port.sync_src = ci->sync_mode;
 	if (ci->chnl->port.frame_trig != ci->trig_mode)
 		ci->chnl->port.frame_trig = ci->trig_mode;
+	ci->chnl->no_partial_update = !ci->partial_update;
+}
+
+void mcde_debugfs_channel_transfer(u8 chnl_id, bool partial, u32 bytes,
+								u32 full_bytes)
+{
+	struct channel_info *ci = find_chnl(chnl_id);
+
+	if (!ci || !ci->chnl)
+		return;
+
+	ci->transfer.frames++;
+	if (partial)
+		ci->transfer.partial_frames++;
+	ci->transfer.bytes_last_frame = bytes;
+	ci->transfer.bytes_total += bytes;
+	ci->transfer.bytes_saved += full_bytes - bytes;
 }
 
 void mcde_debugfs_overlay_update(u8 chnl_id, u8 ovly_id)
@@ -21,6 +21,8 @@ int mcde_debugfs_overlay_create(u8 chnl_id,
 	struct mcde_ovly_state *ovly);
 
 void mcde_debugfs_channel_update(u8 chnl_id);
+void mcde_debugfs_channel_transfer(u8 chnl_id, bool partial, u32 bytes,
+							u32 full_bytes);
 void mcde_debugfs_overlay_update(u8 chnl_id, u8 ovly_id);
 void mcde_debugfs_hw_enabled(void);
 void mcde_debugfs_hw_disabled(void);
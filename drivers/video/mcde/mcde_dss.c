@@ -77,6 +77,8 @@ int mcde_dss_open_channel(struct mcde_display_device *ddev)
 		goto chnl_get_failed;
 	}
 	ddev->chnl_state = chnl;
+	if (mcde_dss_flip_queue_create(ddev))
+		dev_warn(&ddev->dev, "Failed to create flip queue\n");
 chnl_get_failed:
 	mutex_unlock(&ddev->display_lock);
 	return ret;
@@ -85,6 +87,9 @@ EXPORT_SYMBOL(mcde_dss_open_channel);
 
 void mcde_dss_close_channel(struct mcde_display_device *ddev)
 {
+	/* Queued flips update the display, so not under the display lock */
+	mcde_dss_flip_queue_destroy(ddev);
+
 	mutex_lock(&ddev->display_lock);
 	mcde_chnl_put(ddev->chnl_state);
 	ddev->chnl_state = NULL;
@@ -282,7 +287,8 @@ update_failed:
 	return ret;
 }
 
-int mcde_dss_update_overlay(struct mcde_overlay *ovly, bool tripple_buffer)
+int mcde_dss_update_overlay_area(struct mcde_overlay *ovly,
+			bool tripple_buffer, struct mcde_rectangle *area)
 {
 	int ret;
 	dev_vdbg(&ovly->ddev->dev, "Overlay update, chnl=%d\n",
@@ -292,10 +298,18 @@ int mcde_dss_update_overlay(struct mcde_overlay *ovly, bool tripple_buffer)
 		return -EINVAL;
 
 	mutex_lock(&ovly->ddev->display_lock);
+	if (ovly->ddev->chnl_state)
+		mcde_chnl_set_update_area(ovly->ddev->chnl_state, area);
 	ret = dss_update_channel_locked(ovly->ddev, tripple_buffer);
 	mutex_unlock(&ovly->ddev->display_lock);
 	return ret;
 }
+EXPORT_SYMBOL(mcde_dss_update_overlay_area);
+
+int mcde_dss_update_overlay(struct mcde_overlay *ovly, bool tripple_buffer)
+{
+	return mcde_dss_update_overlay_area(ovly, tripple_buffer, NULL);
+}
 EXPORT_SYMBOL(mcde_dss_update_overlay);
 
 void mcde_dss_get_overlay_info(struct mcde_overlay *ovly,
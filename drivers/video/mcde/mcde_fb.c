@@ -707,6 +707,37 @@ static int mcde_fb_ioctl(struct fb_info *fbi, unsigned int cmd,
 		fbi->var = var;
 		return 0;
 	}
+
+	if (cmd == MCDE_UPDATE_AREA_IOC) {
+		struct mcde_fb_update_area req;
+		struct mcde_rectangle area;
+		int i;
+		int ret = 0;
+
+		if (copy_from_user(&req, (void *)arg, sizeof(req))) {
+			dev_warn(fbi->dev,
+				"%s: copy_from_user failed\n",
+				__func__);
+			return -EFAULT;
+		}
+		if (req.x >= fbi->var.xres || req.y >= fbi->var.yres ||
+							!req.w || !req.h)
+			return -EINVAL;
+
+		area.x = req.x;
+		area.y = req.y;
+		area.w = min(req.w, fbi->var.xres - req.x);
+		area.h = min(req.h, fbi->var.yres - req.y);
+
+		for (i = 0; i < mfb->num_ovlys; i++) {
+			int num_buffers = fbi->var.yres_virtual / fbi->var.yres;
+
+			if (mcde_dss_update_overlay_area(mfb->ovlys[i],
+						num_buffers == 3, &area))
+				ret = -EIO;
+		}
+		return ret;
+	}
 	return -EINVAL;
 }
 
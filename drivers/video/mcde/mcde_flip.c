@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * ST-Ericsson MCDE display sub system asynchronous page flips
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#include <linux/kernel.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/timer.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+
+#include <video/mcde_dss.h>
+
+/* Max number of flips waiting to be posted */
+#define FLIP_QUEUE_DEPTH 3
+/* Number of present events kept until they are read */
+#define FLIP_NUM_EVENTS 16
+/* A posted flip not out on the display within this time is dropped */
+#define FLIP_TIMEOUT_MS 100
+
+struct mcde_flip_queue {
+	struct mcde_display_device *ddev;
+	spinlock_t lock;
+
+	u32 seq;
+	struct list_head queued;
+	int n_queued;
+	struct list_head done;
+	struct mcde_dss_flip *inflight;
+	bool inflight_posted;
+
+	int last_vcmp;
+	ktime_t last_vcmp_time;
+
+	struct mcde_dss_present_event events[FLIP_NUM_EVENTS];
+	unsigned int event_first;
+	unsigned int n_events;
+	u32 n_events_lost;
+	wait_queue_head_t event_waitq;
+	wait_queue_head_t idle_waitq;
+
+	struct workqueue_struct *wq;
+	struct work_struct work;
+	struct timer_list timer;
+};
+
+/* LOCKING: q->lock */
+static void flip_done_locked(struct mcde_flip_queue *q,
+				struct mcde_dss_flip *flip, s64 timestamp)
+{
+	struct mcde_dss_present_event *ev;
+
+	if (q->n_events == FLIP_NUM_EVENTS) {
+		/* Nobody reads the events, drop the oldest */
+		q->event_first = (q->event_first + 1) % FLIP_NUM_EVENTS;
+		q->n_events--;
+		q->n_events_lost++;
+	}
+	ev = &q->events[(q->event_first + q->n_events) % FLIP_NUM_EVENTS];
+	ev->seq = flip->seq;
+	ev->timestamp = timestamp;
+	q->n_events++;
+
+	flip->timestamp = timestamp;
+	if (q->inflight == flip) {
+		q->inflight = NULL;
+		del_timer(&q->timer);
+	}
+	list_add_tail(&flip->list, &q->done);
+
+	wake_up_interruptible(&q->event_waitq);
+	/* Release the flip and post the next one */
+	queue_work(q->wq, &q->work);
+}
+
+/* Called from the MCDE interrupt handler when a frame is out */
+static void flip_vcmp(void *data, int vcmp_cnt, ktime_t time)
+{
+	struct mcde_flip_queue *q = data;
+
+	spin_lock(&q->lock);
+	q->last_vcmp = vcmp_cnt;
+	q->last_vcmp_time = time;
+	if (q->inflight && q->inflight_posted &&
+			vcmp_cnt - q->inflight->present_vcmp >= 0)
+		flip_done_locked(q, q->inflight, ktime_to_ns(time));
+	spin_unlock(&q->lock);
+}
+
+static void flip_timeout(unsigned long data)
+{
+	struct mcde_flip_queue *q = (struct mcde_flip_queue *)data;
+
+	queue_work(q->wq, &q->work);
+}
+
+static bool flip_queue_idle(struct mcde_flip_queue *q)
+{
+	unsigned long flags;
+	bool idle;
+
+	spin_lock_irqsave(&q->lock, flags);
+	idle = !q->inflight && list_empty(&q->queued) && list_empty(&q->done);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return idle;
+}
+
+static void release_flips(struct mcde_flip_queue *q)
+{
+	struct mcde_dss_flip *flip;
+	struct mcde_dss_flip *tmp;
+	unsigned long flags;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&q->lock, flags);
+	list_splice_init(&q->done, &done);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	list_for_each_entry_safe(flip, tmp, &done, list) {
+		list_del(&flip->list);
+		if (flip->release)
+			flip->release(flip);
+	}
+}
+
+static void flip_work(struct work_struct *work)
+{
+	struct mcde_flip_queue *q =
+			container_of(work, struct mcde_flip_queue, work);
+	struct mcde_dss_flip *flip;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (q->inflight && q->inflight_posted &&
+				!timer_pending(&q->timer)) {
+		dev_warn(&q->ddev->dev, "Flip %u not presented, dropped\n",
+							q->inflight->seq);
+		flip_done_locked(q, q->inflight, 0);
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	release_flips(q);
+
+	/* Post one flip at a time, the next one when this one is out */
+	spin_lock_irqsave(&q->lock, flags);
+	if (q->inflight || list_empty(&q->queued)) {
+		spin_unlock_irqrestore(&q->lock, flags);
+		if (flip_queue_idle(q))
+			wake_up_all(&q->idle_waitq);
+		return;
+	}
+	flip = list_first_entry(&q->queued, struct mcde_dss_flip, list);
+	list_del(&flip->list);
+	q->n_queued--;
+	q->inflight = flip;
+	q->inflight_posted = false;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	ret = flip->post(flip);
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (q->inflight != flip) {
+		/* Dropped while posted, the flip queue is going away */
+	} else if (ret || q->ddev->power_mode == MCDE_DISPLAY_PM_OFF) {
+		/* Nothing was sent to the display */
+		flip_done_locked(q, flip, 0);
+	} else {
+		flip->present_vcmp =
+			mcde_chnl_get_present_vcmp(q->ddev->chnl_state);
+		q->inflight_posted = true;
+		if (q->last_vcmp - flip->present_vcmp >= 0)
+			flip_done_locked(q, flip,
+					ktime_to_ns(q->last_vcmp_time));
+		else
+			mod_timer(&q->timer, jiffies +
+					msecs_to_jiffies(FLIP_TIMEOUT_MS));
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+int mcde_dss_queue_flip(struct mcde_display_device *ddev,
+				struct mcde_dss_flip *flip, u32 *seq)
+{
+	struct mcde_flip_queue *q = ddev->flip_queue;
+	unsigned long flags;
+
+	if (!q)
+		return -ENODEV;
+	if (!flip->post)
+		return -EINVAL;
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (q->n_queued >= FLIP_QUEUE_DEPTH) {
+		spin_unlock_irqrestore(&q->lock, flags);
+		return -EBUSY;
+	}
+	/* Sequence number 0 is never used */
+	if (++q->seq == 0)
+		q->seq++;
+	flip->seq = q->seq;
+	flip->present_vcmp = 0;
+	flip->timestamp = 0;
+	list_add_tail(&flip->list, &q->queued);
+	q->n_queued++;
+	if (seq)
+		*seq = flip->seq;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	queue_work(q->wq, &q->work);
+
+	return 0;
+}
+EXPORT_SYMBOL(mcde_dss_queue_flip);
+
+void mcde_dss_flush_flips(struct mcde_display_device *ddev)
+{
+	struct mcde_flip_queue *q = ddev->flip_queue;
+
+	if (!q)
+		return;
+
+	wait_event(q->idle_waitq, flip_queue_idle(q));
+}
+EXPORT_SYMBOL(mcde_dss_flush_flips);
+
+int mcde_dss_get_present_event(struct mcde_display_device *ddev,
+				struct mcde_dss_present_event *event)
+{
+	struct mcde_flip_queue *q = ddev->flip_queue;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!q)
+		return -ENODEV;
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (q->n_events) {
+		*event = q->events[q->event_first];
+		q->event_first = (q->event_first + 1) % FLIP_NUM_EVENTS;
+		q->n_events--;
+	} else {
+		ret = -EAGAIN;
+	}
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(mcde_dss_get_present_event);
+
+static bool present_event_pending(struct mcde_flip_queue *q)
+{
+	unsigned long flags;
+	bool pending;
+
+	spin_lock_irqsave(&q->lock, flags);
+	pending = q->n_events != 0;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return pending;
+}
+
+int mcde_dss_wait_present_event(struct mcde_display_device *ddev,
+				struct mcde_dss_present_event *event)
+{
+	struct mcde_flip_queue *q = ddev->flip_queue;
+	int ret;
+
+	if (!q)
+		return -ENODEV;
+
+	/* Another reader may take the event before us, so retry */
+	while ((ret = mcde_dss_get_present_event(ddev, event)) == -EAGAIN) {
+		ret = wait_event_interruptible(q->event_waitq,
+						present_event_pending(q));
+		if (ret)
+			return ret;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL(mcde_dss_wait_present_event);
+
+unsigned int mcde_dss_poll_present_event(struct mcde_display_device *ddev,
+				struct file *file, poll_table *wait)
+{
+	struct mcde_flip_queue *q = ddev->flip_queue;
+	unsigned int mask = 0;
+	unsigned long flags;
+
+	if (!q)
+		return POLLERR;
+
+	poll_wait(file, &q->event_waitq, wait);
+
+	spin_lock_irqsave(&q->lock, flags);
+	if (q->n_events)
+		mask |= POLLIN | POLLRDNORM;
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	return mask;
+}
+EXPORT_SYMBOL(mcde_dss_poll_present_event);
+
+int mcde_dss_flip_queue_create(struct mcde_display_device *ddev)
+{
+	struct mcde_flip_queue *q;
+
+	q = kzalloc(sizeof(*q), GFP_KERNEL);
+	if (!q)
+		return -ENOMEM;
+
+	q->wq = create_singlethread_workqueue("mcde_flip");
+	if (!q->wq) {
+		kfree(q);
+		return -ENOMEM;
+	}
+
+	q->ddev = ddev;
+	spin_lock_init(&q->lock);
+	INIT_LIST_HEAD(&q->queued);
+	INIT_LIST_HEAD(&q->done);
+	init_waitqueue_head(&q->event_waitq);
+	init_waitqueue_head(&q->idle_waitq);
+	INIT_WORK(&q->work, flip_work);
+	setup_timer(&q->timer, flip_timeout, (unsigned long)q);
+
+	ddev->flip_queue = q;
+	mcde_chnl_set_vcmp_callback(ddev->chnl_state, flip_vcmp, q);
+
+	return 0;
+}
+
+void mcde_dss_flip_queue_destroy(struct mcde_display_device *ddev)
+{
+	struct mcde_flip_queue *q = ddev->flip_queue;
+	struct mcde_dss_flip *flip;
+	struct mcde_dss_flip *tmp;
+	unsigned long flags;
+
+	if (!q)
+		return;
+
+	mcde_chnl_set_vcmp_callback(ddev->chnl_state, NULL, NULL);
+
+	/* Drop everything not yet out on the display */
+	spin_lock_irqsave(&q->lock, flags);
+	list_for_each_entry_safe(flip, tmp, &q->queued, list) {
+		list_del(&flip->list);
+		flip_done_locked(q, flip, 0);
+	}
+	q->n_queued = 0;
+	if (q->inflight)
+		flip_done_locked(q, q->inflight, 0);
+	spin_unlock_irqrestore(&q->lock, flags);
+
+	del_timer_sync(&q->timer);
+	flush_workqueue(q->wq);
+	destroy_workqueue(q->wq);
+	release_flips(q);
+
+	if (q->n_events_lost)
+		dev_dbg(&ddev->dev, "%u present events never read\n",
+							q->n_events_lost);
+
+	ddev->flip_queue = NULL;
+	kfree(q);
+}
@@ -60,6 +60,7 @@ static int update_channel_static_registers(struct mcde_chnl_state *chnl);
 static void _mcde_chnl_update_color_conversion(struct mcde_chnl_state *chnl);
 static void chnl_update_overlay(struct mcde_chnl_state *chnl,
 						struct mcde_ovly_state *ovly);
+static void chnl_invalidate_panel_area(struct mcde_chnl_state *chnl);
 #define OVLY_TIMEOUT 100
 #define CHNL_TIMEOUT 100
 #define FLOW_STOP_TIMEOUT 20
@@ -831,6 +832,11 @@ static void mcde_register_vcmp(struct mcde_chnl_state *chnl)
 			chnl->force_restart_frame_cnt = 0;
 
 		chnl->vsync_cnt_wait = atomic_read(&chnl->vsync_cnt) + 1;
+
+		spin_lock(&chnl->vcmp_cb_lock);
+		if (chnl->vcmp_cb)
+			chnl->vcmp_cb(chnl->vcmp_cb_data, vcmp_cnt, ktime_get());
+		spin_unlock(&chnl->vcmp_cb_lock);
 	}
 }
 
@@ -2568,6 +2574,10 @@ static int mcde_dsi_direct_cmd_write(struct mcde_chnl_state *chnl,
 		if (chnl->port.mode == MCDE_PORTMODE_CMD)
 			set_channel_state_sync(chnl, CHNLSTATE_DSI_WRITE);
 
+		if (dcs && (cmd == DCS_CMD_SET_COLUMN_ADDRESS ||
+				cmd == DCS_CMD_SET_PAGE_ADDRESS))
+			chnl_invalidate_panel_area(chnl);
+
 		if (dcs)
 			ret = nova_dsilink_dcs_write(chnl->dsilink,
 								cmd, data, len);
@@ -2838,9 +2848,13 @@ static int _mcde_chnl_apply(struct mcde_chnl_state *chnl)
 	chnl->regs.blend_en = chnl->blend_en;
 	chnl->regs.alpha_blend = chnl->alpha_blend;
 
-	/* For now the update area will always be full screen */
+	/*
+	 * The channel registers always describe the whole display, a partial
+	 * update area is applied on top of them in setup_channel()
+	 */
 	chnl->regs.x   = 0;
 	chnl->regs.y   = 0;
+	memset(&chnl->curr_area, 0, sizeof(chnl->curr_area));
 
 	/* Set oled and color conversion states if necessary */
 	_mcde_chnl_update_color_conversion(chnl);
@@ -2851,6 +2865,160 @@ static int _mcde_chnl_apply(struct mcde_chnl_state *chnl)
 	return 0;
 }
 
+/* Panel window not known, e.g. after the display has been powered off */
+#define PANEL_AREA_UNKNOWN 0xffff
+
+static bool chnl_partial_update_possible(struct mcde_chnl_state *chnl)
+{
+	return chnl->port.type == MCDE_PORTTYPE_DSI &&
+		chnl->port.mode == MCDE_PORTMODE_CMD &&
+		!chnl->port.update_auto_trig &&
+		chnl->hw_rot == MCDE_HW_ROT_0 &&
+		!chnl->vmode.interlaced &&
+		!chnl->update_color_conversion &&
+		!chnl->first_frame_vsync_fix &&
+		!chnl->no_partial_update;
+}
+
+static bool chnl_update_is_partial(struct mcde_chnl_state *chnl)
+{
+	return chnl->curr_area.w != chnl->vmode.xres ||
+		chnl->curr_area.h != chnl->vmode.yres;
+}
+
+static inline bool area_equal(struct mcde_rectangle *a,
+						struct mcde_rectangle *b)
+{
+	return a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h;
+}
+
+/*
+ * Decides the area to send in this update from the staged update area.
+ * The area is aligned to what the DSI formatter can handle, anything that
+ * ends up covering the whole display is sent as a normal full update.
+ * Returns true if the area differs from the area of the previous update.
+ */
+static bool chnl_setup_update_area(struct mcde_chnl_state *chnl)
+{
+	struct mcde_rectangle *staged = &chnl->update_area;
+	struct mcde_rectangle area;
+	int xres = chnl->vmode.xres;
+	int yres = chnl->vmode.yres;
+	bool changed;
+
+	area.x = 0;
+	area.y = 0;
+	area.w = xres;
+	area.h = yres;
+
+	if (staged->w && staged->h && chnl_partial_update_possible(chnl) &&
+			xres >= MCDE_MIN_WIDTH && yres >= MCDE_MIN_HEIGHT) {
+		int x1 = staged->x & ~1;
+		int y1 = staged->y;
+		int x2 = min(ALIGN(staged->x + staged->w, 2), xres);
+		int y2 = min(staged->y + staged->h, yres);
+
+		if (x2 - x1 < MCDE_MIN_WIDTH) {
+			x2 = min(x1 + MCDE_MIN_WIDTH, xres);
+			x1 = x2 - MCDE_MIN_WIDTH;
+		}
+		if (y2 - y1 < MCDE_MIN_HEIGHT) {
+			y2 = min(y1 + MCDE_MIN_HEIGHT, yres);
+			y1 = y2 - MCDE_MIN_HEIGHT;
+		}
+		if (x1 >= 0 && y1 >= 0 && x2 > x1 && y2 > y1) {
+			area.x = x1;
+			area.y = y1;
+			area.w = x2 - x1;
+			area.h = y2 - y1;
+		}
+	}
+	memset(staged, 0, sizeof(*staged));
+
+	changed = !area_equal(&area, &chnl->curr_area);
+	chnl->curr_area = area;
+
+	return changed;
+}
+
+static int dcs_write_window(struct mcde_chnl_state *chnl, u8 cmd,
+							u16 start, u16 len)
+{
+	u16 end = start + len - 1;
+	u8 data[4];
+
+	data[0] = start >> 8;
+	data[1] = start & 0xff;
+	data[2] = end >> 8;
+	data[3] = end & 0xff;
+
+	return nova_dsilink_dcs_write(chnl->dsilink, cmd, data, sizeof(data));
+}
+
+/*
+ * Sets the column/page address window of the panel to the update area.
+ * The panel keeps its default window until a partial update has been done.
+ */
+static int chnl_setup_panel_area(struct mcde_chnl_state *chnl)
+{
+	struct mcde_rectangle *area = &chnl->curr_area;
+	int ret;
+
+	if (area_equal(area, &chnl->panel_area))
+		return 0;
+	if (!chnl_update_is_partial(chnl) && chnl->panel_area.w == 0)
+		return 0;
+
+	ret = dcs_write_window(chnl, DCS_CMD_SET_COLUMN_ADDRESS,
+							area->x, area->w);
+	if (!ret)
+		ret = dcs_write_window(chnl, DCS_CMD_SET_PAGE_ADDRESS,
+							area->y, area->h);
+	if (ret) {
+		dev_warn(&mcde_dev->dev, "%s: Failed to set panel window, "
+				"chnl=%d\n", __func__, chnl->id);
+		chnl->panel_area.w = PANEL_AREA_UNKNOWN;
+		return ret;
+	}
+
+	chnl->panel_area = *area;
+	return 0;
+}
+
+static void chnl_invalidate_panel_area(struct mcde_chnl_state *chnl)
+{
+	if (chnl->panel_area.w != 0)
+		chnl->panel_area.w = PANEL_AREA_UNKNOWN;
+}
+
+/*
+ * Clips the overlay registers to the update area, with positions relative
+ * to the area. Overlays outside the area are disabled for the update.
+ */
+static void ovly_regs_clip(struct ovly_regs *regs, struct mcde_rectangle *area)
+{
+	int x1 = max_t(int, regs->xpos, area->x);
+	int y1 = max_t(int, regs->ypos, area->y);
+	int x2 = min_t(int, regs->xpos + regs->ppl, area->x + area->w);
+	int y2 = min_t(int, regs->ypos + regs->lpf, area->y + area->h);
+
+	if (x2 <= x1 || y2 <= y1) {
+		regs->enabled = false;
+		regs->ppl = min(regs->ppl, area->w);
+		regs->lpf = min(regs->lpf, area->h);
+		regs->xpos = 0;
+		regs->ypos = 0;
+		return;
+	}
+
+	regs->cropx += x1 - regs->xpos;
+	regs->cropy += y1 - regs->ypos;
+	regs->ppl = x2 - x1;
+	regs->lpf = y2 - y1;
+	regs->xpos = x1 - area->x;
+	regs->ypos = y1 - area->y;
+}
+
 static void setup_channel(struct mcde_chnl_state *chnl)
 {
 	static struct mcde_oled_transform yuv240_2_rgb = {
@@ -2914,9 +3082,19 @@ static void setup_channel(struct mcde_chnl_state *chnl)
 			update_oled_registers(chnl->id, &chnl->oled_regs);
 	}
 
-	if (chnl->regs.dirty)
+	if (chnl->regs.dirty && chnl_update_is_partial(chnl)) {
+		struct chnl_regs regs = chnl->regs;
+		struct mcde_video_mode vmode = chnl->vmode;
+
+		regs.ppl = vmode.xres = chnl->curr_area.w;
+		regs.lpf = vmode.yres = chnl->curr_area.h;
+		update_channel_registers(chnl->id, &regs, &chnl->port,
+						chnl->fifo, &vmode);
+		chnl->regs.dirty = false;
+	} else if (chnl->regs.dirty) {
 		update_channel_registers(chnl->id, &chnl->regs, &chnl->port,
 						chnl->fifo, &chnl->vmode);
+	}
 }
 
 static void chnl_update_continous(struct mcde_chnl_state *chnl)
@@ -3111,17 +3289,30 @@ static bool is_update_time_long(struct mcde_chnl_state *chnl,
 static void chnl_update_overlay(struct mcde_chnl_state *chnl,
 						struct mcde_ovly_state *ovly)
 {
+	struct ovly_regs clipped;
+	struct ovly_regs *regs;
+
 	if (!ovly || !ovly->inuse)
 		return;
 
-	if (ovly->regs.dirty_buf)
-		update_overlay_registers_on_the_fly(ovly->idx, &ovly->regs, chnl->regs.ovly_xoffset);
+	regs = &ovly->regs;
+	if (chnl_update_is_partial(chnl)) {
+		clipped = ovly->regs;
+		ovly_regs_clip(&clipped, &chnl->curr_area);
+		regs = &clipped;
+	}
+
+	if (regs->dirty_buf)
+		update_overlay_registers_on_the_fly(ovly->idx, regs, chnl->regs.ovly_xoffset);
 
-	if (ovly->regs.dirty) {
-		update_overlay_registers(ovly, &ovly->regs, &chnl->port,
+	if (regs->dirty) {
+		update_overlay_registers(ovly, regs, &chnl->port,
 			chnl->fifo, ovly->stride,
 			chnl->vmode.interlaced, chnl->hw_rot);
 	}
+
+	ovly->regs.dirty_buf = regs->dirty_buf;
+	ovly->regs.dirty = regs->dirty;
 }
 
 static void stop_channel_if_needed(struct mcde_chnl_state *chnl)
@@ -3154,6 +3345,7 @@ static int _mcde_chnl_update(struct mcde_chnl_state *chnl,
 					bool tripple_buffer)
 {
 	int curr_vcmp_cnt;
+	bool area_changed;
 
 	dev_vdbg(&mcde_dev->dev, "%s\n", __func__);
 
@@ -3187,9 +3379,24 @@ static int _mcde_chnl_update(struct mcde_chnl_state *chnl,
 		curr_vcmp_cnt = atomic_read(&chnl->vcmp_cnt);
 	}
 	chnl->vcmp_cnt_wait = curr_vcmp_cnt + 1;
+	chnl->present_vcmp_cnt = curr_vcmp_cnt + 1;
 
 	/* No access of HW before this line */
 
+	area_changed = chnl_setup_update_area(chnl);
+	if (chnl_setup_panel_area(chnl) && chnl_update_is_partial(chnl)) {
+		/* Panel window unknown, fall back to a full update */
+		area_changed |= chnl_setup_update_area(chnl);
+		(void)chnl_setup_panel_area(chnl);
+	}
+	if (area_changed) {
+		chnl->regs.dirty = true;
+		chnl->ovly0->regs.dirty = true;
+		chnl->ovly0->regs.dirty_buf = true;
+		chnl->ovly1->regs.dirty = true;
+		chnl->ovly1->regs.dirty_buf = true;
+	}
+
 	chnl_update_overlay(chnl, chnl->ovly0);
 	chnl_update_overlay(chnl, chnl->ovly1);
 
@@ -3400,6 +3607,48 @@ int mcde_chnl_apply(struct mcde_chnl_state *chnl)
 	return ret;
 }
 
+void mcde_chnl_set_update_area(struct mcde_chnl_state *chnl,
+					struct mcde_rectangle *area)
+{
+	struct mcde_rectangle *staged = &chnl->update_area;
+	u16 x2;
+	u16 y2;
+
+	dev_vdbg(&mcde_dev->dev, "%s\n", __func__);
+
+	mcde_lock(__func__, __LINE__);
+	if (!area || !area->w || !area->h) {
+		memset(staged, 0, sizeof(*staged));
+	} else if (!staged->w) {
+		*staged = *area;
+	} else {
+		/* Several updates staged, send the union of them */
+		x2 = max(staged->x + staged->w, area->x + area->w);
+		y2 = max(staged->y + staged->h, area->y + area->h);
+		staged->x = min(staged->x, area->x);
+		staged->y = min(staged->y, area->y);
+		staged->w = x2 - staged->x;
+		staged->h = y2 - staged->y;
+	}
+	mcde_unlock(__func__, __LINE__);
+}
+
+void mcde_chnl_set_vcmp_callback(struct mcde_chnl_state *chnl,
+		void (*cb)(void *data, int vcmp_cnt, ktime_t time), void *data)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&chnl->vcmp_cb_lock, flags);
+	chnl->vcmp_cb = cb;
+	chnl->vcmp_cb_data = data;
+	spin_unlock_irqrestore(&chnl->vcmp_cb_lock, flags);
+}
+
+int mcde_chnl_get_present_vcmp(struct mcde_chnl_state *chnl)
+{
+	return chnl->present_vcmp_cnt;
+}
+
 int mcde_chnl_update(struct mcde_chnl_state *chnl,
 					bool tripple_buffer)
 {
@@ -3415,6 +3664,14 @@ int mcde_chnl_update(struct mcde_chnl_state *chnl,
 
 	ret = _mcde_chnl_update(chnl, tripple_buffer);
 	mcde_debugfs_channel_update(chnl->id);
+	if (!ret) {
+		u32 bpp = chnl->regs.bpp;
+
+		mcde_debugfs_channel_transfer(chnl->id,
+			chnl_update_is_partial(chnl),
+			chnl->curr_area.w * chnl->curr_area.h * bpp / 8,
+			chnl->vmode.xres * chnl->vmode.yres * bpp / 8);
+	}
 	if (chnl->ovly0)
 		mcde_debugfs_overlay_update(chnl->id, chnl->ovly0->idx);
 	if (chnl->ovly1)
@@ -3485,6 +3742,8 @@ void mcde_chnl_disable(struct mcde_chnl_state *chnl)
 	WARN_ON_ONCE(chnl->state == CHNLSTATE_RUNNING);
 	disable_mcde_hw(false, true);
 	chnl->enabled = false;
+	/* The panel may lose its window while the channel is disabled */
+	chnl_invalidate_panel_area(chnl);
 	mcde_unlock(__func__, __LINE__);
 
 	dev_vdbg(&mcde_dev->dev, "%s exit\n", __func__);
@@ -3936,6 +4195,7 @@ static int probe_hw(struct platform_device *pdev)
 		init_waitqueue_head(&channels[i].state_waitq);
 		init_waitqueue_head(&channels[i].vcmp_waitq);
 		init_waitqueue_head(&channels[i].vsync_waitq);
+		spin_lock_init(&channels[i].vcmp_cb_lock);
 
 		mcde_debugfs_channel_create(i, &channels[i]);
 		mcde_debugfs_overlay_create(i, 0, channels[i].ovly0);
@@ -205,6 +205,10 @@ struct mcde_chnl_state {
 	wait_queue_head_t vsync_waitq;
 	atomic_t vcmp_cnt;
 	int vcmp_cnt_wait;
+	int present_vcmp_cnt; /* vcmp_cnt when the latest update is out */
+	spinlock_t vcmp_cb_lock;
+	void (*vcmp_cb)(void *data, int vcmp_cnt, ktime_t time);
+	void *vcmp_cb_data;
 	atomic_t vsync_cnt;
 	int vsync_cnt_wait;
 	atomic_t n_vsync_capture_listeners;
@@ -256,6 +260,18 @@ struct mcde_chnl_state {
 	bool first_frame_vsync_fix;
 	bool force_disable;
 
+	/*
+	 * Partial update of DSI command mode displays. The update area is
+	 * staged for the next update only, a zero sized area means the whole
+	 * display. The current area is the area sent in the latest update.
+	 * The panel area is the column/page address window last set in the
+	 * panel, zero sized while the panel has its default window.
+	 */
+	struct mcde_rectangle update_area;
+	struct mcde_rectangle curr_area;
+	struct mcde_rectangle panel_area;
+	bool no_partial_update;
+
 	atomic_t force_restart;
 	int force_restart_frame_cnt;
 	int force_restart_first_cnt;
@@ -1148,6 +1148,7 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	lowmem_index_update(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -1283,6 +1284,7 @@ err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	lowmem_index_update(task);
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -87,6 +87,8 @@ enum compdev_flag {
 enum compdev_ptr_type {
 	COMPDEV_PTR_PHYSICAL,
 	COMPDEV_PTR_HWMEM_BUF_NAME_OFFSET,
+	/* fd is a dma-buf exported by hwmem */
+	COMPDEV_PTR_DMA_BUF_FD_OFFSET,
 };
 
 enum compdev_listener_state {
@@ -123,6 +125,19 @@ struct compdev_img {
 	__u32                flags;
 };
 
+struct compdev_flip {
+	struct compdev_img   img;
+	struct compdev_rect  damage; /* zero sized for the whole display */
+	__u32                seq; /* set by the driver */
+};
+
+/* Read from the compdev device when a queued flip is out on the display */
+struct compdev_present_event {
+	__u32 seq;
+	__u32 reserved;
+	__s64 timestamp; /* ns, 0 if the flip was dropped */
+};
+
 struct compdev_scene_info {
 	enum   compdev_transform  app_transform;
 	enum   compdev_transform  fb_transform;
@@ -151,6 +166,10 @@ struct compdev_video_mode {
 #define COMPDEV_GET_LISTENER_STATE_IOC _IOR('D', 4, enum compdev_listener_state)
 #define COMPDEV_SET_VIDEO_MODE_IOC     _IOW('D', 5, struct compdev_video_mode)
 #define COMPDEV_WAIT_FOR_VSYNC_IOC     _IOR('D', 6, __s64)
+/* Area of the display that changed in the next posted frame */
+#define COMPDEV_POST_DAMAGE_IOC        _IOW('D', 7, struct compdev_rect)
+/* Queues an image without waiting for the display, see compdev_flip */
+#define COMPDEV_QUEUE_FLIP_IOC         _IOWR('D', 8, struct compdev_flip)
 
 
 #if defined(__KERNEL__) || defined(_KERNEL)
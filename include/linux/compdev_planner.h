@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) ST-Ericsson SA 2012
+ *
+ * Overlay composition planner for Compdev
+ *
+ * License terms: GNU General Public License (GPL), version 2.
+ */
+
+#ifndef _COMPDEV_PLANNER_H_
+#define _COMPDEV_PLANNER_H_
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+#include <linux/compdev.h>
+
+/* Number of layers planned per frame, one per MCDE overlay */
+#define COMPDEV_PLAN_MAX_LAYERS 2
+
+enum compdev_plan_path {
+	/* MCDE fetches the layer directly */
+	COMPDEV_PLAN_OVERLAY,
+	/* B2R2 transforms the layer, MCDE can not do it */
+	COMPDEV_PLAN_B2R2,
+	/* B2R2 packs an opaque layer to fewer bytes per pixel for MCDE */
+	COMPDEV_PLAN_B2R2_PACK,
+	COMPDEV_PLAN_NUM_PATHS,
+};
+
+struct compdev_plan_layer {
+	/* The layer set the plan was made for */
+	bool valid;
+	enum compdev_fmt fmt;
+	struct compdev_rect src_rect;
+	struct compdev_rect dst_rect;
+	enum compdev_transform transform;
+	enum compdev_transform mcde_transform;
+	u32 flags;
+	bool b2r2_needed;
+	u32 refresh_hz;
+
+	/* The plan */
+	enum compdev_plan_path path;
+	enum compdev_fmt b2r2_fmt;
+	u32 planned_interval_us;
+	u32 cost_kbps;
+	u32 base_cost_kbps;
+	u32 b2r2_bytes;
+	u32 saved_bytes;
+	u32 b2r2_us;
+
+	/* Average time between posts of this layer */
+	ktime_t last_post;
+	u32 interval_us;
+};
+
+struct compdev_plan_stats {
+	u32 layers;
+	u32 cache_hits;
+	u32 replans;
+	u32 path_count[COMPDEV_PLAN_NUM_PATHS];
+	u64 b2r2_bytes;
+	u64 saved_bytes;
+};
+
+struct compdev_planner {
+	struct compdev_plan_layer layers[COMPDEV_PLAN_MAX_LAYERS];
+	struct compdev_plan_stats stats;
+};
+
+/**
+ * compdev_planner_init() - Initializes a composition planner
+ *
+ * @planner: The planner
+ */
+void compdev_planner_init(struct compdev_planner *planner);
+
+/**
+ * compdev_plan_layer() - Decides how a posted layer reaches the display
+ *
+ * @planner:        The planner
+ * @slot:           The overlay the layer is posted to
+ * @img:            The layer, with the transform left for B2R2
+ * @mcde_transform: The rotation done by MCDE
+ * @b2r2_needed:    True if MCDE can not show the layer as it is
+ * @refresh_hz:     Display refresh rate if MCDE fetches the overlays on
+ *                  every refresh, 0 if only on update
+ * @b2r2_fmt:       Set to the format B2R2 should produce for MCDE
+ *
+ * The path is chosen to minimise the estimated DDR traffic of B2R2 and MCDE
+ * together, as long as the B2R2 job fits well within a frame. The plan is
+ * kept as long as the layer is posted with the same format, geometry and
+ * transform at about the same rate.
+ *
+ * Returns the path of the layer.
+ */
+enum compdev_plan_path compdev_plan_layer(struct compdev_planner *planner,
+		int slot, struct compdev_img *img,
+		enum compdev_transform mcde_transform, bool b2r2_needed,
+		u32 refresh_hz, enum compdev_fmt *b2r2_fmt);
+
+/**
+ * compdev_planner_show() - Prints the plan statistics
+ *
+ * @planner: The planner
+ * @buf:     Buffer of PAGE_SIZE bytes
+ *
+ * Returns the number of bytes printed.
+ */
+ssize_t compdev_planner_show(struct compdev_planner *planner, char *buf);
+
+#endif /* _COMPDEV_PLANNER_H_ */
@@ -368,6 +368,19 @@ struct hwmem_get_info_request {
  */
 #define HWMEM_IMPORT_FD_IOC _IO('W', 12)
 
+/**
+ * @brief Export the buffer as a dma-buf file descriptor.
+ *
+ * The dma-buf can be passed to any driver that imports dma-bufs and keeps the
+ * buffer alive until it is closed.
+ *
+ * Input is the buffer identifier. If 0 is specified the buffer associated with
+ * the current file instance will be exported.
+ *
+ * @return A dma-buf file descriptor on success, or a negative error code.
+ */
+#define HWMEM_EXPORT_DMA_BUF_IOC _IO('W', 13)
+
 #ifdef __KERNEL__
 
 /* Kernel API */
@@ -475,6 +488,32 @@ void hwmem_release(struct hwmem_alloc *alloc);
 int hwmem_set_domain(struct hwmem_alloc *alloc, enum hwmem_access access,
 		enum hwmem_domain domain, struct hwmem_region *region);
 
+/**
+ * @brief Prepare the buffer for access by hardware at the next call to
+ * hwmem_sync_deferred().
+ *
+ * Same as hwmem_set_domain() with domain HWMEM_DOMAIN_SYNC except that the
+ * cache maintenance is postponed. All buffers prepared this way are
+ * synchronized together by hwmem_sync_deferred(), using a single operation
+ * on the entire cache when that is faster than operating on each buffer.
+ * hwmem_sync_deferred() must be called before hardware accesses the buffer.
+ *
+ * @param alloc Buffer to be prepared.
+ * @param access Flags defining memory access mode of the call.
+ * @param region Structure defining the minimum area of the buffer to be
+ * prepared.
+ *
+ * @return Zero on success, or a negative error code.
+ */
+int hwmem_set_domain_deferred(struct hwmem_alloc *alloc,
+		enum hwmem_access access, struct hwmem_region *region);
+
+/**
+ * @brief Perform the cache maintenance of all buffers prepared with
+ * hwmem_set_domain_deferred().
+ */
+void hwmem_sync_deferred(void);
+
 /**
  * @brief Pins the buffer.
  *
@@ -592,6 +631,33 @@ struct hwmem_alloc *hwmem_resolve_by_name(s32 name);
  */
 struct hwmem_alloc *hwmem_resolve_by_vm_addr(void *vm_addr);
 
+struct dma_buf;
+
+/**
+ * @brief Export the buffer as a dma-buf.
+ *
+ * The dma-buf holds a buffer reference until it is released. Importers that
+ * map an attachment get the buffer pinned and synchronized for the direction
+ * they map it for.
+ *
+ * @param alloc Buffer to be exported.
+ *
+ * @return Pointer to dma-buf, or a negative error code.
+ */
+struct dma_buf *hwmem_export_dma_buf(struct hwmem_alloc *alloc);
+
+/**
+ * @brief Resolve the hwmem allocation behind a dma-buf exported by hwmem.
+ * This call will add a buffer reference. Resulting buffer should be
+ * released with a call to hwmem_release.
+ *
+ * @param dmabuf A dma-buf.
+ *
+ * @return Pointer to allocation, or a negative error code if the dma-buf was
+ * not exported by hwmem.
+ */
+struct hwmem_alloc *hwmem_resolve_by_dma_buf(struct dma_buf *dmabuf);
+
 /* Integration */
 
 struct hwmem_allocator_api {
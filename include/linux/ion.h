@@ -219,9 +219,32 @@ struct ion_handle *ion_import(struct ion_client *client,
  * with them from userspace.  These buffers are represented by a file
  * descriptor obtained as the return from the ION_IOC_SHARE ioctl.
  * This function coverts that fd into the underlying buffer, and returns
- * the handle to use to refer to it further.
+ * the handle to use to refer to it further.  dma-buf fds exported by ion
+ * are accepted as well.
  */
 struct ion_handle *ion_import_fd(struct ion_client *client, int fd);
+
+/**
+ * ion_share_dma_buf() - share buffer as dma-buf
+ * @client:	the client
+ * @handle:	the handle
+ *
+ * Returns a dma-buf fd for the buffer. Any driver that imports dma-bufs can
+ * attach to it, the dma-buf keeps the buffer alive until its last fd is
+ * closed.
+ */
+int ion_share_dma_buf(struct ion_client *client, struct ion_handle *handle);
+
+/**
+ * ion_import_dma_buf() - given a dma-buf fd exported by ion, import it
+ * @client:	this blocks client
+ * @fd:		the dma-buf fd
+ *
+ * Given a dma-buf fd that was returned by ion_share_dma_buf or the
+ * ION_IOC_SHARE_DMA_BUF ioctl, add the underlying buffer to the client and
+ * return the handle to use to refer to it further.
+ */
+struct ion_handle *ion_import_dma_buf(struct ion_client *client, int fd);
 #endif /* __KERNEL__ */
 
 /**
@@ -328,11 +351,22 @@ struct ion_custom_data {
  * DOC: ION_IOC_IMPORT - imports a shared file descriptor
  *
  * Takes an ion_fd_data struct with the fd field populated with a valid file
- * descriptor obtained from ION_IOC_SHARE and returns the struct with the handle
- * filed set to the corresponding opaque handle.
+ * descriptor obtained from ION_IOC_SHARE or ION_IOC_SHARE_DMA_BUF and returns
+ * the struct with the handle filed set to the corresponding opaque handle.
  */
 #define ION_IOC_IMPORT		_IOWR(ION_IOC_MAGIC, 5, int)
 
+/**
+ * DOC: ION_IOC_SHARE_DMA_BUF - creates a dma-buf fd to share an allocation
+ *
+ * Takes an ion_fd_data struct with the handle field populated with a valid
+ * opaque handle.  Returns the struct with the fd field set to a dma-buf file
+ * descriptor open in the current address space.  Drivers that import
+ * dma-bufs, such as the GPU and the display, can use the buffer through
+ * this fd without copying it.  ION_IOC_IMPORT also accepts the fd.
+ */
+#define ION_IOC_SHARE_DMA_BUF	_IOWR(ION_IOC_MAGIC, 7, struct ion_fd_data)
+
 /**
  * DOC: ION_IOC_CUSTOM - call architecture specific ion ioctl
  *
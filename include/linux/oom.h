@@ -70,6 +70,40 @@ extern unsigned long badness(struct task_struct *p, struct mem_cgroup *mem,
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+/* Keeps the lowmemorykiller index of processes by oom_adj up to date */
+extern void lowmem_index_add(struct task_struct *p);
+extern void lowmem_index_del(struct task_struct *p);
+extern void lowmem_index_replace(struct task_struct *old,
+		struct task_struct *new);
+extern void lowmem_index_update(struct task_struct *p);
+/* Reports page reclaim efficiency as lowmemorykiller pressure levels */
+extern void lowmem_vmpressure(gfp_t gfp_mask, unsigned long scanned,
+		unsigned long reclaimed);
+#else
+static inline void lowmem_index_add(struct task_struct *p)
+{
+}
+
+static inline void lowmem_index_del(struct task_struct *p)
+{
+}
+
+static inline void lowmem_index_replace(struct task_struct *old,
+		struct task_struct *new)
+{
+}
+
+static inline void lowmem_index_update(struct task_struct *p)
+{
+}
+
+static inline void lowmem_vmpressure(gfp_t gfp_mask, unsigned long scanned,
+		unsigned long reclaimed)
+{
+}
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
@@ -181,6 +181,9 @@ enum b2r2_blt_fmt {
  *    Use fd + offset to determine buffer location.
  * @B2R2_BLT_PTR_HWMEM_BUF_NAME:
  *    Use hwmem_buf_name and offset to determine buffer location.
+ * @B2R2_BLT_PTR_DMA_BUF_FD_OFFSET:
+ *    Use the dma-buf fd + offset to determine buffer location. The buffer
+ *    must be physically contiguous.
  */
 enum b2r2_blt_ptr_type {
 	B2R2_BLT_PTR_NONE,
@@ -188,6 +191,7 @@ enum b2r2_blt_ptr_type {
 	B2R2_BLT_PTR_PHYSICAL,
 	B2R2_BLT_PTR_FD_OFFSET,
 	B2R2_BLT_PTR_HWMEM_BUF_NAME_OFFSET,
+	B2R2_BLT_PTR_DMA_BUF_FD_OFFSET,
 };
 
 /**
@@ -195,7 +199,7 @@ enum b2r2_blt_ptr_type {
  *
  * @type: Buffer pointer type
  * @hwmem_global_buf_id: Hwmem buffer name
- * @fd: File descriptor (e.g. file handle to pmem or fb device)
+ * @fd: File descriptor (e.g. file handle to pmem or fb device, or a dma-buf)
  * @offset: Offset where buffer can be found or address.
  * @len: Size of buffer in bytes
  * @bits: Pointer to the bitmap data. This field can be used to specify
@@ -562,6 +566,60 @@ struct b2r2_blt_report {
 	__u32 usec_elapsed;
 };
 
+/**
+ * enum b2r2_blt_batch_flag - Flags that control a batch of B2R2 requests
+ *
+ * @B2R2_BLT_BATCH_FLAG_ASYNCH:
+ *    Asynchronous batch. The ioctl returns when the batch has been queued.
+ *    Replaces the B2R2_BLT_FLAG_ASYNCH flag of the requests in the batch.
+ * @B2R2_BLT_BATCH_FLAG_DONE_FD:
+ *    Return a file descriptor in done_fd that can be polled for the
+ *    completion of the batch. It becomes readable (POLLIN) when all
+ *    requests of the batch are done, POLLERR is also set if the batch was
+ *    cancelled. The caller must close the file descriptor.
+ */
+enum b2r2_blt_batch_flag {
+	B2R2_BLT_BATCH_FLAG_ASYNCH          = BIT(0),/*0x1*/
+	B2R2_BLT_BATCH_FLAG_DONE_FD         = BIT(1),/*0x2*/
+};
+
+/* Max number of requests in one batch */
+#define B2R2_BLT_MAX_BATCH_COUNT 16
+
+/**
+ * struct b2r2_blt_batch - A batch of B2R2 requests performed as one job
+ *
+ * The node lists of the requests are chained and performed by B2R2 in
+ * array order without any interaction with the CPU in between. There is
+ * one completion for the whole batch.
+ *
+ * The requests may not use B2R2_BLT_FLAG_DRY_RUN,
+ * B2R2_BLT_FLAG_REPORT_WHEN_DONE or B2R2_BLT_FLAG_REPORT_PERFORMANCE. The
+ * priority of the batch replaces the priorities of the requests.
+ *
+ * @size: Size of this structure. Used for versioning. MUST be specified.
+ * @flags: Flags that control the batch ORed together,
+ *         see enum b2r2_blt_batch_flag
+ * @count: Number of requests in @reqs, at most B2R2_BLT_MAX_BATCH_COUNT
+ * @prio: Priority (-20 to 19) of the batch
+ * @deadline: CLOCK_MONOTONIC time in ns by which the batch should be done,
+ *            e.g. the vsync the result is shown at. 0 if the batch has no
+ *            deadline. Batches with a deadline are performed earliest
+ *            deadline first, ahead of all requests without a deadline.
+ * @reqs: Pointer to an array of @count requests
+ * @done_fd: Returned file descriptor if B2R2_BLT_BATCH_FLAG_DONE_FD is
+ *           specified, -1 otherwise
+ */
+struct b2r2_blt_batch {
+	__u32                size;
+	__u32                flags;
+	__u32                count;
+	__s32                prio;
+	__s64                deadline;
+	struct b2r2_blt_req  *reqs;
+	__s32                done_fd;
+};
+
 /**
  * B2R2 BLT driver is used in the following way:
  *
@@ -581,6 +639,14 @@ struct b2r2_blt_report {
  * Wait for all requests from this context to finish
  *        ret = ioctl(fd, B2R2_BLT_SYNCH_IOC, (__u32) 0);
  *
+ * Issue several requests as one job:
+ *        struct b2r2_blt_batch blt_batch;
+ *        blt_batch.size = sizeof(blt_batch);
+ *        blt_batch.reqs = blt_requests;
+ *        ... Fill batch with data...
+ *
+ *        request_id = ioctl(fd, B2R2_BLT_BATCH_IOC, (__u32) &blt_batch);
+ *
  * Wait indefinitely for report data from driver:
  *        pollfd.fd = fd
  *        pollfd.events = 0xFFFFFFFF;
@@ -641,6 +707,20 @@ struct b2r2_blt_report {
 #define B2R2_BLT_QUERY_CAP_IOC  _IOWR(B2R2_BLT_IOC_MAGIC, 3, \
 				  struct b2r2_blt_query_cap)
 
+/**
+ * The B2R2_BLT_BATCH_IOC ioctl adds a batch of blit requests to B2R2.
+ *
+ * The ioctl returns when all requests of the batch have been performed if
+ * not asynchronous execution has been specified for the batch.
+ *
+ * Supplied parameter shall be a pointer to a struct b2r2_blt_batch.
+ *
+ * Returns an unique request id if >= 0, else a negative error code.
+ * This request id can be waited for using B2R2_BLT_SYNC_IOC.
+ */
+#define B2R2_BLT_BATCH_IOC  _IOWR(B2R2_BLT_IOC_MAGIC, 4, \
+				  struct b2r2_blt_batch)
+
 /**
  * struct b2r2_platform_data - The b2r2 core hardware configuration
  *
@@ -681,6 +761,23 @@ int b2r2_blt_close(int handle);
  */
 int b2r2_blt_request(int handle, struct b2r2_blt_req *user_req);
 
+/**
+ * b2r2_blt_request_deadline - Request a blit operation with a deadline
+ *
+ * @handle: The B2R2 BLT instance handle
+ * @user_req: The blit request
+ * @deadline: CLOCK_MONOTONIC time in ns by which the request should be
+ *            done, e.g. the timestamp of the vsync the result is shown at
+ *
+ * Requests with a deadline are performed earliest deadline first, ahead of
+ * all requests without a deadline. A @deadline of 0 is the same as calling
+ * b2r2_blt_request().
+ *
+ * Returns the request id if >= 0, else a negative error code
+ */
+int b2r2_blt_request_deadline(int handle, struct b2r2_blt_req *user_req,
+		__s64 deadline);
+
 /**
  * b2r2_blt_synch - Wait for all or a specified job
  *
@@ -12,6 +12,7 @@
 #define __MCDE__H__
 
 
+#include <linux/ktime.h>
 #include "nova_dsilink.h"
 
 
@@ -235,6 +236,14 @@ struct mcde_video_mode {
 	bool force_update; /* when switching between hdmi and sdtv */
 };
 
+/* Area of a display, in display coordinates */
+struct mcde_rectangle {
+	u16 x;
+	u16 y;
+	u16 w;
+	u16 h;
+};
+
 struct mcde_overlay_info {
 	u32 paddr;
 	void *kaddr;
@@ -290,6 +299,16 @@ int mcde_chnl_set_power_mode(struct mcde_chnl_state *chnl,
 				enum mcde_display_power_mode power_mode);
 
 int mcde_chnl_apply(struct mcde_chnl_state *chnl);
+void mcde_chnl_set_update_area(struct mcde_chnl_state *chnl,
+					struct mcde_rectangle *area);
+/*
+ * The vcmp callback is called from the MCDE interrupt handler each time a
+ * frame has been sent to the display. mcde_chnl_get_present_vcmp() returns
+ * the vcmp count at which the latest update is out on the display.
+ */
+void mcde_chnl_set_vcmp_callback(struct mcde_chnl_state *chnl,
+		void (*cb)(void *data, int vcmp_cnt, ktime_t time), void *data);
+int mcde_chnl_get_present_vcmp(struct mcde_chnl_state *chnl);
 int mcde_chnl_update(struct mcde_chnl_state *chnl,
 			bool tripple_buffer);
 int mcde_chnl_wait_for_next_vsync(struct mcde_chnl_state *chnl, s64 *timestamp);
@@ -26,6 +26,8 @@ struct mcde_display_dsi_platform_data {
 	u8 num_data_lanes;
 };
 
+struct mcde_flip_queue;
+
 #define to_mcde_display_device(__dev) \
 	container_of((__dev), struct mcde_display_device, dev)
 
@@ -49,6 +51,7 @@ struct mcde_display_device {
 	bool enabled;
 	struct mcde_chnl_state *chnl_state;
 	struct list_head ovlys;
+	struct mcde_flip_queue *flip_queue;
 
 /* TODO: Remove once ESRAM allocator is done */
         u32 rotbuf1;
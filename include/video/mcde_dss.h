@@ -13,6 +13,7 @@
 
 #include <linux/kobject.h>
 #include <linux/notifier.h>
+#include <linux/poll.h>
 
 #include "mcde.h"
 #include "mcde_display.h"
@@ -34,6 +35,13 @@ int mcde_dss_apply_overlay(struct mcde_overlay *ovl,
 void mcde_dss_get_overlay_info(struct mcde_overlay *ovly,
 				struct mcde_overlay_info *info);
 int mcde_dss_update_overlay(struct mcde_overlay *ovl, bool tripple_buffer);
+/*
+ * Updates only the given area of the display, in channel coordinates. The
+ * area is a hint, displays that can't do partial updates update everything.
+ * A NULL area updates the whole display.
+ */
+int mcde_dss_update_overlay_area(struct mcde_overlay *ovl,
+			bool tripple_buffer, struct mcde_rectangle *area);
 
 void mcde_dss_get_native_resolution(struct mcde_display_device *ddev,
 	u16 *x_res, u16 *y_res);
@@ -62,6 +70,47 @@ int mcde_dss_wait_for_vsync(struct mcde_display_device *ddev, s64 *timestamp);
 
 bool mcde_dss_secure_output(struct mcde_display_device *ddev);
 
+/* MCDE dss asynchronous page flips */
+
+/* Presentation of a queued flip, timestamp is 0 if the flip was dropped */
+struct mcde_dss_present_event {
+	u32 seq;
+	s64 timestamp; /* ns, same clock as mcde_dss_wait_for_vsync() */
+};
+
+struct mcde_dss_flip {
+	struct list_head list;
+	/*
+	 * Sets up the overlays and updates the display. Called from the flip
+	 * queue worker when the previous flip is out on the display.
+	 */
+	int (*post)(struct mcde_dss_flip *flip);
+	/* Called from the flip queue worker when the flip is out or dropped */
+	void (*release)(struct mcde_dss_flip *flip);
+
+	/* Set by the flip queue */
+	u32 seq;
+	int present_vcmp;
+	s64 timestamp;
+};
+
+/*
+ * Queues a flip without waiting for the display. The sequence number of
+ * the flip is returned in seq and is reported in a present event once the
+ * frame is out on the display. Returns -EBUSY if the queue is full.
+ */
+int mcde_dss_queue_flip(struct mcde_display_device *ddev,
+				struct mcde_dss_flip *flip, u32 *seq);
+/* Waits until all queued flips are out on the display */
+void mcde_dss_flush_flips(struct mcde_display_device *ddev);
+int mcde_dss_get_present_event(struct mcde_display_device *ddev,
+				struct mcde_dss_present_event *event);
+/* Like mcde_dss_get_present_event() but waits for an event to arrive */
+int mcde_dss_wait_present_event(struct mcde_display_device *ddev,
+				struct mcde_dss_present_event *event);
+unsigned int mcde_dss_poll_present_event(struct mcde_display_device *ddev,
+				struct file *file, poll_table *wait);
+
 /* MCDE dss events */
 
 /*      A display device and driver has been loaded, probed and bound */
@@ -77,6 +126,8 @@ int mcde_dss_unregister_notifier(struct notifier_block *nb);
 
 int mcde_dss_init(void);
 void mcde_dss_exit(void);
+int mcde_dss_flip_queue_create(struct mcde_display_device *ddev);
+void mcde_dss_flip_queue_destroy(struct mcde_display_device *ddev);
 
 #endif /* __MCDE_DSS__H__ */
 
@@ -27,8 +27,17 @@
 #endif
 #endif
 
+/* Area of the visible frame buffer that has been updated, in pixels */
+struct mcde_fb_update_area {
+	__u32 x;
+	__u32 y;
+	__u32 w;
+	__u32 h;
+};
+
 #define MCDE_GET_BUFFER_NAME_IOC _IO('M', 1)
 #define MCDE_SET_VSCREENINFO_IOC _IOW('D', 2, struct fb_var_screeninfo)
+#define MCDE_UPDATE_AREA_IOC _IOW('D', 3, struct mcde_fb_update_area)
 
 #ifdef __KERNEL__
 #define to_mcde_fb(x) ((struct mcde_fb *)(x)->par)
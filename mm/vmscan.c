@@ -2048,6 +2048,10 @@ restart:
 	}
 	sc->nr_reclaimed += nr_reclaimed;
 
+	if (scanning_global_lru(sc))
+		lowmem_vmpressure(sc->gfp_mask, sc->nr_scanned - nr_scanned,
+				  nr_reclaimed);
+
 	/*
 	 * Even if we did not try to evict anon pages at all, we want to
 	 * rebalance the anon lru active/inactive ratio.